@@ -63,6 +63,11 @@ Defines.
 
 #define AVI_TRACKS_MAX 3
 
+#define AVI_RIFF_SIZE_LIMIT (INT64_C(1) << 30) /*< Size at which a new 'AVIX' RIFF chunk is started */
+#define AVI_SUPER_INDEX_ENTRIES_MAX 256        /*< Entries reserved in the super index ('indx'), i.e. 
+                                                   maximum number of RIFF chunks */
+#define AVI_DMLH_SIZE 248
+
 #define AVI_AUDIO_CHUNK_SIZE_LIMIT 16384 /*< Watermark limit for data chunks when 'dwSampleSize'
                                              is non-zero */
 
@@ -84,9 +89,15 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
                                    chunks for this track  */
    uint32_t sample_size;      /**< i.e. 'dwSampleSize' in 'strh' */
    uint32_t max_chunk_size;   /**< largest chunk written so far */
-   uint64_t index_offset;     /**< Offset to the start of an OpenDML index for this track 
-                                   i.e. 'indx' */
-   uint32_t index_size;       /**< Size of the OpenDML index for this track i.e. 'indx' */
+   uint32_t riff_chunk_index; /**< chunk_index at the start of the current RIFF chunk */
+   uint32_t riff_chunk_offs;  /**< chunk_offs at the start of the current RIFF chunk */
+
+   struct {
+      uint64_t offset;        /**< Offset of the OpenDML standard index i.e. 'ix##' */
+      uint32_t size;          /**< Size of the standard index chunk */
+      uint32_t duration;      /**< Chunks (or bytes if 'dwSampleSize' is set) indexed */
+   } indexes[AVI_SUPER_INDEX_ENTRIES_MAX]; /**< One standard index per RIFF chunk */
+   unsigned int indexes_num;
 } VC_CONTAINER_TRACK_MODULE_T;
 
 typedef struct VC_CONTAINER_MODULE_T
@@ -98,8 +109,12 @@ typedef struct VC_CONTAINER_MODULE_T
 
    uint32_t header_list_offset;           /**< Offset to the header list chunk ('hdrl') */
    uint32_t header_list_size;             /**< Size of the header list chunk ('hdrl') */
-   uint32_t data_offset;                  /**< Offset to the start of data packets i.e. 
-                                               the data in the AVI RIFF 'movi' list */
+   uint64_t riff_offset;                  /**< Offset to the current RIFF chunk, i.e. 0 for
+                                               the 'AVI ' one, 'AVIX' ones after that */
+   uint64_t data_offset;                  /**< Offset to the start of data packets i.e. 
+                                               the data in the current RIFF 'movi' list */
+   int64_t riff_index_offset;             /**< Offset of the first index entry of the current
+                                               RIFF chunk in the temporary storage */
    uint64_t data_size;                    /**< Size of the chunk containing data packets */
    uint32_t index_offset;                 /**< Offset to the start of index data e.g. 
                                                the data in an 'idx1' list */                                          
@@ -350,17 +365,19 @@ static VC_CONTAINER_STATUS_T avi_write_super_index_chunk(VC_CONTAINER_T *p_ctx,
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[index_track_num]->priv->module;
    VC_CONTAINER_FOURCC_T chunk_id; 
-   uint32_t num_indices = 1; /* FIXME: support for multiple RIFF chunks (AVIX) */
+   uint32_t num_indices = track_module->indexes_num;
    unsigned int i;
 
+   /* Room is reserved for the maximum number of entries since we don't know
+      how many RIFF chunks there will be when writing the headers */
    if(module->null_io.refcount)
    {
       /* Assume that we're not actually writing the data, just want know the index chunk size */
-      WRITE_BYTES(p_ctx, NULL, 8 + 24 + num_indices * (int64_t)AVI_SUPER_INDEX_ENTRY_SIZE);
+      WRITE_BYTES(p_ctx, NULL, 8 + 24 + AVI_SUPER_INDEX_ENTRIES_MAX * (int64_t)AVI_SUPER_INDEX_ENTRY_SIZE);
       return STREAM_STATUS(p_ctx);
    }
   
-   if (track_module->index_offset)
+   if (num_indices)
       WRITE_FOURCC(p_ctx, VC_FOURCC('i','n','d','x'), "Chunk ID");
    else
       WRITE_FOURCC(p_ctx, VC_FOURCC('J','U','N','K'), "Chunk ID");
@@ -377,15 +394,20 @@ static VC_CONTAINER_STATUS_T avi_write_super_index_chunk(VC_CONTAINER_T *p_ctx,
    WRITE_U32(p_ctx, 0, "dwReserved1");
    WRITE_U32(p_ctx, 0, "dwReserved2");
    
-   for (i = 0; i < num_indices; ++i)
-   {  
-      uint64_t index_offset = track_module->index_offset;
-      uint32_t chunk_size = track_module->index_size;  
-      uint32_t length = track_module->sample_size ? 
-         track_module->chunk_offs : track_module->chunk_index;
-      WRITE_U64(p_ctx, index_offset, "qwOffset");
-      WRITE_U32(p_ctx, chunk_size, "dwSize");
-      WRITE_U32(p_ctx, length, "dwDuration");
+   for (i = 0; i < AVI_SUPER_INDEX_ENTRIES_MAX; ++i)
+   {
+      if (i < num_indices)
+      {
+         WRITE_U64(p_ctx, track_module->indexes[i].offset, "qwOffset");
+         WRITE_U32(p_ctx, track_module->indexes[i].size, "dwSize");
+         WRITE_U32(p_ctx, track_module->indexes[i].duration, "dwDuration");
+      }
+      else
+      {
+         WRITE_U64(p_ctx, 0, "qwOffset");
+         WRITE_U32(p_ctx, 0, "dwSize");
+         WRITE_U32(p_ctx, 0, "dwDuration");
+      }
    }
 
    AVI_END_CHUNK(p_ctx);
@@ -450,12 +472,46 @@ static VC_CONTAINER_STATUS_T avi_write_stream_header_list(VC_CONTAINER_T *p_ctx,
    return STREAM_STATUS(p_ctx);
 }
 
+/*****************************************************************************/
+static uint32_t avi_num_video_chunks( VC_CONTAINER_T *p_ctx, int first_riff_only )
+{
+   unsigned int i;
+
+   for (i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      if (p_ctx->tracks[i]->format->es_type != VC_CONTAINER_ES_TYPE_VIDEO) continue;
+      if (first_riff_only && track_module->indexes_num)
+         return track_module->indexes[0].duration;
+      return track_module->chunk_index;
+   }
+
+   return 0;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T avi_write_odml_header_list(VC_CONTAINER_T *p_ctx)
+{
+   unsigned int i;
+
+   WRITE_FOURCC(p_ctx, VC_FOURCC('L','I','S','T'), "Chunk ID");
+   WRITE_U32(p_ctx, 4 + 8 + AVI_DMLH_SIZE, "LIST Size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('o','d','m','l'), "Chunk ID");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('d','m','l','h'), "Chunk ID");
+   WRITE_U32(p_ctx, AVI_DMLH_SIZE, "Chunk Size");
+   WRITE_U32(p_ctx, avi_num_video_chunks(p_ctx, 0), "dwTotalFrames");
+   for (i = 4; i < AVI_DMLH_SIZE; i += 4)
+      WRITE_U32(p_ctx, 0, "dwFuture");
+
+   return STREAM_STATUS(p_ctx);
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T avi_write_avi_header_chunk(VC_CONTAINER_T *p_ctx)
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    uint32_t bitrate = 0, width = 0, height = 0, frame_interval = 0;
-   uint32_t flags, num_chunks = 0, max_video_chunk_size = 0;
+   uint32_t flags, num_chunks, max_video_chunk_size = 0;
    uint32_t num_streams = p_ctx->tracks_num;
    unsigned int i;
 
@@ -470,7 +526,6 @@ static VC_CONTAINER_STATUS_T avi_write_avi_header_chunk(VC_CONTAINER_T *p_ctx)
          if (track->format->type->video.frame_rate_num)
             frame_interval = track->format->type->video.frame_rate_den * UINT64_C(1000000) / 
                               track->format->type->video.frame_rate_num;
-         num_chunks = track_module->chunk_index;
          max_video_chunk_size = track_module->max_chunk_size;
          break;
       }
@@ -479,6 +534,9 @@ static VC_CONTAINER_STATUS_T avi_write_avi_header_chunk(VC_CONTAINER_T *p_ctx)
    flags = (module->index_offset && module->index_status == VC_CONTAINER_SUCCESS) ? 
       (AVIF_HASINDEX | AVIF_TRUSTCKTYPE) : 0;
 
+   /* Legacy readers only see the first RIFF chunk */
+   num_chunks = avi_num_video_chunks(p_ctx, 1);
+
    WRITE_FOURCC(p_ctx, VC_FOURCC('a','v','i','h'), "Chunk ID");
    WRITE_U32(p_ctx, 56, "Chunk Size");
    WRITE_U32(p_ctx, frame_interval, "dwMicroSecPerFrame");
@@ -532,7 +590,8 @@ static VC_CONTAINER_STATUS_T avi_write_header_list( VC_CONTAINER_T *p_ctx, uint3
       if (status != VC_CONTAINER_SUCCESS) return status;
    }
 
-   return status;
+   /* Write the OpenDML extended header list ('odml') */
+   return avi_write_odml_header_list(p_ctx);
 }
 
 /*****************************************************************************/
@@ -569,8 +628,9 @@ static VC_CONTAINER_STATUS_T avi_write_legacy_index_chunk( VC_CONTAINER_T *p_ctx
    VC_CONTAINER_STATUS_T status;
    uint32_t chunk_offset = 4;
    unsigned int track_num;
+   int64_t temp_offset;
 
-   vc_container_assert(8 + avi_num_chunks(p_ctx) * INT64_C(16) <= (int64_t)ULONG_MAX);
+   vc_container_assert(8 + avi_num_chunks(p_ctx) * INT64_C(16) <= (int64_t)UINT32_MAX);
 
    if(module->null_io.refcount)
    {
@@ -585,7 +645,9 @@ static VC_CONTAINER_STATUS_T avi_write_legacy_index_chunk( VC_CONTAINER_T *p_ctx
    WRITE_FOURCC(p_ctx, VC_FOURCC('i','d','x','1'), "Chunk ID");
    WRITE_U32(p_ctx, index_size, "Chunk Size");
 
-   /* Scan through all written entries, convert to appropriate index format */
+   /* Scan through all written entries, convert to appropriate index format.
+      This is only done for the first RIFF chunk so all the entries belong to it. */
+   temp_offset = module->temp_io.io->offset;
    vc_container_io_seek(module->temp_io.io, INT64_C(0));
    
    while((status = STREAM_STATUS(p_ctx)) == VC_CONTAINER_SUCCESS)
@@ -607,6 +669,9 @@ static VC_CONTAINER_STATUS_T avi_write_legacy_index_chunk( VC_CONTAINER_T *p_ctx
       
       chunk_offset += ((chunk_size + 1) & ~1) + 8;
    }
+
+   /* More entries might get appended to the temporary storage */
+   vc_container_io_seek(module->temp_io.io, temp_offset);
    
    AVI_END_CHUNK(p_ctx);
 
@@ -625,10 +690,11 @@ static VC_CONTAINER_STATUS_T avi_write_standard_index_chunk( VC_CONTAINER_T *p_c
    VC_CONTAINER_STATUS_T status;
    VC_CONTAINER_FOURCC_T chunk_id; 
    int64_t base_offset = module->data_offset + 12;
-   uint32_t num_chunks = track_module->chunk_index;
-   uint32_t chunk_offset = 4;
+   uint32_t num_chunks = track_module->chunk_index - track_module->riff_chunk_index;
+   uint32_t chunk_offset = 8;
+   int64_t temp_offset;
 
-   vc_container_assert(32 + num_chunks * (int64_t)AVI_STD_INDEX_ENTRY_SIZE <= (int64_t)ULONG_MAX);
+   vc_container_assert(32 + num_chunks * (int64_t)AVI_STD_INDEX_ENTRY_SIZE <= (int64_t)UINT32_MAX);
 
    if(module->null_io.refcount)
    {
@@ -637,8 +703,12 @@ static VC_CONTAINER_STATUS_T avi_write_standard_index_chunk( VC_CONTAINER_T *p_c
       return STREAM_STATUS(p_ctx);
    }
 
-   track_module->index_offset = STREAM_POSITION(p_ctx);
-   track_module->index_size = index_size ? (index_size - 8) : 0;
+   vc_container_assert(track_module->indexes_num < AVI_SUPER_INDEX_ENTRIES_MAX);
+   track_module->indexes[track_module->indexes_num].offset = STREAM_POSITION(p_ctx);
+   track_module->indexes[track_module->indexes_num].size = index_size + 8;
+   track_module->indexes[track_module->indexes_num].duration = track_module->sample_size ? 
+      track_module->chunk_offs - track_module->riff_chunk_offs : num_chunks;
+   track_module->indexes_num++;
 
    avi_index_chunk_id_from_track_num(&chunk_id, index_track_num);
    WRITE_FOURCC(p_ctx, chunk_id, "Chunk ID");
@@ -653,8 +723,10 @@ static VC_CONTAINER_STATUS_T avi_write_standard_index_chunk( VC_CONTAINER_T *p_c
    WRITE_U64(p_ctx, base_offset, "qwBaseOffset");
    WRITE_U32(p_ctx, 0, "dwReserved");
 
-   /* Scan through all written entries, convert to appropriate index format */
-   vc_container_io_seek(module->temp_io.io, INT64_C(0));
+   /* Scan through the entries written in the current RIFF chunk, convert to 
+      appropriate index format. The offsets point to the data of the chunks. */
+   temp_offset = module->temp_io.io->offset;
+   vc_container_io_seek(module->temp_io.io, module->riff_index_offset);
    
    while(STREAM_STATUS(p_ctx) == VC_CONTAINER_SUCCESS)
    {      
@@ -664,13 +736,17 @@ static VC_CONTAINER_STATUS_T avi_write_standard_index_chunk( VC_CONTAINER_T *p_c
       status = avi_read_index_entry(p_ctx, &track_num, &chunk_size);
       if (status != VC_CONTAINER_SUCCESS) break;
          
-      if(track_num != index_track_num) continue;
-   
-      WRITE_U32(p_ctx, chunk_offset, "dwOffset");
-      WRITE_U32(p_ctx, chunk_size, "dwSize");
+      if(track_num == index_track_num)
+      {
+         WRITE_U32(p_ctx, chunk_offset, "dwOffset");
+         WRITE_U32(p_ctx, chunk_size, "dwSize");
+      }
 
-      chunk_offset += ((chunk_size + 1) & ~(1 | AVI_INDEX_DELTAFRAME)) + 12;
+      chunk_offset += ((chunk_size + 1) & ~(1 | AVI_INDEX_DELTAFRAME)) + 8;
    }
+
+   /* More entries might get appended to the temporary storage */
+   vc_container_io_seek(module->temp_io.io, temp_offset);
    
    AVI_END_CHUNK(p_ctx);
 
@@ -752,7 +828,8 @@ static int64_t avi_calculate_file_size( VC_CONTAINER_T *p_ctx,
       /* Current standard index data */
       if (avi_write_standard_index_data(p_ctx) != VC_CONTAINER_SUCCESS) break;
       
-      /* Current legacy index data */
+      /* Current legacy index data, only written in the first RIFF chunk */
+      if (module->riff_offset) break;
       status = avi_write_legacy_index_data(p_ctx);
       if (status != VC_CONTAINER_SUCCESS) break;
    } while(0);
@@ -764,6 +841,95 @@ static int64_t avi_calculate_file_size( VC_CONTAINER_T *p_ctx,
    return filesize;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T avi_finish_riff( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   int64_t end;
+
+   /* Write standard index data before finalising the size of the 'movi' list */
+   status = avi_write_standard_index_data(p_ctx);
+   if (status != VC_CONTAINER_SUCCESS)
+   {
+      module->index_status = status;
+      LOG_DEBUG(p_ctx, "warning, writing standard index data failed, file will be malformed");
+   }
+
+   module->data_size = STREAM_POSITION(p_ctx) - module->data_offset - 8;
+
+   /* Now write the legacy index, which only covers the first RIFF chunk */
+   if (!module->riff_offset)
+   {
+      status = avi_write_legacy_index_data(p_ctx);
+      if (status != VC_CONTAINER_SUCCESS)
+      {
+         module->index_status = status;
+         LOG_DEBUG(p_ctx, "warning, writing legacy index data failed, file will be malformed");
+      }
+   }
+
+   /* Do the necessary fixups for values not know at the time of writing chunk headers */
+   end = STREAM_POSITION(p_ctx);
+
+   /* Rewrite the RIFF chunk size */
+   SEEK(p_ctx, module->riff_offset + 4);
+   WRITE_U32(p_ctx, (uint32_t)(end - module->riff_offset - 8), "fileSize");
+   if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS)
+   {
+      LOG_DEBUG(p_ctx, "warning, rewriting 'fileSize' failed, file will be malformed");
+   }
+
+   /* Rewrite the 'movi' list size */
+   if (module->data_offset)
+   {
+      SEEK(p_ctx, module->data_offset + 4);
+      WRITE_U32(p_ctx, module->data_size, "Chunk Size");
+      if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS)
+      {
+         LOG_DEBUG(p_ctx, "warning, rewriting 'movi' list size failed, file will be malformed");
+      }
+   }
+
+   SEEK(p_ctx, end);
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T avi_start_riff( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+
+   /* We need a super index entry per RIFF chunk */
+   if (p_ctx->tracks[0]->priv->module->indexes_num + 2 > AVI_SUPER_INDEX_ENTRIES_MAX)
+      return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+
+   if ((status = avi_finish_riff(p_ctx)) != VC_CONTAINER_SUCCESS) return status;
+
+   for (i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      track_module->riff_chunk_index = track_module->chunk_index;
+      track_module->riff_chunk_offs = track_module->chunk_offs;
+   }
+   module->riff_index_offset = module->temp_io.io->offset;
+
+   /* Write the OpenDML RIFF chunk descriptor and start its 'movi' list */
+   module->riff_offset = STREAM_POSITION(p_ctx);
+   WRITE_FOURCC(p_ctx, VC_FOURCC('R','I','F','F'), "RIFF ID");
+   WRITE_U32(p_ctx, 0, "fileSize");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('A','V','I','X'), "fileType");
+
+   module->data_offset = STREAM_POSITION(p_ctx);
+   WRITE_FOURCC(p_ctx, VC_FOURCC('L','I','S','T'), "Chunk ID");
+   WRITE_U32(p_ctx, 0, "LIST Size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('m','o','v','i'), "Chunk ID");
+
+   return STREAM_STATUS(p_ctx);
+}
+
 /*****************************************************************************
 Functions exported as part of the Container Module API
  *****************************************************************************/
@@ -813,11 +979,13 @@ static VC_CONTAINER_STATUS_T avi_writer_write( VC_CONTAINER_T *p_ctx,
    /* Check we are not about to go over the limit of total number of chunks */
    if (avi_num_chunks(p_ctx) == (uint32_t)ULONG_MAX) return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
 
-    if(STREAM_SEEKABLE(p_ctx))
-    {
-       /* Check we are not about to go over the maximum file size */
-       if (avi_calculate_file_size(p_ctx, p_packet) >= (int64_t)ULONG_MAX) return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
-    }
+   /* Check we are not about to go over the maximum RIFF chunk size, in which
+      case we carry on in a new OpenDML RIFF chunk ('AVIX') */
+   if (STREAM_SEEKABLE(p_ctx) && !module->chunk_data_written &&
+       avi_calculate_file_size(p_ctx, p_packet) - (int64_t)module->riff_offset >= AVI_RIFF_SIZE_LIMIT)
+   {
+      if ((status = avi_start_riff(p_ctx)) != VC_CONTAINER_SUCCESS) return status;
+   }
 
    /* FIXME: are we expected to handle this case or should it be picked up by the above layer? */
    vc_container_assert(!(module->chunk_data_written && (p_packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_START)));
@@ -851,7 +1019,7 @@ static VC_CONTAINER_STATUS_T avi_writer_write( VC_CONTAINER_T *p_ctx,
          /* If the output stream can seek we can fix up the frame size later, and if the
           * packet holds the whole frame we won't need to, so write data straight out. */
          WRITE_U32(p_ctx, chunk_size, "Chunk Size");
-         WRITE_BYTES(p_ctx, p_packet->data, p_packet->size);
+         WRITE_PAYLOAD(p_ctx, p_packet->data, p_packet->size);
       }
       else
       {
@@ -881,7 +1049,7 @@ static VC_CONTAINER_STATUS_T avi_writer_write( VC_CONTAINER_T *p_ctx,
       }
       else
       {
-         WRITE_BYTES(p_ctx, p_packet->data, p_packet->size);
+         WRITE_PAYLOAD(p_ctx, p_packet->data, p_packet->size);
       }
       module->chunk_data_written += p_packet->size;
    }
@@ -897,7 +1065,7 @@ static VC_CONTAINER_STATUS_T avi_writer_write( VC_CONTAINER_T *p_ctx,
       if(module->frame_packet.size > 0)
       {
          WRITE_U32(p_ctx, module->frame_packet.size, "Chunk Size");
-         WRITE_BYTES(p_ctx, module->frame_packet.data, module->frame_packet.size);
+         WRITE_PAYLOAD(p_ctx, module->frame_packet.data, module->frame_packet.size);
          p_packet->size = module->frame_packet.size;
          module->frame_packet.size = 0;
       }
@@ -961,38 +1129,8 @@ static VC_CONTAINER_STATUS_T avi_writer_close( VC_CONTAINER_T *p_ctx )
 
    if(STREAM_SEEKABLE(p_ctx))
    {
-      uint32_t filesize;
-
-      /* Write standard index data before finalising the size of the 'movi' list */
-      status = avi_write_standard_index_data(p_ctx);
-      if (status != VC_CONTAINER_SUCCESS)
-      {
-         module->index_status = status;
-         LOG_DEBUG(p_ctx, "warning, writing standard index data failed, file will be malformed");
-      }
-
-      /* FIXME: support for multiple RIFF chunks (AVIX) */
-      module->data_size = STREAM_POSITION(p_ctx) - module->data_offset - 8;
-
-      /* Now write the legacy index */
-      status = avi_write_legacy_index_data(p_ctx);
-      if (status != VC_CONTAINER_SUCCESS)
-      {
-         module->index_status = status;
-         LOG_DEBUG(p_ctx, "warning, writing legacy index data failed, file will be malformed");
-      }
-
-      /* If we can, do the necessary fixups for values not know at the
-       time of writing chunk headers */
-
-      /* Rewrite the AVI RIFF chunk size */
-      filesize = (uint32_t)STREAM_POSITION(p_ctx);
-      SEEK(p_ctx, 4);
-      WRITE_U32(p_ctx, filesize, "fileSize");
-      if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS)
-      {
-         LOG_DEBUG(p_ctx, "warning, rewriting 'fileSize' failed, file will be malformed");
-      }   
+      /* Finalise the last RIFF chunk */
+      status = avi_finish_riff(p_ctx);
 
       /* Rewrite the header list chunk ('hdrl') */
       SEEK(p_ctx, module->header_list_offset);
@@ -1001,14 +1139,6 @@ static VC_CONTAINER_STATUS_T avi_writer_close( VC_CONTAINER_T *p_ctx )
       {
          LOG_DEBUG(p_ctx, "warning, rewriting 'hdrl' failed, file will be malformed");
       }
-
-      /* Rewrite the AVI RIFF 'movi' list size */
-      SEEK(p_ctx, module->data_offset + 4);
-      WRITE_U32(p_ctx, module->data_size, "Chunk Size");
-      if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS)
-      {
-         LOG_DEBUG(p_ctx, "warning, rewriting 'movi' list size failed, file will be malformed");
-      }
    }
 
    vc_container_writer_extraio_delete(p_ctx, &module->null_io);
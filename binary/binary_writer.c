@@ -71,7 +71,7 @@ static VC_CONTAINER_STATUS_T binary_writer_close( VC_CONTAINER_T *p_ctx )
 static VC_CONTAINER_STATUS_T binary_writer_write( VC_CONTAINER_T *p_ctx,
    VC_CONTAINER_PACKET_T *packet )
 {
-   WRITE_BYTES(p_ctx, packet->data, packet->size);
+   WRITE_PAYLOAD(p_ctx, packet->data, packet->size);
    return STREAM_STATUS(p_ctx);
 }
 
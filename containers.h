@@ -517,6 +517,8 @@ typedef uint32_t VC_CONTAINER_READ_FLAGS_T;
 #define VC_CONTAINER_READ_FLAG_SKIP   2
 /** Force the container to read data from the specified track */
 #define VC_CONTAINER_READ_FLAG_FORCE_TRACK 4
+/** Allow the container to point the packet to data held in its own buffers instead of copying it */
+#define VC_CONTAINER_READ_FLAG_ZERO_COPY 8
 /* @} */
 
 /** Reads a data packet from a container reader.
@@ -532,6 +534,10 @@ typedef uint32_t VC_CONTAINER_READ_FLAGS_T;
  * \ref VC_CONTAINER_READ_FLAG_SKIP will instruct the reader to skip the next packet. In this case
  * it isn't necessary for the caller to pass a pointer to a \ref VC_CONTAINER_PACKET_T structure
  * unless the \ref VC_CONTAINER_READ_FLAG_INFO is also given.\n
+ * \ref VC_CONTAINER_READ_FLAG_ZERO_COPY will allow the reader to replace the packet data pointer
+ * with a pointer to the data in its own i/o buffers when the packet is contiguous there. This
+ * data is read-only and needs to be given back with \ref vc_container_packet_release. A buffer
+ * still needs to be given since the data will be copied into it when it can't be borrowed.\n
  * A combination of all these flags can be used.
  *
  * \param  context   Pointer to the context of the reader to use
@@ -543,6 +549,18 @@ typedef uint32_t VC_CONTAINER_READ_FLAGS_T;
 VC_CONTAINER_STATUS_T vc_container_read( VC_CONTAINER_T *context,
    VC_CONTAINER_PACKET_T *packet, VC_CONTAINER_READ_FLAGS_T flags );
 
+/** Releases the data of a packet read with \ref VC_CONTAINER_READ_FLAG_ZERO_COPY.
+ * This needs to be called for every such packet, before closing the container. The packet data
+ * pointer is set back to the buffer given by the caller, so the packet can be used for the next
+ * read. It doesn't do anything if the data was copied into that buffer.
+ *
+ * \param  context   Pointer to the context of the reader to use
+ * \param  packet    Pointer to the VC_CONTAINER_PACKET_T structure returned by the read
+ * \return           the status of the operation
+ */
+VC_CONTAINER_STATUS_T vc_container_packet_release( VC_CONTAINER_T *context,
+   VC_CONTAINER_PACKET_T *packet );
+
 /** Writes a data packet to a container writer.
  *
  * \param  context   Pointer to the context of the writer to use
@@ -625,6 +643,56 @@ typedef struct VC_CONTAINER_WRITE_STATS_T
    /** This logs the length of time that we wait for a flush command to complete. */
    VC_CONTAINER_STATS_T flush;
 } VC_CONTAINER_WRITE_STATS_T;
+
+/** This type represents the statistics saved by the io layer when reading ahead. */
+typedef struct VC_CONTAINER_READ_STATS_T
+{
+   /** This logs the number of bytes read ahead in count, and the microseconds taken to read
+    * in num. */
+   VC_CONTAINER_STATS_T read;
+   /** This logs the length of time the read function has to wait for the asynchronous task. */
+   VC_CONTAINER_STATS_T wait;
+   /** This logs the number of bytes read ahead which were dropped because of a seek. */
+   VC_CONTAINER_STATS_T discard;
+} VC_CONTAINER_READ_STATS_T;
+
+/** This type represents the statistics of the io block cache. */
+typedef struct VC_CONTAINER_CACHE_STATS_T
+{
+   uint32_t hits;       /**< Number of block lookups served from memory */
+   uint32_t misses;     /**< Number of block lookups which had to read from the stream */
+   uint32_t evictions;  /**< Number of blocks dropped to stay within the memory budget */
+   uint32_t blocks;     /**< Number of blocks currently held */
+   uint32_t budget;     /**< Memory budget of the block cache in bytes */
+} VC_CONTAINER_CACHE_STATS_T;
+
+/** The maximum number of tracks the read counters count packets for */
+#define VC_CONTAINER_READ_COUNTERS_TRACKS 16
+
+/** This type represents the read counters of a container. */
+typedef struct VC_CONTAINER_READ_COUNTERS_T
+{
+   uint64_t bytes_read;     /**< Bytes read from the io layer by the container */
+   uint64_t bytes_copied;   /**< Bytes copied out of the io caches */
+   uint64_t module_bytes;   /**< Bytes read from the io module */
+   uint64_t module_read_us; /**< Microseconds spent in the read function of the io module */
+   uint32_t module_reads;   /**< Calls to the read function of the io module */
+   uint32_t module_seeks;   /**< Calls to the seek function of the io module */
+   uint32_t cache_hits;     /**< Reads and peeks served from the io caches */
+   uint32_t cache_misses;   /**< Reads and peeks which needed the io caches refilled */
+   uint32_t bypass_reads;   /**< Reads done straight into the caller's buffer, bypassing the caches */
+   uint32_t peeks;          /**< Peeks at the data ahead of the read position */
+   uint32_t packets[VC_CONTAINER_READ_COUNTERS_TRACKS]; /**< Packets read or skipped on each track */
+} VC_CONTAINER_READ_COUNTERS_T;
+
+/** This type describes where writers keep their temporary data. */
+typedef struct VC_CONTAINER_TEMP_STORAGE_T
+{
+   uint32_t memory_budget;  /**< Temporary data kept in memory up to this size */
+   const char *directory;   /**< Directory the data spills to past the memory budget. If NULL,
+                                 it spills to anonymous memory where the system supports it
+                                 and next to the output otherwise. */
+} VC_CONTAINER_TEMP_STORAGE_T;
    
 
 /** Control operations which can be done on containers. */
@@ -754,6 +822,97 @@ typedef enum
     *   arg1= bool: enable or disable. Enabled by default. */
    VC_CONTAINER_CONTROL_REBASE_TIMESTAMPS,
 
+   /** Request the MP4 writer to place the moov box before the mdat box when the
+    * file is closed, so it can be played back progressively. Room is reserved
+    * for the moov box when this is enabled before writing any data.
+    * Arguments:\n
+    *   arg1= bool: enable or disable. Disabled by default. */
+   VC_CONTAINER_CONTROL_MP4_FASTSTART,
+
+   /** Request the MP4 writer to reserve room for the moov box in front of the mdat
+    * box, so fast start doesn't have to move the data when the file is closed.
+    * Enabling fast start reserves 128KB by default. The data is only moved when
+    * the moov box doesn't fit. Must be set before writing any data and also
+    * enables fast start.
+    * Arguments:\n
+    *   arg1= uint32_t: size in bytes. The room can only be grown. */
+   VC_CONTAINER_CONTROL_MP4_RESERVE_MOOV,
+
+   /** Request the MP4 writer to output a fragmented file (moof+mdat boxes) so the
+    * amount of buffered data stays bounded. Must be set before writing any data.
+    * Arguments:\n
+    *   arg1= unsigned int: minimum duration of a fragment in milliseconds. Fragments
+    *         start on video keyframes so 0 starts a fragment on every keyframe. */
+   VC_CONTAINER_CONTROL_MP4_FRAGMENT,
+
+   /** Read the i/o stream ahead in a background thread while the reader parses the
+    * data already available. This can also be requested with a readahead=n query
+    * option in the URI.\n
+    * Arguments:\n
+    *   arg1= unsigned int: number of memory areas to read ahead, 0 to disable */
+   VC_CONTAINER_CONTROL_IO_SET_READ_AHEAD,
+
+   /** Collects read-ahead performance statistics.\n
+    * Arguments:\n
+    *   arg1= VC_CONTAINER_READ_STATS_T *: */
+   VC_CONTAINER_CONTROL_GET_IO_READ_STATS,
+
+   /** Pin the size of the i/o read cache. By default the cache grows during long
+    * sequential reads and shrinks back when the reader keeps jumping around.
+    * This can also be requested with a cachesize=n query option in the URI.\n
+    * Arguments:\n
+    *   arg1= uint32_t: cache size in bytes (rounded up to a power of 2), 0 to
+    *         go back to adapting it to the access pattern */
+   VC_CONTAINER_CONTROL_IO_SET_CACHE_SIZE,
+
+   /** Set the memory budget of the i/o block cache. The block cache keeps the index
+    * tables readers ask the i/o to cache as well as the data around positions the
+    * reader seeked away from, dropping the least recently used blocks first.
+    * This can also be requested with a cachebudget=n query option in the URI.\n
+    * Arguments:\n
+    *   arg1= uint32_t: budget in bytes, 0 to disable the block cache */
+   VC_CONTAINER_CONTROL_IO_SET_CACHE_BUDGET,
+
+   /** Collects the block cache statistics.\n
+    * Arguments:\n
+    *   arg1= VC_CONTAINER_CACHE_STATS_T *: */
+   VC_CONTAINER_CONTROL_GET_IO_CACHE_STATS,
+
+   /** Collects the read counters of the container. They are always kept up to
+    * date so they can be collected at any time.\n
+    * Arguments:\n
+    *   arg1= VC_CONTAINER_READ_COUNTERS_T *: */
+   VC_CONTAINER_CONTROL_GET_READ_COUNTERS,
+
+   /** Resets the read counters of the container.\n
+    * Arguments: none */
+   VC_CONTAINER_CONTROL_RESET_READ_COUNTERS,
+
+   /** Set where a writer keeps its temporary data (e.g. the sample tables of the
+    * MP4 writer). Must be set before writing any data. This can also be requested
+    * with tmpbudget=n and tmpdir=path query options in the URI.\n
+    * Arguments:\n
+    *   arg1= VC_CONTAINER_TEMP_STORAGE_T *: */
+   VC_CONTAINER_CONTROL_SET_TEMP_STORAGE,
+
+   /** Fetch the data of an http i/o stream over several connections at once, each
+    * of them getting consecutive chunks of the file in turn. This helps on links where
+    * a single connection can't use all the bandwidth. This can also be requested with
+    * connections=n and chunksize=n query options in the URI.\n
+    * Arguments:\n
+    *   arg1= unsigned int: number of connections (up to 16), 1 for a single one\n
+    *   arg2= uint32_t: size of the chunks in bytes, 0 for the default (1MB) */
+   VC_CONTAINER_CONTROL_IO_SET_HTTP_CONNECTIONS,
+
+   /** Receive datagrams in batches on a datagram (e.g. UDP) i/o, so a single system
+    * call can fetch all the datagrams waiting on the socket. They are still handed
+    * out one per read. Datagrams larger than the buffer size are truncated.\n
+    * Arguments:\n
+    *   arg1= uint32_t: number of datagrams per batch, 0 to receive them one at a time\n
+    *   arg2= uint32_t: size of the buffer of each datagram in bytes, 0 for the maximum
+    *         datagram size */
+   VC_CONTAINER_CONTROL_IO_SET_READ_BATCH,
+
    /** Private user extensions must be above this number */
    VC_CONTAINER_CONTROL_USER_EXTENSIONS = 0x1000
 
@@ -211,18 +211,59 @@ VC_CONTAINER_STATUS_T vc_container_close( VC_CONTAINER_T *p_ctx )
    if(p_ctx->priv->module_handle) vc_container_unload(p_ctx);
    for(i = 0; i < p_ctx->meta_num; i++) free(p_ctx->meta[i]);
    if(p_ctx->meta_num) free(p_ctx->meta);
+   free(p_ctx->priv->borrowed);
    p_ctx->meta_num = 0;
    free(p_ctx);
 
    return VC_CONTAINER_SUCCESS;
 }
 
+/*****************************************************************************/
+static bool container_borrowed_reserve( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_PRIVATE_T *priv = p_ctx->priv;
+   struct VC_CONTAINER_BORROWED_PACKET_T *borrowed;
+   unsigned int max;
+
+   if(priv->borrowed_num < priv->borrowed_max)
+      return true;
+
+   max = priv->borrowed_max ? priv->borrowed_max * 2 : 4;
+   borrowed = realloc(priv->borrowed, max * sizeof(*borrowed));
+   if(!borrowed) return false;
+   priv->borrowed = borrowed;
+   priv->borrowed_max = max;
+   return true;
+}
+
+/*****************************************************************************/
+static uint8_t *container_borrowed_remove( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PACKET_T *p_packet )
+{
+   VC_CONTAINER_PRIVATE_T *priv = p_ctx->priv;
+   uint8_t *buffer;
+   unsigned int i;
+
+   for(i = 0; i < priv->borrowed_num; i++)
+      if(priv->borrowed[i].packet == p_packet) break;
+   if(i == priv->borrowed_num) return NULL;
+
+   buffer = priv->borrowed[i].buffer;
+   priv->borrowed[i] = priv->borrowed[--priv->borrowed_num];
+   return buffer;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T container_read_packet( VC_CONTAINER_T *p_ctx,
    VC_CONTAINER_PACKET_T *p_packet, uint32_t flags )
 {
+   uint8_t *data = p_packet ? p_packet->data : 0;
    VC_CONTAINER_STATUS_T status;
 
+   /* Make sure we can remember the caller's buffer before letting the reader
+    * replace it */
+   if((flags & VC_CONTAINER_READ_FLAG_ZERO_COPY) && !container_borrowed_reserve(p_ctx))
+      flags &= ~VC_CONTAINER_READ_FLAG_ZERO_COPY;
+
    while(1)
    {
       status = p_ctx->priv->pf_read(p_ctx, p_packet, flags);
@@ -233,7 +274,15 @@ static VC_CONTAINER_STATUS_T container_read_packet( VC_CONTAINER_T *p_ctx,
          return status; /* We've just been requested to skip the data */
 
       if(status != VC_CONTAINER_SUCCESS)
+      {
+         /* Borrowed data is never handed out on failure */
+         if(p_packet->data != data)
+         {
+            vc_container_io_release(p_ctx->priv->io, p_packet->data);
+            p_packet->data = data;
+         }
          return status;
+      }
 
       /* Skip data from out of bounds tracks, disabled tracks or packets that are encrypted
          and cannot be decrypted */
@@ -243,6 +292,12 @@ static VC_CONTAINER_STATUS_T container_read_packet( VC_CONTAINER_T *p_ctx,
       {
          if(flags & VC_CONTAINER_READ_FLAG_INFO)
             status = p_ctx->priv->pf_read(p_ctx, p_packet, VC_CONTAINER_READ_FLAG_SKIP);
+         else if(p_packet->data != data)
+         {
+            /* Give back the borrowed data and use the caller's buffer again */
+            vc_container_io_release(p_ctx->priv->io, p_packet->data);
+            p_packet->data = data;
+         }
          if(status == VC_CONTAINER_SUCCESS || status == VC_CONTAINER_ERROR_CONTINUE)
             continue;
       }
@@ -252,6 +307,11 @@ static VC_CONTAINER_STATUS_T container_read_packet( VC_CONTAINER_T *p_ctx,
       if(p_ctx->priv->drm_filter)
          status = vc_container_filter_process(p_ctx->priv->drm_filter, p_packet);
 
+      if(p_packet->data != data)
+      {
+         p_ctx->priv->borrowed[p_ctx->priv->borrowed_num].packet = p_packet;
+         p_ctx->priv->borrowed[p_ctx->priv->borrowed_num++].buffer = data;
+      }
       break;
    }
    return status;
@@ -280,6 +340,10 @@ VC_CONTAINER_STATUS_T vc_container_read( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PAC
    if(!p_packet)
       p_packet = &p_ctx->priv->packetizer_packet;
 
+   /* The DRM filter decrypts the data in place */
+   if(p_ctx->priv->drm_filter)
+      flags &= ~VC_CONTAINER_READ_FLAG_ZERO_COPY;
+
    /* Simple/Fast case first */
    if(!p_ctx->priv->packetizing)
    {
@@ -349,6 +413,14 @@ VC_CONTAINER_STATUS_T vc_container_read( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PAC
    if(status != VC_CONTAINER_SUCCESS)
       return status;
 
+   if(flags & VC_CONTAINER_READ_FLAG_INFO)
+      p_ctx->priv->info_track = p_packet->track;
+   else
+   {
+      i = p_packet == &p_ctx->priv->packetizer_packet ? p_ctx->priv->info_track : p_packet->track;
+      if(i < VC_CONTAINER_READ_COUNTERS_TRACKS) p_ctx->priv->packets[i]++;
+   }
+
    if(p_packet && p_packet->dts > p_ctx->position)
       p_ctx->position = p_packet->dts;
    if(p_packet && p_packet->pts > p_ctx->position)
@@ -357,6 +429,24 @@ VC_CONTAINER_STATUS_T vc_container_read( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PAC
    return VC_CONTAINER_SUCCESS;
 }
 
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_packet_release( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PACKET_T *p_packet )
+{
+   uint8_t *buffer;
+
+   if(!p_packet || !p_ctx->priv->io)
+      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+
+   buffer = container_borrowed_remove(p_ctx, p_packet);
+   if(!buffer)
+      return VC_CONTAINER_SUCCESS; /* The data was copied into the caller's buffer */
+
+   /* Give the caller its buffer back for the next read */
+   vc_container_io_release(p_ctx->priv->io, p_packet->data);
+   p_packet->data = buffer;
+   return VC_CONTAINER_SUCCESS;
+}
+
 /*****************************************************************************/
 VC_CONTAINER_STATUS_T vc_container_write( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PACKET_T *p_packet )
 {
@@ -576,6 +666,29 @@ VC_CONTAINER_STATUS_T vc_container_control( VC_CONTAINER_T *p_ctx, VC_CONTAINER_
       }
       break;
 
+   case VC_CONTAINER_CONTROL_GET_READ_COUNTERS:
+      {
+         VC_CONTAINER_READ_COUNTERS_T *counters = va_arg(args, VC_CONTAINER_READ_COUNTERS_T *);
+         status = vc_container_io_control(p_ctx->priv->io, operation, counters);
+         if(status == VC_CONTAINER_SUCCESS)
+            memcpy(counters->packets, p_ctx->priv->packets, sizeof(counters->packets));
+      }
+      break;
+
+   case VC_CONTAINER_CONTROL_RESET_READ_COUNTERS:
+      status = vc_container_io_control(p_ctx->priv->io, operation);
+      memset(p_ctx->priv->packets, 0, sizeof(p_ctx->priv->packets));
+      break;
+
+   case VC_CONTAINER_CONTROL_SET_TEMP_STORAGE:
+      {
+         const VC_CONTAINER_TEMP_STORAGE_T *storage = va_arg(args, const VC_CONTAINER_TEMP_STORAGE_T *);
+         if(p_ctx->priv->tmp_io)
+            status = vc_container_io_set_temp_storage(p_ctx->priv->tmp_io,
+               storage->memory_budget, storage->directory);
+      }
+      break;
+
    default: break;
    }
 
@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "containers.h"
 #include "core/containers_io.h"
@@ -35,50 +36,88 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "core/containers_utils.h"
 #include "core/containers_uri.h"
 
-#define MAX_NUM_CACHED_AREAS 16
 #define MAX_NUM_MEMORY_AREAS 4
 #define NUM_TMP_MEMORY_AREAS 2
-#define MEM_CACHE_READ_MAX_SIZE (32*1024) /* Needs to be a power of 2 */
+#define MEM_CACHE_READ_SIZE (32*1024) /* Initial size, needs to be a power of 2 */
+#define MEM_CACHE_READ_MIN_SIZE (4*1024) /* Needs to be a power of 2 */
+#define MEM_CACHE_READ_ADAPTIVE_MAX_SIZE (4*1024*1024) /* Needs to be a power of 2 */
+#define MEM_CACHE_READ_PINNED_MAX_SIZE (64*1024*1024) /* Needs to be a power of 2 */
+#define MEM_CACHE_GROW_STREAK 4 /* Sequential refills before the read cache grows */
+#define MEM_CACHE_SHRINK_JUMPS 2 /* Non sequential refills before it shrinks */
 #define MEM_CACHE_WRITE_MAX_SIZE (128*1024) /* Needs to be a power of 2 */
 #define MEM_CACHE_TMP_MAX_SIZE (32*1024) /* Needs to be a power of 2 */
+#define MEM_CACHE_WRITE_THROUGH_SIZE (32*1024) /* Vectored writes at least this big bypass the cache */
 #define MEM_CACHE_ALIGNMENT (1*1024) /* Needs to be a power of 2 */
-#define MEM_CACHE_AREA_READ_MAX_SIZE (4*1024*1024) /* Needs to be a power of 2 */
-
-typedef struct VC_CONTAINER_IO_PRIVATE_CACHE_T
+/* Offset in the cache memory of the data at the given offset in the stream */
+#define MEM_CACHE_SHIFT(p_ctx, offset) ((offset) & \
+   (((p_ctx)->capabilities & VC_CONTAINER_IO_CAPS_DIRECT ? \
+     VC_CONTAINER_IO_DIRECT_ALIGNMENT : MEM_CACHE_ALIGNMENT) - 1))
+#define MEM_CACHE_BLOCK_SIZE (32*1024) /* Needs to be a power of 2 */
+#define MEM_CACHE_BLOCKS_BUDGET (1*1024*1024) /* Default memory budget of the block cache */
+#define MEM_CACHE_BLOCKS_SLOW_BUDGET (16*1024*1024) /* Same for streams slow or unable to seek */
+#define READ_AHEAD_AREA_SIZE (256*1024) /* Needs to be a power of 2 */
+#define READ_AHEAD_DEFAULT_AREAS 4
+#define READ_AHEAD_MAX_AREAS 16
+
+/** Cache memory some of which was handed out by vc_container_io_borrow */
+typedef struct VC_CONTAINER_IO_BORROWED_T
 {
-   int64_t start; /**< Offset to the start of the cached area in the stream */
-   int64_t end;    /**< Offset to the end of the cached area in the stream */
-
-   int64_t offset; /**< Offset of the currently cached data in the stream */
-   size_t size;    /**< Size of the cached area */
-   bool dirty;     /**< Whether the cache is dirty and needs to be written back */
+   struct VC_CONTAINER_IO_BORROWED_T *next;
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache; /**< Cache using the memory, NULL once it moved on */
+   uint8_t *mem;
+   size_t size;
+   unsigned int refcount;                  /**< Number of views still handed out */
 
-   size_t position; /**< Current position in the cache */
+} VC_CONTAINER_IO_BORROWED_T;
 
-   uint8_t *buffer;          /**< Pointer to the start of the valid cache area */
-   uint8_t *buffer_end;      /**< Pointer to the end of the cache */
+/** Block of stream data kept by the block cache */
+typedef struct VC_CONTAINER_IO_BLOCK_T
+{
+   int64_t offset;      /**< Offset of the data in the stream */
+   size_t size;         /**< Size of the data */
+   uint8_t *mem;        /**< MEM_CACHE_BLOCK_SIZE bytes of memory */
+   uint32_t last_use;   /**< Tick of the last time the block was used */
+   bool locked;         /**< The stream can't seek back to this data so it is never evicted */
 
-   unsigned int mem_max_size; /**< Maximum size of the memory cache */
-   unsigned int mem_size; /**< Size of the memory cache */
-   uint8_t *mem;          /**< Pointer to the memory cache */
+} VC_CONTAINER_IO_BLOCK_T;
 
-   VC_CONTAINER_IO_T *io;
+/** Region of the stream cached with vc_container_io_cache() */
+typedef struct VC_CONTAINER_IO_REGION_T
+{
+   int64_t start;
+   int64_t end;
 
-} VC_CONTAINER_IO_PRIVATE_CACHE_T;
+} VC_CONTAINER_IO_REGION_T;
 
 typedef struct VC_CONTAINER_IO_PRIVATE_T
 {
-   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache; /**< Current cache */
-
    unsigned int caches_num;
    VC_CONTAINER_IO_PRIVATE_CACHE_T caches;
 
-   unsigned int cached_areas_num;
-   VC_CONTAINER_IO_PRIVATE_CACHE_T cached_areas[MAX_NUM_CACHED_AREAS];
+   /* Block cache, holding the cached regions and the data the main cache seeked away from */
+   VC_CONTAINER_IO_PRIVATE_CACHE_T view; /**< Cache used to read from the current block */
+   int view_block;                       /**< Index of the current block, -1 if none */
+   VC_CONTAINER_IO_BLOCK_T *blocks;
+   unsigned int blocks_num;
+   unsigned int blocks_max;              /**< Memory budget in number of blocks */
+   uint32_t blocks_tick;
+   VC_CONTAINER_IO_REGION_T *regions;
+   unsigned int regions_num;
+   VC_CONTAINER_CACHE_STATS_T cache_stats;
 
    int64_t actual_offset;
+   VC_CONTAINER_IO_MODE_T mode;
+
+   /* Sizing of the read cache */
+   size_t cache_pinned_size;   /**< Size requested by the user, 0 to adapt to the access pattern */
+   int64_t cache_fill_end;     /**< Offset following the data read by the last refill */
+   unsigned int cache_streak;  /**< Number of sequential refills in a row */
+   unsigned int cache_jumps;   /**< Number of non sequential refills in a row */
 
    struct VC_CONTAINER_IO_ASYNC_T *async_io;
+   struct VC_CONTAINER_IO_READ_AHEAD_T *read_ahead;
+
+   VC_CONTAINER_IO_BORROWED_T *borrowed; /**< List of cache memory with views handed out */
 
 } VC_CONTAINER_IO_PRIVATE_T;
 
@@ -93,18 +132,49 @@ VC_CONTAINER_STATUS_T vc_container_io_pktfile_open( VC_CONTAINER_IO_T *p_ctx, co
                                                  VC_CONTAINER_IO_MODE_T mode );
 VC_CONTAINER_STATUS_T vc_container_io_http_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
                                                  VC_CONTAINER_IO_MODE_T mode );
+VC_CONTAINER_STATUS_T vc_container_io_mmap_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
+                                                 VC_CONTAINER_IO_MODE_T mode );
+VC_CONTAINER_STATUS_T vc_container_io_memory_open( VC_CONTAINER_IO_T *p_ctx,
+   const VC_CONTAINER_IO_MEMORY_BUFFER_T *buffers, unsigned int buffers_num );
+VC_CONTAINER_STATUS_T vc_container_io_temp_open( VC_CONTAINER_IO_T *p_ctx,
+   uint32_t memory_budget, const char *directory );
+VC_CONTAINER_STATUS_T vc_container_io_temp_storage( VC_CONTAINER_IO_T *p_ctx,
+   uint32_t memory_budget, const char *directory );
 static VC_CONTAINER_STATUS_T io_seek_not_seekable(VC_CONTAINER_IO_T *p_ctx, int64_t offset);
 
 static size_t vc_container_io_cache_read( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, uint8_t *data, size_t size );
+static size_t vc_container_io_cache_peek( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, uint8_t *data, size_t size );
 static int32_t vc_container_io_cache_write( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, const uint8_t *data, size_t size );
+static size_t vc_container_io_cache_write_through( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, const uint8_t *data, size_t size );
 static VC_CONTAINER_STATUS_T vc_container_io_cache_seek( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, int64_t offset );
 static size_t vc_container_io_cache_refill( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache );
 static size_t vc_container_io_cache_flush( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, int complete );
+static size_t vc_container_io_cache_next_size( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, int64_t offset );
+static void vc_container_io_cache_adapt( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache );
+static size_t vc_container_io_cache_pinned_size( size_t size );
+static uint8_t *vc_container_io_cache_alloc( VC_CONTAINER_IO_T *p_ctx, size_t size );
+static size_t vc_container_io_module_read( VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size );
+static VC_CONTAINER_STATUS_T vc_container_io_module_seek( VC_CONTAINER_IO_T *p_ctx, int64_t offset );
+static uint32_t vc_container_io_get_microsecs( void );
+static size_t vc_container_io_block_refill( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache );
+static void vc_container_io_block_stash( VC_CONTAINER_IO_T *p_ctx, int64_t offset );
+static void vc_container_io_block_budget( VC_CONTAINER_IO_T *p_ctx, size_t budget );
+static int vc_container_io_block_alloc( VC_CONTAINER_IO_T *p_ctx );
+static int vc_container_io_block_fill( VC_CONTAINER_IO_T *p_ctx,
+   int index, int64_t offset, size_t size );
+static bool vc_container_io_block_region( VC_CONTAINER_IO_PRIVATE_T *private, int64_t offset );
+static int vc_container_io_block_find( VC_CONTAINER_IO_PRIVATE_T *private, int64_t offset );
+static void vc_container_io_block_use( VC_CONTAINER_IO_T *p_ctx, int index, int64_t offset );
 
 static struct VC_CONTAINER_IO_ASYNC_T *async_io_start( VC_CONTAINER_IO_T *io, int num_areas, VC_CONTAINER_STATUS_T * );
 static VC_CONTAINER_STATUS_T async_io_stop( struct VC_CONTAINER_IO_ASYNC_T *ctx );
@@ -114,6 +184,15 @@ static VC_CONTAINER_STATUS_T async_io_wait_complete( struct VC_CONTAINER_IO_ASYN
 static void async_io_stats_initialise( struct VC_CONTAINER_IO_ASYNC_T *ctx, int enable );
 static void async_io_stats_get( struct VC_CONTAINER_IO_ASYNC_T *ctx, VC_CONTAINER_WRITE_STATS_T *stats );
 
+static struct VC_CONTAINER_IO_READ_AHEAD_T *read_ahead_start( VC_CONTAINER_IO_T *io, unsigned int num_areas );
+static void read_ahead_stop( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx );
+static void read_ahead_pause( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx );
+static size_t read_ahead_refill( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_IO_PRIVATE_CACHE_T *cache );
+static void read_ahead_stats_initialise( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, int enable );
+static void read_ahead_stats_get( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_READ_STATS_T *stats );
+static void read_ahead_counters_get( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_READ_COUNTERS_T *counters );
+static void read_ahead_counters_reset( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx );
+
 /*****************************************************************************/
 static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAINER_IO_MODE_T mode,
                                                      VC_CONTAINER_IO_CAPABILITIES_T capabilities,
@@ -123,6 +202,7 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
    VC_CONTAINER_IO_T *p_ctx = 0;
    VC_CONTAINER_IO_PRIVATE_T *private = 0;
    unsigned int uri_length, caches = 0, cache_max_size, num_areas = MAX_NUM_MEMORY_AREAS;
+   const char *value;
 
    /* XXX */
    uri_length = strlen(uri) + 1;
@@ -137,6 +217,7 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
    p_ctx->uri_parts = vc_uri_create();
    if(!p_ctx->uri_parts) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
    vc_uri_parse(p_ctx->uri_parts, uri);
+   private->mode = mode;
 
    if (b_open)
    {
@@ -155,6 +236,9 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
 #ifdef ENABLE_CONTAINER_IO_HTTP
       if(status) status = vc_container_io_http_open(p_ctx, uri, mode);
 #endif
+#ifdef ENABLE_CONTAINER_IO_MMAP
+      if(status) status = vc_container_io_mmap_open(p_ctx, uri, mode);
+#endif
 #ifdef ENABLE_CONTAINER_IO_FILE
       if(status) status = vc_container_io_file_open(p_ctx, uri, mode);
 #endif
@@ -177,7 +261,7 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
       caches = 1;
 
    if(mode == VC_CONTAINER_IO_MODE_WRITE) cache_max_size = MEM_CACHE_WRITE_MAX_SIZE;
-   else cache_max_size = MEM_CACHE_READ_MAX_SIZE;
+   else cache_max_size = MEM_CACHE_READ_SIZE;
 
    if(mode == VC_CONTAINER_IO_MODE_WRITE &&
       vc_uri_path_extension(p_ctx->uri_parts) &&
@@ -195,7 +279,7 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
       cache->mem_max_size = cache_max_size;
       cache->mem_size = cache->mem_max_size;
       cache->io = p_ctx;
-      cache->mem = malloc(p_ctx->priv->caches.mem_size);
+      cache->mem = vc_container_io_cache_alloc(p_ctx, cache->mem_size);
       if(cache->mem)
       {      
          cache->buffer = cache->mem;
@@ -205,13 +289,39 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
    }
 
    if(p_ctx->priv->caches_num)
-      p_ctx->priv->cache = &p_ctx->priv->caches;
+      p_ctx->cache = &p_ctx->priv->caches;
+
+   /* Block cache for the index tables and the data we seek away from. Mapped data
+    * is already in memory. */
+   p_ctx->priv->view.io = p_ctx;
+   p_ctx->priv->view.mem_size = p_ctx->priv->view.mem_max_size = MEM_CACHE_BLOCK_SIZE;
+   p_ctx->priv->view_block = -1;
+   if(mode == VC_CONTAINER_IO_MODE_READ && !(p_ctx->capabilities & VC_CONTAINER_IO_CAPS_MAPPED))
+   {
+      size_t budget = MEM_CACHE_BLOCKS_BUDGET;
+      if(p_ctx->capabilities & (VC_CONTAINER_IO_CAPS_CANT_SEEK|VC_CONTAINER_IO_CAPS_SEEK_SLOW))
+         budget = MEM_CACHE_BLOCKS_SLOW_BUDGET;
+      if(vc_uri_find_query(p_ctx->uri_parts, 0, "cachebudget", &value) && value)
+         budget = strtoul(value, 0, 0);
+      vc_container_io_block_budget(p_ctx, budget);
+   }
+
+   /* The read cache size can be pinned from the URI (e.g. file.mp4?cachesize=1048576) */
+   if(mode == VC_CONTAINER_IO_MODE_READ && p_ctx->cache &&
+      vc_uri_find_query(p_ctx->uri_parts, 0, "cachesize", &value) && value)
+      p_ctx->priv->cache_pinned_size = vc_container_io_cache_pinned_size(strtoul(value, 0, 0));
 
 
    /* Try to start an asynchronous io if we're in write mode and we've got at least 2 cache memory areas */
-   if(mode == VC_CONTAINER_IO_MODE_WRITE && p_ctx->priv->cache && num_areas >= 2)
+   if(mode == VC_CONTAINER_IO_MODE_WRITE && p_ctx->cache && num_areas >= 2)
       p_ctx->priv->async_io = async_io_start( p_ctx, num_areas, 0 );
 
+   /* Start reading ahead if the URI asks for it (e.g. file.mp4?readahead=8) */
+   if(mode == VC_CONTAINER_IO_MODE_READ && p_ctx->cache &&
+      vc_uri_find_query(p_ctx->uri_parts, 0, "readahead", &value))
+      p_ctx->priv->read_ahead = read_ahead_start( p_ctx,
+         value && *value ? strtoul(value, 0, 0) : READ_AHEAD_DEFAULT_AREAS );
+
  end:
    if(p_status) *p_status = status;
    return p_ctx;
@@ -238,6 +348,86 @@ VC_CONTAINER_IO_T *vc_container_io_create( const char *uri, VC_CONTAINER_IO_MODE
    return vc_container_io_open_core( uri, mode, capabilities, false, p_status );
 }
 
+/*****************************************************************************/
+VC_CONTAINER_IO_T *vc_container_io_open_memory( const char *uri, const void *data, size_t size,
+                                                VC_CONTAINER_STATUS_T *p_status )
+{
+   VC_CONTAINER_IO_MEMORY_BUFFER_T buffer;
+   buffer.data = data;
+   buffer.size = size;
+   return vc_container_io_open_memory_chain( uri, &buffer, 1, p_status );
+}
+
+/*****************************************************************************/
+VC_CONTAINER_IO_T *vc_container_io_open_memory_chain( const char *uri,
+                                                      const VC_CONTAINER_IO_MEMORY_BUFFER_T *buffers,
+                                                      unsigned int buffers_num,
+                                                      VC_CONTAINER_STATUS_T *p_status )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   VC_CONTAINER_IO_T *p_ctx = 0;
+
+#ifdef ENABLE_CONTAINER_IO_MEMORY
+   /* Mapped data doesn't get a cache */
+   p_ctx = vc_container_io_create( uri ? uri : "memory:", VC_CONTAINER_IO_MODE_READ,
+                                   VC_CONTAINER_IO_CAPS_MAPPED, &status );
+   if(p_ctx)
+      status = vc_container_io_memory_open( p_ctx, buffers, buffers_num );
+   if(p_ctx && status != VC_CONTAINER_SUCCESS)
+   {
+      vc_container_io_close( p_ctx );
+      p_ctx = 0;
+   }
+#else
+   VC_CONTAINER_PARAM_UNUSED(uri);
+   VC_CONTAINER_PARAM_UNUSED(buffers);
+   VC_CONTAINER_PARAM_UNUSED(buffers_num);
+#endif
+
+   if(p_status) *p_status = status;
+   return p_ctx;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_IO_T *vc_container_io_open_temp( const char *uri, uint32_t memory_budget,
+                                              const char *directory, VC_CONTAINER_STATUS_T *p_status )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   VC_CONTAINER_IO_T *p_ctx = 0;
+
+#ifdef ENABLE_CONTAINER_IO_TEMP
+   p_ctx = vc_container_io_create( uri, VC_CONTAINER_IO_MODE_WRITE, 0, &status );
+   if(p_ctx)
+      status = vc_container_io_temp_open( p_ctx, memory_budget, directory );
+   if(p_ctx && status != VC_CONTAINER_SUCCESS)
+   {
+      vc_container_io_close( p_ctx );
+      p_ctx = 0;
+   }
+#else
+   VC_CONTAINER_PARAM_UNUSED(uri);
+   VC_CONTAINER_PARAM_UNUSED(memory_budget);
+   VC_CONTAINER_PARAM_UNUSED(directory);
+#endif
+
+   if(p_status) *p_status = status;
+   return p_ctx;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_set_temp_storage( VC_CONTAINER_IO_T *p_ctx,
+   uint32_t memory_budget, const char *directory )
+{
+#ifdef ENABLE_CONTAINER_IO_TEMP
+   return vc_container_io_temp_storage( p_ctx, memory_budget, directory );
+#else
+   VC_CONTAINER_PARAM_UNUSED(p_ctx);
+   VC_CONTAINER_PARAM_UNUSED(memory_budget);
+   VC_CONTAINER_PARAM_UNUSED(directory);
+   return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+#endif
+}
+
 /*****************************************************************************/
 VC_CONTAINER_STATUS_T vc_container_io_close( VC_CONTAINER_IO_T *p_ctx )
 {
@@ -247,6 +437,9 @@ VC_CONTAINER_STATUS_T vc_container_io_close( VC_CONTAINER_IO_T *p_ctx )
    {
       if(p_ctx->priv)
       {
+         if(p_ctx->priv->read_ahead)
+            read_ahead_stop( p_ctx->priv->read_ahead );
+
          if(p_ctx->priv->caches_num)
          {
             if(p_ctx->priv->caches.dirty)
@@ -258,8 +451,19 @@ VC_CONTAINER_STATUS_T vc_container_io_close( VC_CONTAINER_IO_T *p_ctx )
          else if(p_ctx->priv->caches_num)
             free(p_ctx->priv->caches.mem);
 
-         for(i = 0; i < p_ctx->priv->cached_areas_num; i++)
-            free(p_ctx->priv->cached_areas[i].mem);
+         for(i = 0; i < p_ctx->priv->blocks_num; i++)
+            free(p_ctx->priv->blocks[i].mem);
+         free(p_ctx->priv->blocks);
+         free(p_ctx->priv->regions);
+
+         /* Cache memory which was still borrowed */
+         while(p_ctx->priv->borrowed)
+         {
+            VC_CONTAINER_IO_BORROWED_T *borrowed = p_ctx->priv->borrowed;
+            p_ctx->priv->borrowed = borrowed->next;
+            if(!borrowed->cache) free(borrowed->mem);
+            free(borrowed);
+         }
          
          if(p_ctx->pf_close)
             p_ctx->pf_close(p_ctx);
@@ -275,20 +479,15 @@ size_t vc_container_io_peek(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
 {
    size_t ret;
 
-   if(p_ctx->priv->cache)
-   {
-      /* FIXME: do something a bit more clever than this */
-      int64_t offset = p_ctx->offset;
-      ret = vc_container_io_read(p_ctx, buffer, size);
-      vc_container_io_seek(p_ctx, offset);
-      return ret;
-   }
+   p_ctx->counters.peeks++;
+   if(p_ctx->cache)
+      return vc_container_io_cache_peek( p_ctx, p_ctx->cache, (uint8_t *)buffer, size );
 
    if (p_ctx->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK)
       return 0;
 
-   ret = p_ctx->pf_read(p_ctx, buffer, size);
-   p_ctx->pf_seek(p_ctx, p_ctx->offset);
+   ret = vc_container_io_module_read(p_ctx, buffer, size);
+   vc_container_io_module_seek(p_ctx, p_ctx->offset);
    return ret;
 }
 
@@ -297,25 +496,97 @@ size_t vc_container_io_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
 {
    size_t ret;
 
-   if(p_ctx->priv->cache)
-      ret = vc_container_io_cache_read( p_ctx, p_ctx->priv->cache, (uint8_t*)buffer, size );
+   if(p_ctx->cache)
+      ret = vc_container_io_cache_read( p_ctx, p_ctx->cache, (uint8_t*)buffer, size );
    else
    {
-      ret = p_ctx->pf_read(p_ctx, buffer, size);
+      ret = vc_container_io_module_read(p_ctx, buffer, size);
       p_ctx->priv->actual_offset += ret;
    }
 
    p_ctx->offset += ret;
+   p_ctx->counters.bytes_read += ret;
    return ret;
 }
 
+/*****************************************************************************/
+const void *vc_container_io_borrow(VC_CONTAINER_IO_T *p_ctx, size_t *size)
+{
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache = p_ctx->cache;
+   const void *data;
+
+   if(cache)
+   {
+      /* Only data which is already in the cache can be handed out. The memory
+       * of the block cache gets reused too quickly to be handed out. */
+      if(!*size || cache->dirty || cache->position + *size > cache->size ||
+         cache == &p_ctx->priv->view)
+         return NULL;
+
+      /* Keep track of the views so the memory isn't reused while they exist */
+      if(!cache->borrowed)
+      {
+         VC_CONTAINER_IO_BORROWED_T *borrowed = malloc(sizeof(*borrowed));
+         if(!borrowed) return NULL;
+         borrowed->cache = cache;
+         borrowed->mem = cache->mem;
+         borrowed->size = cache->buffer_end - cache->mem;
+         borrowed->refcount = 0;
+         borrowed->next = p_ctx->priv->borrowed;
+         p_ctx->priv->borrowed = cache->borrowed = borrowed;
+      }
+      cache->borrowed->refcount++;
+
+      data = cache->buffer + cache->position;
+      cache->position += *size;
+      p_ctx->offset += *size;
+      p_ctx->counters.cache_hits++;
+      p_ctx->counters.bytes_read += *size;
+      return data;
+   }
+
+   /* Mapped data stays valid until the i/o is closed */
+   if(!(p_ctx->capabilities & VC_CONTAINER_IO_CAPS_MAPPED) || !p_ctx->pf_map)
+      return NULL;
+
+   data = p_ctx->pf_map(p_ctx, size);
+   if(!data) return NULL;
+   p_ctx->priv->actual_offset += *size;
+   p_ctx->offset += *size;
+   p_ctx->counters.bytes_read += *size;
+   return data;
+}
+
+/*****************************************************************************/
+void vc_container_io_release(VC_CONTAINER_IO_T *p_ctx, const void *data)
+{
+   VC_CONTAINER_IO_BORROWED_T **pp_borrowed, *borrowed;
+
+   for(pp_borrowed = &p_ctx->priv->borrowed; *pp_borrowed; pp_borrowed = &(*pp_borrowed)->next)
+   {
+      borrowed = *pp_borrowed;
+      if((const uint8_t *)data >= borrowed->mem &&
+         (const uint8_t *)data < borrowed->mem + borrowed->size)
+         break;
+   }
+
+   /* Mapped data or data which wasn't borrowed */
+   borrowed = *pp_borrowed;
+   if(!borrowed || --borrowed->refcount) return;
+
+   *pp_borrowed = borrowed->next;
+   if(borrowed->cache) borrowed->cache->borrowed = NULL;
+   else free(borrowed->mem);
+   free(borrowed);
+}
+
 /*****************************************************************************/
 size_t vc_container_io_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_t size)
 {
    int32_t ret;
 
-   if(p_ctx->priv->cache)
-      ret = vc_container_io_cache_write( p_ctx, p_ctx->priv->cache, (const uint8_t*)buffer, size );
+   if(p_ctx->cache)
+      ret = vc_container_io_cache_write( p_ctx, p_ctx->cache, (const uint8_t*)buffer, size );
    else
    {
       ret = p_ctx->pf_write(p_ctx, buffer, size);
@@ -326,6 +597,45 @@ size_t vc_container_io_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_
    return ret < 0 ? 0 : ret;
 }
 
+/*****************************************************************************/
+size_t vc_container_io_write_vector(VC_CONTAINER_IO_T *p_ctx,
+   const VC_CONTAINER_IO_VECTOR_T *vectors, unsigned int vectors_num)
+{
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache = p_ctx->cache;
+   size_t written = 0, ret;
+   unsigned int i;
+
+   if(!cache && p_ctx->pf_write_vector)
+   {
+      written = p_ctx->pf_write_vector(p_ctx, vectors, vectors_num);
+      p_ctx->priv->actual_offset += written;
+      p_ctx->offset += written;
+      return written;
+   }
+
+   for(i = 0; i < vectors_num; i++)
+   {
+      /* Big pieces skip the copy into the write cache when they are appended to it.
+       * O_DIRECT streams need the cache to keep their writes aligned. */
+      if(cache && vectors[i].size >= MEM_CACHE_WRITE_THROUGH_SIZE &&
+         cache == &p_ctx->priv->caches && !p_ctx->priv->async_io &&
+         p_ctx->priv->mode == VC_CONTAINER_IO_MODE_WRITE &&
+         !(p_ctx->capabilities & VC_CONTAINER_IO_CAPS_DIRECT) &&
+         (cache->dirty || !cache->size) && cache->position >= cache->size)
+      {
+         ret = vc_container_io_cache_write_through( p_ctx, cache, vectors[i].data, vectors[i].size );
+         p_ctx->offset += ret;
+      }
+      else
+         ret = vc_container_io_write( p_ctx, vectors[i].data, vectors[i].size );
+
+      written += ret;
+      if(ret != vectors[i].size) break;
+   }
+
+   return written;
+}
+
 /*****************************************************************************/
 size_t vc_container_io_skip(VC_CONTAINER_IO_T *p_ctx, size_t size)
 {
@@ -337,9 +647,9 @@ size_t vc_container_io_skip(VC_CONTAINER_IO_T *p_ctx, size_t size)
       return vc_container_io_read(p_ctx, value, size);
    }
 
-   if(p_ctx->priv->cache)
+   if(p_ctx->cache)
    {
-      if(vc_container_io_cache_seek(p_ctx, p_ctx->priv->cache, p_ctx->offset + size)) return 0;
+      if(vc_container_io_cache_seek(p_ctx, p_ctx->cache, p_ctx->offset + size)) return 0;
       p_ctx->offset += size;
       return size;
    }
@@ -351,33 +661,45 @@ size_t vc_container_io_skip(VC_CONTAINER_IO_T *p_ctx, size_t size)
 /*****************************************************************************/
 VC_CONTAINER_STATUS_T vc_container_io_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
 {
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *main_cache = private->caches_num ? &private->caches : 0;
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *view = &private->view;
    VC_CONTAINER_STATUS_T status;
-   unsigned int i;
-
-   /* Check if the requested position is in one of the cached areas */
-   for(i = 0; i < p_ctx->priv->cached_areas_num; i++)
+   int index;
+
+   /* Cached regions and data still in the block cache are read from there unless
+    * the main cache already has it. Parsers jump between tables all the time so
+    * this needs to be quick. */
+   p_ctx->cache = main_cache;
+   if(private->blocks_max &&
+      !(main_cache && offset >= main_cache->offset &&
+        offset < main_cache->offset + (int64_t)main_cache->size))
    {
-      VC_CONTAINER_IO_PRIVATE_CACHE_T *cache = &p_ctx->priv->cached_areas[i];
-      if(offset >= cache->start && offset < cache->end)
+      if(offset >= view->offset && offset < view->offset + (int64_t)view->size)
+         p_ctx->cache = view;
+      else if((index = vc_container_io_block_find(private, offset)) >= 0)
       {
-         p_ctx->priv->cache = cache;
-         break;
+         private->cache_stats.hits++;
+         vc_container_io_block_use(p_ctx, index, offset);
+         p_ctx->cache = view;
+         p_ctx->offset = offset;
+         return VC_CONTAINER_SUCCESS;
       }
+      else if(vc_container_io_block_region(private, offset))
+         p_ctx->cache = view;
    }
-   if(i == p_ctx->priv->cached_areas_num)
-      p_ctx->priv->cache = p_ctx->priv->caches_num ? &p_ctx->priv->caches : 0;
 
-   if(p_ctx->priv->cache)
+   if(p_ctx->cache)
    {
-      status = vc_container_io_cache_seek( p_ctx, p_ctx->priv->cache, offset );
+      status = vc_container_io_cache_seek( p_ctx, p_ctx->cache, offset );
       if(status == VC_CONTAINER_SUCCESS) p_ctx->offset = offset;
       return status;
    }
 
-   if(p_ctx->status == VC_CONTAINER_SUCCESS &&
-      offset == p_ctx->offset) return VC_CONTAINER_SUCCESS;
+   if(p_ctx->status == VC_CONTAINER_SUCCESS && offset == p_ctx->offset &&
+      offset == private->actual_offset) return VC_CONTAINER_SUCCESS;
 
-   status = p_ctx->pf_seek(p_ctx, offset);
+   status = vc_container_io_module_seek(p_ctx, offset);
    if(status == VC_CONTAINER_SUCCESS) p_ctx->offset = offset;
    p_ctx->priv->actual_offset = p_ctx->offset;
    return status;
@@ -402,8 +724,8 @@ static VC_CONTAINER_STATUS_T io_seek_not_seekable(VC_CONTAINER_IO_T *p_ctx, int6
    {
       uint8_t value[64];
       unsigned int ret, size = MIN(offset, 64);
-      ret = p_ctx->pf_read(p_ctx, value, size);
-      if(ret != size) p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      ret = vc_container_io_module_read(p_ctx, value, size);
+      if(!ret && !p_ctx->status) p_ctx->status = VC_CONTAINER_ERROR_EOS;
       offset -= ret;
    }
    return p_ctx->status;
@@ -415,14 +737,22 @@ VC_CONTAINER_STATUS_T vc_container_io_control_list(VC_CONTAINER_IO_T *context, V
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
 
    if (context->pf_control)
+   {
+      /* The read-ahead thread can't be using the io module at the same time */
+      if(context->priv->read_ahead && operation != VC_CONTAINER_CONTROL_GET_IO_READ_STATS &&
+         operation != VC_CONTAINER_CONTROL_GET_IO_CACHE_STATS &&
+         operation != VC_CONTAINER_CONTROL_GET_READ_COUNTERS &&
+         operation != VC_CONTAINER_CONTROL_RESET_READ_COUNTERS)
+         read_ahead_pause(context->priv->read_ahead);
       status = context->pf_control(context, operation, args);
+   }
 
    /* Option to add generic I/O control here */
 
-   if(operation == VC_CONTAINER_CONTROL_IO_FLUSH && context->priv->cache)
+   if(operation == VC_CONTAINER_CONTROL_IO_FLUSH && context->cache)
    {
       status = VC_CONTAINER_SUCCESS;
-      (void)vc_container_io_cache_flush( context, context->priv->cache, 1 );
+      (void)vc_container_io_cache_flush( context, context->cache, 1 );
    }
 
    if(operation == VC_CONTAINER_CONTROL_SET_IO_PERF_STATS && context->priv->async_io)
@@ -437,6 +767,72 @@ VC_CONTAINER_STATUS_T vc_container_io_control_list(VC_CONTAINER_IO_T *context, V
       async_io_stats_get(context->priv->async_io, va_arg(args, VC_CONTAINER_WRITE_STATS_T *));
    }
 
+   if(operation == VC_CONTAINER_CONTROL_SET_IO_PERF_STATS && context->priv->read_ahead)
+   {
+      status = VC_CONTAINER_SUCCESS;
+      read_ahead_stats_initialise(context->priv->read_ahead, va_arg(args, int));
+   }
+
+   if(operation == VC_CONTAINER_CONTROL_GET_IO_READ_STATS && context->priv->read_ahead)
+   {
+      status = VC_CONTAINER_SUCCESS;
+      read_ahead_stats_get(context->priv->read_ahead, va_arg(args, VC_CONTAINER_READ_STATS_T *));
+   }
+
+   if(operation == VC_CONTAINER_CONTROL_IO_SET_CACHE_SIZE &&
+      context->priv->mode == VC_CONTAINER_IO_MODE_READ && context->priv->caches_num)
+   {
+      /* Takes effect on the next refill of the cache */
+      context->priv->cache_pinned_size = vc_container_io_cache_pinned_size(va_arg(args, uint32_t));
+      context->priv->cache_streak = context->priv->cache_jumps = 0;
+      status = VC_CONTAINER_SUCCESS;
+   }
+
+   if(operation == VC_CONTAINER_CONTROL_IO_SET_CACHE_BUDGET &&
+      context->priv->mode == VC_CONTAINER_IO_MODE_READ &&
+      !(context->capabilities & VC_CONTAINER_IO_CAPS_MAPPED))
+   {
+      vc_container_io_block_budget(context, va_arg(args, uint32_t));
+      status = VC_CONTAINER_SUCCESS;
+   }
+
+   if(operation == VC_CONTAINER_CONTROL_GET_IO_CACHE_STATS)
+   {
+      VC_CONTAINER_CACHE_STATS_T *stats = va_arg(args, VC_CONTAINER_CACHE_STATS_T *);
+      *stats = context->priv->cache_stats;
+      stats->blocks = context->priv->blocks_num;
+      stats->budget = context->priv->blocks_max * MEM_CACHE_BLOCK_SIZE;
+      status = VC_CONTAINER_SUCCESS;
+   }
+
+   if(operation == VC_CONTAINER_CONTROL_GET_READ_COUNTERS)
+   {
+      VC_CONTAINER_READ_COUNTERS_T *counters = va_arg(args, VC_CONTAINER_READ_COUNTERS_T *);
+      if(context->priv->read_ahead) read_ahead_counters_get(context->priv->read_ahead, counters);
+      else *counters = context->counters;
+      status = VC_CONTAINER_SUCCESS;
+   }
+
+   if(operation == VC_CONTAINER_CONTROL_RESET_READ_COUNTERS)
+   {
+      if(context->priv->read_ahead) read_ahead_counters_reset(context->priv->read_ahead);
+      else memset(&context->counters, 0, sizeof(context->counters));
+      status = VC_CONTAINER_SUCCESS;
+   }
+
+   if(operation == VC_CONTAINER_CONTROL_IO_SET_READ_AHEAD &&
+      context->priv->mode == VC_CONTAINER_IO_MODE_READ && context->cache)
+   {
+      unsigned int num_areas = va_arg(args, unsigned int);
+
+      if(context->priv->read_ahead)
+         read_ahead_stop(context->priv->read_ahead);
+      context->priv->read_ahead = num_areas ? read_ahead_start(context, num_areas) : 0;
+
+      status = !num_areas || context->priv->read_ahead ?
+         VC_CONTAINER_SUCCESS : VC_CONTAINER_ERROR_FAILED;
+   }
+
    return status;
 }
 
@@ -457,64 +853,59 @@ VC_CONTAINER_STATUS_T vc_container_io_control(VC_CONTAINER_IO_T *context, VC_CON
 size_t vc_container_io_cache(VC_CONTAINER_IO_T *p_ctx, size_t size)
 {
    VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
-   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, *main_cache;
-   VC_CONTAINER_STATUS_T status;
-
-   /* Sanity checking */
-   if(private->cached_areas_num >= MAX_NUM_CACHED_AREAS) return 0;
-
-   cache = &private->cached_areas[private->cached_areas_num];
-   cache->start = p_ctx->offset;
-   cache->end = cache->start + size;
-   cache->offset = p_ctx->offset;
-   cache->position = 0;
-   cache->size = 0;
-   cache->io = p_ctx;
-
-   /* Set the size of the cache area depending on the capabilities of the i/o */
-   if(p_ctx->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK)
-      cache->mem_max_size = MEM_CACHE_AREA_READ_MAX_SIZE;
-   else if((p_ctx->capabilities & VC_CONTAINER_IO_CAPS_SEEK_SLOW) &&
-           size <= MEM_CACHE_AREA_READ_MAX_SIZE)
-      cache->mem_max_size = MEM_CACHE_AREA_READ_MAX_SIZE;
-   else
-      cache->mem_max_size = MEM_CACHE_READ_MAX_SIZE;
-
-   cache->mem_size = size;
-   if(cache->mem_size > cache->mem_max_size) cache->mem_size = cache->mem_max_size;
-   cache->mem = malloc(cache->mem_size);
+   VC_CONTAINER_IO_REGION_T *region;
+   int64_t start = p_ctx->offset;
+   size_t cached = 0, preload, ret;
+   int index;
 
-   cache->buffer = cache->mem;
-   cache->buffer_end = cache->mem + cache->mem_size;
-
-   if(!cache->mem) return 0;
-   private->cached_areas_num++;
+   /* Without a block cache, we can still come back to the data if we can seek */
+   if(!private->blocks_max)
+   {
+      if(p_ctx->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK) return 0;
+      return vc_container_io_seek(p_ctx, start + size) == VC_CONTAINER_SUCCESS ? size : 0;
+   }
 
-   /* Copy any data we've got in the current cache into the new cache */
-   main_cache = p_ctx->priv->cache;
-   if(main_cache && main_cache->position < main_cache->size)
+   /* Keep track of the region so seeking into it goes to the block cache */
+   if(!(private->regions_num % 16))
    {
-      cache->size = main_cache->size - main_cache->position;
-      if(cache->size > cache->mem_size) cache->size = cache->mem_size;
-      memcpy(cache->buffer, main_cache->buffer + main_cache->position, cache->size);
-      main_cache->position += cache->size;
+      region = realloc(private->regions, (private->regions_num + 16) * sizeof(*region));
+      if(!region) return 0;
+      private->regions = region;
    }
+   region = &private->regions[private->regions_num++];
+   region->start = start;
+   region->end = start + size;
 
-   /* Read the rest of the cache directly from the stream */
-   if(cache->mem_size > cache->size)
+   /* We are reading the start of the region anyway so load it now. Streams which
+    * are slow or unable to seek get as much of it as the budget allows. */
+   preload = MIN(size, MEM_CACHE_BLOCK_SIZE);
+   if(p_ctx->capabilities & (VC_CONTAINER_IO_CAPS_CANT_SEEK|VC_CONTAINER_IO_CAPS_SEEK_SLOW))
+      preload = size;
+
+   while(cached < preload && vc_container_io_block_find(private, start + cached) < 0)
    {
-      size_t ret = cache->io->pf_read(cache->io, cache->buffer + cache->size,
-                                      cache->mem_size - cache->size);
-      cache->size += ret;
-      cache->io->priv->actual_offset = cache->offset + cache->size;
+      index = vc_container_io_block_alloc(p_ctx);
+      if(index < 0) break;
+
+      size_t bytes = MIN(preload - cached, MEM_CACHE_BLOCK_SIZE);
+      index = vc_container_io_block_fill(p_ctx, index, start + cached, bytes);
+      private->blocks[index].locked = !!(p_ctx->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK);
+      ret = private->blocks[index].size;
+      cached += ret;
+      if(ret < bytes) break; /* The stream ended, no need to wait for more */
    }
 
-   status = vc_container_io_seek(p_ctx, cache->end);
-   if(status != VC_CONTAINER_SUCCESS)
+   /* Streams which can't seek may well end within the region, in which case the
+    * region stops where the data does */
+   if((p_ctx->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK) && cached < size &&
+      p_ctx->status == VC_CONTAINER_ERROR_EOS)
+      region->end = start + cached;
+
+   if(vc_container_io_seek(p_ctx, region->end) != VC_CONTAINER_SUCCESS)
       return 0;
 
    if(p_ctx->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK)
-      return cache->size;
+      return cached;
    else
       return size;
 }
@@ -527,16 +918,41 @@ static size_t vc_container_io_cache_refill( VC_CONTAINER_IO_T *p_ctx,
 
    if(ret) return 0; /* TODO what should we do there ? */
 
+   if(cache == &p_ctx->priv->view)
+      return vc_container_io_block_refill( p_ctx, cache );
+
+   vc_container_io_cache_adapt( p_ctx, cache );
+
+   /* Views of the cache memory are still handed out so carry on with new memory */
+   if(cache->borrowed)
+   {
+      uint8_t *mem = malloc(cache->borrowed->size);
+      if(!mem) return 0;
+      cache->buffer = mem + (cache->buffer - cache->mem);
+      cache->buffer_end = mem + cache->borrowed->size;
+      cache->mem = mem;
+      cache->borrowed->cache = NULL;
+      cache->borrowed = NULL;
+   }
+
+   if(p_ctx->priv->read_ahead)
+   {
+      if(cache == &p_ctx->priv->caches)
+         return read_ahead_refill( p_ctx->priv->read_ahead, cache );
+      read_ahead_pause( p_ctx->priv->read_ahead );
+   }
+
    if(p_ctx->priv->actual_offset != cache->offset)
    {
-      if(cache->io->pf_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
+      if(vc_container_io_module_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
          return 0;
    }
 
-   ret = cache->io->pf_read(cache->io, cache->buffer, cache->buffer_end - cache->buffer);
+   ret = vc_container_io_module_read(cache->io, cache->buffer, cache->buffer_end - cache->buffer);
    cache->size = ret;
    cache->position = 0;
    cache->io->priv->actual_offset = cache->offset + ret;
+   p_ctx->priv->cache_fill_end = cache->offset + ret;
    return ret;
 }
 
@@ -548,16 +964,22 @@ static size_t vc_container_io_cache_refill_bypass( VC_CONTAINER_IO_T *p_ctx,
 
    if(ret) return 0; /* TODO what should we do there ? */
 
+   /* Reads bigger than the cache are a good hint it is too small */
+   vc_container_io_cache_adapt( p_ctx, cache );
+
+   if(p_ctx->priv->read_ahead) read_ahead_pause( p_ctx->priv->read_ahead );
+
    if(p_ctx->priv->actual_offset != cache->offset)
    {
-      if(cache->io->pf_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
+      if(vc_container_io_module_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
          return 0;
    }
 
-   ret = cache->io->pf_read(cache->io, buffer, size);
+   ret = vc_container_io_module_read(cache->io, buffer, size);
    cache->size = cache->position = 0;
    cache->offset += ret;
    cache->io->priv->actual_offset = cache->offset;
+   p_ctx->priv->cache_fill_end = cache->offset;
    return ret;
 }
 
@@ -567,28 +989,40 @@ static size_t vc_container_io_cache_read( VC_CONTAINER_IO_T *p_ctx,
 {
    size_t read = 0, bytes, ret;
 
+   if(cache->size - cache->position >= size) p_ctx->counters.cache_hits++;
+   else p_ctx->counters.cache_misses++;
+
    while(size)
    {
       bytes = cache->size - cache->position; /* Bytes left in cache */
 
 #if 1 // FIXME Only if stream is seekable
-      /* Try to read directly from the stream if the cache just gets in the way */
-      if(!bytes && size > cache->mem_size)
+      /* Try to read directly from the stream if the cache just gets in the way.
+       * When reading ahead, the data is most likely already waiting for us. */
+      if(!bytes && size > cache->mem_size &&
+         !(p_ctx->priv->read_ahead && cache == &p_ctx->priv->caches))
       {
          bytes = cache->mem_size;
          ret = vc_container_io_cache_refill_bypass( p_ctx, cache, data + read, bytes);
+         p_ctx->counters.bypass_reads++;
          read += ret;
 
-         if(ret != bytes) /* We didn't read as many bytes as we had hoped */
-            goto end;
+         /* Live streams hand over the data as it arrives so short reads aren't
+          * necessarily the end */
+         if(!ret) goto end;
 
-         size -= bytes;
+         size -= ret;
          continue;
       }
 #endif
 
-      /* Refill the cache if it is empty */
-      if(!bytes) bytes = vc_container_io_cache_refill( p_ctx, cache );
+      /* Refill the cache if it is empty. This can move us between the block
+       * cache and the main cache. */
+      if(!bytes)
+      {
+         bytes = vc_container_io_cache_refill( p_ctx, cache );
+         cache = p_ctx->cache;
+      }
       if(!bytes) goto end;
 
       /* We do have some data in the cache so override the status */
@@ -597,6 +1031,7 @@ static size_t vc_container_io_cache_read( VC_CONTAINER_IO_T *p_ctx,
       /* Read data directly from the cache */
       if(bytes > size) bytes = size;
       memcpy(data + read, cache->buffer + cache->position, bytes);
+      p_ctx->counters.bytes_copied += bytes;
       cache->position += bytes;
       read += bytes;
       size -= bytes;
@@ -607,6 +1042,96 @@ static size_t vc_container_io_cache_read( VC_CONTAINER_IO_T *p_ctx,
    return read;
 }
 
+/*****************************************************************************/
+static size_t vc_container_io_cache_peek( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, uint8_t *data, size_t size )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   size_t bytes = cache->size - cache->position, mem_size, ret;
+   int64_t offset;
+   uint8_t *mem;
+
+   if(bytes >= size)
+   {
+      p_ctx->counters.cache_hits++;
+      goto end;
+   }
+   p_ctx->counters.cache_misses++;
+
+   /* Only the main read cache can be extended, and its size is fixed while reading ahead */
+   if(cache != &private->caches || cache->dirty)
+      goto fallback;
+   mem_size = vc_container_io_cache_next_size( p_ctx, cache, cache->offset + cache->size );
+   while(mem_size < size && mem_size < MEM_CACHE_READ_PINNED_MAX_SIZE)
+      mem_size <<= 1;
+   if(mem_size < size || (private->read_ahead && mem_size != cache->mem_size))
+      goto fallback;
+
+   /* Move the data we've still got to the start of the cache memory so the
+    * rest can be read right after it */
+   if(mem_size != cache->mem_size ||
+      cache->buffer + cache->position + size > cache->buffer_end)
+   {
+      mem = cache->mem;
+      if(mem_size != cache->mem_size || cache->borrowed)
+      {
+         mem = malloc(mem_size);
+         if(!mem) goto fallback;
+      }
+      memmove(mem, cache->buffer + cache->position, bytes);
+
+      if(mem != cache->mem)
+      {
+         if(cache->borrowed)
+         {
+            cache->borrowed->cache = NULL;
+            cache->borrowed = NULL;
+         }
+         else
+            free(cache->mem);
+         cache->mem = mem;
+         cache->mem_size = cache->mem_max_size = mem_size;
+         cache->buffer_end = cache->mem + cache->mem_size;
+      }
+
+      cache->offset += cache->position;
+      cache->buffer = cache->mem;
+      cache->size = bytes;
+      cache->position = 0;
+   }
+
+   /* Fill up the rest of the cache memory */
+   if(private->read_ahead) read_ahead_pause( private->read_ahead );
+
+   offset = cache->offset + cache->size;
+   if(private->actual_offset != offset &&
+      vc_container_io_module_seek(cache->io, offset) != VC_CONTAINER_SUCCESS)
+      goto end;
+
+   /* Live streams hand over the data as it arrives so this can take a few reads */
+   do {
+      ret = vc_container_io_module_read(cache->io, cache->buffer + cache->size,
+                                        cache->buffer_end - cache->buffer - cache->size);
+      cache->size += ret;
+      private->actual_offset = private->cache_fill_end = cache->offset + cache->size;
+      bytes = cache->size - cache->position;
+   } while(ret && bytes < size);
+
+ end:
+   /* We do have all the data so override the status */
+   if(bytes >= size) p_ctx->status = VC_CONTAINER_SUCCESS;
+   if(bytes > size) bytes = size;
+   memcpy(data, cache->buffer + cache->position, bytes);
+   p_ctx->counters.bytes_copied += bytes;
+   return bytes;
+
+ fallback:
+   offset = p_ctx->offset;
+   ret = vc_container_io_read(p_ctx, data, size);
+   vc_container_io_seek(p_ctx, offset);
+   return ret;
+}
+
 /*****************************************************************************/
 static int32_t vc_container_io_cache_write( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, const uint8_t *data, size_t size )
@@ -617,8 +1142,13 @@ static int32_t vc_container_io_cache_write( VC_CONTAINER_IO_T *p_ctx,
    /* If we do not have a write cache then we need to flush it */
    if(cache->size && !cache->dirty)
    {
+      /* The read data is dropped, writing starts at the current position */
+      int64_t offset = cache->offset + cache->position;
       ret = vc_container_io_cache_flush( p_ctx, cache, 1 );
       if(ret) return -(int32_t)ret;
+      cache->offset = offset;
+      if(cache->mem_size == cache->mem_max_size)
+         cache->buffer = cache->mem + MEM_CACHE_SHIFT(p_ctx, offset);
    }
 
    while(size)
@@ -668,6 +1198,51 @@ static int32_t vc_container_io_cache_write( VC_CONTAINER_IO_T *p_ctx,
    return written;
 }
 
+/*****************************************************************************/
+static size_t vc_container_io_cache_write_through( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, const uint8_t *data, size_t size )
+{
+   VC_CONTAINER_IO_VECTOR_T vectors[2];
+   size_t cached, ret;
+
+   if(cache->position > cache->size) cache->size = cache->position;
+   cached = cache->dirty ? cache->size : 0;
+
+   /* The data in the cache goes out in the same call as the payload if the
+    * module can do it, otherwise it is flushed first */
+   if(cached && !cache->io->pf_write_vector)
+   {
+      if(vc_container_io_cache_flush( p_ctx, cache, 1 )) return 0;
+      cached = 0;
+   }
+
+   if(cache->io->priv->actual_offset != cache->offset &&
+      vc_container_io_module_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
+      return 0;
+
+   if(cached)
+   {
+      vectors[0].data = cache->buffer;
+      vectors[0].size = cached;
+      vectors[1].data = data;
+      vectors[1].size = size;
+      ret = cache->io->pf_write_vector(cache->io, vectors, 2);
+   }
+   else
+      ret = cache->io->pf_write(cache->io, data, size);
+   cache->io->priv->actual_offset = cache->offset + ret;
+
+   /* Like with a flush, the cached data is dropped even if it couldn't all be written */
+   ret = ret > cached ? ret - cached : 0;
+   cache->offset += cached + ret;
+   cache->dirty = 0;
+   cache->position = cache->size = 0;
+   if(cache->mem_size == cache->mem_max_size)
+      cache->buffer = cache->mem + MEM_CACHE_SHIFT(p_ctx, cache->offset);
+
+   return ret;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T vc_container_io_cache_seek(VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, int64_t offset)
@@ -682,17 +1257,77 @@ static VC_CONTAINER_STATUS_T vc_container_io_cache_seek(VC_CONTAINER_IO_T *p_ctx
       return VC_CONTAINER_SUCCESS;
    }
 
+   /* Keep the data the main cache is jumping away from in the block cache */
+   if(cache == &p_ctx->priv->caches && p_ctx->priv->blocks_max)
+      vc_container_io_block_stash(p_ctx, offset);
+
+   /* Move the view onto the block if we have it, otherwise the next refill loads it */
+   if(cache == &p_ctx->priv->view)
+   {
+      int index = vc_container_io_block_find(p_ctx->priv, offset);
+      if(index >= 0)
+      {
+         p_ctx->priv->cache_stats.hits++;
+         vc_container_io_block_use(p_ctx, index, offset);
+         return VC_CONTAINER_SUCCESS;
+      }
+      cache->offset = offset;
+      cache->size = cache->position = 0;
+      return VC_CONTAINER_SUCCESS;
+   }
+
+   if(p_ctx->priv->read_ahead)
+   {
+      /* The stream belongs to the read-ahead thread, the next refill will catch up */
+      if(cache == &p_ctx->priv->caches)
+      {
+         vc_container_io_cache_flush( p_ctx, cache, 1 );
+         cache->offset = offset;
+         return VC_CONTAINER_SUCCESS;
+      }
+      read_ahead_pause( p_ctx->priv->read_ahead );
+   }
+
+   /* Streams which can't seek have no way back to the data skipped over, so short
+    * forward seeks keep what's left from the current position and read up to the
+    * new position after it */
+   if((p_ctx->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK) && cache == &p_ctx->priv->caches &&
+      !cache->dirty && !cache->borrowed && offset >= cache->offset + (int64_t)cache->size &&
+      p_ctx->priv->actual_offset == cache->offset + (int64_t)cache->size &&
+      offset - cache->offset - (int64_t)cache->position < (int64_t)cache->mem_size)
+   {
+      shift = cache->size - cache->position;
+      memmove(cache->mem, cache->buffer + cache->position, shift);
+      cache->offset += cache->position;
+      cache->buffer = cache->mem;
+      cache->size = shift;
+      cache->position = 0;
+
+      while(offset >= cache->offset + (int64_t)cache->size)
+      {
+         ret = vc_container_io_module_read(cache->io, cache->buffer + cache->size,
+                                           cache->buffer_end - cache->buffer - cache->size);
+         cache->size += ret;
+         cache->io->priv->actual_offset = cache->offset + cache->size;
+         p_ctx->priv->cache_fill_end = cache->offset + cache->size;
+         if(!ret) return p_ctx->status ? p_ctx->status : VC_CONTAINER_ERROR_EOS;
+      }
+
+      cache->position = offset - cache->offset;
+      return VC_CONTAINER_SUCCESS;
+   }
+
    shift = cache->buffer - cache->mem;
    if(!cache->dirty && shift && cache->size &&
       offset >= cache->offset - (int64_t)shift && offset < cache->offset)
    {
       /* We need to refill the partial bit of the cache that we didn't take care of last time */
-      status = cache->io->pf_seek(cache->io, cache->offset - shift);
+      status = vc_container_io_module_seek(cache->io, cache->offset - shift);
       if(status != VC_CONTAINER_SUCCESS) return status;
       cache->offset -= shift;
       cache->buffer -= shift;
 
-      ret = cache->io->pf_read(cache->io, cache->buffer, shift);
+      ret = vc_container_io_module_read(cache->io, cache->buffer, shift);
       vc_container_assert(ret == shift); /* FIXME: ret must = shift */
       cache->size += shift;
       cache->position = offset - cache->offset;
@@ -705,7 +1340,7 @@ static VC_CONTAINER_STATUS_T vc_container_io_cache_seek(VC_CONTAINER_IO_T *p_ctx
 
    if(p_ctx->priv->async_io) async_io_wait_complete( p_ctx->priv->async_io, cache, 1 );
 
-   status = cache->io->pf_seek(cache->io, offset);
+   status = vc_container_io_module_seek(cache->io, offset);
    if(status != VC_CONTAINER_SUCCESS) return status;
 
    vc_container_io_cache_flush( p_ctx, cache, 1 );
@@ -729,7 +1364,7 @@ static size_t vc_container_io_cache_flush( VC_CONTAINER_IO_T *p_ctx,
       {
          if(p_ctx->priv->async_io) async_io_wait_complete( p_ctx->priv->async_io, cache, complete );
 
-         if(cache->io->pf_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
+         if(vc_container_io_module_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
             return 0;
       }
 
@@ -750,7 +1385,7 @@ static size_t vc_container_io_cache_flush( VC_CONTAINER_IO_T *p_ctx,
    cache->offset += cache->size;
    if(cache->mem_size == cache->mem_max_size)
    {
-      shift = cache->offset &(MEM_CACHE_ALIGNMENT-1);
+      shift = MEM_CACHE_SHIFT(p_ctx, cache->offset);
       cache->buffer = cache->mem + shift;
    }
 
@@ -758,16 +1393,413 @@ static size_t vc_container_io_cache_flush( VC_CONTAINER_IO_T *p_ctx,
    return ret;
 }
 
-/*****************************************************************************
- * Asynchronous I/O.
- * This is here to keep the I/O as busy as possible by allowing the writer
- * to continue its work while the I/O is taking place in the background.
- *****************************************************************************/
-
-#ifdef ENABLE_CONTAINERS_ASYNC_IO
-#include "vcos.h"
+/*****************************************************************************/
+static size_t vc_container_io_cache_pinned_size( size_t size )
+{
+   size_t pinned = MEM_CACHE_READ_MIN_SIZE;
 
-#define NUMPC(c,n,s) ((c) < (1<<(s)) ? (n) : ((n) / (c >> (s))))
+   if(!size) return 0;
+   while(pinned < size && pinned < MEM_CACHE_READ_PINNED_MAX_SIZE)
+      pinned <<= 1;
+   return pinned;
+}
+
+/*****************************************************************************/
+static size_t vc_container_io_cache_next_size( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, int64_t offset )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   size_t size = cache->mem_size;
+
+   /* Only the main read cache is sized on the fly. Read-ahead uses its own areas. */
+   if(cache != &private->caches || private->mode != VC_CONTAINER_IO_MODE_READ ||
+      private->read_ahead)
+      return size;
+
+   if(private->cache_pinned_size)
+      size = private->cache_pinned_size;
+   else if(offset >= private->cache_fill_end &&
+           offset - private->cache_fill_end < (int64_t)cache->mem_size)
+   {
+      /* Sequential access, possibly skipping over a bit of data. Long streaks
+       * are typical of high bitrate streams so give them bigger reads. */
+      private->cache_jumps = 0;
+      if(++private->cache_streak >= MEM_CACHE_GROW_STREAK &&
+         size < MEM_CACHE_READ_ADAPTIVE_MAX_SIZE)
+      {
+         private->cache_streak = 0;
+         size <<= 1;
+      }
+   }
+   else
+   {
+      /* Random access (e.g. parsing an index) only needs a small cache since
+       * most of what a refill reads ahead is never used */
+      private->cache_streak = 0;
+      if(++private->cache_jumps >= MEM_CACHE_SHRINK_JUMPS &&
+         size > MEM_CACHE_READ_MIN_SIZE)
+         size >>= 1;
+   }
+
+   return size;
+}
+
+/*****************************************************************************/
+static uint8_t *vc_container_io_cache_alloc( VC_CONTAINER_IO_T *p_ctx, size_t size )
+{
+#if !defined(_VIDEOCORE) && !defined(_MSC_VER)
+   /* Direct i/o writes straight from the cache memory */
+   if(p_ctx->capabilities & VC_CONTAINER_IO_CAPS_DIRECT)
+   {
+      void *mem;
+      return posix_memalign(&mem, VC_CONTAINER_IO_DIRECT_ALIGNMENT, size) ? NULL : mem;
+   }
+#else
+   VC_CONTAINER_PARAM_UNUSED(p_ctx);
+#endif
+   return malloc(size);
+}
+
+/*****************************************************************************/
+static size_t vc_container_io_module_read( VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size )
+{
+   uint32_t time = vc_container_io_get_microsecs();
+   size_t ret = p_ctx->pf_read(p_ctx, buffer, size);
+
+   p_ctx->counters.module_read_us += vc_container_io_get_microsecs() - time;
+   p_ctx->counters.module_reads++;
+   p_ctx->counters.module_bytes += ret;
+   return ret;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T vc_container_io_module_seek( VC_CONTAINER_IO_T *p_ctx, int64_t offset )
+{
+   p_ctx->counters.module_seeks++;
+   return p_ctx->pf_seek(p_ctx, offset);
+}
+
+/*****************************************************************************/
+static uint32_t vc_container_io_get_microsecs( void )
+{
+#if defined(CLOCK_MONOTONIC)
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+   return 0;
+#endif
+}
+
+/*****************************************************************************/
+static void vc_container_io_cache_adapt( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   size_t size = vc_container_io_cache_next_size( p_ctx, cache, cache->offset );
+   uint8_t *mem;
+
+   if(size == cache->mem_size) return;
+
+   /* The cache is empty at this point so we only need to swap the memory */
+   mem = malloc(size);
+   if(!mem) return;
+   if(cache->borrowed)
+   {
+      cache->borrowed->cache = NULL;
+      cache->borrowed = NULL;
+   }
+   else
+      free(cache->mem);
+
+   cache->mem = mem;
+   cache->mem_size = cache->mem_max_size = size;
+   cache->buffer = cache->mem + (cache->offset & (MEM_CACHE_ALIGNMENT-1));
+   cache->buffer_end = cache->mem + cache->mem_size;
+}
+
+/*****************************************************************************
+ * Block cache.
+ * Fixed size blocks of stream data shared by the regions cached with
+ * vc_container_io_cache() and the data around the positions the main cache
+ * seeked away from. The view cache reads from one block at a time and the
+ * least recently used blocks make room for new ones within the memory budget.
+ * Blocks are kept sorted by offset since the parsers jump between tables
+ * on every packet.
+ *****************************************************************************/
+
+/*****************************************************************************/
+static int vc_container_io_block_find( VC_CONTAINER_IO_PRIVATE_T *private, int64_t offset )
+{
+   int low = 0, high = (int)private->blocks_num - 1;
+
+   /* Find the last block starting at or before the offset */
+   while(low <= high)
+   {
+      int middle = (low + high) / 2;
+      if(private->blocks[middle].offset <= offset) low = middle + 1;
+      else high = middle - 1;
+   }
+
+   /* Blocks can overlap but none is bigger than MEM_CACHE_BLOCK_SIZE */
+   for(; high >= 0 && private->blocks[high].offset > offset - MEM_CACHE_BLOCK_SIZE; high--)
+      if(offset < private->blocks[high].offset + (int64_t)private->blocks[high].size)
+         return high;
+   return -1;
+}
+
+/*****************************************************************************/
+static int vc_container_io_block_sort( VC_CONTAINER_IO_PRIVATE_T *private, int index )
+{
+   VC_CONTAINER_IO_BLOCK_T block = private->blocks[index];
+   int i = index;
+
+   /* Move the block to its new place, shifting the ones in between */
+   for(; i > 0 && private->blocks[i-1].offset > block.offset; i--)
+      private->blocks[i] = private->blocks[i-1];
+   for(; i + 1 < (int)private->blocks_num && private->blocks[i+1].offset < block.offset; i++)
+      private->blocks[i] = private->blocks[i+1];
+   private->blocks[i] = block;
+
+   if(private->view_block == index) private->view_block = i;
+   else if(i < index && private->view_block >= i && private->view_block < index) private->view_block++;
+   else if(i > index && private->view_block > index && private->view_block <= i) private->view_block--;
+   return i;
+}
+
+/*****************************************************************************/
+static bool vc_container_io_block_region( VC_CONTAINER_IO_PRIVATE_T *private, int64_t offset )
+{
+   unsigned int i;
+
+   for(i = 0; i < private->regions_num; i++)
+      if(offset >= private->regions[i].start && offset < private->regions[i].end)
+         return true;
+   return false;
+}
+
+/*****************************************************************************/
+static void vc_container_io_block_evicted( VC_CONTAINER_IO_T *p_ctx, int index )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *view = &private->view;
+
+   private->cache_stats.evictions++;
+   if(index != private->view_block) return;
+
+   /* The view will load its data again on the next read */
+   view->offset += view->position;
+   view->size = view->position = 0;
+   private->view_block = -1;
+}
+
+/*****************************************************************************/
+static int vc_container_io_block_evict( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   int index = -1;
+   unsigned int i;
+
+   /* Pick the least recently used block */
+   for(i = 0; i < private->blocks_num; i++)
+   {
+      if(private->blocks[i].locked) continue;
+      if(index < 0 || private->blocks[i].last_use - private->blocks[index].last_use > UINT32_MAX / 2)
+         index = i;
+   }
+   if(index < 0) return -1;
+
+   vc_container_io_block_evicted(p_ctx, index);
+   private->blocks[index].size = 0;
+   return index;
+}
+
+/*****************************************************************************/
+static int vc_container_io_block_alloc( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   VC_CONTAINER_IO_BLOCK_T *block;
+
+   if(private->blocks_num < private->blocks_max)
+   {
+      block = &private->blocks[private->blocks_num];
+      memset(block, 0, sizeof(*block));
+      block->mem = malloc(MEM_CACHE_BLOCK_SIZE);
+      if(block->mem)
+         return private->blocks_num++;
+   }
+
+   return vc_container_io_block_evict(p_ctx);
+}
+
+/*****************************************************************************/
+static int vc_container_io_block_fill( VC_CONTAINER_IO_T *p_ctx,
+   int index, int64_t offset, size_t size )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache = &private->caches;
+   VC_CONTAINER_IO_BLOCK_T *block;
+   size_t bytes = 0, ret;
+
+   /* The block moves to its sorted place, whose index we return */
+   private->blocks[index].offset = offset;
+   private->blocks[index].size = 0;
+   index = vc_container_io_block_sort(private, index);
+   block = &private->blocks[index];
+   block->locked = false;
+   block->last_use = ++private->blocks_tick;
+
+   /* Start with what the main cache has already got */
+   if(private->caches_num && !cache->dirty && offset >= cache->offset &&
+      offset < cache->offset + (int64_t)cache->size)
+   {
+      bytes = MIN(size, (size_t)(cache->offset + cache->size - offset));
+      memcpy(block->mem, cache->buffer + (offset - cache->offset), bytes);
+   }
+
+   /* And read the rest from the stream */
+   if(bytes < size)
+   {
+      if(private->read_ahead) read_ahead_pause( private->read_ahead );
+
+      if(private->actual_offset != offset + (int64_t)bytes &&
+         vc_container_io_module_seek(p_ctx, offset + bytes) != VC_CONTAINER_SUCCESS)
+         goto end;
+
+      /* Live streams hand over the data as it arrives so this can take a few reads */
+      do {
+         ret = vc_container_io_module_read(p_ctx, block->mem + bytes, size - bytes);
+         bytes += ret;
+      } while(ret && bytes < size);
+      private->actual_offset = offset + bytes;
+   }
+
+ end:
+   block->size = bytes;
+   return index;
+}
+
+/*****************************************************************************/
+static size_t vc_container_io_block_refill( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   int64_t offset = cache->offset;
+   int index;
+
+   index = vc_container_io_block_find(private, offset);
+   if(index < 0 && private->caches_num && !vc_container_io_block_region(private, offset))
+   {
+      /* We've read past the cached data, carry on with the main cache */
+      VC_CONTAINER_IO_PRIVATE_CACHE_T *main_cache = &private->caches;
+      size_t bytes;
+
+      p_ctx->cache = main_cache;
+      if(vc_container_io_cache_seek(p_ctx, main_cache, offset) != VC_CONTAINER_SUCCESS)
+         return 0;
+      bytes = main_cache->size - main_cache->position;
+      return bytes ? bytes : vc_container_io_cache_refill(p_ctx, main_cache);
+   }
+
+   if(index >= 0)
+      private->cache_stats.hits++;
+   else
+   {
+      /* Blocks start on a block boundary unless we can't seek back there */
+      int64_t start = offset;
+      if(!(p_ctx->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK))
+         start &= ~(int64_t)(MEM_CACHE_BLOCK_SIZE-1);
+
+      private->cache_stats.misses++;
+      index = vc_container_io_block_alloc(p_ctx);
+      if(index < 0) return 0;
+      index = vc_container_io_block_fill(p_ctx, index, start, MEM_CACHE_BLOCK_SIZE);
+      private->blocks[index].locked = !!(p_ctx->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK);
+   }
+
+   vc_container_io_block_use(p_ctx, index, offset);
+   return cache->size - cache->position;
+}
+
+/*****************************************************************************/
+static void vc_container_io_block_use( VC_CONTAINER_IO_T *p_ctx, int index, int64_t offset )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *view = &private->view;
+   VC_CONTAINER_IO_BLOCK_T *block = &private->blocks[index];
+
+   block->last_use = ++private->blocks_tick;
+   private->view_block = index;
+
+   view->mem = view->buffer = block->mem;
+   view->buffer_end = block->mem + MEM_CACHE_BLOCK_SIZE;
+   view->offset = block->offset;
+   view->size = block->size;
+   view->position = MIN((size_t)(offset - block->offset), block->size);
+}
+
+/*****************************************************************************/
+static void vc_container_io_block_stash( VC_CONTAINER_IO_T *p_ctx, int64_t offset )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache = &private->caches;
+   int64_t position, start, end;
+   int index;
+
+   /* Nothing to keep if we are staying within the cache or only skipping forward */
+   if(cache->dirty || !cache->size || (offset >= cache->offset &&
+      offset < cache->offset + (int64_t)(cache->size + cache->mem_size)))
+      return;
+
+   position = cache->offset + cache->position;
+   start = position & ~(int64_t)(MEM_CACHE_ALIGNMENT-1);
+   if(start < cache->offset) start = cache->offset;
+   end = MIN(start + MEM_CACHE_BLOCK_SIZE, cache->offset + (int64_t)cache->size);
+   if(end <= position || vc_container_io_block_find(private, position) >= 0)
+      return;
+
+   index = vc_container_io_block_alloc(p_ctx);
+   if(index < 0) return;
+   vc_container_io_block_fill(p_ctx, index, start, end - start);
+}
+
+/*****************************************************************************/
+static void vc_container_io_block_budget( VC_CONTAINER_IO_T *p_ctx, size_t budget )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   unsigned int max = MIN(budget, UINT32_MAX) / MEM_CACHE_BLOCK_SIZE;
+   VC_CONTAINER_IO_BLOCK_T *blocks;
+   int index;
+
+   /* Drop the least recently used blocks which don't fit anymore */
+   while(private->blocks_num > max)
+   {
+      unsigned int last = private->blocks_num - 1;
+      index = vc_container_io_block_evict(p_ctx);
+      if(index < 0) break;
+      free(private->blocks[index].mem);
+      memmove(&private->blocks[index], &private->blocks[index + 1],
+              (last - index) * sizeof(*private->blocks));
+      if(private->view_block > index) private->view_block--;
+      private->blocks_num--;
+   }
+   if(private->blocks_num > max) max = private->blocks_num; /* Locked blocks */
+
+   blocks = realloc(private->blocks, MAX(max, 1) * sizeof(*blocks));
+   if(blocks) private->blocks = blocks;
+   else if(max > private->blocks_max) max = private->blocks_max;
+   private->blocks_max = max;
+
+   /* Find out again where to read from if the view lost its block */
+   if(p_ctx->cache == &private->view && private->view_block < 0)
+      vc_container_io_seek(p_ctx, p_ctx->offset);
+}
+
+/*****************************************************************************
+ * Statistics shared by the asynchronous write and read-ahead code.
+ *****************************************************************************/
+
+#if defined(ENABLE_CONTAINERS_ASYNC_IO) || defined(ENABLE_CONTAINERS_READ_AHEAD)
+#define NUMPC(c,n,s) ((c) < (1u << (s)) ? (n) : ((n) / ((c) >> (s))))
 
 static void stats_initialise(VC_CONTAINER_STATS_T *st, uint32_t shift)
 {
@@ -839,6 +1871,16 @@ static void stats_add_value(VC_CONTAINER_STATS_T *st, uint32_t count, uint32_t n
       }
    }
 }
+#endif
+
+/*****************************************************************************
+ * Asynchronous I/O.
+ * This is here to keep the I/O as busy as possible by allowing the writer
+ * to continue its work while the I/O is taking place in the background.
+ *****************************************************************************/
+
+#ifdef ENABLE_CONTAINERS_ASYNC_IO
+#include "vcos.h"
 
 typedef struct VC_CONTAINER_IO_ASYNC_T
 {
@@ -987,11 +2029,11 @@ static VC_CONTAINER_IO_ASYNC_T *async_io_start( VC_CONTAINER_IO_T *io, int num_a
    memset(ctx, 0, sizeof(*ctx));
    ctx->io = io;
 
-   ctx->mem[0] = io->priv->cache->mem;
+   ctx->mem[0] = io->cache->mem;
 
    for(ctx->num_area = 1; ctx->num_area < num_areas; ctx->num_area++)
    {
-      ctx->mem[ctx->num_area] = malloc(io->priv->cache->mem_size);
+      ctx->mem[ctx->num_area] = malloc(io->cache->mem_size);
       if(!ctx->mem[ctx->num_area])
          break;
    }
@@ -1096,4 +2138,399 @@ static void async_io_stats_get( struct VC_CONTAINER_IO_ASYNC_T *ctx, VC_CONTAINE
 }
 
 
+#endif
+
+/*****************************************************************************
+ * Asynchronous read-ahead.
+ * This is the reading counterpart of the asynchronous I/O above. A background
+ * thread keeps a few memory areas filled with the data following the current
+ * read position so the reader doesn't have to wait for the stream every time
+ * its cache needs refilling.
+ *****************************************************************************/
+
+#ifdef ENABLE_CONTAINERS_READ_AHEAD
+#include <pthread.h>
+#include <time.h>
+
+typedef struct VC_CONTAINER_IO_READ_AHEAD_AREA_T
+{
+   uint8_t *mem;   /**< Base address of the memory area */
+   int64_t offset; /**< Offset in the stream of the data in the area */
+   size_t shift;   /**< Offset of the data from the start of the memory area */
+   size_t size;    /**< Size of the data in the area */
+} VC_CONTAINER_IO_READ_AHEAD_AREA_T;
+
+typedef struct VC_CONTAINER_IO_READ_AHEAD_T
+{
+   VC_CONTAINER_IO_T *io;
+   VC_CONTAINER_IO_T stream; /**< Copy of the io used by the thread so they don't race on the status */
+   pthread_t thread;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+   int quit;
+
+   unsigned int num_area;
+   VC_CONTAINER_IO_READ_AHEAD_AREA_T area[READ_AHEAD_MAX_AREAS];
+   uint8_t *spare;          /**< Memory given to the cache the first time it swaps areas */
+   unsigned int read_area;  /**< Next area to hand over to the cache */
+   unsigned int fill_area;  /**< Next area to fill */
+   unsigned int filled;     /**< Number of areas ready to be handed over */
+
+   int64_t next_offset;     /**< Offset of the next read, or of the one in progress */
+   bool busy;               /**< The thread is using the io module */
+   bool paused;             /**< The io module belongs to the reader */
+   VC_CONTAINER_STATUS_T status; /**< Set once a read fails */
+
+   int stats_enable;
+   VC_CONTAINER_READ_STATS_T stats;
+
+} VC_CONTAINER_IO_READ_AHEAD_T;
+
+static void read_ahead_stats_initialise( VC_CONTAINER_IO_READ_AHEAD_T *ctx, int enable )
+{
+   pthread_mutex_lock(&ctx->lock);
+   ctx->stats_enable = enable;
+   stats_initialise(&ctx->stats.read, 8);
+   stats_initialise(&ctx->stats.wait, 0);
+   stats_initialise(&ctx->stats.discard, 0);
+   pthread_mutex_unlock(&ctx->lock);
+}
+
+static void read_ahead_stats_get( VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_READ_STATS_T *stats )
+{
+   pthread_mutex_lock(&ctx->lock);
+   *stats = ctx->stats;
+   pthread_mutex_unlock(&ctx->lock);
+}
+
+static void read_ahead_counters_get( VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_READ_COUNTERS_T *counters )
+{
+   pthread_mutex_lock(&ctx->lock);
+   *counters = ctx->io->counters;
+   pthread_mutex_unlock(&ctx->lock);
+}
+
+static void read_ahead_counters_reset( VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   pthread_mutex_lock(&ctx->lock);
+   memset(&ctx->io->counters, 0, sizeof(ctx->io->counters));
+   pthread_mutex_unlock(&ctx->lock);
+}
+
+/* Drops the next area to hand over. Must be called with the lock held. */
+static void read_ahead_drop( VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   if(ctx->stats_enable)
+      stats_add_value(&ctx->stats.discard, 1, ctx->area[ctx->read_area].size);
+
+   if(++ctx->read_area == ctx->num_area)
+      ctx->read_area = 0;
+   ctx->filled--;
+   pthread_cond_broadcast(&ctx->cond);
+}
+
+static void *read_ahead_thread( void *argv )
+{
+   VC_CONTAINER_IO_READ_AHEAD_T *ctx = argv;
+   VC_CONTAINER_IO_READ_AHEAD_AREA_T *area;
+   uint32_t time = 0;
+   int stats_enable;
+   size_t size, ret;
+
+   pthread_mutex_lock(&ctx->lock);
+   while(!ctx->quit)
+   {
+      if(ctx->paused || ctx->status != VC_CONTAINER_SUCCESS || ctx->filled == ctx->num_area)
+      {
+         pthread_cond_wait(&ctx->cond, &ctx->lock);
+         continue;
+      }
+
+      area = &ctx->area[ctx->fill_area];
+      area->offset = ctx->next_offset;
+      area->shift = area->offset & (MEM_CACHE_ALIGNMENT-1);
+      size = READ_AHEAD_AREA_SIZE - area->shift;
+      stats_enable = ctx->stats_enable;
+      ctx->busy = true;
+      pthread_mutex_unlock(&ctx->lock);
+
+      time = vc_container_io_get_microsecs();
+      ret = ctx->stream.pf_read(&ctx->stream, area->mem + area->shift, size);
+      time = vc_container_io_get_microsecs() - time;
+
+      pthread_mutex_lock(&ctx->lock);
+      ctx->busy = false;
+      if(stats_enable && ctx->stats_enable)
+         stats_add_value(&ctx->stats.read, ret, time);
+
+      /* While reading ahead, the counters are only updated with the lock held */
+      ctx->io->counters.module_read_us += time;
+      ctx->io->counters.module_reads++;
+      ctx->io->counters.module_bytes += ret;
+
+      area->size = ret;
+      if(ret)
+      {
+         ctx->next_offset += ret;
+         ctx->filled++;
+         if(++ctx->fill_area == ctx->num_area)
+            ctx->fill_area = 0;
+      }
+      if(!ret || ctx->stream.status != VC_CONTAINER_SUCCESS)
+         ctx->status = ctx->stream.status ? ctx->stream.status : VC_CONTAINER_ERROR_EOS;
+
+      pthread_cond_broadcast(&ctx->cond);
+   }
+   pthread_mutex_unlock(&ctx->lock);
+
+   return NULL;
+}
+
+/* Gives the io module back to the reader. Must be called with the lock held
+ * while the thread isn't busy. */
+static void read_ahead_hand_back( VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   while(ctx->filled)
+      read_ahead_drop(ctx);
+
+   if(!ctx->paused)
+      ctx->io->priv->actual_offset = ctx->next_offset;
+   ctx->paused = true;
+}
+
+/* Restarts reading ahead from a new position. Must be called with the lock held
+ * while the thread isn't busy. */
+static VC_CONTAINER_STATUS_T read_ahead_restart( VC_CONTAINER_IO_READ_AHEAD_T *ctx, int64_t offset )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+
+   read_ahead_hand_back(ctx);
+
+   ctx->stream = *ctx->io;
+   ctx->stream.status = VC_CONTAINER_SUCCESS;
+
+   if(ctx->io->priv->actual_offset != offset)
+   {
+      ctx->io->counters.module_seeks++;
+      status = ctx->stream.pf_seek(&ctx->stream, offset);
+   }
+   if(status != VC_CONTAINER_SUCCESS)
+      return status;
+
+   ctx->io->priv->actual_offset = offset;
+   ctx->next_offset = offset;
+   ctx->status = VC_CONTAINER_SUCCESS;
+   ctx->paused = false;
+   pthread_cond_broadcast(&ctx->cond);
+   return VC_CONTAINER_SUCCESS;
+}
+
+static void read_ahead_pause( VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   pthread_mutex_lock(&ctx->lock);
+   while(ctx->busy)
+      pthread_cond_wait(&ctx->cond, &ctx->lock);
+   read_ahead_hand_back(ctx);
+   pthread_mutex_unlock(&ctx->lock);
+}
+
+static size_t read_ahead_refill( VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   VC_CONTAINER_IO_READ_AHEAD_AREA_T *area;
+   VC_CONTAINER_STATUS_T status;
+   int64_t offset = cache->offset;
+   uint32_t time = 0;
+   uint8_t *mem;
+
+   pthread_mutex_lock(&ctx->lock);
+   if(ctx->stats_enable)
+      time = vc_container_io_get_microsecs();
+
+   for(;;)
+   {
+      /* Skip the data the reader has seeked past */
+      while(ctx->filled && ctx->area[ctx->read_area].offset +
+            (int64_t)ctx->area[ctx->read_area].size <= offset)
+         read_ahead_drop(ctx);
+
+      area = &ctx->area[ctx->read_area];
+      if(ctx->filled && offset >= area->offset)
+         break;
+
+      /* Wait for the data if the thread is already on its way there */
+      if(!ctx->paused && !ctx->filled && offset >= ctx->next_offset &&
+         offset - ctx->next_offset < (int64_t)READ_AHEAD_AREA_SIZE * ctx->num_area)
+      {
+         if(ctx->status != VC_CONTAINER_SUCCESS)
+         {
+            /* Make sure the next refill tries again */
+            status = ctx->status;
+            read_ahead_hand_back(ctx);
+            goto error;
+         }
+         pthread_cond_wait(&ctx->cond, &ctx->lock);
+         continue;
+      }
+
+      /* Otherwise start again from the new position */
+      if(ctx->busy)
+      {
+         pthread_cond_wait(&ctx->cond, &ctx->lock);
+         continue;
+      }
+      status = read_ahead_restart(ctx, offset);
+      if(status != VC_CONTAINER_SUCCESS)
+         goto error;
+   }
+
+   /* Swap the cache memory with the memory area */
+   mem = cache->mem;
+   if(cache->mem_size != READ_AHEAD_AREA_SIZE)
+   {
+      free(mem);
+      mem = ctx->spare;
+      ctx->spare = 0;
+   }
+   cache->mem = area->mem;
+   area->mem = mem;
+
+   cache->mem_size = cache->mem_max_size = READ_AHEAD_AREA_SIZE;
+   cache->buffer = cache->mem + area->shift;
+   cache->buffer_end = cache->mem + READ_AHEAD_AREA_SIZE;
+   cache->offset = area->offset;
+   cache->size = area->size;
+   cache->position = offset - area->offset;
+
+   if(++ctx->read_area == ctx->num_area)
+      ctx->read_area = 0;
+   ctx->filled--;
+   pthread_cond_broadcast(&ctx->cond);
+
+   if(ctx->stats_enable)
+      stats_add_value(&ctx->stats.wait, 1, vc_container_io_get_microsecs() - time);
+   pthread_mutex_unlock(&ctx->lock);
+   return cache->size - cache->position;
+
+ error:
+   pthread_mutex_unlock(&ctx->lock);
+   ctx->io->status = status;
+   return 0;
+}
+
+static VC_CONTAINER_IO_READ_AHEAD_T *read_ahead_start( VC_CONTAINER_IO_T *io, unsigned int num_areas )
+{
+   VC_CONTAINER_IO_READ_AHEAD_T *ctx;
+
+   if(!num_areas) return 0;
+   if(num_areas > READ_AHEAD_MAX_AREAS) num_areas = READ_AHEAD_MAX_AREAS;
+
+   /* Allocate our context  */
+   ctx = malloc(sizeof(*ctx));
+   if(!ctx) return 0;
+   memset(ctx, 0, sizeof(*ctx));
+   ctx->io = io;
+   ctx->paused = true; /* Until the first refill tells us where to start */
+   stats_initialise(&ctx->stats.read, 8);
+   stats_initialise(&ctx->stats.wait, 0);
+   stats_initialise(&ctx->stats.discard, 0);
+
+   ctx->spare = malloc(READ_AHEAD_AREA_SIZE);
+   for(ctx->num_area = 0; ctx->num_area < num_areas; ctx->num_area++)
+   {
+      ctx->area[ctx->num_area].mem = malloc(READ_AHEAD_AREA_SIZE);
+      if(!ctx->area[ctx->num_area].mem)
+         break;
+   }
+   if(!ctx->spare || !ctx->num_area)
+      goto error_mem;
+
+   if(pthread_mutex_init(&ctx->lock, NULL))
+      goto error_mem;
+   if(pthread_cond_init(&ctx->cond, NULL))
+      goto error_cond;
+   if(pthread_create(&ctx->thread, NULL, read_ahead_thread, ctx))
+      goto error_thread;
+
+   return ctx;
+
+ error_thread:
+   pthread_cond_destroy(&ctx->cond);
+ error_cond:
+   pthread_mutex_destroy(&ctx->lock);
+ error_mem:
+   while(ctx->num_area > 0)
+      free(ctx->area[--ctx->num_area].mem);
+   free(ctx->spare);
+   free(ctx);
+   return 0;
+}
+
+static void read_ahead_stop( VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   /* Leave the io module in a state the reader can carry on with */
+   read_ahead_pause(ctx);
+
+   pthread_mutex_lock(&ctx->lock);
+   ctx->quit = 1;
+   pthread_cond_broadcast(&ctx->cond);
+   pthread_mutex_unlock(&ctx->lock);
+   pthread_join(ctx->thread, NULL);
+
+   pthread_cond_destroy(&ctx->cond);
+   pthread_mutex_destroy(&ctx->lock);
+
+   while(ctx->num_area > 0)
+      free(ctx->area[--ctx->num_area].mem);
+   free(ctx->spare);
+   free(ctx);
+}
+#else
+
+static struct VC_CONTAINER_IO_READ_AHEAD_T *read_ahead_start( VC_CONTAINER_IO_T *io, unsigned int num_areas )
+{
+   VC_CONTAINER_PARAM_UNUSED(io);
+   VC_CONTAINER_PARAM_UNUSED(num_areas);
+   return 0;
+}
+
+static void read_ahead_stop( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+}
+
+static void read_ahead_pause( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+}
+
+static size_t read_ahead_refill( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+   VC_CONTAINER_PARAM_UNUSED(cache);
+   return 0;
+}
+
+static void read_ahead_stats_initialise( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, int enable )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+   VC_CONTAINER_PARAM_UNUSED(enable);
+}
+
+static void read_ahead_stats_get( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_READ_STATS_T *stats )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+   VC_CONTAINER_PARAM_UNUSED(stats);
+}
+
+static void read_ahead_counters_get( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_READ_COUNTERS_T *counters )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+   VC_CONTAINER_PARAM_UNUSED(counters);
+}
+
+static void read_ahead_counters_reset( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+}
+
 #endif
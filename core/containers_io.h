@@ -58,8 +58,51 @@ typedef uint32_t VC_CONTAINER_IO_CAPABILITIES_T;
 #define VC_CONTAINER_IO_CAPS_SEEK_SLOW    0x2
 /** The I/O doesn't provide any caching of the data */
 #define VC_CONTAINER_IO_CAPS_NO_CACHING   0x4
+/** The data can be accessed directly without copying (see vc_container_io_borrow) */
+#define VC_CONTAINER_IO_CAPS_MAPPED       0x8
+/** Writes bypass the system cache and want their memory aligned like the data
+ * is in the stream (see VC_CONTAINER_IO_DIRECT_ALIGNMENT) */
+#define VC_CONTAINER_IO_CAPS_DIRECT       0x10
 /* @} */
 
+/** Alignment of the transfers of i/o streams exporting VC_CONTAINER_IO_CAPS_DIRECT */
+#define VC_CONTAINER_IO_DIRECT_ALIGNMENT (4*1024)
+
+/** Piece of data written with vc_container_io_write_vector */
+typedef struct VC_CONTAINER_IO_VECTOR_T
+{
+   const void *data; /**< Pointer to the data */
+   size_t size;      /**< Size of the data */
+} VC_CONTAINER_IO_VECTOR_T;
+
+/** \private
+ * Memory cache sitting between the container and the io module.
+ * This is only exposed so the inline helpers in containers_io_helpers.h can read
+ * small values straight from the cache. It should not be used directly. */
+typedef struct VC_CONTAINER_IO_PRIVATE_CACHE_T
+{
+   int64_t start; /**< Offset to the start of the cached area in the stream */
+   int64_t end;    /**< Offset to the end of the cached area in the stream */
+
+   int64_t offset; /**< Offset of the currently cached data in the stream */
+   size_t size;    /**< Size of the cached area */
+   bool dirty;     /**< Whether the cache is dirty and needs to be written back */
+
+   size_t position; /**< Current position in the cache */
+
+   uint8_t *buffer;          /**< Pointer to the start of the valid cache area */
+   uint8_t *buffer_end;      /**< Pointer to the end of the cache */
+
+   unsigned int mem_max_size; /**< Maximum size of the memory cache */
+   unsigned int mem_size; /**< Size of the memory cache */
+   uint8_t *mem;          /**< Pointer to the memory cache */
+
+   struct VC_CONTAINER_IO_T *io;
+
+   struct VC_CONTAINER_IO_BORROWED_T *borrowed; /**< Set while views of the memory are handed out */
+
+} VC_CONTAINER_IO_PRIVATE_CACHE_T;
+
 /** Container Input / Output Context.
  * This structure defines the context for a container io instance */
 struct VC_CONTAINER_IO_T
@@ -70,6 +113,9 @@ struct VC_CONTAINER_IO_T
    /** Pointer to information private to the container io module */
    struct VC_CONTAINER_IO_MODULE_T *module;
 
+   /** \private Current cache (NULL if the stream isn't cached) */
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache;
+
    /** Uniform Resource Identifier for the stream to open.
     * This is a string encoded in UTF-8 which follows the syntax defined in
     * RFC2396 (http://tools.ietf.org/html/rfc2396). */
@@ -95,6 +141,10 @@ struct VC_CONTAINER_IO_T
     * to limit the size of the stream to below this value. */
    int64_t max_size;
 
+   /** \private Read counters (see VC_CONTAINER_CONTROL_GET_READ_COUNTERS). These are
+    * updated by the inline helpers too so they live here. */
+   VC_CONTAINER_READ_COUNTERS_T counters;
+
    /** \note the following list of function pointers should not be used directly.
     * They defines the interface for implementing container io modules and are filled in
     * by the container modules themselves. */
@@ -121,6 +171,19 @@ struct VC_CONTAINER_IO_T
    VC_CONTAINER_STATUS_T (*pf_control)(struct VC_CONTAINER_IO_T *io, 
                                        VC_CONTAINER_CONTROL_T operation, va_list args);
 
+   /** \private
+    * Function pointer to get direct access to the data of a container io module.
+    * This behaves like pf_read but returns a pointer to the data instead of copying it.
+    * It returns NULL without reading anything if fewer than *size contiguous bytes
+    * are available. */
+   const void *(*pf_map)(struct VC_CONTAINER_IO_T *io, size_t *size);
+
+   /** \private
+    * Function pointer to write several pieces of data at once to a container io module.
+    * This is optional and behaves like pf_write called on each of the pieces. */
+   size_t (*pf_write_vector)(struct VC_CONTAINER_IO_T *io,
+                             const VC_CONTAINER_IO_VECTOR_T *vectors, unsigned int vectors_num);
+
 };
 
 /** Opens an i/o stream pointed to by a URI.
@@ -150,6 +213,73 @@ VC_CONTAINER_IO_T *vc_container_io_create( const char *uri, VC_CONTAINER_IO_MODE
                                            VC_CONTAINER_IO_CAPABILITIES_T capabilities,
                                            VC_CONTAINER_STATUS_T *p_status );
 
+/** Buffer of memory making up part of the data of a memory i/o stream
+ * (see vc_container_io_open_memory_chain). */
+typedef struct VC_CONTAINER_IO_MEMORY_BUFFER_T
+{
+   const void *data; /**< Pointer to the data */
+   size_t size;      /**< Size of the data */
+} VC_CONTAINER_IO_MEMORY_BUFFER_T;
+
+/** Opens an i/o stream reading data which is already in memory.
+ * The data is read straight from the given memory, without any caching, and
+ * readers can access it without copying (see vc_container_io_borrow).
+ * The memory must stay valid until the i/o stream is closed.
+ *
+ * \param  uri         Uniform Resource Identifier describing the data, the extension of
+ *                     which is used as a hint by vc_container_open_reader_with_io (can be NULL)
+ * \param  data        Pointer to the data
+ * \param  size        Size of the data
+ * \param  status      Returns the status of the operation
+ * \return             If successful, this returns a pointer to the new instance
+ *                     of the i/o module. Returns NULL on failure.
+ */
+VC_CONTAINER_IO_T *vc_container_io_open_memory( const char *uri, const void *data, size_t size,
+                                                VC_CONTAINER_STATUS_T *status );
+
+/** Opens an i/o stream reading data which is already in memory but split over several
+ * buffers. The data of the stream is the concatenation of all the buffers.
+ * See vc_container_io_open_memory.
+ *
+ * \param  uri         Uniform Resource Identifier describing the data (can be NULL)
+ * \param  buffers     Array of the buffers making up the data. This is copied.
+ * \param  buffers_num Number of buffers in the array
+ * \param  status      Returns the status of the operation
+ * \return             If successful, this returns a pointer to the new instance
+ *                     of the i/o module. Returns NULL on failure.
+ */
+VC_CONTAINER_IO_T *vc_container_io_open_memory_chain( const char *uri,
+                                                      const VC_CONTAINER_IO_MEMORY_BUFFER_T *buffers,
+                                                      unsigned int buffers_num,
+                                                      VC_CONTAINER_STATUS_T *status );
+
+/** Opens an i/o stream for the temporary data of a writer.
+ * The data is kept in memory up to the given budget. Past that it is moved to a
+ * file in the given directory, or if there is none, to an anonymous memory file
+ * where the system supports it and to a file at the path of the uri otherwise.
+ * Nothing is left on disk once the i/o stream is closed.
+ *
+ * \param  uri           Uniform Resource Identifier of the last resort file
+ * \param  memory_budget Maximum size of the data kept in memory
+ * \param  directory     Directory of the file the data spills to (can be NULL)
+ * \param  status        Returns the status of the operation
+ * \return               If successful, this returns a pointer to the new instance
+ *                       of the i/o module. Returns NULL on failure.
+ */
+VC_CONTAINER_IO_T *vc_container_io_open_temp( const char *uri, uint32_t memory_budget,
+                                              const char *directory, VC_CONTAINER_STATUS_T *status );
+
+/** Changes where the data of an i/o stream opened with vc_container_io_open_temp is stored.
+ * This can only be done before anything is written to it.
+ *
+ * \param  context       Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  memory_budget Maximum size of the data kept in memory
+ * \param  directory     Directory of the file the data spills to (can be NULL)
+ * \return               VC_CONTAINER_SUCCESS on success.
+ */
+VC_CONTAINER_STATUS_T vc_container_io_set_temp_storage( VC_CONTAINER_IO_T *context,
+                                                        uint32_t memory_budget, const char *directory );
+
 /** Closes an instance of a container i/o module.
  * \param  context     Pointer to the VC_CONTAINER_IO_T context of the instance to close
  * \return             VC_CONTAINER_SUCCESS on success.
@@ -172,6 +302,25 @@ size_t vc_container_io_peek(VC_CONTAINER_IO_T *context, void *buffer, size_t siz
  */
 size_t vc_container_io_read(VC_CONTAINER_IO_T *context, void *buffer, size_t size);
 
+/** Get direct access to data from an i/o stream instead of reading it into a buffer.
+ * This is supported by i/o streams exporting the VC_CONTAINER_IO_CAPS_MAPPED
+ * capability, otherwise only for data which is already in the cache. The read position
+ * is advanced as with vc_container_io_read and the data stays valid until it is
+ * released with vc_container_io_release.
+ * \param  context     Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  size        Number of bytes requested.
+ * \return             Pointer to the data or NULL if direct access isn't possible or
+ *                     fewer than size bytes are available. Nothing is read then.
+ */
+const void *vc_container_io_borrow(VC_CONTAINER_IO_T *context, size_t *size);
+
+/** Give back data obtained with vc_container_io_borrow.
+ * Pointers which weren't borrowed are ignored.
+ * \param  context     Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  data        Pointer returned by vc_container_io_borrow
+ */
+void vc_container_io_release(VC_CONTAINER_IO_T *context, const void *data);
+
 /** Skip data in an i/o stream without reading it.
  * \param  context     Pointer to the VC_CONTAINER_IO_T instance to use
  * \param  size        Number of bytes to skip
@@ -187,6 +336,18 @@ size_t vc_container_io_skip(VC_CONTAINER_IO_T *context, size_t size);
  */
 size_t vc_container_io_write(VC_CONTAINER_IO_T *context, const void *buffer, size_t size);
 
+/** Write several pieces of data to an i/o stream, one after the other.
+ * Small pieces are gathered in the write cache like with vc_container_io_write.
+ * Big ones (e.g. the payload of a video frame) are handed straight to the i/o
+ * module along with the data already in the cache, instead of being copied.
+ * \param  context     Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  vectors     Array of the pieces of data to write
+ * \param  vectors_num Number of pieces in the array
+ * \return             The size of the data actually written.
+ */
+size_t vc_container_io_write_vector(VC_CONTAINER_IO_T *context,
+   const VC_CONTAINER_IO_VECTOR_T *vectors, unsigned int vectors_num);
+
 /** Seek into an i/o stream.
  * \param  context     Pointer to the VC_CONTAINER_IO_T instance to use
  * \param  offset      Absolute file offset to seek to
@@ -34,6 +34,59 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "core/containers_io.h"
 #include "core/containers_utils.h"
 
+/*****************************************************************************
+ * Fast path used by the helpers below when the data is already in the cache
+ *****************************************************************************/
+
+/** \private Reads a few bytes from an i/o stream.
+ * When the bytes are already in the i/o cache, this returns a pointer to them
+ * in the cache instead of going through vc_container_io_read.
+ * \param  io          Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  buffer      Buffer used when the bytes aren't in the cache
+ * \param  size        Number of bytes to read
+ * \return             Pointer to the bytes read or NULL if fewer bytes were read
+ */
+STATIC_INLINE const uint8_t *vc_container_io_read_ptr(VC_CONTAINER_IO_T *io, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache = io->cache;
+   const uint8_t *data;
+
+   if(cache && cache->position + size <= cache->size)
+   {
+      data = cache->buffer + cache->position;
+      cache->position += size;
+      io->offset += size;
+      io->status = VC_CONTAINER_SUCCESS;
+      io->counters.cache_hits++;
+      io->counters.bytes_read += size;
+      return data;
+   }
+
+   return vc_container_io_read(io, buffer, size) == size ? (const uint8_t *)buffer : NULL;
+}
+
+/** \private Peeks a few bytes from an i/o stream.
+ * Same as vc_container_io_read_ptr but without moving the read position.
+ * \param  io          Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  buffer      Buffer used when the bytes aren't in the cache
+ * \param  size        Number of bytes to peek
+ * \return             Pointer to the bytes peeked or NULL if fewer bytes were peeked
+ */
+STATIC_INLINE const uint8_t *vc_container_io_peek_ptr(VC_CONTAINER_IO_T *io, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache = io->cache;
+
+   if(cache && cache->position + size <= cache->size)
+   {
+      io->status = VC_CONTAINER_SUCCESS;
+      io->counters.cache_hits++;
+      io->counters.peeks++;
+      return cache->buffer + cache->position;
+   }
+
+   return vc_container_io_peek(io, buffer, size) == size ? (const uint8_t *)buffer : NULL;
+}
+
 /*****************************************************************************
  * Helper inline functions to read integers from an i/o stream
  *****************************************************************************/
@@ -46,8 +99,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 STATIC_INLINE uint8_t vc_container_io_read_uint8(VC_CONTAINER_IO_T *io)
 {
    uint8_t value;
-   size_t ret = vc_container_io_read(io, &value, 1);
-   return ret == 1 ? value : 0;
+   const uint8_t *data = vc_container_io_read_ptr(io, &value, 1);
+   return data ? data[0] : 0;
 }
 
 /** Reads a FOURCC from an i/o stream.
@@ -57,9 +110,12 @@ STATIC_INLINE uint8_t vc_container_io_read_uint8(VC_CONTAINER_IO_T *io)
  */
 STATIC_INLINE VC_CONTAINER_FOURCC_T vc_container_io_read_fourcc(VC_CONTAINER_IO_T *io)
 {
-   VC_CONTAINER_FOURCC_T value;
-   size_t ret = vc_container_io_read(io, (int8_t *)&value, 4);
-   return ret == 4 ? value : 0;
+   VC_CONTAINER_FOURCC_T fourcc;
+   uint8_t value[4];
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 4);
+   if(!data) return 0;
+   memcpy(&fourcc, data, 4);
+   return fourcc;
 }
 
 /** Reads an unsigned 16 bits big endian integer from an i/o stream.
@@ -70,8 +126,8 @@ STATIC_INLINE VC_CONTAINER_FOURCC_T vc_container_io_read_fourcc(VC_CONTAINER_IO_
 STATIC_INLINE uint16_t vc_container_io_read_be_uint16(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[2];
-   size_t ret = vc_container_io_read(io, value, 2);
-   return ret == 2 ? (value[0] << 8) | value[1] : 0;
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 2);
+   return data ? (data[0] << 8) | data[1] : 0;
 }
 
 /** Reads an unsigned 24 bits big endian integer from an i/o stream.
@@ -82,8 +138,8 @@ STATIC_INLINE uint16_t vc_container_io_read_be_uint16(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint32_t vc_container_io_read_be_uint24(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[3];
-   size_t ret = vc_container_io_read(io, value, 3);
-   return ret == 3 ? (value[0] << 16) | (value[1] << 8) | value[2] : 0;
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 3);
+   return data ? (data[0] << 16) | (data[1] << 8) | data[2] : 0;
 }
 
 /** Reads an unsigned 32 bits big endian integer from an i/o stream.
@@ -94,8 +150,8 @@ STATIC_INLINE uint32_t vc_container_io_read_be_uint24(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint32_t vc_container_io_read_be_uint32(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[4];
-   size_t ret = vc_container_io_read(io, value, 4);
-   return ret == 4 ? (value[0] << 24) | (value[1] << 16) | (value[2] << 8) | value[3] : 0;
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 4);
+   return data ? (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3] : 0;
 }
 
 /** Reads an unsigned 40 bits big endian integer from an i/o stream.
@@ -107,12 +163,13 @@ STATIC_INLINE uint64_t vc_container_io_read_be_uint40(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[5];
    uint32_t value1, value2;
-   size_t ret = vc_container_io_read(io, value, 5);
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 5);
+   if(!data) return 0;
 
-   value1 = (value[0] << 24) | (value[1] << 16) | (value[2] << 8) | value[3];
-   value2 = value[4];
+   value1 = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+   value2 = data[4];
 
-   return ret == 5 ? (((uint64_t)value1) << 8)|value2 : 0;
+   return (((uint64_t)value1) << 8)|value2;
 }
 
 /** Reads an unsigned 48 bits big endian integer from an i/o stream.
@@ -124,12 +181,13 @@ STATIC_INLINE uint64_t vc_container_io_read_be_uint48(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[6];
    uint32_t value1, value2;
-   size_t ret = vc_container_io_read(io, value, 6);
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 6);
+   if(!data) return 0;
 
-   value1 = (value[0] << 24) | (value[1] << 16) | (value[2] << 8) | value[3];
-   value2 = (value[4] << 8) | value[5];
+   value1 = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+   value2 = (data[4] << 8) | data[5];
 
-   return ret == 6 ? (((uint64_t)value1) << 16)|value2 : 0;
+   return (((uint64_t)value1) << 16)|value2;
 }
 
 /** Reads an unsigned 56 bits big endian integer from an i/o stream.
@@ -141,12 +199,13 @@ STATIC_INLINE uint64_t vc_container_io_read_be_uint56(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[7];
    uint32_t value1, value2;
-   size_t ret = vc_container_io_read(io, value, 7);
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 7);
+   if(!data) return 0;
 
-   value1 = (value[0] << 24) | (value[1] << 16) | (value[2] << 8) | value[3];
-   value2 = (value[4] << 16) | (value[5] << 8) | value[6];
+   value1 = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+   value2 = (data[4] << 16) | (data[5] << 8) | data[6];
 
-   return ret == 7 ? (((uint64_t)value1) << 24)|value2 : 0;
+   return (((uint64_t)value1) << 24)|value2;
 }
 
 /** Reads an unsigned 64 bits big endian integer from an i/o stream.
@@ -158,12 +217,13 @@ STATIC_INLINE uint64_t vc_container_io_read_be_uint64(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[8];
    uint32_t value1, value2;
-   size_t ret = vc_container_io_read(io, value, 8);
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 8);
+   if(!data) return 0;
 
-   value1 = (value[0] << 24) | (value[1] << 16) | (value[2] << 8) | value[3];
-   value2 = (value[4] << 24) | (value[5] << 16) | (value[6] << 8) | value[7];
+   value1 = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+   value2 = (data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
 
-   return ret == 8 ? (((uint64_t)value1) << 32)|value2 : 0;
+   return (((uint64_t)value1) << 32)|value2;
 }
 
 /** Reads an unsigned 16 bits little endian integer from an i/o stream.
@@ -174,8 +234,8 @@ STATIC_INLINE uint64_t vc_container_io_read_be_uint64(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint16_t vc_container_io_read_le_uint16(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[2];
-   size_t ret = vc_container_io_read(io, value, 2);
-   return ret == 2 ? (value[1] << 8) | value[0] : 0;
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 2);
+   return data ? (data[1] << 8) | data[0] : 0;
 }
 
 /** Reads an unsigned 24 bits little endian integer from an i/o stream.
@@ -186,8 +246,8 @@ STATIC_INLINE uint16_t vc_container_io_read_le_uint16(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint32_t vc_container_io_read_le_uint24(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[3];
-   size_t ret = vc_container_io_read(io, value, 3);
-   return ret == 3 ? (value[2] << 16) | (value[1] << 8) | value[0] : 0;
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 3);
+   return data ? (data[2] << 16) | (data[1] << 8) | data[0] : 0;
 }
 
 /** Reads an unsigned 32 bits little endian integer from an i/o stream.
@@ -198,8 +258,8 @@ STATIC_INLINE uint32_t vc_container_io_read_le_uint24(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint32_t vc_container_io_read_le_uint32(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[4];
-   size_t ret = vc_container_io_read(io, value, 4);
-   return ret == 4 ? (value[3] << 24) | (value[2] << 16) | (value[1] << 8) | value[0] : 0;
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 4);
+   return data ? (data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0] : 0;
 }
 
 /** Reads an unsigned 40 bits little endian integer from an i/o stream.
@@ -211,12 +271,13 @@ STATIC_INLINE uint64_t vc_container_io_read_le_uint40(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[5];
    uint32_t value1, value2;
-   size_t ret = vc_container_io_read(io, value, 5);
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 5);
+   if(!data) return 0;
 
-   value1 = (value[3] << 24) | (value[2] << 16) | (value[1] << 8) | value[0];
-   value2 = value[4];
+   value1 = (data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0];
+   value2 = data[4];
 
-   return ret == 5 ? (((uint64_t)value2) << 32)|value1 : 0;
+   return (((uint64_t)value2) << 32)|value1;
 }
 
 /** Reads an unsigned 48 bits little endian integer from an i/o stream.
@@ -228,12 +289,13 @@ STATIC_INLINE uint64_t vc_container_io_read_le_uint48(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[6];
    uint32_t value1, value2;
-   size_t ret = vc_container_io_read(io, value, 6);
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 6);
+   if(!data) return 0;
 
-   value1 = (value[3] << 24) | (value[2] << 16) | (value[1] << 8) | value[0];
-   value2 = (value[5] << 8) | value[4];
+   value1 = (data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0];
+   value2 = (data[5] << 8) | data[4];
 
-   return ret == 6 ? (((uint64_t)value2) << 32)|value1 : 0;
+   return (((uint64_t)value2) << 32)|value1;
 }
 
 /** Reads an unsigned 56 bits little endian integer from an i/o stream.
@@ -245,12 +307,13 @@ STATIC_INLINE uint64_t vc_container_io_read_le_uint56(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[7];
    uint32_t value1, value2;
-   size_t ret = vc_container_io_read(io, value, 7);
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 7);
+   if(!data) return 0;
 
-   value1 = (value[3] << 24) | (value[2] << 16) | (value[1] << 8) | value[0];
-   value2 = (value[6] << 16) | (value[5] << 8) | value[4];
+   value1 = (data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0];
+   value2 = (data[6] << 16) | (data[5] << 8) | data[4];
 
-   return ret == 7 ? (((uint64_t)value2) << 32)|value1 : 0;
+   return (((uint64_t)value2) << 32)|value1;
 }
 
 /** Reads an unsigned 64 bits little endian integer from an i/o stream.
@@ -262,12 +325,13 @@ STATIC_INLINE uint64_t vc_container_io_read_le_uint64(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[8];
    uint32_t value1, value2;
-   size_t ret = vc_container_io_read(io, value, 8);
+   const uint8_t *data = vc_container_io_read_ptr(io, value, 8);
+   if(!data) return 0;
 
-   value1 = (value[3] << 24) | (value[2] << 16) | (value[1] << 8) | value[0];
-   value2 = (value[7] << 24) | (value[6] << 16) | (value[5] << 8) | value[4];
+   value1 = (data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0];
+   value2 = (data[7] << 24) | (data[6] << 16) | (data[5] << 8) | data[4];
 
-   return ret == 8 ? (((uint64_t)value2) << 32)|value1 : 0;
+   return (((uint64_t)value2) << 32)|value1;
 }
 
 /*****************************************************************************
@@ -282,8 +346,8 @@ STATIC_INLINE uint64_t vc_container_io_read_le_uint64(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint8_t vc_container_io_peek_uint8(VC_CONTAINER_IO_T *io)
 {
    uint8_t value;
-   size_t ret = vc_container_io_peek(io, &value, 1);
-   return ret == 1 ? value : 0;
+   const uint8_t *data = vc_container_io_peek_ptr(io, &value, 1);
+   return data ? data[0] : 0;
 }
 
 /** Peeks an unsigned 16 bits big endian integer from an i/o stream.
@@ -294,8 +358,8 @@ STATIC_INLINE uint8_t vc_container_io_peek_uint8(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint16_t vc_container_io_peek_be_uint16(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[2];
-   size_t ret = vc_container_io_peek(io, value, 2);
-   return ret == 2 ? (value[0] << 8) | value[1] : 0;
+   const uint8_t *data = vc_container_io_peek_ptr(io, value, 2);
+   return data ? (data[0] << 8) | data[1] : 0;
 }
 
 /** Peeks an unsigned 24 bits big endian integer from an i/o stream.
@@ -306,8 +370,8 @@ STATIC_INLINE uint16_t vc_container_io_peek_be_uint16(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint32_t vc_container_io_peek_be_uint24(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[3];
-   size_t ret = vc_container_io_peek(io, value, 3);
-   return ret == 3 ? (value[0] << 16) | (value[1] << 8) | value[2] : 0;
+   const uint8_t *data = vc_container_io_peek_ptr(io, value, 3);
+   return data ? (data[0] << 16) | (data[1] << 8) | data[2] : 0;
 }
 
 /** Peeks an unsigned 32 bits big endian integer from an i/o stream.
@@ -318,8 +382,8 @@ STATIC_INLINE uint32_t vc_container_io_peek_be_uint24(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint32_t vc_container_io_peek_be_uint32(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[4];
-   size_t ret = vc_container_io_peek(io, value, 4);
-   return ret == 4 ? (value[0] << 24) | (value[1] << 16) | (value[2] << 8) | value[3] : 0;
+   const uint8_t *data = vc_container_io_peek_ptr(io, value, 4);
+   return data ? (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3] : 0;
 }
 
 /** Peeks an unsigned 64 bits big endian integer from an i/o stream.
@@ -331,12 +395,13 @@ STATIC_INLINE uint64_t vc_container_io_peek_be_uint64(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[8];
    uint32_t value1, value2;
-   size_t ret = vc_container_io_peek(io, value, 8);
+   const uint8_t *data = vc_container_io_peek_ptr(io, value, 8);
+   if(!data) return 0;
 
-   value1 = (value[0] << 24) | (value[1] << 16) | (value[2] << 8) | value[3];
-   value2 = (value[4] << 24) | (value[5] << 16) | (value[6] << 8) | value[7];
+   value1 = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+   value2 = (data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
 
-   return ret == 8 ? (((uint64_t)value1) << 32)|value2 : 0;
+   return (((uint64_t)value1) << 32)|value2;
 }
 
 /** Peeks an unsigned 16 bits little endian integer from an i/o stream.
@@ -347,8 +412,8 @@ STATIC_INLINE uint64_t vc_container_io_peek_be_uint64(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint16_t vc_container_io_peek_le_uint16(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[2];
-   size_t ret = vc_container_io_peek(io, value, 2);
-   return ret == 2 ? (value[1] << 8) | value[0] : 0;
+   const uint8_t *data = vc_container_io_peek_ptr(io, value, 2);
+   return data ? (data[1] << 8) | data[0] : 0;
 }
 
 /** Peeks an unsigned 24 bits little endian integer from an i/o stream.
@@ -359,8 +424,8 @@ STATIC_INLINE uint16_t vc_container_io_peek_le_uint16(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint32_t vc_container_io_peek_le_uint24(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[3];
-   size_t ret = vc_container_io_peek(io, value, 3);
-   return ret == 3 ? (value[2] << 16) | (value[1] << 8) | value[0] : 0;
+   const uint8_t *data = vc_container_io_peek_ptr(io, value, 3);
+   return data ? (data[2] << 16) | (data[1] << 8) | data[0] : 0;
 }
 
 /** Peeks an unsigned 32 bits little endian integer from an i/o stream.
@@ -371,8 +436,8 @@ STATIC_INLINE uint32_t vc_container_io_peek_le_uint24(VC_CONTAINER_IO_T *io)
 STATIC_INLINE uint32_t vc_container_io_peek_le_uint32(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[4];
-   size_t ret = vc_container_io_peek(io, value, 4);
-   return ret == 4 ? (value[3] << 24) | (value[2] << 16) | (value[1] << 8) | value[0] : 0;
+   const uint8_t *data = vc_container_io_peek_ptr(io, value, 4);
+   return data ? (data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0] : 0;
 }
 
 /** Peeks an unsigned 64 bits little endian integer from an i/o stream.
@@ -384,12 +449,13 @@ STATIC_INLINE uint64_t vc_container_io_peek_le_uint64(VC_CONTAINER_IO_T *io)
 {
    uint8_t value[8];
    uint32_t value1, value2;
-   size_t ret = vc_container_io_peek(io, value, 8);
+   const uint8_t *data = vc_container_io_peek_ptr(io, value, 8);
+   if(!data) return 0;
 
-   value1 = (value[3] << 24) | (value[2] << 16) | (value[1] << 8) | value[0];
-   value2 = (value[7] << 24) | (value[6] << 16) | (value[5] << 8) | value[4];
+   value1 = (data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0];
+   value2 = (data[7] << 24) | (data[6] << 16) | (data[5] << 8) | data[4];
 
-   return ret == 8 ? (((uint64_t)value2) << 32)|value1 : 0;
+   return (((uint64_t)value2) << 32)|value1;
 }
 
 /*****************************************************************************
@@ -534,6 +600,22 @@ STATIC_INLINE VC_CONTAINER_STATUS_T vc_container_io_write_le_uint64(VC_CONTAINER
    return ret == 8 ? VC_CONTAINER_SUCCESS : VC_CONTAINER_ERROR_FAILED;
 }
 
+/** Writes the payload of a packet to an i/o stream.
+ * Big payloads are written without being copied into the write cache
+ * (see vc_container_io_write_vector).
+ * \param  io          Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  buffer      Pointer to the payload
+ * \param  size        Size of the payload
+ * \return             The size of the data actually written.
+ */
+STATIC_INLINE size_t vc_container_io_write_payload(VC_CONTAINER_IO_T *io, const void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_VECTOR_T vector;
+   vector.data = buffer;
+   vector.size = size;
+   return vc_container_io_write_vector(io, &vector, 1);
+}
+
 /*****************************************************************************
  * Helper macros for accessing the i/o stream. These will also call the right
  * functions depending on the endianness defined.
@@ -552,6 +634,7 @@ STATIC_INLINE VC_CONTAINER_STATUS_T vc_container_io_write_le_uint64(VC_CONTAINER
 
 #define PEEK_BYTES(ctx, buffer, size) vc_container_io_peek((ctx)->priv->io, buffer, (size_t)(size))
 #define READ_BYTES(ctx, buffer, size) vc_container_io_read((ctx)->priv->io, buffer, (size_t)(size))
+#define BORROW_BYTES(ctx, p_size) vc_container_io_borrow((ctx)->priv->io, p_size)
 #define SKIP_BYTES(ctx, size) vc_container_io_skip((ctx)->priv->io, (size_t)(size))
 #define SEEK(ctx, off) vc_container_io_seek((ctx)->priv->io, (int64_t)(off))
 #define CACHE_BYTES(ctx, size) vc_container_io_cache((ctx)->priv->io, (size_t)(size))
@@ -596,6 +679,8 @@ STATIC_INLINE VC_CONTAINER_STATUS_T vc_container_io_write_le_uint64(VC_CONTAINER
 #endif
 
 #define WRITE_BYTES(ctx, buffer, size) vc_container_io_write((ctx)->priv->io, buffer, (size_t)(size))
+#define WRITE_PAYLOAD(ctx, buffer, size) vc_container_io_write_payload((ctx)->priv->io, buffer, (size_t)(size))
+#define WRITE_VECTOR(ctx, vectors, num) vc_container_io_write_vector((ctx)->priv->io, vectors, num)
 #define _WRITE_GUID(ctx, buffer) vc_container_io_write((ctx)->priv->io, buffer, 16)
 #define _WRITE_U8(ctx, v)  vc_container_io_write_uint8((ctx)->priv->io, v)
 #define _WRITE_FOURCC(ctx, v) vc_container_io_write_fourcc((ctx)->priv->io, v)
@@ -168,6 +168,20 @@ typedef struct VC_CONTAINER_PRIVATE_T
    /** Temporary buffer used by the packetizer */
    uint8_t *packetizer_buffer;
 
+   /** Number of packets read or skipped on each track (see VC_CONTAINER_CONTROL_GET_READ_COUNTERS) */
+   uint32_t packets[VC_CONTAINER_READ_COUNTERS_TRACKS];
+   /** Track of the last packet information returned, which is where a skip without a packet goes */
+   unsigned int info_track;
+
+   /** Packets whose data was borrowed from the i/o (see VC_CONTAINER_READ_FLAG_ZERO_COPY),
+    * with the buffer the caller gave them, which they get back when they are released */
+   struct VC_CONTAINER_BORROWED_PACKET_T {
+      VC_CONTAINER_PACKET_T *packet;
+      uint8_t *buffer;
+   } *borrowed;
+   unsigned int borrowed_num;
+   unsigned int borrowed_max;
+
 } VC_CONTAINER_PRIVATE_T;
 
 /* Internal functions */
@@ -32,9 +32,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "core/containers_private.h"
 #include "core/containers_utils.h"
 #include "core/containers_writer_utils.h"
+#include "core/containers_uri.h"
 
 #include <stdio.h>
 
+/* Temporary data kept in memory by default before it spills to a file */
+#define WRITER_TEMP_MEMORY_BUDGET (8*1024*1024)
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T vc_container_writer_extraio_create(VC_CONTAINER_T *context, const char *uri,
    VC_CONTAINER_WRITER_EXTRAIO_T *extraio)
@@ -59,6 +63,8 @@ VC_CONTAINER_STATUS_T vc_container_writer_extraio_create_temp(VC_CONTAINER_T *co
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    const char *io_uri = vc_uri_path(context->priv->io->uri_parts);
+   const char *value, *directory;
+   uint32_t budget = WRITER_TEMP_MEMORY_BUDGET;
    unsigned int length;
    char *uri;
 
@@ -69,9 +75,24 @@ VC_CONTAINER_STATUS_T vc_container_writer_extraio_create_temp(VC_CONTAINER_T *co
    if(!uri) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
 
    snprintf(uri, length, "%s.tmp", io_uri);
-   status = vc_container_writer_extraio_create(context, uri, extraio);
+
+   /* The temporary data is kept in memory while it is small enough. Where it goes
+    * next can be chosen with the tmpbudget and tmpdir query options of the uri. */
+   if(vc_uri_find_query(context->priv->io->uri_parts, 0, "tmpbudget", &value) && value)
+      budget = strtoul(value, 0, 0);
+   if(!vc_uri_find_query(context->priv->io->uri_parts, 0, "tmpdir", &directory))
+      directory = 0;
+   extraio->io = vc_container_io_open_temp(uri, budget, directory, &status);
+   extraio->refcount = 0;
+   extraio->temp = false; /* Nothing is left to remove once it is closed */
+
+   /* Otherwise fall back to a plain file next to the output */
+   if(!extraio->io)
+   {
+      status = vc_container_writer_extraio_create(context, uri, extraio);
+      extraio->temp = true;
+   }
    free(uri);
-   extraio->temp = true;
 
    if(status == VC_CONTAINER_SUCCESS && !context->priv->tmp_io)
       context->priv->tmp_io = extraio->io;
@@ -25,32 +25,198 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#define _FILE_OFFSET_BITS 64 /* Large file support on 32 bits systems */
+#if defined(ENABLE_CONTAINER_IO_URING) || defined(ENABLE_CONTAINER_IO_DIRECT)
+# define _GNU_SOURCE /* syscall(), O_DIRECT, fallocate() */
+#endif
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <limits.h>
+#include <sys/types.h>
+#ifdef ENABLE_CONTAINER_IO_URING
+# include <errno.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <sys/uio.h>
+# include <linux/io_uring.h>
+#endif
+#ifdef ENABLE_CONTAINER_IO_DIRECT
+# include <errno.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+#ifdef ENABLE_CONTAINER_IO_WRITEV
+# include <errno.h>
+# include <unistd.h>
+# include <sys/uio.h>
+#endif
 
 #include "containers.h"
 #include "core/containers_common.h"
 #include "core/containers_io.h"
 #include "core/containers_uri.h"
 
+/* 64 bits file offsets */
+#if defined(_VIDEOCORE)
+extern int fseek64(FILE *fp, int64_t offset, int whence);
+# define IO_FILE_SEEK(stream, offset, whence) fseek64(stream, offset, whence)
+# define IO_FILE_TELL(stream) ftell(stream)
+#elif defined(_MSC_VER)
+# define IO_FILE_SEEK(stream, offset, whence) _fseeki64(stream, offset, whence)
+# define IO_FILE_TELL(stream) _ftelli64(stream)
+#else
+# define IO_FILE_SEEK(stream, offset, whence) fseeko(stream, (off_t)(offset), whence)
+# define IO_FILE_TELL(stream) ftello(stream)
+#endif
+
+#ifdef ENABLE_CONTAINER_IO_WRITEV
+#define IO_FILE_WRITEV_MAX 16 /* Pieces written by a single writev() call */
+#endif
+
+#ifdef ENABLE_CONTAINER_IO_URING
+/* On Linux, a uring=n query option in the URI (e.g. file.mp4?uring=16) has the
+ * file read and written with an io_uring keeping up to n requests in flight:
+ * reads ahead of sequential readers and writes behind writers, using registered
+ * buffers. The ring is only created once there is something to overlap (a
+ * second sequential read or a first write) and everything falls back to plain
+ * pread / pwrite calls if the kernel doesn't let us have one.
+ * This isn't the default as the data has to be copied through the registered
+ * buffers, which costs more than it saves when the page cache is hot. */
+#define IO_URING_DEFAULT_SLOTS 8 /* Requests in flight */
+#define IO_URING_MAX_SLOTS 32
+#define IO_URING_SLOT_SIZE (128*1024) /* Size of the registered buffer of each request */
+
+typedef enum {
+   IO_URING_SLOT_FREE = 0,
+   IO_URING_SLOT_FILLING,   /**< Write data being gathered */
+   IO_URING_SLOT_PENDING,   /**< Request in flight */
+   IO_URING_SLOT_DONE       /**< Read data available */
+} IO_URING_SLOT_STATE_T;
+
+typedef struct IO_URING_SLOT_T
+{
+   IO_URING_SLOT_STATE_T state;
+   bool write;
+   bool stale;              /**< Read nobody wants anymore, freed when it completes */
+   int64_t offset;          /**< Offset in the file of the data */
+   size_t size;             /**< Size of the request */
+   int result;              /**< Result of the completed request */
+   struct iovec iov;        /**< Registered buffer */
+
+} IO_URING_SLOT_T;
+
+typedef struct IO_URING_T
+{
+   int fd;
+   bool fixed;              /**< Buffers are registered with the kernel */
+
+   void *ring;
+   size_t ring_size;
+   struct io_uring_sqe *sqes;
+   size_t sqes_size;
+   unsigned *sq_tail, *sq_array, sq_mask;
+   unsigned *cq_head, *cq_tail, cq_mask;
+   struct io_uring_cqe *cqes;
+   unsigned int to_submit;  /**< Requests queued but not submitted yet */
+   unsigned int in_flight;
+
+   uint8_t *mem;
+   unsigned int slots_num;
+   unsigned int batch;      /**< Requests handed to the kernel at once */
+   IO_URING_SLOT_T slots[IO_URING_MAX_SLOTS];
+   int filling;             /**< Slot gathering write data, -1 if none */
+
+} IO_URING_T;
+#endif
+
+#ifdef ENABLE_CONTAINER_IO_DIRECT
+/* On Linux, a direct query option in the URI of a file being written (e.g.
+ * file.mp4?direct) has it written with O_DIRECT, so long recordings don't fill
+ * the page cache with data nobody reads back. O_DIRECT transfers need aligned
+ * offsets, sizes and memory: the core aligns its write cache so whole blocks go
+ * straight from it, and the partial blocks (the end of the data, the headers
+ * rewritten on close) are merged with what the file has in a bounce buffer.
+ * The file is padded to the alignment while written and truncated on close.
+ * A preallocate=n option also reserves the space n bytes ahead of the data
+ * with fallocate() to keep the file contiguous. */
+#define IO_FILE_DIRECT_ALIGNMENT VC_CONTAINER_IO_DIRECT_ALIGNMENT
+#define IO_FILE_DIRECT_BOUNCE_SIZE (128*1024) /* For data which isn't aligned in memory */
+#define IO_FILE_DIRECT_DEFAULT_PREALLOCATE (64*1024*1024)
+#endif
+
 typedef struct VC_CONTAINER_IO_MODULE_T
 {
    FILE *stream;
 
+#ifdef ENABLE_CONTAINER_IO_URING
+   int fd;
+   int64_t position;
+   IO_URING_T *uring;
+   unsigned int uring_slots;
+   bool uring_failed;       /**< Don't try to create the ring again */
+   int64_t stream_end;      /**< End of the reads served by the read-ahead */
+   int64_t direct_end;      /**< End of the last read which wasn't */
+   bool write_mode;
+   bool write_failed;       /**< A write behind failed */
+#endif
+
+#ifdef ENABLE_CONTAINER_IO_DIRECT
+   bool direct;
+   int direct_fd;
+   int64_t direct_position;
+   int64_t direct_size;     /**< Size of the data, the file itself is padded to the alignment */
+   uint8_t *direct_mem;     /**< Bounce buffer */
+   uint8_t *direct_block;   /**< Copy of the last partial block written */
+   int64_t direct_block_offset; /**< Offset of that block, -1 if none */
+   int64_t preallocate;     /**< Space reserved ahead of the data, 0 if none */
+   int64_t allocated;       /**< End of the space reserved */
+#endif
+
 } VC_CONTAINER_IO_MODULE_T;
 
 VC_CONTAINER_STATUS_T vc_container_io_file_open( VC_CONTAINER_IO_T *, const char *,
    VC_CONTAINER_IO_MODE_T );
 
+/*****************************************************************************/
+#ifdef ENABLE_CONTAINER_IO_URING
+static void io_file_uring_sync( VC_CONTAINER_IO_MODULE_T *module );
+static void io_file_uring_destroy( IO_URING_T *uring );
+#endif
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T io_file_close( VC_CONTAINER_IO_T *p_ctx )
 {
    VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+
+#ifdef ENABLE_CONTAINER_IO_URING
+   /* The kernel mustn't be left using our buffers */
+   if(module->uring)
+   {
+      io_file_uring_sync(module);
+      io_file_uring_destroy(module->uring);
+   }
+   if(module->write_failed) status = VC_CONTAINER_ERROR_FAILED;
+#endif
+
+#ifdef ENABLE_CONTAINER_IO_DIRECT
+   if(module->direct)
+   {
+      /* Drop the padding and give back the space reserved past the data */
+      if(ftruncate(module->direct_fd, module->direct_size))
+         status = VC_CONTAINER_ERROR_FAILED;
+      if(module->allocated > module->direct_size)
+         fallocate(module->direct_fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
+                   module->direct_size, module->allocated - module->direct_size);
+      free(module->direct_mem);
+   }
+#endif
+
    fclose(module->stream);
    free(module);
-   return VC_CONTAINER_SUCCESS;
+   return status;
 }
 
 /*****************************************************************************/
@@ -74,24 +240,71 @@ static size_t io_file_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_t
    return fwrite(buffer, 1, size, p_ctx->module->stream);
 }
 
+#ifdef ENABLE_CONTAINER_IO_WRITEV
+/*****************************************************************************/
+static size_t io_file_write_vector(VC_CONTAINER_IO_T *p_ctx,
+   const VC_CONTAINER_IO_VECTOR_T *vectors, unsigned int vectors_num)
+{
+   struct iovec iov[IO_FILE_WRITEV_MAX];
+   int fd = fileno(p_ctx->module->stream);
+   unsigned int i, num = vectors_num;
+   size_t written = 0;
+   ssize_t ret;
+
+   /* The stream isn't buffered so we can write to its file descriptor directly */
+   if(num > IO_FILE_WRITEV_MAX)
+   {
+      for(i = 0; i < num; i++)
+      {
+         ret = io_file_write(p_ctx, vectors[i].data, vectors[i].size);
+         written += ret;
+         if((size_t)ret != vectors[i].size) break;
+      }
+      return written;
+   }
+
+   for(i = 0; i < num; i++)
+   {
+      iov[i].iov_base = (void *)(uintptr_t)vectors[i].data;
+      iov[i].iov_len = vectors[i].size;
+   }
+
+   for(i = 0; i < num; )
+   {
+      ret = writev(fd, iov + i, num - i);
+      if(ret < 0 && errno == EINTR) continue;
+      if(ret <= 0) break;
+      written += ret;
+
+      /* Carry on from where a short write stopped */
+      for(; i < num && (size_t)ret >= iov[i].iov_len; i++)
+         ret -= iov[i].iov_len;
+      if(i < num)
+      {
+         iov[i].iov_base = (uint8_t *)iov[i].iov_base + ret;
+         iov[i].iov_len -= ret;
+      }
+   }
+
+   return written;
+}
+#endif
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T io_file_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    int ret;
 
-   //FIXME: large file support
-#ifdef _VIDEOCORE
-   extern int fseek64(FILE *fp, int64_t offset, int whence);
-   ret = fseek64(p_ctx->module->stream, offset, SEEK_SET);
-#else
-   if (offset > (int64_t)UINT_MAX)
+#if !defined(_VIDEOCORE) && !defined(_MSC_VER)
+   /* Without large file support we can't go past 2GB */
+   if (sizeof(off_t) < sizeof(int64_t) && offset > (int64_t)LONG_MAX)
    {
       p_ctx->status = VC_CONTAINER_ERROR_EOS;
       return VC_CONTAINER_ERROR_EOS;
    }
-   ret = fseek(p_ctx->module->stream, (long)offset, SEEK_SET);
-#endif   
+#endif
+   ret = IO_FILE_SEEK(p_ctx->module->stream, offset, SEEK_SET);
    if(ret)
    {
       if( feof(p_ctx->module->stream) ) status = VC_CONTAINER_ERROR_EOS;
@@ -102,6 +315,658 @@ static VC_CONTAINER_STATUS_T io_file_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offs
    return status;
 }
 
+#ifdef ENABLE_CONTAINER_IO_URING
+/*****************************************************************************
+ * io_uring backend.
+ *****************************************************************************/
+
+/*****************************************************************************/
+static void io_file_uring_destroy( IO_URING_T *uring )
+{
+   if(uring->sqes) munmap(uring->sqes, uring->sqes_size);
+   if(uring->ring) munmap(uring->ring, uring->ring_size);
+   if(uring->fd >= 0) close(uring->fd);
+   free(uring->mem);
+   free(uring);
+}
+
+/*****************************************************************************/
+static IO_URING_T *io_file_uring_create( unsigned int slots )
+{
+   struct iovec iov[IO_URING_MAX_SLOTS];
+   struct io_uring_params params;
+   IO_URING_T *uring;
+   uint8_t *ring;
+   void *mem;
+   unsigned int i;
+
+   uring = malloc(sizeof(*uring));
+   if(!uring) return NULL;
+   memset(uring, 0, sizeof(*uring));
+   uring->filling = -1;
+   uring->slots_num = slots;
+   uring->batch = MAX(slots / 2, 1);
+
+   memset(&params, 0, sizeof(params));
+   uring->fd = syscall(__NR_io_uring_setup, slots, &params);
+   if(uring->fd < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP)) goto error;
+
+   /* The submission and completion rings share the same mapping */
+   uring->ring_size = MAX(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                          params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+   ring = mmap(0, uring->ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+               uring->fd, IORING_OFF_SQ_RING);
+   if(ring == MAP_FAILED) goto error;
+   uring->ring = ring;
+
+   uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+   uring->sqes = mmap(0, uring->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                      uring->fd, IORING_OFF_SQES);
+   if(uring->sqes == MAP_FAILED) { uring->sqes = 0; goto error; }
+
+   uring->sq_tail = (unsigned *)(ring + params.sq_off.tail);
+   uring->sq_mask = *(unsigned *)(ring + params.sq_off.ring_mask);
+   uring->sq_array = (unsigned *)(ring + params.sq_off.array);
+   uring->cq_head = (unsigned *)(ring + params.cq_off.head);
+   uring->cq_tail = (unsigned *)(ring + params.cq_off.tail);
+   uring->cq_mask = *(unsigned *)(ring + params.cq_off.ring_mask);
+   uring->cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+
+   if(posix_memalign(&mem, 4096, slots * IO_URING_SLOT_SIZE)) goto error;
+   uring->mem = mem;
+   for(i = 0; i < slots; i++)
+   {
+      iov[i].iov_base = uring->mem + i * IO_URING_SLOT_SIZE;
+      iov[i].iov_len = IO_URING_SLOT_SIZE;
+      uring->slots[i].iov = iov[i];
+   }
+
+   /* Registered buffers don't need mapping on every request. They count against
+    * the locked memory limit on older kernels so we can do without. */
+   uring->fixed = !syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_BUFFERS,
+                           iov, slots);
+   return uring;
+
+ error:
+   io_file_uring_destroy(uring);
+   return NULL;
+}
+
+/*****************************************************************************/
+static IO_URING_T *io_file_uring_get( VC_CONTAINER_IO_MODULE_T *module )
+{
+   if(!module->uring && !module->uring_failed)
+   {
+      module->uring = io_file_uring_create(module->uring_slots);
+      module->uring_failed = !module->uring;
+   }
+   return module->uring;
+}
+
+/*****************************************************************************/
+static int io_file_uring_enter( IO_URING_T *uring, unsigned int wait )
+{
+   int ret;
+
+   do {
+      ret = syscall(__NR_io_uring_enter, uring->fd, uring->to_submit, wait,
+                    wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+   } while(ret < 0 && errno == EINTR);
+
+   if(ret > 0) uring->to_submit -= MIN((unsigned int)ret, uring->to_submit);
+   return ret;
+}
+
+/*****************************************************************************/
+static void io_file_uring_queue( VC_CONTAINER_IO_MODULE_T *module, unsigned int index )
+{
+   IO_URING_T *uring = module->uring;
+   IO_URING_SLOT_T *slot = &uring->slots[index];
+   unsigned int tail = *uring->sq_tail;
+   struct io_uring_sqe *sqe = &uring->sqes[tail & uring->sq_mask];
+
+   memset(sqe, 0, sizeof(*sqe));
+   sqe->fd = module->fd;
+   sqe->off = slot->offset;
+   sqe->user_data = index;
+   slot->iov.iov_len = slot->size;
+   if(uring->fixed)
+   {
+      sqe->opcode = slot->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+      sqe->addr = (uintptr_t)slot->iov.iov_base;
+      sqe->len = slot->size;
+      sqe->buf_index = index;
+   }
+   else
+   {
+      sqe->opcode = slot->write ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->addr = (uintptr_t)&slot->iov;
+      sqe->len = 1;
+   }
+
+   /* The kernel picks it up on the next io_uring_enter() */
+   uring->sq_array[tail & uring->sq_mask] = tail & uring->sq_mask;
+   __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+   slot->state = IO_URING_SLOT_PENDING;
+   uring->to_submit++;
+   uring->in_flight++;
+}
+
+/*****************************************************************************/
+static void io_file_uring_reap( VC_CONTAINER_IO_MODULE_T *module )
+{
+   IO_URING_T *uring = module->uring;
+   unsigned int head = *uring->cq_head;
+   unsigned int tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+   for(; head != tail; head++)
+   {
+      struct io_uring_cqe *cqe = &uring->cqes[head & uring->cq_mask];
+      IO_URING_SLOT_T *slot = &uring->slots[cqe->user_data];
+
+      slot->result = cqe->res;
+      if(slot->write && slot->result != (int)slot->size)
+         module->write_failed = true;
+      slot->state = slot->write || slot->stale ? IO_URING_SLOT_FREE : IO_URING_SLOT_DONE;
+      slot->stale = false;
+      uring->in_flight--;
+   }
+
+   __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*****************************************************************************/
+static void io_file_uring_wait( VC_CONTAINER_IO_MODULE_T *module, IO_URING_SLOT_T *slot )
+{
+   IO_URING_T *uring = module->uring;
+
+   /* Waits for the given request or for all of them */
+   io_file_uring_reap(module);
+   while(slot ? slot->state == IO_URING_SLOT_PENDING : uring->in_flight > 0)
+   {
+      if(io_file_uring_enter(uring, 1) < 0) break;
+      io_file_uring_reap(module);
+   }
+}
+
+/*****************************************************************************/
+static int io_file_uring_slot( VC_CONTAINER_IO_MODULE_T *module, bool wait )
+{
+   IO_URING_T *uring = module->uring;
+   unsigned int i;
+
+   for(;;)
+   {
+      for(i = 0; i < uring->slots_num; i++)
+         if(uring->slots[i].state == IO_URING_SLOT_FREE) return i;
+
+      if(!wait || !uring->in_flight || io_file_uring_enter(uring, 1) < 0)
+         return -1;
+      io_file_uring_reap(module);
+   }
+}
+
+/*****************************************************************************/
+static void io_file_uring_queue_write( VC_CONTAINER_IO_MODULE_T *module, unsigned int index )
+{
+   IO_URING_T *uring = module->uring;
+   IO_URING_SLOT_T *slot = &uring->slots[index];
+   unsigned int i;
+
+   /* Requests complete in any order so writes to the same data can't overlap */
+   for(i = 0; i < uring->slots_num; i++)
+   {
+      IO_URING_SLOT_T *other = &uring->slots[i];
+      if(other->state == IO_URING_SLOT_PENDING &&
+         other->offset < slot->offset + (int64_t)slot->size &&
+         slot->offset < other->offset + (int64_t)other->size)
+         io_file_uring_wait(module, other);
+   }
+
+   if(uring->filling == (int)index) uring->filling = -1;
+   io_file_uring_queue(module, index);
+}
+
+/*****************************************************************************/
+static void io_file_uring_sync( VC_CONTAINER_IO_MODULE_T *module )
+{
+   IO_URING_T *uring = module->uring;
+
+   if(!uring) return;
+   if(uring->filling >= 0) io_file_uring_queue_write(module, uring->filling);
+   io_file_uring_wait(module, NULL);
+}
+
+/*****************************************************************************/
+static IO_URING_SLOT_T *io_file_uring_find( VC_CONTAINER_IO_MODULE_T *module, int64_t offset )
+{
+   IO_URING_T *uring = module->uring;
+   unsigned int i;
+
+   if(!uring) return NULL;
+   for(i = 0; i < uring->slots_num; i++)
+   {
+      IO_URING_SLOT_T *slot = &uring->slots[i];
+      if((slot->state == IO_URING_SLOT_PENDING || slot->state == IO_URING_SLOT_DONE) &&
+         !slot->write && !slot->stale &&
+         offset >= slot->offset && offset < slot->offset + (int64_t)slot->size)
+         return slot;
+   }
+   return NULL;
+}
+
+/*****************************************************************************/
+static void io_file_uring_prefetch( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_URING_T *uring = module->uring;
+   int64_t offset = module->stream_end;
+   unsigned int i, free = 0;
+   IO_URING_SLOT_T *slot;
+   int index;
+
+   for(i = 0; i < uring->slots_num; i++)
+   {
+      slot = &uring->slots[i];
+      if(slot->write || slot->stale || slot->state == IO_URING_SLOT_FREE) continue;
+
+      /* Data the reader skipped over isn't wanted anymore */
+      if(slot->offset + (int64_t)slot->size <= module->position)
+      {
+         if(slot->state == IO_URING_SLOT_DONE) slot->state = IO_URING_SLOT_FREE;
+         else slot->stale = true;
+      }
+      else if(slot->offset + (int64_t)slot->size > offset)
+         offset = slot->offset + slot->size;
+   }
+
+   /* Keep reading ahead of the reader, a batch at a time unless it caught up with us */
+   for(i = 0; i < uring->slots_num; i++)
+      if(uring->slots[i].state == IO_URING_SLOT_FREE) free++;
+   if(free < uring->batch && free < uring->slots_num) return;
+
+   while(offset < p_ctx->size && (index = io_file_uring_slot(module, false)) >= 0)
+   {
+      slot = &uring->slots[index];
+      slot->write = slot->stale = false;
+      slot->offset = offset;
+      slot->size = MIN(IO_URING_SLOT_SIZE, p_ctx->size - offset);
+      io_file_uring_queue(module, index);
+      offset += slot->size;
+   }
+   if(uring->to_submit) io_file_uring_enter(uring, 0);
+}
+
+/*****************************************************************************/
+static void io_file_uring_drop( VC_CONTAINER_IO_MODULE_T *module )
+{
+   IO_URING_T *uring = module->uring;
+   unsigned int i;
+
+   /* Drop what was read ahead for the previous position */
+   for(i = 0; i < uring->slots_num; i++)
+   {
+      IO_URING_SLOT_T *slot = &uring->slots[i];
+      if(slot->write) continue;
+      if(slot->state == IO_URING_SLOT_DONE) slot->state = IO_URING_SLOT_FREE;
+      else if(slot->state == IO_URING_SLOT_PENDING) slot->stale = true;
+   }
+}
+
+/*****************************************************************************/
+static size_t io_file_uring_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   int64_t position = module->position;
+   IO_URING_SLOT_T *slot;
+   size_t bytes = 0, available;
+   bool streaming = false;
+   ssize_t ret;
+
+   /* Data being written needs to land before it can be read back */
+   if(module->write_mode)
+      io_file_uring_sync(module);
+
+   /* A read following the previous one (re)starts the read-ahead once it is done */
+   else if(io_file_uring_find(module, position))
+      streaming = true;
+   else if(position < p_ctx->size &&
+           (position == module->stream_end || position == module->direct_end) &&
+           io_file_uring_get(module))
+   {
+      io_file_uring_drop(module);
+      streaming = true;
+   }
+
+   while(bytes < size && (slot = io_file_uring_find(module, position)))
+   {
+      if(slot->state == IO_URING_SLOT_PENDING) io_file_uring_wait(module, slot);
+      if(slot->state != IO_URING_SLOT_DONE) break;
+
+      available = 0;
+      if(slot->result > position - slot->offset)
+         available = slot->result - (position - slot->offset);
+      if(!available) { slot->state = IO_URING_SLOT_FREE; break; }
+
+      available = MIN(available, size - bytes);
+      memcpy((uint8_t *)buffer + bytes, (uint8_t *)slot->iov.iov_base + (position - slot->offset), available);
+      bytes += available;
+      position += available;
+      if(position >= slot->offset + slot->result) slot->state = IO_URING_SLOT_FREE;
+   }
+
+   /* Whatever the read-ahead doesn't have is read directly, which saves copying
+    * big reads through the slots */
+   if(bytes < size)
+   {
+      ret = pread(module->fd, (uint8_t *)buffer + bytes, size - bytes, position);
+      if(ret < 0) p_ctx->status = VC_CONTAINER_ERROR_FAILED;
+      else if((size_t)ret < size - bytes) p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      if(ret > 0) { bytes += ret; position += ret; }
+      module->direct_end = position;
+   }
+
+   /* And the read-ahead carries on from where the reader is now */
+   module->position = position;
+   if(streaming)
+   {
+      module->stream_end = position;
+      io_file_uring_prefetch(p_ctx);
+   }
+   return bytes;
+}
+
+/*****************************************************************************/
+static size_t io_file_uring_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_URING_T *uring = io_file_uring_get(module);
+   size_t written = 0, bytes;
+   IO_URING_SLOT_T *slot;
+   ssize_t ret;
+   int index;
+
+   if(module->write_failed) return 0;
+
+   if(!uring)
+   {
+      ret = pwrite(module->fd, buffer, size, module->position);
+      if(ret < 0) return 0;
+      module->position += ret;
+      return ret;
+   }
+
+   /* Gather the data in the slots and write it behind the writer */
+   while(written < size)
+   {
+      index = uring->filling;
+      if(index >= 0 && uring->slots[index].offset + (int64_t)uring->slots[index].size != module->position)
+      {
+         io_file_uring_queue_write(module, index);
+         index = -1;
+      }
+      if(index < 0)
+      {
+         index = io_file_uring_slot(module, true);
+         if(index < 0) break;
+         slot = &uring->slots[index];
+         slot->state = IO_URING_SLOT_FILLING;
+         slot->write = true;
+         slot->stale = false;
+         slot->offset = module->position;
+         slot->size = 0;
+         uring->filling = index;
+      }
+
+      slot = &uring->slots[index];
+      bytes = MIN(size - written, IO_URING_SLOT_SIZE - slot->size);
+      memcpy((uint8_t *)slot->iov.iov_base + slot->size, (const uint8_t *)buffer + written, bytes);
+      slot->size += bytes;
+      written += bytes;
+      module->position += bytes;
+      if(slot->size == IO_URING_SLOT_SIZE) io_file_uring_queue_write(module, index);
+   }
+
+   /* Full slots go to the kernel in batches */
+   if(uring->to_submit >= uring->batch) io_file_uring_enter(uring, 0);
+   io_file_uring_reap(module);
+   return module->write_failed ? 0 : written;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_file_uring_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   if(offset < 0)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      return p_ctx->status;
+   }
+
+   p_ctx->module->position = offset;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   return VC_CONTAINER_SUCCESS;
+}
+#endif
+
+#ifdef ENABLE_CONTAINER_IO_DIRECT
+/*****************************************************************************
+ * O_DIRECT write mode.
+ *****************************************************************************/
+
+/*****************************************************************************/
+static bool io_file_direct_fallback( VC_CONTAINER_IO_MODULE_T *module )
+{
+   int flags = fcntl(module->direct_fd, F_GETFL);
+
+   /* Some filesystems take the flag but then fail the transfers. We carry on
+    * through the page cache with them. */
+   if(flags < 0 || !(flags & O_DIRECT)) return false;
+   return !fcntl(module->direct_fd, F_SETFL, flags & ~O_DIRECT);
+}
+
+/*****************************************************************************/
+static ssize_t io_file_direct_pread( VC_CONTAINER_IO_MODULE_T *module, uint8_t *mem,
+   size_t size, int64_t offset )
+{
+   ssize_t ret;
+
+   do {
+      ret = pread(module->direct_fd, mem, size, offset);
+   } while(ret < 0 && (errno == EINTR || (errno == EINVAL && io_file_direct_fallback(module))));
+   return ret;
+}
+
+/*****************************************************************************/
+static size_t io_file_direct_pwrite( VC_CONTAINER_IO_MODULE_T *module, const uint8_t *mem,
+   size_t size, int64_t offset )
+{
+   size_t written = 0;
+   ssize_t ret;
+
+   /* Reserve the space ahead of the data */
+   if(module->preallocate && offset + (int64_t)size > module->allocated)
+   {
+      int64_t end = offset + size + module->preallocate;
+      if(fallocate(module->direct_fd, FALLOC_FL_KEEP_SIZE, module->allocated,
+                   end - module->allocated))
+         module->preallocate = 0; /* Not supported by the filesystem */
+      else
+         module->allocated = end;
+   }
+
+   while(written < size)
+   {
+      ret = pwrite(module->direct_fd, mem + written, size - written, offset + written);
+      if(ret < 0 && (errno == EINTR || (errno == EINVAL && io_file_direct_fallback(module))))
+         continue;
+      if(ret <= 0) break;
+      written += ret;
+   }
+   return written;
+}
+
+/*****************************************************************************/
+static bool io_file_direct_load( VC_CONTAINER_IO_MODULE_T *module, int64_t offset )
+{
+   ssize_t ret = 0;
+
+   if(module->direct_block_offset == offset) return true;
+   module->direct_block_offset = -1;
+
+   if(offset < module->direct_size)
+   {
+      ret = io_file_direct_pread(module, module->direct_block, IO_FILE_DIRECT_ALIGNMENT, offset);
+      if(ret < 0) return false;
+      ret = MIN(ret, module->direct_size - offset);
+   }
+
+   /* Past the end of the data is only padding */
+   memset(module->direct_block + ret, 0, IO_FILE_DIRECT_ALIGNMENT - ret);
+   module->direct_block_offset = offset;
+   return true;
+}
+
+/*****************************************************************************/
+static size_t io_file_direct_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   int64_t offset = module->direct_position, start;
+   size_t bytes = 0, wanted = size, shift, length;
+   ssize_t ret;
+
+   /* Anything past the data is padding */
+   if(offset >= module->direct_size) size = 0;
+   else size = MIN((int64_t)size, module->direct_size - offset);
+
+   while(bytes < size)
+   {
+      shift = offset & (IO_FILE_DIRECT_ALIGNMENT - 1);
+      start = offset - shift;
+      if(start == module->direct_block_offset)
+      {
+         length = MIN(size - bytes, IO_FILE_DIRECT_ALIGNMENT - shift);
+         memcpy((uint8_t *)buffer + bytes, module->direct_block + shift, length);
+      }
+      else
+      {
+         length = (shift + size - bytes + IO_FILE_DIRECT_ALIGNMENT - 1) & ~(IO_FILE_DIRECT_ALIGNMENT - 1);
+         ret = io_file_direct_pread(module, module->direct_mem,
+                                    MIN(length, IO_FILE_DIRECT_BOUNCE_SIZE), start);
+         if(ret <= (ssize_t)shift) break;
+         length = MIN(size - bytes, ret - shift);
+         memcpy((uint8_t *)buffer + bytes, module->direct_mem + shift, length);
+      }
+      bytes += length;
+      offset += length;
+   }
+
+   if(bytes < wanted)
+      p_ctx->status = bytes < size ? VC_CONTAINER_ERROR_FAILED : VC_CONTAINER_ERROR_EOS;
+   module->direct_position = offset;
+   return bytes;
+}
+
+/*****************************************************************************/
+static size_t io_file_direct_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   int64_t offset = module->direct_position, start;
+   const uint8_t *data;
+   size_t written = 0, bytes, shift;
+
+   while(written < size)
+   {
+      data = (const uint8_t *)buffer + written;
+      bytes = size - written;
+      shift = offset & (IO_FILE_DIRECT_ALIGNMENT - 1);
+
+      if(shift || bytes < IO_FILE_DIRECT_ALIGNMENT)
+      {
+         /* Partial block, merged with what the file already has */
+         start = offset - shift;
+         bytes = MIN(bytes, IO_FILE_DIRECT_ALIGNMENT - shift);
+         if(!io_file_direct_load(module, start)) break;
+         memcpy(module->direct_block + shift, data, bytes);
+         if(io_file_direct_pwrite(module, module->direct_block, IO_FILE_DIRECT_ALIGNMENT, start) !=
+            IO_FILE_DIRECT_ALIGNMENT)
+         {
+            module->direct_block_offset = -1;
+            break;
+         }
+      }
+      else
+      {
+         /* Whole blocks, written straight from the caller's memory if it is aligned */
+         bytes &= ~(size_t)(IO_FILE_DIRECT_ALIGNMENT - 1);
+         if((uintptr_t)data & (IO_FILE_DIRECT_ALIGNMENT - 1))
+         {
+            bytes = MIN(bytes, IO_FILE_DIRECT_BOUNCE_SIZE);
+            memcpy(module->direct_mem, data, bytes);
+            data = module->direct_mem;
+         }
+         if(module->direct_block_offset >= offset &&
+            module->direct_block_offset < offset + (int64_t)bytes)
+            module->direct_block_offset = -1;
+         if(io_file_direct_pwrite(module, data, bytes, offset) != bytes) break;
+      }
+
+      written += bytes;
+      offset += bytes;
+      module->direct_size = MAX(module->direct_size, offset);
+   }
+
+   module->direct_position = offset;
+   return written;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_file_direct_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   if(offset < 0)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      return p_ctx->status;
+   }
+
+   p_ctx->module->direct_position = offset;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static void io_file_direct_open( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   const char *value;
+   void *mem;
+   int flags;
+
+   /* Stays a normal file if the filesystem doesn't do O_DIRECT */
+   module->direct_fd = fileno(module->stream);
+   flags = fcntl(module->direct_fd, F_GETFL);
+   if(flags < 0 || posix_memalign(&mem, IO_FILE_DIRECT_ALIGNMENT,
+                                  IO_FILE_DIRECT_BOUNCE_SIZE + IO_FILE_DIRECT_ALIGNMENT))
+      return;
+   if(fcntl(module->direct_fd, F_SETFL, flags | O_DIRECT))
+   {
+      free(mem);
+      return;
+   }
+
+   module->direct = true;
+   module->direct_mem = mem;
+   module->direct_block = module->direct_mem + IO_FILE_DIRECT_BOUNCE_SIZE;
+   module->direct_block_offset = -1;
+   if(vc_uri_find_query(p_ctx->uri_parts, 0, "preallocate", &value))
+      module->preallocate = value && *value ? strtoll(value, 0, 0) : IO_FILE_DIRECT_DEFAULT_PREALLOCATE;
+
+   p_ctx->pf_read = io_file_direct_read;
+   p_ctx->pf_write = io_file_direct_write;
+   p_ctx->pf_seek = io_file_direct_seek;
+   p_ctx->pf_write_vector = 0;
+}
+#endif
+
 /*****************************************************************************/
 VC_CONTAINER_STATUS_T vc_container_io_file_open( VC_CONTAINER_IO_T *p_ctx,
    const char *unused, VC_CONTAINER_IO_MODE_T mode )
@@ -110,6 +975,9 @@ VC_CONTAINER_STATUS_T vc_container_io_file_open( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_MODULE_T *module = 0;
    const char *psz_mode = mode == VC_CONTAINER_IO_MODE_WRITE ? "wb+" : "rb";
    const char *uri = p_ctx->uri;
+#ifdef ENABLE_CONTAINER_IO_URING
+   const char *value;
+#endif
    FILE *stream = 0;
    VC_CONTAINER_PARAM_UNUSED(unused);
 
@@ -132,20 +1000,52 @@ VC_CONTAINER_STATUS_T vc_container_io_file_open( VC_CONTAINER_IO_T *p_ctx,
    p_ctx->pf_read = io_file_read;
    p_ctx->pf_write = io_file_write;
    p_ctx->pf_seek = io_file_seek;
+#ifdef ENABLE_CONTAINER_IO_WRITEV
+   p_ctx->pf_write_vector = io_file_write_vector;
+#endif
+
+#ifdef ENABLE_CONTAINER_IO_URING
+   if(vc_uri_find_query(p_ctx->uri_parts, 0, "uring", &value))
+   {
+      module->uring_slots = value && *value ? strtoul(value, 0, 0) : IO_URING_DEFAULT_SLOTS;
+      module->uring_slots = MIN(module->uring_slots, IO_URING_MAX_SLOTS);
+   }
+   if(module->uring_slots)
+   {
+      module->fd = fileno(stream);
+      module->write_mode = mode == VC_CONTAINER_IO_MODE_WRITE;
+      module->stream_end = module->direct_end = -1;
+      p_ctx->pf_read = io_file_uring_read;
+      p_ctx->pf_write = io_file_uring_write;
+      p_ctx->pf_seek = io_file_uring_seek;
+      p_ctx->pf_write_vector = 0;
+   }
+#endif
+
+#ifdef ENABLE_CONTAINER_IO_DIRECT
+   /* Takes over from the io_uring backend */
+   if(mode == VC_CONTAINER_IO_MODE_WRITE && vc_uri_find_query(p_ctx->uri_parts, 0, "direct", 0))
+      io_file_direct_open(p_ctx);
+#endif
 
    if(mode == VC_CONTAINER_IO_MODE_WRITE)
    {
-      p_ctx->max_size = (1UL<<31)-1; /* For now limit to 2GB */
+#if !defined(_VIDEOCORE) && !defined(_MSC_VER)
+      /* Without large file support we can't go past 2GB */
+      if(sizeof(off_t) < sizeof(int64_t)) p_ctx->max_size = LONG_MAX;
+#endif
    }
    else
    {
-      //FIXME: large file support, platform-specific file size
-      fseek(p_ctx->module->stream, 0, SEEK_END);
-      p_ctx->size = ftell(p_ctx->module->stream);
-      fseek(p_ctx->module->stream, 0, SEEK_SET);
+      IO_FILE_SEEK(p_ctx->module->stream, 0, SEEK_END);
+      p_ctx->size = IO_FILE_TELL(p_ctx->module->stream);
+      IO_FILE_SEEK(p_ctx->module->stream, 0, SEEK_SET);
    }
 
    p_ctx->capabilities = VC_CONTAINER_IO_CAPS_NO_CACHING;
+#ifdef ENABLE_CONTAINER_IO_DIRECT
+   if(module->direct) p_ctx->capabilities |= VC_CONTAINER_IO_CAPS_DIRECT;
+#endif
    return VC_CONTAINER_SUCCESS;
 
  error:
@@ -29,6 +29,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 
 #include "containers.h"
 #include "core/containers_common.h"
@@ -55,6 +60,35 @@ Defines and constants.
  * to allow for the headers that may be sent. */
 #define HTTP_URI_LENGTH_MAX            1024
 
+/** Forward seeks within the response being streamed up to this distance read through
+ * the data instead of sending a new request */
+#define HTTP_STREAM_SKIP_MAX           (64*1024)
+
+/** When a seek leaves the response being streamed, the rest of the response is
+ * drained if it is this small, so the persistent connection can be reused */
+#define HTTP_STREAM_DRAIN_MAX          (64*1024)
+
+/** Maximum number of connections data can be fetched over in parallel */
+#define HTTP_CONNECTIONS_MAX           16
+
+/** Default size of the ranges fetched over each of the parallel connections */
+#define HTTP_CHUNK_SIZE_DEFAULT        (1024*1024)
+
+/** End of the content of a response whose length isn't known in advance */
+#define HTTP_STREAM_END_UNKNOWN        INT64_MAX
+
+/** Interval at which a live file that has stopped growing is polled */
+#define HTTP_LIVE_POLL_MS              100
+
+/** Default time after which a live file that has stopped growing is considered complete */
+#define HTTP_LIVE_TIMEOUT_MS_DEFAULT   10000
+
+/** Default size limit of the disk cache directory */
+#define HTTP_DISK_CACHE_SIZE_DEFAULT   (INT64_C(256)*1024*1024)
+
+/** Largest validator (ETag or Last-Modified) of a file kept for the disk cache */
+#define HTTP_VALIDATOR_LENGTH_MAX      256
+
 /** Initial capacity of header list */
 #define HEADER_LIST_INITIAL_CAPACITY   16
 
@@ -64,6 +98,9 @@ Defines and constants.
 /** Format of a range request */
 #define HTTP_RANGE_REQUEST             "Range: bytes=%"PRId64"-%"PRId64"\r\n"
 
+/** Format of a request for everything from an offset on */
+#define HTTP_RANGE_REQUEST_OPEN        "Range: bytes=%"PRId64"-\r\n"
+
 /** Format string for common headers used with all request methods.
  * Note: includes double new line to terminate headers */
 #define TRAILING_HEADERS_FORMAT        "User-Agent: Broadcom/1.0\r\n\r\n"
@@ -81,6 +118,9 @@ Defines and constants.
 #define CONTENT_LOCATION_NAME          "Content-Location"
 #define ACCEPT_RANGES_NAME             "Accept-Ranges"
 #define CONNECTION_NAME                "Connection"
+#define TRANSFER_ENCODING_NAME         "Transfer-Encoding"
+#define ETAG_NAME                      "ETag"
+#define LAST_MODIFIED_NAME             "Last-Modified"
 /* @} */
 
 /** Supported HTTP major version number */
@@ -91,6 +131,7 @@ Defines and constants.
 /** Lowest successful status code value */
 #define HTTP_STATUS_OK                 200
 #define HTTP_STATUS_PARTIAL_CONTENT    206
+#define HTTP_STATUS_RANGE_NOT_SATISFIABLE 416
 
 typedef struct http_header_tag {
    const char *name;
@@ -101,14 +142,53 @@ typedef struct http_header_tag {
 /******************************************************************************
 Type definitions
 ******************************************************************************/
-typedef struct VC_CONTAINER_IO_MODULE_T
+/** State of a connection to the server */
+typedef struct IO_HTTP_CONNECTION_T
 {
    VC_CONTAINER_NET_T *sock;
+
+   /* Request whose response hasn't been read yet, request_offset == request_end if none */
+   int64_t request_offset;                      /**< Offset of the first byte requested */
+   int64_t request_end;                         /**< Offset following the last byte requested */
+
+   /* Response whose content is being streamed, stream_offset == stream_end if none */
+   int64_t stream_offset;                       /**< Offset of the next byte of content */
+   int64_t stream_end;                          /**< Offset following the last byte of content */
+
+   bool chunked;                                /**< Content uses the chunked transfer encoding */
+   int64_t chunk_left;                          /**< Bytes left in the current chunk of content */
+} IO_HTTP_CONNECTION_T;
+
+typedef struct VC_CONTAINER_IO_HTTP_CACHE_T VC_CONTAINER_IO_HTTP_CACHE_T;
+
+typedef struct VC_CONTAINER_IO_MODULE_T
+{
+   VC_CONTAINER_NET_T *sock;                    /**< Socket of the connection in use */
    VC_CONTAINERS_LIST_T *header_list;           /**< Parsed response headers, pointing into comms buffer */
 
    bool persistent;
    int64_t cur_offset;
    bool reconnecting;
+   unsigned int status_code;                    /**< Status code of the last response */
+
+   /* Live sources have no known length (e.g. a live stream or a file still being
+    * recorded). They are read sequentially, their size growing as data arrives. */
+   bool live;
+   bool ranges;                                 /**< Server accepts byte range requests */
+   uint32_t live_timeout_ms;                    /**< How long to wait for a live file to grow */
+
+   /* Connections ranges of the file are fetched over. The one in use is connections[connection],
+    * with its socket in sock. When there are several of them, consecutive chunks of the file
+    * are requested over each connection in turn so they all transfer data at the same time. */
+   IO_HTTP_CONNECTION_T connections[HTTP_CONNECTIONS_MAX];
+   unsigned int connections_num;
+   unsigned int connection;
+   uint32_t chunk_size;                         /**< Size of the ranges requested in parallel */
+   int64_t next_offset;                         /**< Offset of the next range to request */
+
+   /* Data fetched before, kept on disk for the same version of the file */
+   VC_CONTAINER_IO_HTTP_CACHE_T *cache;
+   char validator[HTTP_VALIDATOR_LENGTH_MAX];   /**< ETag or Last-Modified of the file, if any */
 
    /* Buffer used for sending and receiving HTTP messages */
    char comms_buffer[COMMS_BUFFER_SIZE];
@@ -124,6 +204,19 @@ static VC_CONTAINER_STATUS_T io_http_send(VC_CONTAINER_IO_T *p_ctx);
 VC_CONTAINER_STATUS_T vc_container_io_http_open(VC_CONTAINER_IO_T *, const char *,
    VC_CONTAINER_IO_MODE_T);
 
+#ifdef ENABLE_CONTAINER_IO_HTTP_CACHE
+VC_CONTAINER_IO_HTTP_CACHE_T *vc_container_io_http_cache_open(const char *directory,
+   int64_t budget, const char *url, const char *validator, int64_t size);
+void vc_container_io_http_cache_close(VC_CONTAINER_IO_HTTP_CACHE_T *cache);
+size_t vc_container_io_http_cache_read(VC_CONTAINER_IO_HTTP_CACHE_T *cache,
+   int64_t offset, void *buffer, size_t size);
+size_t vc_container_io_http_cache_missing(VC_CONTAINER_IO_HTTP_CACHE_T *cache,
+   int64_t offset, size_t size);
+size_t vc_container_io_http_cache_gap(VC_CONTAINER_IO_HTTP_CACHE_T *cache, int64_t offset);
+void vc_container_io_http_cache_write(VC_CONTAINER_IO_HTTP_CACHE_T *cache,
+   int64_t offset, const void *buffer, size_t size);
+#endif
+
 /******************************************************************************
 Local Functions
 ******************************************************************************/
@@ -173,15 +266,19 @@ static int io_http_header_comparator(const HTTP_HEADER_T *first, const HTTP_HEAD
  *    - Unsupported version
  *    - Status code is not in the 2xx range
  *
+ * A request for a range starting past the end of the file is also accepted, since
+ * live files may not have grown that far yet.
+ *
  * @param status_line   The response status line.
+ * @param status_code   Where to store the status code of the response.
  * @return  The resulting status of the function.
  */
-static bool io_http_successful_response_status(const char *status_line)
+static bool io_http_successful_response_status(const char *status_line, unsigned int *status_code)
 {
-   unsigned int major_version, minor_version, status_code;
+   unsigned int major_version, minor_version;
 
    /* coverity[secure_coding] String is null-terminated */
-   if (sscanf(status_line, "HTTP/%u.%u %u", &major_version, &minor_version, &status_code) != 3)
+   if (sscanf(status_line, "HTTP/%u.%u %u", &major_version, &minor_version, status_code) != 3)
    {
       LOG_ERROR(NULL, "HTTP: Invalid response status line:\n%s", status_line);
       return false;
@@ -193,7 +290,8 @@ static bool io_http_successful_response_status(const char *status_line)
       return false;
    }
 
-   if (status_code != HTTP_STATUS_OK && status_code != HTTP_STATUS_PARTIAL_CONTENT)
+   if (*status_code != HTTP_STATUS_OK && *status_code != HTTP_STATUS_PARTIAL_CONTENT &&
+       *status_code != HTTP_STATUS_RANGE_NOT_SATISFIABLE)
    {
       LOG_ERROR(NULL, "HTTP: Response status unsuccessful:\n%s", status_line);
       return false;
@@ -203,27 +301,55 @@ static bool io_http_successful_response_status(const char *status_line)
 }
 
 /**************************************************************************//**
- * Get the content length header from the response headers as an unsigned
+ * Get the content length header from the response headers as a signed
  * 64-bit integer.
- * If the content length header is not found or badly formatted, zero is
+ * If the content length header is not found or badly formatted, -1 is
  * returned.
  *
  * @param header_list   The response headers.
  * @return  The content length.
  */
-static uint64_t io_http_get_content_length(VC_CONTAINERS_LIST_T *header_list)
+static int64_t io_http_get_content_length(VC_CONTAINERS_LIST_T *header_list)
 {
-   uint64_t content_length = 0;
+   int64_t content_length = -1;
    HTTP_HEADER_T header;
 
    header.name = CONTENT_LENGTH_NAME;
    if (header_list && vc_containers_list_find_entry(header_list, &header))
+   {
       /* coverity[secure_coding] String is null-terminated */
-      sscanf(header.value, "%"PRIu64, &content_length);
+      if (sscanf(header.value, "%"SCNd64, &content_length) != 1 || content_length < 0)
+         content_length = -1;
+   }
 
    return content_length;
 }
 
+/**************************************************************************//**
+ * Check whether the content of the response uses the chunked transfer encoding.
+ *
+ * @param header_list   The response headers.
+ * @return  The resulting status of the function.
+ */
+static bool io_http_check_chunked(VC_CONTAINERS_LIST_T *header_list)
+{
+   HTTP_HEADER_T header;
+
+   header.name = TRANSFER_ENCODING_NAME;
+   if (header_list && vc_containers_list_find_entry(header_list, &header))
+   {
+      /* Chunked is always the last encoding applied */
+      const char *encoding = strrchr(header.value, ',');
+      encoding = encoding ? encoding + 1 : header.value;
+      while (*encoding == ' ' || *encoding == '\t')
+         encoding++;
+      if (!strcasecmp(encoding, "chunked"))
+         return true;
+   }
+
+   return false;
+}
+
 /**************************************************************************//**
  * Get the accept ranges header from the response headers and verify that
  * the server accepts byte ranges..
@@ -268,6 +394,36 @@ static bool io_http_check_persistent_connection(VC_CONTAINERS_LIST_T *header_lis
    return true;
 }
 
+/**************************************************************************//**
+ * Get what identifies the version of the file from the response headers.
+ * A strong ETag is used if there is one, otherwise the last modification date.
+ * Weak ETags don't guarantee the content is the same byte for byte.
+ *
+ * @param header_list   The response headers.
+ * @param validator     Where to store the validator, empty if there is none.
+ * @param size          Size of the validator buffer.
+ */
+static void io_http_get_validator(VC_CONTAINERS_LIST_T *header_list, char *validator, size_t size)
+{
+   HTTP_HEADER_T header;
+
+   validator[0] = '\0';
+   if (!header_list)
+      return;
+
+   header.name = ETAG_NAME;
+   if (vc_containers_list_find_entry(header_list, &header) && strncmp(header.value, "W/", 2) &&
+       strlen(header.value) < size)
+   {
+      snprintf(validator, size, "%s", header.value);
+      return;
+   }
+
+   header.name = LAST_MODIFIED_NAME;
+   if (vc_containers_list_find_entry(header_list, &header) && strlen(header.value) < size)
+      snprintf(validator, size, "%s", header.value);
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T translate_net_status_to_container_status(vc_container_net_status_t net_status)
 {
@@ -452,7 +608,7 @@ static VC_CONTAINER_STATUS_T io_http_read_response(VC_CONTAINER_IO_T *p_ctx)
                      }
                   } else {
                      /* Check response status line */
-                     if (!io_http_successful_response_status(header.value))
+                     if (!io_http_successful_response_status(header.value, &module->status_code))
                         return VC_CONTAINER_ERROR_FORMAT_INVALID;
                   }
                   /* Ready for next header */
@@ -491,26 +647,112 @@ static VC_CONTAINER_STATUS_T io_http_read_response(VC_CONTAINER_IO_T *p_ctx)
 }
 
 /**************************************************************************//**
- * Send a GET request to the HTTP server.
+ * Read a line of a chunked response, without its line ending.
+ *
+ * @param p_ctx   The HTTP reader context.
+ * @param line    Where to store the line.
+ * @param size    Size of the line buffer.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_read_line(VC_CONTAINER_IO_T *p_ctx, char *line, size_t size)
+{
+   size_t length = 0;
+   char c;
+
+   while (io_http_read_from_net(p_ctx, &c, 1) == 1 && c != '\n')
+   {
+      if (length < size - 1 && c != '\r')
+         line[length++] = c;
+   }
+   line[length] = '\0';
+
+   return p_ctx->status;
+}
+
+/**************************************************************************//**
+ * Read the size of the next chunk of a chunked response.
+ * When this is the last chunk, the trailers following it are skipped and the
+ * content of the response ends there.
+ *
+ * @param p_ctx   The HTTP reader context.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_read_chunk_size(VC_CONTAINER_IO_T *p_ctx)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_HTTP_CONNECTION_T *conn = &module->connections[module->connection];
+   char *line = module->comms_buffer;
+   int64_t chunk_size;
+
+   /* Skip the line ending that follows the data of the previous chunk */
+   do {
+      if (io_http_read_line(p_ctx, line, sizeof(module->comms_buffer)) != VC_CONTAINER_SUCCESS)
+         return p_ctx->status;
+   } while (!*line);
+
+   /* coverity[secure_coding] String is null-terminated */
+   if (sscanf(line, "%"SCNx64, &chunk_size) != 1 || chunk_size < 0)
+   {
+      LOG_ERROR(NULL, "HTTP: Invalid chunk size line:\n%s", line);
+      p_ctx->status = VC_CONTAINER_ERROR_CORRUPTED;
+      return p_ctx->status;
+   }
+
+   if (!chunk_size)
+   {
+      /* Last chunk, only trailers up to an empty line are left */
+      do {
+         if (io_http_read_line(p_ctx, line, sizeof(module->comms_buffer)) != VC_CONTAINER_SUCCESS)
+            return p_ctx->status;
+      } while (*line);
+
+      conn->chunked = false;
+      conn->stream_end = conn->stream_offset;
+   }
+
+   conn->chunk_left = chunk_size;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/**************************************************************************//**
+ * Wait for a while, giving a live file time to grow.
+ *
+ * @param time_ms    Time to wait for in milliseconds.
+ */
+static void io_http_sleep(uint32_t time_ms)
+{
+#ifdef WIN32
+   Sleep(time_ms);
+#else
+   struct timespec ts;
+   ts.tv_sec = time_ms / 1000;
+   ts.tv_nsec = (long)(time_ms % 1000) * 1000000;
+   nanosleep(&ts, NULL);
+#endif
+}
+
+/**************************************************************************//**
+ * Send a GET request to the HTTP server for a range of the file.
+ * If the server doesn't accept range requests, the whole file is requested.
  *
  * @param p_ctx      The reader context.
+ * @param offset     Offset of the first byte requested.
+ * @param end_offset Offset following the last byte requested, HTTP_STREAM_END_UNKNOWN
+ *                   for everything from the offset on.
  * @return  The resulting status of the function.
  */
-static VC_CONTAINER_STATUS_T io_http_send_get_request(VC_CONTAINER_IO_T *p_ctx, size_t size)
+static VC_CONTAINER_STATUS_T io_http_send_get_request(VC_CONTAINER_IO_T *p_ctx, int64_t offset, int64_t end_offset)
 {
    VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
    char *ptr = module->comms_buffer, *end = ptr + sizeof(module->comms_buffer);
-   int64_t end_offset;
 
    ptr += snprintf(ptr, end - ptr, HTTP_REQUEST_LINE_FORMAT, GET_METHOD,
                    vc_uri_path(p_ctx->uri_parts), vc_uri_host(p_ctx->uri_parts));
 
-   end_offset = module->cur_offset + size - 1;
-   if (end_offset >= p_ctx->size)
-      end_offset = p_ctx->size - 1;
-
-   if (ptr < end)
-      ptr += snprintf(ptr, end - ptr, HTTP_RANGE_REQUEST, module->cur_offset, end_offset);
+   if (ptr < end && module->ranges && end_offset == HTTP_STREAM_END_UNKNOWN)
+      ptr += snprintf(ptr, end - ptr, HTTP_RANGE_REQUEST_OPEN, offset);
+   else if (ptr < end && module->ranges)
+      ptr += snprintf(ptr, end - ptr, HTTP_RANGE_REQUEST, offset, end_offset - 1);
 
    if (ptr < end)
       ptr += snprintf(ptr, end - ptr, TRAILING_HEADERS_FORMAT);
@@ -527,6 +769,328 @@ static VC_CONTAINER_STATUS_T io_http_send_get_request(VC_CONTAINER_IO_T *p_ctx,
    return io_http_send(p_ctx);
 }
 
+/**************************************************************************//**
+ * Read content of the response being streamed.
+ * Live sources return as soon as some data has arrived.
+ *
+ * @param p_ctx      The reader context.
+ * @param buffer     Where to store the data, NULL to discard it.
+ * @param size       The amount of data to read.
+ * @return  The amount of data read.
+ */
+static size_t io_http_stream_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_HTTP_CONNECTION_T *conn = &module->connections[module->connection];
+   size_t bytes_read = 0, ret, chunk;
+   char *ptr = buffer;
+
+   if ((int64_t)size > conn->stream_end - conn->stream_offset)
+      size = (size_t)(conn->stream_end - conn->stream_offset);
+
+   while (bytes_read < size && p_ctx->status == VC_CONTAINER_SUCCESS)
+   {
+      /* Chunked content comes in pieces, each preceded by its size */
+      if (conn->chunked && !conn->chunk_left &&
+          (io_http_read_chunk_size(p_ctx) != VC_CONTAINER_SUCCESS || !conn->chunk_left))
+         break;
+
+      chunk = size - bytes_read;
+      if (!buffer && chunk > sizeof(module->comms_buffer))
+         chunk = sizeof(module->comms_buffer);
+      if (conn->chunked && (int64_t)chunk > conn->chunk_left)
+         chunk = (size_t)conn->chunk_left;
+
+      ret = io_http_read_from_net(p_ctx, buffer ? ptr : module->comms_buffer, chunk);
+      if (p_ctx->status == VC_CONTAINER_SUCCESS)
+      {
+         bytes_read += ret;
+         conn->stream_offset += ret;
+         if (conn->chunked) conn->chunk_left -= ret;
+         if (buffer) ptr += ret;
+         if (module->live && buffer) break;
+      }
+   }
+
+   /* All the content requested is there, but the last chunk still needs reading
+    * before the connection can be used again */
+   if (conn->chunked && !conn->chunk_left && conn->stream_offset == conn->stream_end &&
+       p_ctx->status == VC_CONTAINER_SUCCESS &&
+       io_http_read_chunk_size(p_ctx) == VC_CONTAINER_SUCCESS && conn->chunked)
+   {
+      LOG_ERROR(NULL, "HTTP: received more data than requested");
+      p_ctx->status = VC_CONTAINER_ERROR_CORRUPTED;
+   }
+
+   return bytes_read;
+}
+
+/**************************************************************************//**
+ * Make another connection the one in use.
+ *
+ * @param p_ctx      The reader context.
+ * @param connection Index of the connection to use.
+ */
+static void io_http_connection_select(VC_CONTAINER_IO_T *p_ctx, unsigned int connection)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_HTTP_CONNECTION_T *current = &module->connections[module->connection];
+
+   current->sock = module->sock;
+   module->connection = connection;
+   module->sock = module->connections[connection].sock;
+}
+
+/**************************************************************************//**
+ * Stop streaming the response of the connection in use, dropping any request
+ * whose response hasn't been read yet.
+ * The connection is kept if the end of the response is close enough to be drained,
+ * otherwise it is closed since the rest of the response would have to be read anyway.
+ *
+ * @param p_ctx      The reader context.
+ */
+static void io_http_stream_stop(VC_CONTAINER_IO_T *p_ctx)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_HTTP_CONNECTION_T *conn = &module->connections[module->connection];
+
+   if (module->persistent && conn->request_offset == conn->request_end &&
+       conn->stream_end - conn->stream_offset <= HTTP_STREAM_DRAIN_MAX)
+      io_http_stream_read(p_ctx, NULL, (size_t)(conn->stream_end - conn->stream_offset));
+
+   if (!module->persistent || conn->stream_offset != conn->stream_end ||
+       conn->request_offset != conn->request_end || p_ctx->status != VC_CONTAINER_SUCCESS)
+      io_http_close_socket(module);
+
+   conn->stream_offset = conn->stream_end = 0;
+   conn->request_offset = conn->request_end = 0;
+   conn->chunked = false;
+   conn->chunk_left = 0;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+}
+
+/**************************************************************************//**
+ * Request a range of the file over the connection in use.
+ * The response is read later on with io_http_stream_response.
+ *
+ * @param p_ctx      The reader context.
+ * @param offset     Offset of the first byte requested.
+ * @param end        Offset following the last byte requested.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_stream_request(VC_CONTAINER_IO_T *p_ctx, int64_t offset, int64_t end)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_HTTP_CONNECTION_T *conn = &module->connections[module->connection];
+   VC_CONTAINER_STATUS_T status;
+
+   if (!module->sock)
+   {
+      status = io_http_open_socket(p_ctx);
+      if (status != VC_CONTAINER_SUCCESS)
+      {
+         LOG_ERROR(NULL, "Error opening socket for GET request");
+         return status;
+      }
+   }
+
+   status = io_http_send_get_request(p_ctx, offset, end);
+   if (status != VC_CONTAINER_SUCCESS)
+   {
+      io_http_close_socket(module);
+      return status;
+   }
+
+   conn->request_offset = offset;
+   conn->request_end = end;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/**************************************************************************//**
+ * Read the response to the request sent over the connection in use and start
+ * streaming its content.
+ *
+ * @param p_ctx      The reader context.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_stream_response(VC_CONTAINER_IO_T *p_ctx)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_HTTP_CONNECTION_T *conn = &module->connections[module->connection];
+   int64_t offset = conn->request_offset, end = conn->request_end;
+   VC_CONTAINER_STATUS_T status;
+   int64_t content_length;
+
+   status = io_http_read_response(p_ctx);
+   conn->request_offset = conn->request_end = 0;
+
+   /* The server may have closed the persistent connection while it was idle */
+   if (status == VC_CONTAINER_ERROR_EOS && !module->reconnecting)
+   {
+      LOG_DEBUG(NULL, "reconnecting");
+      io_http_close_socket(module);
+      p_ctx->status = VC_CONTAINER_SUCCESS;
+      module->reconnecting = true;
+      status = io_http_stream_request(p_ctx, offset, end);
+      if (status == VC_CONTAINER_SUCCESS)
+         status = io_http_stream_response(p_ctx);
+      module->reconnecting = false;
+      return status;
+   }
+   if (status != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "Error reading GET response");
+      io_http_close_socket(module);
+      return status;
+   }
+
+   /*
+    * How much data is the server offering us?
+    */
+
+   content_length = io_http_get_content_length(module->header_list);
+   conn->chunked = io_http_check_chunked(module->header_list);
+   conn->chunk_left = 0;
+   conn->stream_offset = conn->stream_end = offset;
+
+   /* Nothing past the end of the file, a live file may still grow though */
+   if (module->status_code == HTTP_STATUS_RANGE_NOT_SATISFIABLE)
+   {
+      if (content_length || conn->chunked)
+         io_http_close_socket(module);
+      conn->chunked = false;
+      return module->live ? VC_CONTAINER_SUCCESS : VC_CONTAINER_ERROR_EOS;
+   }
+
+   /* Chunked content or content ending with the connection is only bounded by
+    * what was requested */
+   if (conn->chunked || content_length < 0)
+   {
+      conn->stream_end = end;
+      return VC_CONTAINER_SUCCESS;
+   }
+
+   if (content_length > end - offset)
+   {
+      LOG_ERROR(NULL, "received too much data (%"PRId64"/%"PRId64")",
+                content_length, end - offset);
+      io_http_close_socket(module);
+      return VC_CONTAINER_ERROR_CORRUPTED;
+   }
+
+   conn->stream_end = offset + content_length;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/**************************************************************************//**
+ * Request the next chunk of the file over the connection in use, if the
+ * file is fetched over several connections.
+ *
+ * @param p_ctx      The reader context.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_request_next_chunk(VC_CONTAINER_IO_T *p_ctx)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   int64_t offset = module->next_offset;
+
+   if (offset >= p_ctx->size)
+      return VC_CONTAINER_SUCCESS;
+
+   module->next_offset += module->chunk_size;
+   if (module->next_offset > p_ctx->size)
+      module->next_offset = p_ctx->size;
+   return io_http_stream_request(p_ctx, offset, module->next_offset);
+}
+
+/**************************************************************************//**
+ * Start fetching the data from the current offset.
+ * With a single connection, the rest of the file is requested in one go.
+ * Otherwise consecutive chunks are requested over each of the connections.
+ *
+ * @param p_ctx      The reader context.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_stream_start(VC_CONTAINER_IO_T *p_ctx)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   unsigned int i;
+
+   if (module->connections_num <= 1)
+   {
+      status = io_http_stream_request(p_ctx, module->cur_offset, p_ctx->size);
+      if (status == VC_CONTAINER_SUCCESS)
+         status = io_http_stream_response(p_ctx);
+      return status;
+   }
+
+   module->next_offset = module->cur_offset;
+   for (i = 0; i < module->connections_num && status == VC_CONTAINER_SUCCESS; i++)
+   {
+      io_http_connection_select(p_ctx, i);
+      status = io_http_request_next_chunk(p_ctx);
+   }
+
+   io_http_connection_select(p_ctx, 0);
+   if (status == VC_CONTAINER_SUCCESS)
+      status = io_http_stream_response(p_ctx);
+   return status;
+}
+
+/**************************************************************************//**
+ * Stop fetching data over all the connections.
+ *
+ * @param p_ctx      The reader context.
+ */
+static void io_http_stream_stop_all(VC_CONTAINER_IO_T *p_ctx)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   unsigned int i;
+
+   for (i = 0; i < module->connections_num; i++)
+   {
+      io_http_connection_select(p_ctx, i);
+      io_http_stream_stop(p_ctx);
+   }
+   io_http_connection_select(p_ctx, 0);
+}
+
+/**************************************************************************//**
+ * Set the number of connections the file is fetched over.
+ *
+ * @param p_ctx       The reader context.
+ * @param connections Number of connections.
+ * @param chunk_size  Size of the ranges requested over each connection, 0 for the default.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_set_connections(VC_CONTAINER_IO_T *p_ctx,
+   unsigned int connections, uint32_t chunk_size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   unsigned int i;
+
+   if (connections > HTTP_CONNECTIONS_MAX)
+      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+
+   /* Live sources are read sequentially as the data arrives */
+   if (module->live)
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   /* Everything is requested again from the current offset on the next read */
+   io_http_stream_stop_all(p_ctx);
+   for (i = 1; i < module->connections_num; i++)
+   {
+      io_http_connection_select(p_ctx, i);
+      io_http_close_socket(module);
+   }
+   io_http_connection_select(p_ctx, 0);
+
+   module->connections_num = connections ? connections : 1;
+   module->chunk_size = chunk_size ? chunk_size : HTTP_CHUNK_SIZE_DEFAULT;
+   return VC_CONTAINER_SUCCESS;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T io_http_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
 {
@@ -552,13 +1116,22 @@ static VC_CONTAINER_STATUS_T io_http_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offs
 static VC_CONTAINER_STATUS_T io_http_close(VC_CONTAINER_IO_T *p_ctx)
 {
    VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   unsigned int i;
 
    if (!module)
       return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
 
-   io_http_close_socket(module);
+   for (i = 0; i < HTTP_CONNECTIONS_MAX; i++)
+   {
+      io_http_connection_select(p_ctx, i);
+      io_http_close_socket(module);
+   }
    if (module->header_list)
       vc_containers_list_destroy(module->header_list);
+#ifdef ENABLE_CONTAINER_IO_HTTP_CACHE
+   if (module->cache)
+      vc_container_io_http_cache_close(module->cache);
+#endif
 
    free(module);
    p_ctx->module = NULL;
@@ -567,103 +1140,238 @@ static VC_CONTAINER_STATUS_T io_http_close(VC_CONTAINER_IO_T *p_ctx)
 }
 
 /*****************************************************************************/
-static size_t io_http_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+static size_t io_http_read_part(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
-   size_t content_length;
-   size_t bytes_read;
-   size_t ret = 0;
-   char *ptr = buffer;
+   IO_HTTP_CONNECTION_T *conn = &module->connections[module->connection];
+   size_t ret;
 
    /*
-    * Are we at the end of the file?
+    * The data is read from responses covering the rest of the file (or consecutive
+    * chunks of it when using several connections), so sequential reads don't pay
+    * for a round trip each. New requests are only sent when a seek leaves these.
     */
 
-   if (module->cur_offset >= p_ctx->size)
-   {
-      p_ctx->status = VC_CONTAINER_ERROR_EOS;
-      return 0;
-   }
+   /* The response to the request the data comes from next is only read when needed */
+   if (conn->request_offset != conn->request_end && conn->request_offset == module->cur_offset)
+      status = io_http_stream_response(p_ctx);
 
-   if (!module->persistent)
+   /* Short forward seeks within the response being streamed read through the data */
+   if (status == VC_CONTAINER_SUCCESS && module->cur_offset > conn->stream_offset &&
+       module->cur_offset < conn->stream_end &&
+       module->cur_offset - conn->stream_offset <= HTTP_STREAM_SKIP_MAX)
+      io_http_stream_read(p_ctx, NULL, (size_t)(module->cur_offset - conn->stream_offset));
+
+   if (status != VC_CONTAINER_SUCCESS || p_ctx->status != VC_CONTAINER_SUCCESS ||
+       conn->stream_offset == conn->stream_end || conn->stream_offset != module->cur_offset)
    {
-      status = io_http_open_socket(p_ctx);
+      io_http_stream_stop_all(p_ctx);
+      status = io_http_stream_start(p_ctx);
       if (status != VC_CONTAINER_SUCCESS)
       {
-         LOG_ERROR(NULL, "Error opening socket for GET request");
-         return status;
+         io_http_stream_stop_all(p_ctx);
+         p_ctx->status = status;
+         return 0;
       }
+      conn = &module->connections[module->connection];
    }
 
-   /* Send GET request and get response */
-   status = io_http_send_get_request(p_ctx, size);
-   if (status != VC_CONTAINER_SUCCESS)
-   {
-      LOG_ERROR(NULL, "Error sending GET request");
-      goto error;
-   }
+   ret = io_http_stream_read(p_ctx, buffer, size);
+   module->cur_offset += ret;
 
-   status = io_http_read_response(p_ctx);
-   if (status == VC_CONTAINER_ERROR_EOS && !module->reconnecting)
+   /* Start again from where we are if the connection was lost */
+   if (p_ctx->status != VC_CONTAINER_SUCCESS)
    {
-      LOG_DEBUG(NULL, "reconnecting");
-      io_http_close_socket(module);
-      status = io_http_open_socket(p_ctx);
-      if (status == VC_CONTAINER_SUCCESS)
+      status = p_ctx->status;
+      io_http_stream_stop_all(p_ctx);
+      if (!ret && !module->reconnecting)
       {
+         LOG_DEBUG(NULL, "connection lost, restarting the stream");
          module->reconnecting = true;
-         status = io_http_read(p_ctx, buffer, size);
+         ret = io_http_read_part(p_ctx, buffer, size);
          module->reconnecting = false;
-         return status;
       }
-   }
-   if (status != VC_CONTAINER_SUCCESS)
-   {
-      LOG_ERROR(NULL, "Error reading GET response");
-      goto error;
+      else if (!ret)
+         p_ctx->status = status;
+      return ret;
    }
 
-   /*
-    * How much data is the server offering us?
-    */
+   if (conn->stream_offset != conn->stream_end)
+      return ret;
+
+   if (!module->persistent)
+      io_http_close_socket(module);
 
-   content_length = (size_t)io_http_get_content_length(module->header_list);
-   if (content_length > size)
+   /* Keep the connection busy with the next chunk and move on to the one
+    * the following data comes from. If the request can't be sent, everything
+    * will be requested again when getting there. */
+   if (module->connections_num > 1)
    {
-      LOG_ERROR(NULL, "received too much data (%i/%i)",
-                (int)content_length, (int)size);
-      status = VC_CONTAINER_ERROR_CORRUPTED;
-      goto error;
+      io_http_request_next_chunk(p_ctx);
+      p_ctx->status = VC_CONTAINER_SUCCESS;
+      io_http_connection_select(p_ctx, (module->connection + 1) % module->connections_num);
    }
 
-   bytes_read = 0;
-   while (bytes_read < content_length && p_ctx->status == VC_CONTAINER_SUCCESS)
+   return ret;
+}
+
+/**************************************************************************//**
+ * Read data from a live source.
+ * The data is handed over as soon as it arrives. When a response ends, the rest
+ * of the file is requested again if the server accepts range requests, so files
+ * that are still being recorded can be followed. The server is polled until the
+ * file grows or the live timeout expires.
+ *
+ * @param p_ctx      The reader context.
+ * @param buffer     Where to store the data.
+ * @param size       The amount of data to read.
+ * @return  The amount of data read.
+ */
+static size_t io_http_live_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_HTTP_CONNECTION_T *conn = &module->connections[module->connection];
+   uint32_t waited_ms = 0;
+   size_t ret;
+
+   while (size)
    {
-      ret = io_http_read_from_net(p_ctx, ptr, content_length - bytes_read);
-      if (p_ctx->status == VC_CONTAINER_SUCCESS)
+      if (conn->stream_offset == conn->stream_end)
       {
-         bytes_read += ret;
-         ptr += ret;
+         /* Without range requests, there is no getting back to where we were */
+         if (module->cur_offset && !module->ranges)
+            break;
+
+         io_http_stream_stop(p_ctx);
+         status = io_http_stream_request(p_ctx, module->cur_offset, HTTP_STREAM_END_UNKNOWN);
+         if (status == VC_CONTAINER_SUCCESS)
+            status = io_http_stream_response(p_ctx);
+         if (status != VC_CONTAINER_SUCCESS)
+         {
+            io_http_stream_stop(p_ctx);
+            p_ctx->status = status;
+            return 0;
+         }
+
+         /* Nothing new yet, give the file some time to grow */
+         if (conn->stream_offset == conn->stream_end)
+         {
+            if (waited_ms >= module->live_timeout_ms)
+               break;
+            io_http_sleep(HTTP_LIVE_POLL_MS);
+            waited_ms += HTTP_LIVE_POLL_MS;
+            continue;
+         }
+      }
+
+      ret = io_http_stream_read(p_ctx, buffer, size);
+      module->cur_offset += ret;
+      if (module->cur_offset > p_ctx->size)
+         p_ctx->size = module->cur_offset;
+
+      if (p_ctx->status != VC_CONTAINER_SUCCESS)
+      {
+         /* The connection was lost or the stream ended */
+         io_http_stream_stop(p_ctx);
+         if (!module->ranges)
+         {
+            p_ctx->status = ret ? VC_CONTAINER_SUCCESS : VC_CONTAINER_ERROR_EOS;
+            return ret;
+         }
       }
+      if (ret)
+         return ret;
    }
 
-   if (p_ctx->status == VC_CONTAINER_SUCCESS)
+   io_http_stream_stop(p_ctx);
+   p_ctx->status = VC_CONTAINER_ERROR_EOS;
+   return 0;
+}
+
+#ifdef ENABLE_CONTAINER_IO_HTTP_CACHE
+/**************************************************************************//**
+ * Read data through the disk cache.
+ * What the cache has got is read from disk. The rest is fetched and stored in
+ * the cache, starting from the beginning of the block it is in so the whole
+ * block ends up cached.
+ *
+ * @param p_ctx      The reader context.
+ * @param buffer     Where to store the data.
+ * @param size       The amount of data to read.
+ * @return  The amount of data read.
+ */
+static size_t io_http_read_cached(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   int64_t offset = module->cur_offset;
+   uint8_t data[4096];
+   size_t ret, bytes;
+
+   ret = vc_container_io_http_cache_read(module->cache, offset, buffer, size);
+   if (ret)
    {
-      module->cur_offset += bytes_read;
-      ret = bytes_read;
+      module->cur_offset += ret;
+      return ret;
    }
 
-   if (!module->persistent)
-      io_http_close_socket(module);
+   module->cur_offset -= vc_container_io_http_cache_gap(module->cache, offset);
+   while (module->cur_offset < offset)
+   {
+      bytes = io_http_read_part(p_ctx, data, MIN(sizeof(data), (size_t)(offset - module->cur_offset)));
+      if (!bytes)
+      {
+         module->cur_offset = offset;
+         return 0;
+      }
+      vc_container_io_http_cache_write(module->cache, module->cur_offset - bytes, data, bytes);
+   }
 
+   /* Stop where the cached data starts again */
+   size = vc_container_io_http_cache_missing(module->cache, offset, size);
+   ret = io_http_read_part(p_ctx, buffer, size);
+   if (ret)
+      vc_container_io_http_cache_write(module->cache, offset, buffer, ret);
    return ret;
+}
+#endif
 
-error:
-   if (!module->persistent)
-      io_http_close_socket(module);
+/*****************************************************************************/
+static size_t io_http_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t ret = 0, bytes;
 
-   return status;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   if (module->live)
+      return io_http_live_read(p_ctx, buffer, size);
+
+   /*
+    * Are we at the end of the file?
+    */
+
+   if (module->cur_offset >= p_ctx->size)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      return 0;
+   }
+
+   /* Reads can span the chunks fetched over several connections */
+   while (ret < size && module->cur_offset < p_ctx->size && p_ctx->status == VC_CONTAINER_SUCCESS)
+   {
+#ifdef ENABLE_CONTAINER_IO_HTTP_CACHE
+      if (module->cache)
+         bytes = io_http_read_cached(p_ctx, (uint8_t *)buffer + ret, size - ret);
+      else
+#endif
+      bytes = io_http_read_part(p_ctx, (uint8_t *)buffer + ret, size - ret);
+      if (!bytes) break;
+      ret += bytes;
+   }
+
+   if (ret) p_ctx->status = VC_CONTAINER_SUCCESS;
+   return ret;
 }
 
 /*****************************************************************************/
@@ -694,6 +1402,14 @@ static VC_CONTAINER_STATUS_T io_http_control(struct VC_CONTAINER_IO_T *p_ctx,
    case VC_CONTAINER_CONTROL_IO_SET_READ_TIMEOUT_MS:
       net_status = vc_container_net_control(p_ctx->module->sock, VC_CONTAINER_NET_CONTROL_SET_READ_TIMEOUT_MS, args);
       break;
+   case VC_CONTAINER_CONTROL_IO_SET_HTTP_CONNECTIONS:
+      {
+         unsigned int connections = va_arg(args, unsigned int);
+         uint32_t chunk_size = va_arg(args, uint32_t);
+         status = io_http_set_connections(p_ctx, connections, chunk_size);
+         p_ctx->status = VC_CONTAINER_SUCCESS;
+         return status;
+      }
    default:
       net_status = VC_CONTAINER_NET_ERROR_NOT_ALLOWED;
    }
@@ -762,7 +1478,7 @@ static VC_CONTAINER_STATUS_T io_http_head(VC_CONTAINER_IO_T *p_ctx)
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
-   uint64_t content_length;
+   int64_t content_length;
 
    /* Send HEAD request and get response */
    status = io_http_send_head_request(p_ctx);
@@ -777,17 +1493,26 @@ static VC_CONTAINER_STATUS_T io_http_head(VC_CONTAINER_IO_T *p_ctx)
     */
 
    content_length = io_http_get_content_length(module->header_list);
-   if (content_length)
+   if (content_length >= 0 && !io_http_check_chunked(module->header_list))
    {
       p_ctx->size = content_length;
       LOG_DEBUG(NULL, "File size is %"PRId64, p_ctx->size);
    }
+   else
+   {
+      /* Without a length, this has to be a live source */
+      LOG_DEBUG(NULL, "File size is unknown, reading it live");
+      module->live = true;
+   }
 
    /*
     * Now make sure that the server supports byte range requests.
+    * Live sources can do without since they are read sequentially.
     */
 
-   if (!io_http_check_accept_range(module->header_list))
+   module->ranges = io_http_check_accept_range(module->header_list);
+   io_http_get_validator(module->header_list, module->validator, sizeof(module->validator));
+   if (!module->ranges && !module->live)
    {
       LOG_ERROR(NULL, "Server doesn't support byte range requests");
       return VC_CONTAINER_ERROR_FAILED;
@@ -822,6 +1547,7 @@ VC_CONTAINER_STATUS_T vc_container_io_http_open(VC_CONTAINER_IO_T *p_ctx,
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    VC_CONTAINER_IO_MODULE_T *module = 0;
+   const char *value;
    VC_CONTAINER_PARAM_UNUSED(unused);
 
    /* Check the URI to see if we're dealing with an http stream */
@@ -887,9 +1613,56 @@ VC_CONTAINER_STATUS_T vc_container_io_http_open(VC_CONTAINER_IO_T *p_ctx,
    p_ctx->pf_control = io_http_control;
    p_ctx->pf_seek    = io_http_seek;
 
+   /* Files still being recorded can be followed as they grow (e.g. ?live&livetimeout=5000) */
+   module->live_timeout_ms = HTTP_LIVE_TIMEOUT_MS_DEFAULT;
+   if (vc_uri_find_query(p_ctx->uri_parts, 0, "live", &value))
+      module->live = true;
+   if (vc_uri_find_query(p_ctx->uri_parts, 0, "livetimeout", &value) && value)
+      module->live_timeout_ms = strtoul(value, 0, 0);
+
+   /* The file can be fetched over several connections (e.g. ?connections=4&chunksize=1048576) */
+   module->connections_num = 1;
+   module->chunk_size = HTTP_CHUNK_SIZE_DEFAULT;
+   if (vc_uri_find_query(p_ctx->uri_parts, 0, "connections", &value) && value)
+   {
+      unsigned int connections = strtoul(value, 0, 0);
+      uint32_t chunk_size = 0;
+      if (vc_uri_find_query(p_ctx->uri_parts, 0, "chunksize", &value) && value)
+         chunk_size = strtoul(value, 0, 0);
+      io_http_set_connections(p_ctx, connections, chunk_size);
+   }
+
    p_ctx->capabilities = VC_CONTAINER_IO_CAPS_NO_CACHING;
    p_ctx->capabilities |= VC_CONTAINER_IO_CAPS_SEEK_SLOW;
 
+   /* The size of live sources grows as the data arrives */
+   if (module->live)
+   {
+      p_ctx->size = 0;
+      p_ctx->capabilities |= VC_CONTAINER_IO_CAPS_CANT_SEEK;
+   }
+
+#ifdef ENABLE_CONTAINER_IO_HTTP_CACHE
+   /* Data can be kept on disk for the next time the file is opened, as long as we can
+    * tell whether it is still the same file (e.g. ?diskcache=/tmp/vc&diskcachesize=1073741824) */
+   if (!module->live && module->validator[0] &&
+       vc_uri_find_query(p_ctx->uri_parts, 0, "diskcache", &value) && value && *value)
+   {
+      const char *directory = value;
+      int64_t budget = HTTP_DISK_CACHE_SIZE_DEFAULT;
+      char url[HTTP_URI_LENGTH_MAX + 32];
+
+      if (vc_uri_find_query(p_ctx->uri_parts, 0, "diskcachesize", &value) && value)
+         budget = strtoll(value, 0, 0);
+
+      /* The query options are ours, not part of the file's URL */
+      snprintf(url, sizeof(url), "http://%s:%s%s", vc_uri_host(p_ctx->uri_parts),
+               vc_uri_port(p_ctx->uri_parts), vc_uri_path(p_ctx->uri_parts));
+      module->cache = vc_container_io_http_cache_open(directory, budget, url,
+                                                      module->validator, p_ctx->size);
+   }
+#endif
+
    return VC_CONTAINER_SUCCESS;
 
 error:
@@ -0,0 +1,407 @@
+/*
+Copyright (c) 2021, Gildas Bazin
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#define _FILE_OFFSET_BITS 64 /* Large file support on 32 bits systems */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "containers.h"
+#include "core/containers_common.h"
+#include "core/containers_logging.h"
+
+/* Persistent cache of the data fetched by the http i/o, so files opened over
+ * and over again (e.g. to get a thumbnail, then to probe them, then to transcode
+ * them) don't have their headers and indexes downloaded every time.
+ * Each file gets an entry in the cache directory, named after a hash of its URL
+ * and of the validator (ETag or Last-Modified) the server gave for it, so an entry
+ * is never used for a different version of the file. An entry is a sparse file:
+ * a header, a map of the blocks we've got and the data at its offset in the file.
+ * Entries least recently opened are removed to keep the directory within its
+ * size limit. The map is only written back on close, a process dying before that
+ * just means the data gets downloaded again. */
+
+/******************************************************************************
+Defines.
+******************************************************************************/
+#define IO_HTTP_CACHE_BLOCK_SIZE (64*1024)
+#define IO_HTTP_CACHE_ALIGNMENT 4096 /* Alignment of the data in an entry */
+#define IO_HTTP_CACHE_MAGIC "VCHC"
+#define IO_HTTP_CACHE_VERSION 1
+#define IO_HTTP_CACHE_EXTENSION ".vchc"
+
+/******************************************************************************
+Type definitions.
+******************************************************************************/
+/** Header of an entry, in native byte order since the cache is local */
+typedef struct IO_HTTP_CACHE_HEADER_T
+{
+   char magic[4];
+   uint32_t version;
+   uint32_t block_size;
+   uint32_t reserved;
+   uint64_t key;        /**< Hash of the URL and validator */
+   int64_t size;        /**< Size of the file */
+
+} IO_HTTP_CACHE_HEADER_T;
+
+typedef struct VC_CONTAINER_IO_HTTP_CACHE_T
+{
+   int fd;
+   int64_t size;        /**< Size of the file */
+   int64_t data_offset; /**< Offset of the data in the entry */
+
+   uint8_t *map;        /**< One bit per block, set when we've got all of the block */
+   size_t map_size;
+   bool map_dirty;
+
+   /* Data written contiguously since the last jump. Blocks are only marked as cached
+    * once this covers them from start to end. */
+   int64_t run_start;
+   int64_t run_end;
+
+} VC_CONTAINER_IO_HTTP_CACHE_T;
+
+/** Entry of the cache directory, used when trimming it */
+typedef struct IO_HTTP_CACHE_ENTRY_T
+{
+   char *path;
+   time_t last_use;
+   int64_t usage;
+
+} IO_HTTP_CACHE_ENTRY_T;
+
+VC_CONTAINER_IO_HTTP_CACHE_T *vc_container_io_http_cache_open( const char *directory,
+   int64_t budget, const char *url, const char *validator, int64_t size );
+void vc_container_io_http_cache_close( VC_CONTAINER_IO_HTTP_CACHE_T *cache );
+size_t vc_container_io_http_cache_read( VC_CONTAINER_IO_HTTP_CACHE_T *cache,
+   int64_t offset, void *buffer, size_t size );
+size_t vc_container_io_http_cache_missing( VC_CONTAINER_IO_HTTP_CACHE_T *cache,
+   int64_t offset, size_t size );
+size_t vc_container_io_http_cache_gap( VC_CONTAINER_IO_HTTP_CACHE_T *cache, int64_t offset );
+void vc_container_io_http_cache_write( VC_CONTAINER_IO_HTTP_CACHE_T *cache,
+   int64_t offset, const void *buffer, size_t size );
+
+/*****************************************************************************/
+static uint64_t io_http_cache_hash( uint64_t hash, const char *str )
+{
+   /* FNV-1a, including the terminating character so strings don't run into each other */
+   do {
+      hash ^= (uint8_t)*str;
+      hash *= UINT64_C(0x100000001b3);
+   } while(*str++);
+   return hash;
+}
+
+/*****************************************************************************/
+static bool io_http_cache_block_cached( VC_CONTAINER_IO_HTTP_CACHE_T *cache, int64_t offset )
+{
+   int64_t block = offset / IO_HTTP_CACHE_BLOCK_SIZE;
+   return offset < cache->size && (cache->map[block >> 3] & (1 << (block & 7)));
+}
+
+/*****************************************************************************/
+static int io_http_cache_entry_compare( const void *a, const void *b )
+{
+   const IO_HTTP_CACHE_ENTRY_T *first = a, *second = b;
+   return first->last_use < second->last_use ? -1 : first->last_use > second->last_use;
+}
+
+/*****************************************************************************/
+static void io_http_cache_trim( const char *directory, int64_t budget, const char *keep )
+{
+   IO_HTTP_CACHE_ENTRY_T *entries = 0, *entry;
+   unsigned int entries_num = 0, i;
+   size_t length, extension_length = sizeof(IO_HTTP_CACHE_EXTENSION) - 1;
+   struct dirent *dirent;
+   struct stat st;
+   int64_t usage = 0;
+   DIR *dir;
+
+   dir = opendir(directory);
+   if(!dir) return;
+
+   while((dirent = readdir(dir)) != NULL)
+   {
+      length = strlen(dirent->d_name);
+      if(length <= extension_length ||
+         strcmp(dirent->d_name + length - extension_length, IO_HTTP_CACHE_EXTENSION))
+         continue;
+
+      if(!(entries_num % 64))
+      {
+         entry = realloc(entries, (entries_num + 64) * sizeof(*entries));
+         if(!entry) break;
+         entries = entry;
+      }
+      entry = &entries[entries_num];
+      length += strlen(directory) + 2;
+      entry->path = malloc(length);
+      if(!entry->path) break;
+      snprintf(entry->path, length, "%s/%s", directory, dirent->d_name);
+
+      /* The entry being opened has its room set aside already */
+      if(!strcmp(entry->path, keep) || stat(entry->path, &st))
+      {
+         free(entry->path);
+         continue;
+      }
+
+      /* Entries are sparse so what counts is the space actually used */
+      entry->usage = (int64_t)st.st_blocks * 512;
+      entry->last_use = st.st_mtime;
+      usage += entry->usage;
+      entries_num++;
+   }
+   closedir(dir);
+
+   /* Remove the entries least recently opened until we're within budget */
+   if(usage > budget)
+      qsort(entries, entries_num, sizeof(*entries), io_http_cache_entry_compare);
+   for(i = 0; i < entries_num && usage > budget; i++)
+   {
+      LOG_DEBUG(NULL, "http cache: removing %s", entries[i].path);
+      if(!unlink(entries[i].path))
+         usage -= entries[i].usage;
+   }
+
+   for(i = 0; i < entries_num; i++)
+      free(entries[i].path);
+   free(entries);
+}
+
+/*****************************************************************************/
+static bool io_http_cache_load( VC_CONTAINER_IO_HTTP_CACHE_T *cache, uint64_t key )
+{
+   IO_HTTP_CACHE_HEADER_T header;
+
+   if(pread(cache->fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, IO_HTTP_CACHE_MAGIC, sizeof(header.magic)) ||
+      header.version != IO_HTTP_CACHE_VERSION ||
+      header.block_size != IO_HTTP_CACHE_BLOCK_SIZE ||
+      header.key != key || header.size != cache->size)
+      return false;
+
+   return pread(cache->fd, cache->map, cache->map_size, sizeof(header)) ==
+      (ssize_t)cache->map_size;
+}
+
+/*****************************************************************************/
+static bool io_http_cache_create( VC_CONTAINER_IO_HTTP_CACHE_T *cache, uint64_t key )
+{
+   IO_HTTP_CACHE_HEADER_T header;
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, IO_HTTP_CACHE_MAGIC, sizeof(header.magic));
+   header.version = IO_HTTP_CACHE_VERSION;
+   header.block_size = IO_HTTP_CACHE_BLOCK_SIZE;
+   header.key = key;
+   header.size = cache->size;
+   memset(cache->map, 0, cache->map_size);
+
+   return !ftruncate(cache->fd, 0) &&
+      pwrite(cache->fd, &header, sizeof(header), 0) == sizeof(header) &&
+      pwrite(cache->fd, cache->map, cache->map_size, sizeof(header)) == (ssize_t)cache->map_size;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_IO_HTTP_CACHE_T *vc_container_io_http_cache_open( const char *directory,
+   int64_t budget, const char *url, const char *validator, int64_t size )
+{
+   VC_CONTAINER_IO_HTTP_CACHE_T *cache;
+   uint64_t key = UINT64_C(0xcbf29ce484222325);
+   char *path;
+   size_t length;
+
+   /* Files that wouldn't fit aren't worth evicting everything else for */
+   if(size <= 0 || size > budget)
+      return NULL;
+
+   cache = calloc(1, sizeof(*cache));
+   if(!cache) return NULL;
+   cache->fd = -1;
+   cache->size = size;
+   cache->map_size = (size_t)((size + IO_HTTP_CACHE_BLOCK_SIZE - 1) / IO_HTTP_CACHE_BLOCK_SIZE + 7) / 8;
+   cache->data_offset = (sizeof(IO_HTTP_CACHE_HEADER_T) + cache->map_size +
+      IO_HTTP_CACHE_ALIGNMENT - 1) & ~(IO_HTTP_CACHE_ALIGNMENT - 1);
+   cache->map = malloc(cache->map_size);
+
+   key = io_http_cache_hash(key, url);
+   key = io_http_cache_hash(key, validator);
+   length = strlen(directory) + sizeof("/0123456789abcdef" IO_HTTP_CACHE_EXTENSION);
+   path = malloc(length);
+   if(!cache->map || !path) goto error;
+   snprintf(path, length, "%s/%016"PRIx64 IO_HTTP_CACHE_EXTENSION, directory, key);
+
+   /* Make room for the whole file before we start storing it */
+   io_http_cache_trim(directory, budget - size, path);
+
+   cache->fd = open(path, O_RDWR|O_CREAT, 0644);
+   if(cache->fd < 0 && errno == ENOENT && !mkdir(directory, 0755))
+      cache->fd = open(path, O_RDWR|O_CREAT, 0644);
+   if(cache->fd < 0)
+   {
+      LOG_ERROR(NULL, "http cache: could not open %s (%s)", path, strerror(errno));
+      goto error;
+   }
+
+   if(!io_http_cache_load(cache, key) && !io_http_cache_create(cache, key))
+   {
+      LOG_ERROR(NULL, "http cache: could not create %s (%s)", path, strerror(errno));
+      goto error;
+   }
+
+   /* The modification time tells which entries were used least recently */
+   futimens(cache->fd, NULL);
+
+   LOG_DEBUG(NULL, "http cache: using %s", path);
+   free(path);
+   return cache;
+
+ error:
+   free(path);
+   vc_container_io_http_cache_close(cache);
+   return NULL;
+}
+
+/*****************************************************************************/
+void vc_container_io_http_cache_close( VC_CONTAINER_IO_HTTP_CACHE_T *cache )
+{
+   if(cache->map_dirty &&
+      pwrite(cache->fd, cache->map, cache->map_size, sizeof(IO_HTTP_CACHE_HEADER_T)) !=
+         (ssize_t)cache->map_size)
+      LOG_ERROR(NULL, "http cache: could not update the map (%s)", strerror(errno));
+
+   if(cache->fd >= 0) close(cache->fd);
+   free(cache->map);
+   free(cache);
+}
+
+/*****************************************************************************/
+size_t vc_container_io_http_cache_read( VC_CONTAINER_IO_HTTP_CACHE_T *cache,
+   int64_t offset, void *buffer, size_t size )
+{
+   size_t cached = 0, ret = 0;
+   ssize_t bytes;
+   int64_t block;
+
+   if(offset >= cache->size) return 0;
+   if((int64_t)size > cache->size - offset) size = (size_t)(cache->size - offset);
+
+   while(cached < size && io_http_cache_block_cached(cache, offset + cached))
+      cached += IO_HTTP_CACHE_BLOCK_SIZE - (offset + cached) % IO_HTTP_CACHE_BLOCK_SIZE;
+   cached = MIN(cached, size);
+
+   while(ret < cached)
+   {
+      bytes = pread(cache->fd, (uint8_t *)buffer + ret, cached - ret,
+                    cache->data_offset + offset + ret);
+      if(bytes < 0 && errno == EINTR) continue;
+      if(bytes <= 0) break;
+      ret += bytes;
+   }
+
+   /* Whatever we couldn't read back will be fetched again */
+   if(ret < cached)
+   {
+      block = (offset + ret) / IO_HTTP_CACHE_BLOCK_SIZE;
+      cache->map[block >> 3] &= ~(1 << (block & 7));
+      cache->map_dirty = true;
+   }
+
+   return ret;
+}
+
+/*****************************************************************************/
+size_t vc_container_io_http_cache_missing( VC_CONTAINER_IO_HTTP_CACHE_T *cache,
+   int64_t offset, size_t size )
+{
+   size_t missing = 0;
+
+   while(missing < size && offset + (int64_t)missing < cache->size &&
+         !io_http_cache_block_cached(cache, offset + missing))
+      missing += IO_HTTP_CACHE_BLOCK_SIZE - (offset + missing) % IO_HTTP_CACHE_BLOCK_SIZE;
+
+   return missing ? MIN(missing, size) : size;
+}
+
+/*****************************************************************************/
+size_t vc_container_io_http_cache_gap( VC_CONTAINER_IO_HTTP_CACHE_T *cache, int64_t offset )
+{
+   int64_t start = offset - offset % IO_HTTP_CACHE_BLOCK_SIZE;
+
+   /* Blocks only get cached once we have all of them, so data fetched from the middle
+    * of a block needs the start of the block fetched as well, unless we've just
+    * written it */
+   if(offset == cache->run_end && cache->run_start <= start)
+      return 0;
+   return (size_t)(offset - start);
+}
+
+/*****************************************************************************/
+void vc_container_io_http_cache_write( VC_CONTAINER_IO_HTTP_CACHE_T *cache,
+   int64_t offset, const void *buffer, size_t size )
+{
+   int64_t block, end;
+   size_t written = 0;
+   ssize_t bytes;
+
+   if(offset + (int64_t)size > cache->size) return;
+   if(offset != cache->run_end)
+      cache->run_start = cache->run_end = offset;
+
+   while(written < size)
+   {
+      bytes = pwrite(cache->fd, (const uint8_t *)buffer + written, size - written,
+                     cache->data_offset + offset + written);
+      if(bytes < 0 && errno == EINTR) continue;
+      if(bytes <= 0)
+      {
+         /* Start over after the data that didn't make it (e.g. the disk is full) */
+         cache->run_start = cache->run_end = -1;
+         return;
+      }
+      written += bytes;
+   }
+   cache->run_end = offset + size;
+
+   /* Mark the blocks the data we've written now covers entirely */
+   block = MAX(cache->run_start + IO_HTTP_CACHE_BLOCK_SIZE - 1, offset) / IO_HTTP_CACHE_BLOCK_SIZE;
+   end = cache->run_end == cache->size ? (cache->size + IO_HTTP_CACHE_BLOCK_SIZE - 1) / IO_HTTP_CACHE_BLOCK_SIZE :
+      cache->run_end / IO_HTTP_CACHE_BLOCK_SIZE;
+   for(; block < end; block++)
+   {
+      cache->map[block >> 3] |= 1 << (block & 7);
+      cache->map_dirty = true;
+   }
+}
@@ -0,0 +1,197 @@
+/*
+Copyright (c) 2021, Gildas Bazin
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "containers.h"
+#include "core/containers_common.h"
+#include "core/containers_io.h"
+
+/* Memory i/o, used for reading data the client already has in memory (see
+ * vc_container_io_open_memory). The data can be split over several buffers.
+ * It is served straight from the client's buffers, which means the container
+ * i/o layer doesn't need a cache and readers can borrow pointers to the data.
+ * The buffers must stay valid until the i/o is closed. */
+
+/******************************************************************************
+Type definitions.
+******************************************************************************/
+typedef struct VC_CONTAINER_IO_MODULE_T
+{
+   VC_CONTAINER_IO_MEMORY_BUFFER_T *buffers;
+   int64_t *offsets;           /**< Offset in the stream of each of the buffers */
+   unsigned int buffers_num;
+
+   unsigned int buffer;        /**< Buffer the current position is in */
+   int64_t position;
+
+} VC_CONTAINER_IO_MODULE_T;
+
+VC_CONTAINER_STATUS_T vc_container_io_memory_open( VC_CONTAINER_IO_T *,
+   const VC_CONTAINER_IO_MEMORY_BUFFER_T *, unsigned int );
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_memory_close( VC_CONTAINER_IO_T *p_ctx )
+{
+   free(p_ctx->module);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static const void *io_memory_data(VC_CONTAINER_IO_T *p_ctx, size_t *size, bool b_partial)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   VC_CONTAINER_IO_MEMORY_BUFFER_T *buffer;
+   size_t position, available;
+
+   /* Move on to the next buffer once we've reached the end of the current one */
+   if(module->buffer < module->buffers_num &&
+      module->position >= module->offsets[module->buffer] +
+         (int64_t)module->buffers[module->buffer].size)
+      module->buffer++;
+
+   if(module->buffer >= module->buffers_num)
+   {
+      if(*size) p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      *size = 0;
+      return NULL;
+   }
+
+   /* Only the data up to the end of the current buffer is contiguous */
+   buffer = &module->buffers[module->buffer];
+   position = (size_t)(module->position - module->offsets[module->buffer]);
+   available = buffer->size - position;
+   if(*size > available)
+   {
+      if(!b_partial)
+      {
+         *size = 0;
+         return NULL;
+      }
+      if(module->buffer + 1 == module->buffers_num)
+         p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      *size = available;
+   }
+
+   module->position += *size;
+   return (const uint8_t *)buffer->data + position;
+}
+
+/*****************************************************************************/
+static const void *io_memory_map(VC_CONTAINER_IO_T *p_ctx, size_t *size)
+{
+   /* Data spanning several buffers or past the end can't be accessed directly.
+    * The caller will fall back to reading it. */
+   return io_memory_data(p_ctx, size, false);
+}
+
+/*****************************************************************************/
+static size_t io_memory_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   size_t ret = 0, chunk;
+   const void *data;
+
+   while(ret < size)
+   {
+      chunk = size - ret;
+      data = io_memory_data(p_ctx, &chunk, true);
+      if(!chunk) break;
+      memcpy((uint8_t *)buffer + ret, data, chunk);
+      ret += chunk;
+   }
+
+   return ret;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_memory_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   unsigned int start = 0, end = module->buffers_num;
+
+   if(offset < 0)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      return p_ctx->status;
+   }
+
+   /* Find the last buffer starting before the offset. Seeking past the end is
+    * allowed, the next read will just return the end of stream. */
+   while(end - start > 1)
+   {
+      unsigned int middle = start + (end - start) / 2;
+      if(module->offsets[middle] <= offset) start = middle;
+      else end = middle;
+   }
+
+   module->buffer = start;
+   module->position = offset;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_memory_open( VC_CONTAINER_IO_T *p_ctx,
+   const VC_CONTAINER_IO_MEMORY_BUFFER_T *buffers, unsigned int buffers_num )
+{
+   VC_CONTAINER_IO_MODULE_T *module;
+   unsigned int i, num = 0;
+   int64_t size = 0;
+
+   if(buffers_num && !buffers)
+      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+   for(i = 0; i < buffers_num; i++)
+      if(buffers[i].size && !buffers[i].data)
+         return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+
+   module = malloc(sizeof(*module) + buffers_num * (sizeof(*module->buffers) + sizeof(*module->offsets)));
+   if(!module) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   memset(module, 0, sizeof(*module));
+   module->offsets = (int64_t *)(module + 1);
+   module->buffers = (VC_CONTAINER_IO_MEMORY_BUFFER_T *)(module->offsets + buffers_num);
+
+   /* Empty buffers are dropped so each offset belongs to a single buffer */
+   for(i = 0; i < buffers_num; i++)
+   {
+      if(!buffers[i].size) continue;
+      module->buffers[num] = buffers[i];
+      module->offsets[num++] = size;
+      size += buffers[i].size;
+   }
+   module->buffers_num = num;
+
+   p_ctx->module = module;
+   p_ctx->pf_close = io_memory_close;
+   p_ctx->pf_read = io_memory_read;
+   p_ctx->pf_seek = io_memory_seek;
+   p_ctx->pf_map = io_memory_map;
+
+   p_ctx->size = size;
+   p_ctx->capabilities = VC_CONTAINER_IO_CAPS_MAPPED;
+   return VC_CONTAINER_SUCCESS;
+}
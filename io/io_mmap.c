@@ -0,0 +1,235 @@
+/*
+Copyright (c) 2021, Gildas Bazin
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "containers.h"
+#include "core/containers_common.h"
+#include "core/containers_io.h"
+#include "core/containers_uri.h"
+
+/* Memory mapped file i/o, used for reading local files when the uri uses the
+ * mmap scheme (e.g. mmap:/path/file.mp4) or has an mmap query option.
+ * The data is served straight from the mapping, which means the container i/o
+ * layer doesn't need a cache and readers can borrow pointers to the data. */
+
+/******************************************************************************
+Defines.
+******************************************************************************/
+#define IO_MMAP_RANDOM_SEEK_DISTANCE (1024*1024) /* Seeks further than this aren't sequential */
+#define IO_MMAP_RANDOM_SEEKS 4 /* Seeks in a row before switching to random access */
+#define IO_MMAP_SEQUENTIAL_SIZE (4*1024*1024) /* Data read before switching back to sequential */
+#define IO_MMAP_WILLNEED_SIZE (256*1024) /* Data prefetched after a seek in random access */
+
+/******************************************************************************
+Type definitions.
+******************************************************************************/
+typedef struct VC_CONTAINER_IO_MODULE_T
+{
+   uint8_t *data;
+   size_t size;
+   int64_t position;
+
+   int advice;                  /**< Current access pattern hint given to the kernel */
+   unsigned int random_seeks;   /**< Number of seeks since the last long sequential read */
+   size_t sequential_size;      /**< Data read since the last seek */
+
+} VC_CONTAINER_IO_MODULE_T;
+
+VC_CONTAINER_STATUS_T vc_container_io_mmap_open( VC_CONTAINER_IO_T *, const char *,
+   VC_CONTAINER_IO_MODE_T );
+
+/*****************************************************************************/
+static void io_mmap_advise( VC_CONTAINER_IO_MODULE_T *module, int advice )
+{
+   if(module->advice == advice || !module->size) return;
+   posix_madvise(module->data, module->size, advice);
+   module->advice = advice;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_mmap_close( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   if(module->size) munmap(module->data, module->size);
+   free(module);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static const void *io_mmap_data(VC_CONTAINER_IO_T *p_ctx, size_t *size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   int64_t available = (int64_t)module->size - module->position;
+   const uint8_t *data;
+
+   if(available < 0) available = 0;
+   if((int64_t)*size > available)
+   {
+      *size = (size_t)available;
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+   }
+   if(!*size) return module->data;
+
+   data = module->data + module->position;
+   module->position += *size;
+
+   /* Long sequential reads switch the mapping back to sequential access */
+   module->sequential_size += *size;
+   if(module->sequential_size >= IO_MMAP_SEQUENTIAL_SIZE)
+   {
+      module->random_seeks = 0;
+      io_mmap_advise(module, POSIX_MADV_SEQUENTIAL);
+   }
+
+   return data;
+}
+
+/*****************************************************************************/
+static const void *io_mmap_map(VC_CONTAINER_IO_T *p_ctx, size_t *size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+
+   /* Data running past the end of the file isn't handed out. The caller
+    * will fall back to reading it and hit the end of stream then. */
+   if(module->position < 0 || (int64_t)*size > (int64_t)module->size - module->position)
+      return NULL;
+   return io_mmap_data(p_ctx, size);
+}
+
+/*****************************************************************************/
+static size_t io_mmap_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   const void *data = io_mmap_data(p_ctx, &size);
+   if(size) memcpy(buffer, data, size);
+   return size;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_mmap_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   int64_t distance = offset - module->position;
+
+   if(offset < 0)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      return p_ctx->status;
+   }
+
+   /* Readers jumping around the file (seeking, interleaving far apart) don't
+    * benefit from the kernel read-ahead */
+   if(distance > IO_MMAP_RANDOM_SEEK_DISTANCE || distance < -IO_MMAP_RANDOM_SEEK_DISTANCE)
+   {
+      module->sequential_size = 0;
+      if(++module->random_seeks >= IO_MMAP_RANDOM_SEEKS)
+         io_mmap_advise(module, POSIX_MADV_RANDOM);
+
+      /* Without read-ahead, at least prefetch the data following the seek point */
+      if(module->advice == POSIX_MADV_RANDOM && offset < (int64_t)module->size)
+      {
+         size_t start = (size_t)offset & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+         posix_madvise(module->data + start, MIN(IO_MMAP_WILLNEED_SIZE, module->size - start),
+                 POSIX_MADV_WILLNEED);
+      }
+   }
+
+   module->position = offset;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_mmap_open( VC_CONTAINER_IO_T *p_ctx,
+   const char *unused, VC_CONTAINER_IO_MODE_T mode )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_IO_MODULE_T *module = 0;
+   const char *uri = p_ctx->uri;
+   void *data = MAP_FAILED;
+   struct stat st;
+   int fd = -1;
+   VC_CONTAINER_PARAM_UNUSED(unused);
+
+   /* Check the URI */
+   if((!vc_uri_scheme(p_ctx->uri_parts) ||
+       strcasecmp(vc_uri_scheme(p_ctx->uri_parts), "mmap")) &&
+      !vc_uri_find_query(p_ctx->uri_parts, 0, "mmap", 0))
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+
+   /* We only support reading. The file i/o will take over for writing. */
+   if(mode != VC_CONTAINER_IO_MODE_READ)
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   if(vc_uri_path(p_ctx->uri_parts))
+      uri = vc_uri_path(p_ctx->uri_parts);
+
+   fd = open(uri, O_RDONLY);
+   if(fd < 0) { status = VC_CONTAINER_ERROR_URI_NOT_FOUND; goto error; }
+   if(fstat(fd, &st) || (uint64_t)st.st_size > SIZE_MAX)
+   { status = VC_CONTAINER_ERROR_FAILED; goto error; }
+
+   /* An empty file can't be mapped but is still a valid stream */
+   if(st.st_size)
+   {
+      data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(data == MAP_FAILED) { status = VC_CONTAINER_ERROR_FAILED; goto error; }
+   }
+
+   /* The mapping stays valid once the file descriptor is closed */
+   close(fd);
+   fd = -1;
+
+   module = malloc( sizeof(*module) );
+   if(!module) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+   memset(module, 0, sizeof(*module));
+
+   p_ctx->module = module;
+   module->data = st.st_size ? data : 0;
+   module->size = (size_t)st.st_size;
+   module->advice = POSIX_MADV_NORMAL;
+   io_mmap_advise(module, POSIX_MADV_SEQUENTIAL);
+
+   p_ctx->pf_close = io_mmap_close;
+   p_ctx->pf_read = io_mmap_read;
+   p_ctx->pf_seek = io_mmap_seek;
+   p_ctx->pf_map = io_mmap_map;
+
+   p_ctx->size = st.st_size;
+   p_ctx->capabilities = VC_CONTAINER_IO_CAPS_MAPPED;
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   if(data != MAP_FAILED) munmap(data, (size_t)st.st_size);
+   if(fd >= 0) close(fd);
+   return status;
+}
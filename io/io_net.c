@@ -280,6 +280,9 @@ static VC_CONTAINER_STATUS_T io_net_control(struct VC_CONTAINER_IO_T *p_ctx,
    case VC_CONTAINER_CONTROL_IO_SET_READ_TIMEOUT_MS:
       net_status = vc_container_net_control(p_ctx->module->sock, VC_CONTAINER_NET_CONTROL_SET_READ_TIMEOUT_MS, args);
       break;
+   case VC_CONTAINER_CONTROL_IO_SET_READ_BATCH:
+      net_status = vc_container_net_control(p_ctx->module->sock, VC_CONTAINER_NET_CONTROL_SET_READ_BATCH, args);
+      break;
    default:
       net_status = VC_CONTAINER_NET_ERROR_NOT_ALLOWED;
    }
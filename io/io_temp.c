@@ -0,0 +1,310 @@
+/*
+Copyright (c) 2021, Gildas Bazin
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#define _GNU_SOURCE /* memfd_create */
+#define _FILE_OFFSET_BITS 64 /* Large file support on 32 bits systems */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef ENABLE_CONTAINER_IO_MEMFD
+# include <sys/mman.h>
+#endif
+
+#include "containers.h"
+#include "core/containers_common.h"
+#include "core/containers_io.h"
+#include "core/containers_uri.h"
+#include "core/containers_logging.h"
+
+/* Temporary storage i/o, used by writers for the data they need to keep aside
+ * until the file is closed (see vc_container_io_open_temp).
+ * The data is kept in memory as long as it fits in the memory budget. Past that
+ * it spills to an anonymous memory file, or to a file in the given directory.
+ * Spill files are unlinked as soon as they are created so nothing is left behind,
+ * even if the process dies. */
+
+/******************************************************************************
+Defines.
+******************************************************************************/
+#define IO_TEMP_MEM_MIN_SIZE (64*1024) /* Initial size of the memory holding the data */
+#define IO_TEMP_FILE_TEMPLATE "vc_container_XXXXXX"
+
+/******************************************************************************
+Type definitions.
+******************************************************************************/
+typedef struct VC_CONTAINER_IO_MODULE_T
+{
+   uint8_t *mem;        /**< Data while it is kept in memory */
+   size_t mem_size;     /**< Size of the memory allocated for the data */
+   size_t budget;       /**< Maximum size of the data kept in memory */
+   char *directory;     /**< Directory of the spill file, NULL for the default */
+
+   int fd;              /**< Spill file, -1 while the data is in memory */
+   int64_t size;        /**< Size of the data */
+   int64_t position;
+
+} VC_CONTAINER_IO_MODULE_T;
+
+VC_CONTAINER_STATUS_T vc_container_io_temp_open( VC_CONTAINER_IO_T *, uint32_t, const char * );
+VC_CONTAINER_STATUS_T vc_container_io_temp_storage( VC_CONTAINER_IO_T *, uint32_t, const char * );
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_temp_close( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   if(module->fd >= 0) close(module->fd);
+   free(module->directory);
+   free(module->mem);
+   free(module);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static int io_temp_spill_open( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   const char *path;
+   char *name;
+   size_t length;
+   int fd;
+
+   if(module->directory)
+   {
+      length = strlen(module->directory) + sizeof("/" IO_TEMP_FILE_TEMPLATE);
+      name = malloc(length);
+      if(!name) return -1;
+      snprintf(name, length, "%s/" IO_TEMP_FILE_TEMPLATE, module->directory);
+      fd = mkstemp(name);
+      if(fd >= 0) unlink(name);
+      free(name);
+      return fd;
+   }
+
+#ifdef ENABLE_CONTAINER_IO_MEMFD
+   fd = memfd_create("vc_container_tmp", MFD_CLOEXEC);
+   if(fd >= 0) return fd;
+#endif
+
+   /* Fall back to a file next to the output */
+   path = vc_uri_path(p_ctx->uri_parts);
+   if(!path) path = p_ctx->uri;
+   fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0600);
+   if(fd >= 0) unlink(path);
+   return fd;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_temp_spill( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t written = 0;
+   ssize_t ret;
+   int fd;
+
+   fd = io_temp_spill_open(p_ctx);
+   if(fd < 0)
+   {
+      LOG_ERROR(NULL, "temp: could not create spill file (%s)", strerror(errno));
+      return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+   }
+
+   while(written < (size_t)module->size)
+   {
+      ret = write(fd, module->mem + written, (size_t)module->size - written);
+      if(ret < 0 && errno == EINTR) continue;
+      if(ret <= 0)
+      {
+         close(fd);
+         return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+      }
+      written += ret;
+   }
+
+   free(module->mem);
+   module->mem = 0;
+   module->mem_size = 0;
+   module->fd = fd;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static size_t io_temp_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t ret = 0;
+   ssize_t bytes;
+
+   if(module->position >= module->size)
+      size = 0;
+   else if((int64_t)size > module->size - module->position)
+      size = (size_t)(module->size - module->position);
+
+   if(module->fd < 0)
+   {
+      if(size) memcpy(buffer, module->mem + module->position, size);
+      ret = size;
+   }
+   else while(ret < size)
+   {
+      bytes = pread(module->fd, (uint8_t *)buffer + ret, size - ret, module->position + ret);
+      if(bytes < 0 && errno == EINTR) continue;
+      if(bytes <= 0) break;
+      ret += bytes;
+   }
+
+   if(!ret) p_ctx->status = VC_CONTAINER_ERROR_EOS;
+   module->position += ret;
+   return ret;
+}
+
+/*****************************************************************************/
+static size_t io_temp_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   int64_t end = module->position + size;
+   size_t ret = 0, mem_size;
+   ssize_t bytes;
+   uint8_t *mem;
+
+   /* Move the data out of memory once it doesn't fit in the budget anymore */
+   if(module->fd < 0 && end > (int64_t)module->budget)
+   {
+      p_ctx->status = io_temp_spill(p_ctx);
+      if(p_ctx->status != VC_CONTAINER_SUCCESS) return 0;
+   }
+
+   if(module->fd >= 0)
+   {
+      while(ret < size)
+      {
+         bytes = pwrite(module->fd, (const uint8_t *)buffer + ret, size - ret, module->position + ret);
+         if(bytes < 0 && errno == EINTR) continue;
+         if(bytes <= 0) break;
+         ret += bytes;
+      }
+   }
+   else
+   {
+      if(end > (int64_t)module->mem_size)
+      {
+         mem_size = module->mem_size ? module->mem_size : IO_TEMP_MEM_MIN_SIZE;
+         while((int64_t)mem_size < end) mem_size *= 2;
+         if(mem_size > module->budget) mem_size = module->budget;
+         mem = realloc(module->mem, mem_size);
+         if(!mem)
+         {
+            p_ctx->status = VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+            return 0;
+         }
+         module->mem = mem;
+         module->mem_size = mem_size;
+      }
+
+      /* Data skipped over by a seek past the end reads back as zeros */
+      if(module->position > module->size)
+         memset(module->mem + module->size, 0, (size_t)(module->position - module->size));
+      memcpy(module->mem + module->position, buffer, size);
+      ret = size;
+   }
+
+   module->position += ret;
+   if(module->position > module->size) module->size = module->position;
+   return ret;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_temp_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+
+   if(offset < 0)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      return p_ctx->status;
+   }
+
+   module->position = offset;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_temp_storage( VC_CONTAINER_IO_T *p_ctx,
+   uint32_t memory_budget, const char *directory )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   char *dir = 0;
+
+   if(p_ctx->pf_close != io_temp_close)
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   /* Once data has been written, it is too late to change where it goes */
+   if(module->size || p_ctx->offset)
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   if(directory && *directory)
+   {
+      dir = strdup(directory);
+      if(!dir) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   }
+
+   free(module->directory);
+   module->directory = dir;
+   module->budget = memory_budget;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_temp_open( VC_CONTAINER_IO_T *p_ctx,
+   uint32_t memory_budget, const char *directory )
+{
+   VC_CONTAINER_IO_MODULE_T *module;
+   VC_CONTAINER_STATUS_T status;
+
+   module = malloc(sizeof(*module));
+   if(!module) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   memset(module, 0, sizeof(*module));
+   module->fd = -1;
+
+   p_ctx->module = module;
+   p_ctx->pf_close = io_temp_close;
+   p_ctx->pf_read = io_temp_read;
+   p_ctx->pf_write = io_temp_write;
+   p_ctx->pf_seek = io_temp_seek;
+
+   status = vc_container_io_temp_storage(p_ctx, memory_budget, directory);
+   if(status != VC_CONTAINER_SUCCESS)
+   {
+      free(module);
+      p_ctx->module = 0;
+      p_ctx->pf_close = 0;
+   }
+   return status;
+}
@@ -88,11 +88,12 @@ static int64_t mkv_io_read_uint(VC_CONTAINER_IO_T *io, int64_t *size)
    uint64_t value, mask;
 
    value = vc_container_io_read_uint8(io); (*size)--;
-   if(value == 0xFF) return -1;
 
    for(mask = 0x80; mask; mask <<= 7)
    {
-      if(value & mask) return value & ~mask;
+      /* All the bits set means an unknown size, whatever the length (live streams
+       * typically use 0x01FFFFFFFFFFFFFF for the segment) */
+      if(value & mask) return (value & ~mask) == mask - 1 ? -1 : (int64_t)(value & ~mask);
       value = (value << 8) | vc_container_io_read_uint8(io); (*size)--;
    }
    return 0;
@@ -83,6 +83,8 @@ typedef enum {
    MP4_BOX_TYPE_TREX              = VC_FOURCC('t','r','e','x'),
    MP4_BOX_TYPE_TFHD              = VC_FOURCC('t','f','h','d'),
    MP4_BOX_TYPE_TRUN              = VC_FOURCC('t','r','u','n'),
+   MP4_BOX_TYPE_MFHD              = VC_FOURCC('m','f','h','d'),
+   MP4_BOX_TYPE_TFDT              = VC_FOURCC('t','f','d','t'),
    MP4_BOX_TYPE_PSSH              = VC_FOURCC('p','s','s','h'),
    MP4_BOX_TYPE_SINF              = VC_FOURCC('s','i','n','f'),
    MP4_BOX_TYPE_FRMA              = VC_FOURCC('f','r','m','a'),
@@ -120,6 +120,28 @@ typedef struct
 
 } MP4_READER_STATE_T;
 
+/* Entry of the in-memory sample index */
+typedef struct
+{
+   int64_t offset;
+   int64_t dts; /* In track timescale units */
+   int32_t composition_offset;
+   unsigned int size : 31;
+   unsigned int keyframe : 1;
+
+} MP4_SAMPLE_INDEX_T;
+
+/* Prefix-summed entry of the stts/ctts/stsc/stss tables, used for seeking */
+typedef struct
+{
+   uint32_t sample; /* First sample (0 based) covered by the entry */
+   uint32_t count;  /* Number of samples (stts/ctts) or chunks (stsc) in the entry */
+   uint32_t value;  /* Sample delta, composition offset or samples per chunk */
+   uint32_t chunk;  /* First chunk (0 based) covered by the entry */
+   int64_t time;    /* Decoding time of the first sample */
+
+} MP4_SEEK_ENTRY_T;
+
 typedef struct VC_CONTAINER_TRACK_MODULE_T
 {
    MP4_READER_STATE_T state;
@@ -130,6 +152,7 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
    uint8_t object_type_indication;
 
    uint32_t sample_size;
+   uint32_t sample_count; /* Number of samples advertised by the stsz box */
    struct {
       int64_t offset;
       uint32_t entries;
@@ -143,6 +166,12 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
 
    int64_t pts_offset;
 
+   MP4_SAMPLE_INDEX_T *index; /* Decoded sample tables, if requested */
+   uint32_t index_entries;
+
+   bool seek_tables_built; /* Built on the first seek */
+   MP4_SEEK_ENTRY_T *seek_table[MP4_SAMPLE_TABLE_NUM];
+
 } VC_CONTAINER_TRACK_MODULE_T;
 
 typedef struct VC_CONTAINER_MODULE_T
@@ -198,6 +227,7 @@ static VC_CONTAINER_STATUS_T mp4_read_box_edts( VC_CONTAINER_T *p_ctx, int64_t s
 static VC_CONTAINER_STATUS_T mp4_read_box_elst( VC_CONTAINER_T *p_ctx, int64_t size );
 static VC_CONTAINER_STATUS_T mp4_read_box_mvex( VC_CONTAINER_T *p_ctx, int64_t size );
 static VC_CONTAINER_STATUS_T mp4_read_box_trex( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_traf( VC_CONTAINER_T *p_ctx, int64_t size );
 static VC_CONTAINER_STATUS_T mp4_read_box_tfhd( VC_CONTAINER_T *p_ctx, int64_t size );
 static VC_CONTAINER_STATUS_T mp4_read_box_trun( VC_CONTAINER_T *p_ctx, int64_t size );
 static VC_CONTAINER_STATUS_T mp4_read_box_pssh( VC_CONTAINER_T *p_ctx, int64_t size );
@@ -249,7 +279,7 @@ static struct {
    {MP4_BOX_TYPE_MOOF, mp4_read_box_moof, MP4_BOX_TYPE_ROOT},
    {MP4_BOX_TYPE_MVHD, mp4_read_box_mvhd, MP4_BOX_TYPE_MOOV},
    {MP4_BOX_TYPE_TRAK, mp4_read_box_trak, MP4_BOX_TYPE_MOOV},
-   {MP4_BOX_TYPE_TRAF, mp4_read_box_trak, MP4_BOX_TYPE_MOOF},
+   {MP4_BOX_TYPE_TRAF, mp4_read_box_traf, MP4_BOX_TYPE_MOOF},
    {MP4_BOX_TYPE_TKHD, mp4_read_box_tkhd, MP4_BOX_TYPE_TRAK},
    {MP4_BOX_TYPE_EDTS, mp4_read_box_edts, MP4_BOX_TYPE_TRAK},
    {MP4_BOX_TYPE_ELST, mp4_read_box_elst, MP4_BOX_TYPE_EDTS},
@@ -571,6 +601,13 @@ static VC_CONTAINER_STATUS_T mp4_read_box_trex( VC_CONTAINER_T *p_ctx, int64_t s
    return STREAM_STATUS(p_ctx);
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_traf( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   /* The track fragment refers to a track declared in the moov (through tfhd) */
+   return mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_TRAK);
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_read_box_tfhd( VC_CONTAINER_T *p_ctx, int64_t size )
 {
@@ -1044,6 +1081,7 @@ static VC_CONTAINER_STATUS_T mp4_read_box_elst( VC_CONTAINER_T *p_ctx, int64_t s
    VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
    uint32_t i, version, entries;
    int64_t duration, media_time;
+   bool media_edit = false;
 
    version = MP4_READ_U8(p_ctx, "version");
    MP4_SKIP_U24(p_ctx, "flags");
@@ -1066,6 +1104,9 @@ static VC_CONTAINER_STATUS_T mp4_read_box_elst( VC_CONTAINER_T *p_ctx, int64_t s
 
       if(!i && media_time < 0)
          track_module->pts_offset = duration;
+      else if(media_time > 0 && !media_edit)
+         track_module->pts_offset -= media_time; /* Usually the composition delay */
+      if(media_time >= 0) media_edit = true;
    }
 
    return STREAM_STATUS(p_ctx);
@@ -1336,7 +1377,8 @@ static VC_CONTAINER_STATUS_T mp4_cache_table( VC_CONTAINER_T *p_ctx, MP4_SAMPLE_
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
-   uint32_t available_entries, entries_size;
+   uint32_t available_entries;
+   int64_t entries_size;
 
    if(size < 0) return VC_CONTAINER_ERROR_CORRUPTED;
 
@@ -1351,19 +1393,22 @@ static VC_CONTAINER_STATUS_T mp4_cache_table( VC_CONTAINER_T *p_ctx, MP4_SAMPLE_
       return STREAM_STATUS(p_ctx);
    }
 
-   available_entries = size / track_module->sample_table[table].entry_size;
+   /* The entry count comes straight from the file so it can't be trusted
+    * past the end of the box */
+   available_entries = (uint32_t)MIN(size / track_module->sample_table[table].entry_size, (int64_t)UINT32_MAX);
    if(available_entries < entries)
    {
-      LOG_DEBUG(p_ctx, "table has less entries than advertised (%i/%i)", available_entries, entries);
+      LOG_DEBUG(p_ctx, "table has less entries than advertised (%u/%u)", available_entries, entries);
       entries = available_entries;
+      track_module->sample_table[table].entries = entries;
    }
 
-   entries_size = entries * track_module->sample_table[table].entry_size;
-   size = vc_container_io_cache(p_ctx->priv->io, entries_size );
+   entries_size = (int64_t)entries * track_module->sample_table[table].entry_size;
+   size = vc_container_io_cache(p_ctx->priv->io, (size_t)entries_size );
    if(size != entries_size)
    {
       available_entries = size / track_module->sample_table[table].entry_size;
-      LOG_DEBUG(p_ctx, "cached less table entries than advertised (%i/%i/%i/%i)", available_entries, entries, entries_size, size);
+      LOG_DEBUG(p_ctx, "cached less table entries than advertised (%u/%u/%"PRIi64"/%"PRIi64")", available_entries, entries, entries_size, size);
       track_module->sample_table[table].entries = available_entries;
    }
 
@@ -1444,10 +1489,11 @@ static VC_CONTAINER_STATUS_T mp4_read_box_stsz( VC_CONTAINER_T *p_ctx, int64_t s
    MP4_SKIP_U8(p_ctx, "version");
    MP4_SKIP_U24(p_ctx, "flags");
 
-   track_module->sample_size = READ_U32(p_ctx, "sample_size");
+   track_module->sample_size = MP4_READ_U32(p_ctx, "sample_size");
+   entries = MP4_READ_U32(p_ctx, "sample_count");
+   track_module->sample_count = entries;
    if(track_module->sample_size) return STREAM_STATUS(p_ctx);
 
-   entries = MP4_READ_U32(p_ctx, "sample_count");
    return mp4_cache_table( p_ctx, MP4_SAMPLE_TABLE_STSZ, entries, size );
 }
 
@@ -1821,10 +1867,16 @@ static VC_CONTAINER_STATUS_T mp4_read_box_text( VC_CONTAINER_T *p_ctx, int64_t s
 static VC_CONTAINER_STATUS_T mp4_reader_close( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
-   unsigned int i;
+   unsigned int i, j;
 
    for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      for(j = 0; j < MP4_SAMPLE_TABLE_NUM; j++)
+         free(track_module->seek_table[j]);
+      free(track_module->index);
       vc_container_free_track(p_ctx, p_ctx->tracks[i]);
+   }
    p_ctx->tracks_num = 0;
    free(module);
    return VC_CONTAINER_SUCCESS;
@@ -1962,6 +2014,171 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_table( VC_CONTAINER_T *p_ctx,
    return state->status;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_build_sample_index( VC_CONTAINER_T *p_ctx, uint32_t track )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[track]->priv->module;
+   MP4_SAMPLE_TABLE_T chunk_table = MP4_SAMPLE_TABLE_STCO;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   MP4_SAMPLE_INDEX_T *index = 0;
+   uint32_t *stsc = 0, i, j, count, samples = 0, sample, stsc_entries;
+   int64_t offset, duration = 0, data_size;
+   uint64_t total = 0;
+
+   /* Batched tracks return several samples at once so we leave them alone */
+   if(track_module->samples_batch_size) return VC_CONTAINER_SUCCESS;
+
+   /* Find out how many samples we have */
+   if(track_module->sample_size)
+   {
+      SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].offset);
+      for(i = 0; i < track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries; i++)
+      {
+         total += _READ_U32(p_ctx);
+         _SKIP_U32(p_ctx);
+      }
+
+      /* The counts come straight from the file. Don't let them make us allocate
+       * more samples than the stsz box advertises or the mdat can hold. */
+      data_size = module->data_size > 0 ? module->data_size : p_ctx->priv->io->size;
+      if(total > track_module->sample_count ||
+         (data_size > 0 && total > (uint64_t)data_size / track_module->sample_size))
+         return VC_CONTAINER_ERROR_CORRUPTED;
+      samples = (uint32_t)total;
+   }
+   else samples = track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entries;
+   status = STREAM_STATUS(p_ctx);
+   if(status != VC_CONTAINER_SUCCESS || !samples) return status;
+
+   /* The extra entry marks the end of the track. If we can't get the memory,
+    * we'll just read the tables as we go. */
+   stsc_entries = track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries;
+   if((size_t)samples + 1 > SIZE_MAX / sizeof(*index) ||
+      (size_t)stsc_entries + 1 > SIZE_MAX / 2 / sizeof(*stsc))
+      return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   index = malloc(((size_t)samples + 1) * sizeof(*index));
+   stsc = malloc(((size_t)stsc_entries + 1) * 2 * sizeof(*stsc));
+   if(!index || !stsc) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+   memset(index, 0, ((size_t)samples + 1) * sizeof(*index));
+
+   /* Sample sizes */
+   if(!track_module->sample_size)
+      SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].offset);
+   for(i = 0; i < samples; i++)
+      index[i].size = track_module->sample_size ? track_module->sample_size : _READ_U32(p_ctx);
+
+   /* Sample offsets. We load the sample to chunk table first so we can then
+    * go through the chunk offsets in one go. */
+   SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSC].offset);
+   for(i = 0; i < track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries; i++)
+   {
+      stsc[2*i] = _READ_U32(p_ctx); /* first_chunk */
+      stsc[2*i+1] = _READ_U32(p_ctx); /* samples_per_chunk */
+      _SKIP_U32(p_ctx);
+   }
+
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_CO64].entries)
+      chunk_table = MP4_SAMPLE_TABLE_CO64;
+   SEEK(p_ctx, track_module->sample_table[chunk_table].offset);
+   for(i = 0, count = 0, sample = 0; sample < samples &&
+       i < track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries; i++)
+   {
+      uint32_t chunks = i + 1 < track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries ?
+         stsc[2*i+2] : (uint32_t)-1;
+      if(!stsc[2*i] || !stsc[2*i+1] || stsc[2*i] >= chunks) break;
+
+      for(chunks -= stsc[2*i]; chunks && sample < samples &&
+          count < track_module->sample_table[chunk_table].entries; chunks--, count++)
+      {
+         offset = chunk_table == MP4_SAMPLE_TABLE_STCO ? _READ_U32(p_ctx) : _READ_U64(p_ctx);
+         for(j = 0; j < stsc[2*i+1] && sample < samples; j++, sample++)
+         {
+            index[sample].offset = offset;
+            offset += index[sample].size;
+         }
+      }
+   }
+   samples = sample;
+
+   /* Decoding times */
+   SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].offset);
+   for(i = 0, sample = 0; sample < samples &&
+       i < track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries; i++)
+   {
+      uint32_t delta;
+      count = _READ_U32(p_ctx);
+      delta = _READ_U32(p_ctx);
+      for(j = 0; j < count && sample < samples; j++, sample++)
+      {
+         index[sample].dts = duration;
+         duration += delta;
+      }
+   }
+   samples = sample;
+   index[samples].dts = duration;
+
+   /* Composition offsets */
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries)
+      SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].offset);
+   for(i = 0, sample = 0; sample < samples &&
+       i < track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries; i++)
+   {
+      int32_t composition_offset;
+      count = _READ_U32(p_ctx);
+      composition_offset = _READ_U32(p_ctx); /* Converted to signed */
+      for(j = 0; j < count && sample < samples; j++, sample++)
+         index[sample].composition_offset = composition_offset;
+   }
+
+   /* Sync samples */
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries)
+      SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSS].offset);
+   for(i = 0; i < track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries; i++)
+   {
+      sample = _READ_U32(p_ctx);
+      if(sample && sample <= samples) index[sample - 1].keyframe = 1;
+   }
+
+   status = STREAM_STATUS(p_ctx);
+   if(status != VC_CONTAINER_SUCCESS || !samples) goto error;
+
+   LOG_DEBUG(p_ctx, "track %u: indexed %u samples", track, samples);
+   track_module->index = index;
+   track_module->index_entries = samples;
+   free(stsc);
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   free(index);
+   free(stsc);
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_sample_index( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_TRACK_MODULE_T *track_module, MP4_READER_STATE_T *state )
+{
+   MP4_SAMPLE_INDEX_T *entry;
+   VC_CONTAINER_PARAM_UNUSED(p_ctx);
+
+   if(state->sample > track_module->index_entries)
+      return state->status = VC_CONTAINER_ERROR_EOS;
+
+   entry = &track_module->index[state->sample - 1];
+   state->offset = entry->offset;
+   state->sample_size = entry->size;
+   state->keyframe = entry->keyframe;
+   if(track_module->timescale)
+   {
+      state->dts = (track_module->pts_offset + entry->dts) * 1000000 / track_module->timescale;
+      state->pts = (track_module->pts_offset + entry->dts + entry->composition_offset) *
+         1000000 / track_module->timescale;
+   }
+
+   return state->status;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_read_sample_header( VC_CONTAINER_T *p_ctx, uint32_t track,
    MP4_READER_STATE_T *state )
@@ -1979,6 +2196,9 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_header( VC_CONTAINER_T *p_ctx, uint
    state->sample_size = 0;
    state->sample++;
 
+   if(track_module->index)
+      return mp4_read_sample_index(p_ctx, track_module, state);
+
    if(!state->samples_in_chunk)
    {
       /* We're switching to the next chunk */
@@ -2071,22 +2291,33 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_header( VC_CONTAINER_T *p_ctx, uint
 
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_read_sample_data( VC_CONTAINER_T *p_ctx, uint32_t track,
-   MP4_READER_STATE_T *state, uint8_t *data, unsigned int *data_size )
+   MP4_READER_STATE_T *state, uint8_t *data, unsigned int *data_size, const uint8_t **borrowed )
 {
    VC_CONTAINER_STATUS_T status;
    unsigned int size = state->sample_size - state->sample_offset;
 
    if(state->status != VC_CONTAINER_SUCCESS) return state->status;
 
-   if(data_size && *data_size < size) size = *data_size;
+   if(data_size && *data_size < size && !borrowed) size = *data_size;
 
-   if(data)
+   if(data || borrowed)
    {
       state->status = SEEK(p_ctx, state->offset + state->sample_offset);
       if(state->status != VC_CONTAINER_SUCCESS) return state->status;
+   }
 
-      size = READ_BYTES(p_ctx, data, size);
+   if(borrowed)
+   {
+      /* Try to hand out the rest of the sample straight from the i/o buffers,
+       * otherwise fall back to reading it into the given buffer */
+      size_t borrowed_size = size;
+      *borrowed = BORROW_BYTES(p_ctx, &borrowed_size);
+      if(*borrowed) { size = borrowed_size; data = 0; }
+      else if(data_size && *data_size < size) size = *data_size;
    }
+
+   if(data)
+      size = READ_BYTES(p_ctx, data, size);
    state->sample_offset += size;
 
    if(data_size) *data_size = size;
@@ -2111,6 +2342,7 @@ static VC_CONTAINER_STATUS_T mp4_reader_read( VC_CONTAINER_T *p_ctx,
    MP4_READER_STATE_T *state;
    uint32_t i, track;
    unsigned int data_size;
+   const uint8_t *borrowed = 0;
    uint8_t *data = 0;
    int64_t offset;
 
@@ -2141,7 +2373,7 @@ static VC_CONTAINER_STATUS_T mp4_reader_read( VC_CONTAINER_T *p_ctx,
    if(status != VC_CONTAINER_SUCCESS) return status;
 
    if(!packet) /* Skip packet */
-      return mp4_read_sample_data(p_ctx, track, state, 0, 0);
+      return mp4_read_sample_data(p_ctx, track, state, 0, 0, 0);
 
    packet->dts = state->dts;
    packet->pts = state->pts;
@@ -2153,20 +2385,25 @@ static VC_CONTAINER_STATUS_T mp4_reader_read( VC_CONTAINER_T *p_ctx,
    packet->size = state->sample_size - state->sample_offset;
 
    if(flags & VC_CONTAINER_READ_FLAG_SKIP)
-      return mp4_read_sample_data(p_ctx, track, state, 0, 0);
+      return mp4_read_sample_data(p_ctx, track, state, 0, 0, 0);
    else if((flags & VC_CONTAINER_READ_FLAG_INFO) || !packet->data)
       return VC_CONTAINER_SUCCESS;
 
    data = packet->data;
    data_size = packet->buffer_size;
 
-   status = mp4_read_sample_data(p_ctx, track, state, data, &data_size);
+   status = mp4_read_sample_data(p_ctx, track, state, data, &data_size,
+      (flags & VC_CONTAINER_READ_FLAG_ZERO_COPY) ? &borrowed : 0);
    if(status != VC_CONTAINER_SUCCESS)
    {
-      /* FIXME */
+      /* The caller keeps its own buffer */
+      if(borrowed) vc_container_io_release(p_ctx->priv->io, borrowed);
       return status;
    }
 
+   /* The packet data is only const by convention when it was borrowed */
+   if(borrowed) packet->data = (uint8_t *)(uintptr_t)borrowed;
+
    packet->size = data_size;
    if(state->sample_offset) //?
       packet->flags &= ~VC_CONTAINER_PACKET_FLAG_FRAME_END;
@@ -2174,6 +2411,156 @@ static VC_CONTAINER_STATUS_T mp4_reader_read( VC_CONTAINER_T *p_ctx,
    return status;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_build_seek_tables( VC_CONTAINER_T *p_ctx, uint32_t track )
+{
+   static const MP4_SAMPLE_TABLE_T tables[] = {MP4_SAMPLE_TABLE_STTS,
+      MP4_SAMPLE_TABLE_CTTS, MP4_SAMPLE_TABLE_STSC, MP4_SAMPLE_TABLE_STSS};
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[track]->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   unsigned int i, t;
+
+   track_module->seek_tables_built = true;
+   if(!track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries ||
+      !track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries)
+      return VC_CONTAINER_SUCCESS;
+
+   for(t = 0; t < sizeof(tables)/sizeof(tables[0]); t++)
+   {
+      MP4_SAMPLE_TABLE_T table = tables[t];
+      uint32_t entries = track_module->sample_table[table].entries;
+      uint64_t sample = 0, chunk = 0;
+      MP4_SEEK_ENTRY_T *entry;
+      int64_t time = 0;
+
+      if(!entries) continue;
+      entry = track_module->seek_table[table] = malloc(entries * sizeof(*entry));
+      if(!entry) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+
+      status = SEEK(p_ctx, track_module->sample_table[table].offset);
+      if(status != VC_CONTAINER_SUCCESS) goto error;
+
+      for(i = 0; i < entries; i++)
+      {
+         switch(table)
+         {
+         case MP4_SAMPLE_TABLE_STSS:
+            entry[i].sample = _READ_U32(p_ctx) - 1; /* sample_number starts at 1 */
+            if(entry[i].sample == UINT32_MAX ||
+               (i && entry[i].sample <= entry[i-1].sample)) status = VC_CONTAINER_ERROR_CORRUPTED;
+            break;
+         case MP4_SAMPLE_TABLE_STSC:
+            entry[i].chunk = _READ_U32(p_ctx); /* first_chunk for now */
+            entry[i].value = _READ_U32(p_ctx);
+            _SKIP_U32(p_ctx);
+            if(!entry[i].chunk || !entry[i].value ||
+               (i && entry[i].chunk <= entry[i-1].chunk)) status = VC_CONTAINER_ERROR_CORRUPTED;
+            break;
+         default:
+            entry[i].sample = sample;
+            entry[i].time = time;
+            entry[i].count = _READ_U32(p_ctx);
+            entry[i].value = _READ_U32(p_ctx);
+            if(!entry[i].count) status = VC_CONTAINER_ERROR_CORRUPTED;
+            sample += entry[i].count;
+            time += (int64_t)entry[i].count * entry[i].value;
+            break;
+         }
+         if(status == VC_CONTAINER_SUCCESS) status = STREAM_STATUS(p_ctx);
+         if(status != VC_CONTAINER_SUCCESS) goto error;
+      }
+
+      if(sample > UINT32_MAX) { status = VC_CONTAINER_ERROR_CORRUPTED; goto error; }
+      if(table != MP4_SAMPLE_TABLE_STSC) continue;
+
+      /* Work out how many chunks and samples are covered by each stsc entry */
+      for(i = 0; i < entries; i++)
+      {
+         entry[i].count = (i + 1 < entries ? entry[i+1].chunk : (uint32_t)-1) - entry[i].chunk;
+         entry[i].chunk = chunk;
+         entry[i].sample = sample;
+         chunk += entry[i].count;
+         sample += (uint64_t)entry[i].count * entry[i].value;
+         if(i + 1 < entries && sample > UINT32_MAX)
+         { status = VC_CONTAINER_ERROR_CORRUPTED; goto error; }
+      }
+   }
+
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   LOG_DEBUG(p_ctx, "couldn't build seek tables for track %u (%i)", track, status);
+   for(t = 0; t < MP4_SAMPLE_TABLE_NUM; t++)
+   {
+      free(track_module->seek_table[t]);
+      track_module->seek_table[t] = 0;
+   }
+   return status;
+}
+
+/*****************************************************************************/
+static uint32_t mp4_search_seek_table( MP4_SEEK_ENTRY_T *table, uint32_t entries,
+   uint32_t sample )
+{
+   uint32_t low = 0, high = entries;
+
+   /* Returns the number of entries starting at or before the given sample */
+   while(low < high)
+   {
+      uint32_t middle = low + (high - low) / 2;
+      if(table[middle].sample <= sample) low = middle + 1;
+      else high = middle;
+   }
+   return low;
+}
+
+/*****************************************************************************/
+static void mp4_seek_sample_tables( VC_CONTAINER_TRACK_MODULE_T *track_module,
+   MP4_READER_STATE_T *state, uint32_t sample )
+{
+   uint32_t entries, i, samples;
+   MP4_SEEK_ENTRY_T *entry;
+
+   /* Get the timestamp */
+   entries = track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries;
+   i = mp4_search_seek_table(track_module->seek_table[MP4_SAMPLE_TABLE_STTS], entries, sample);
+   entry = &track_module->seek_table[MP4_SAMPLE_TABLE_STTS][i - 1];
+   samples = MIN(sample - entry->sample, entry->count);
+   state->sample_duration = entry->value;
+   state->duration = entry->time + (int64_t)samples * entry->value;
+   if(samples < entry->count)
+      state->sample_duration_count = entry->count - samples;
+   else
+      state->sample_duration_count = entry->count, i = entries;
+   state->sample_table[MP4_SAMPLE_TABLE_STTS].entry = i;
+
+   /* Find the right place in the sample composition table */
+   entries = track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries;
+   if(track_module->seek_table[MP4_SAMPLE_TABLE_CTTS])
+   {
+      i = mp4_search_seek_table(track_module->seek_table[MP4_SAMPLE_TABLE_CTTS], entries, sample);
+      entry = &track_module->seek_table[MP4_SAMPLE_TABLE_CTTS][i - 1];
+      samples = MIN(sample - entry->sample, entry->count);
+      state->sample_composition_offset = entry->value; /* Converted to signed */
+      if(samples < entry->count)
+         state->sample_composition_count = entry->count - samples;
+      else
+         state->sample_composition_count = entry->count, i = entries;
+      state->sample_table[MP4_SAMPLE_TABLE_CTTS].entry = i;
+   }
+
+   /* Find the right place in the synchronisation table */
+   entries = track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries;
+   if(track_module->seek_table[MP4_SAMPLE_TABLE_STSS])
+   {
+      i = sample ? mp4_search_seek_table(track_module->seek_table[MP4_SAMPLE_TABLE_STSS],
+         entries, sample - 1) : 0;
+      entry = &track_module->seek_table[MP4_SAMPLE_TABLE_STSS][MIN(i, entries - 1)];
+      state->next_sync_sample = entry->sample + 1;
+      state->sample_table[MP4_SAMPLE_TABLE_STSS].entry = MIN(i + 1, entries);
+   }
+}
+
 /*****************************************************************************/
 static uint32_t mp4_find_sample( VC_CONTAINER_T *p_ctx, uint32_t track,
    MP4_READER_STATE_T *state, int64_t seek_time, VC_CONTAINER_STATUS_T *p_status )
@@ -2191,6 +2578,50 @@ static uint32_t mp4_find_sample( VC_CONTAINER_T *p_ctx, uint32_t track,
     * rounding errors in the timestamp (because of the timescale conversion) */
    seek_time_up = seek_time_up * track_module->timescale / 1000000;
    seek_time_up -= track_module->pts_offset;
+   /* Seeking before the start of the track lands on its first sample */
+   if(seek_time < 0) seek_time = 0;
+   if(seek_time_up < 0) seek_time_up = 0;
+
+   if(track_module->index)
+   {
+      uint32_t low = 0, high = track_module->index_entries + 1;
+
+      /* Binary search for the last sample starting before the requested time */
+      while(low + 1 < high)
+      {
+         uint32_t middle = low + (high - low) / 2;
+         if(track_module->index[middle].dts <= seek_time_up) low = middle;
+         else high = middle;
+      }
+      sample = low;
+      goto end;
+   }
+
+   if(!track_module->seek_tables_built)
+      mp4_build_seek_tables(p_ctx, track);
+   if(track_module->seek_table[MP4_SAMPLE_TABLE_STTS])
+   {
+      MP4_SEEK_ENTRY_T *stts = track_module->seek_table[MP4_SAMPLE_TABLE_STTS];
+      uint32_t low = 0, high = track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries;
+
+      /* Binary search for the first entry ending after the requested time */
+      while(low < high)
+      {
+         uint32_t middle = low + (high - low) / 2;
+         if(stts[middle].time + (int64_t)stts[middle].count * stts[middle].value <= seek_time)
+            low = middle + 1;
+         else high = middle;
+      }
+
+      if(low == track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries)
+         sample = stts[low - 1].sample + stts[low - 1].count;
+      else if(!stts[low].value)
+         sample = stts[low].sample;
+      else
+         sample = stts[low].sample + MAX((seek_time - stts[low].time) / stts[low].value,
+            (seek_time_up - stts[low].time) / stts[low].value);
+      goto end;
+   }
 
    status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].offset);
    if(status != VC_CONTAINER_SUCCESS) goto end;
@@ -2233,6 +2664,31 @@ static VC_CONTAINER_STATUS_T mp4_seek_track( VC_CONTAINER_T *p_ctx, uint32_t tra
 
    memset(state, 0, sizeof(*state));
 
+   if(track_module->index)
+   {
+      state->sample = sample;
+      return mp4_read_sample_header(p_ctx, track, state);
+   }
+
+   if(!track_module->seek_tables_built)
+      mp4_build_seek_tables(p_ctx, track);
+   if(track_module->seek_table[MP4_SAMPLE_TABLE_STTS])
+   {
+      MP4_SEEK_ENTRY_T *entry = track_module->seek_table[MP4_SAMPLE_TABLE_STSC];
+      entry += mp4_search_seek_table(entry,
+         track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries, sample) - 1;
+
+      /* Find the right chunk */
+      samples = sample - entry->sample;
+      chunk = entry->chunk + samples / entry->value;
+      state->sample_table[MP4_SAMPLE_TABLE_STSC].entry =
+         entry - track_module->seek_table[MP4_SAMPLE_TABLE_STSC] + 1;
+      state->samples_per_chunk = state->samples_in_chunk = entry->value;
+      state->chunks = entry->count - samples / entry->value - 1;
+      samples %= entry->value;
+      goto chunk_found;
+   }
+
    /* Find the right chunk */
    for(i = 0, samples = sample; i < track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries; i++)
    {
@@ -2258,6 +2714,7 @@ static VC_CONTAINER_STATUS_T mp4_seek_track( VC_CONTAINER_T *p_ctx, uint32_t tra
    }
 
    /* Get the offset of the selected chunk */
+ chunk_found:
    state->sample_table[MP4_SAMPLE_TABLE_STCO].entry = chunk;
    state->sample_table[MP4_SAMPLE_TABLE_CO64].entry = chunk;
    state->status = mp4_read_sample_table( p_ctx, track_module, state, MP4_SAMPLE_TABLE_STCO, 1 );
@@ -2273,6 +2730,12 @@ static VC_CONTAINER_STATUS_T mp4_seek_track( VC_CONTAINER_T *p_ctx, uint32_t tra
       state->samples_in_chunk--;
    }
 
+   if(track_module->seek_table[MP4_SAMPLE_TABLE_STTS])
+   {
+      mp4_seek_sample_tables(track_module, state, sample);
+      goto done;
+   }
+
    /* Get the timestamp */
    for(i = 0, samples = sample; i < track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries; i++)
    {
@@ -2316,6 +2779,7 @@ static VC_CONTAINER_STATUS_T mp4_seek_track( VC_CONTAINER_T *p_ctx, uint32_t tra
       if(state->next_sync_sample >= sample + 1) break;
    }
 
+ done:
    state->sample = sample;
    state->sample_size = 0;
    mp4_read_sample_header(p_ctx, track, state);
@@ -2331,7 +2795,7 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module;
    VC_CONTAINER_STATUS_T status;
-   uint32_t i, track, sample, prev_sample, next_sample;
+   uint32_t i, track, sample, samples, prev_sample, next_sample;
    int64_t seek_time = *offset;
    VC_CONTAINER_PARAM_UNUSED(module);
    VC_CONTAINER_PARAM_UNUSED(mode);
@@ -2363,7 +2827,34 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
    sample = mp4_find_sample( p_ctx, track, &track_module->state, seek_time, &status );
    if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
 
+   /* Seeking past the end lands on the last sync sample */
+   samples = track_module->index ? track_module->index_entries : track_module->sample_count;
+   if(samples && sample >= samples) sample = samples - 1;
+
    /* Find the closest sync sample */
+   if(track_module->index && track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries &&
+      sample < track_module->index_entries)
+   {
+      for(prev_sample = sample; prev_sample &&
+          !track_module->index[prev_sample].keyframe; prev_sample--);
+      for(next_sample = sample + 1; next_sample < track_module->index_entries &&
+          !track_module->index[next_sample].keyframe; next_sample++);
+      if((flags & VC_CONTAINER_SEEK_FLAG_FORWARD) && next_sample < track_module->index_entries)
+         sample = next_sample;
+      else
+         sample = prev_sample;
+      goto seek_track;
+   }
+   if(track_module->seek_table[MP4_SAMPLE_TABLE_STSS])
+   {
+      MP4_SEEK_ENTRY_T *stss = track_module->seek_table[MP4_SAMPLE_TABLE_STSS];
+      i = mp4_search_seek_table(stss, track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries, sample);
+      if((flags & VC_CONTAINER_SEEK_FLAG_FORWARD) && i < track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries)
+         sample = stss[i].sample;
+      else
+         sample = i ? stss[i-1].sample : 0;
+      goto seek_track;
+   }
    status = mp4_seek_sample_table( p_ctx, track_module, &track_module->state, MP4_SAMPLE_TABLE_STSS );
    if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
    for(i = 0, prev_sample = 0, next_sample = 0;
@@ -2377,8 +2868,12 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
       }
       prev_sample = next_sample;
    }
+   /* No sync sample after the requested one, use the last one */
+   if(i == track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries)
+      sample = prev_sample;
 
    /* Do the seek on this track and use its timestamp as the new seek point */
+ seek_track:
    status = mp4_seek_track(p_ctx, track, &track_module->state, sample);
    if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
    seek_time = track_module->state.pts;
@@ -2408,6 +2903,7 @@ VC_CONTAINER_STATUS_T mp4_reader_open( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
    VC_CONTAINER_MODULE_T *module = 0;
+   const char *value = 0;
    unsigned int i;
    uint8_t h[8];
 
@@ -2473,6 +2969,20 @@ VC_CONTAINER_STATUS_T mp4_reader_open( VC_CONTAINER_T *p_ctx )
 #endif
    }
 
+   /* Decode the sample tables once and for all if requested */
+   if(vc_uri_find_query(p_ctx->priv->uri, 0, "index", &value) && (!value || strcmp(value, "0")))
+   {
+      for(i = 0; i < p_ctx->tracks_num; i++)
+      {
+         /* Not critical, we'll just fall back to reading the tables, unless
+          * the tables themselves don't make sense */
+         status = mp4_build_sample_index(p_ctx, i);
+         if(status == VC_CONTAINER_ERROR_CORRUPTED) goto error;
+         if(status != VC_CONTAINER_SUCCESS)
+            LOG_DEBUG(p_ctx, "couldn't index track %u (%i)", i, status);
+      }
+   }
+
    /* Initialise tracks */
    for(i = 0; i < p_ctx->tracks_num; i++)
    {
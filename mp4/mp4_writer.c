@@ -49,9 +49,49 @@ Defines.
 
 #define MP4_64BITS_TIME 0 /* 0 to disable / 1 to enable */
 
+#define MP4_FASTSTART_BLOCK_SIZE (256*1024)
+#define MP4_FASTSTART_RESERVE_SIZE (128*1024) /* Room left for the moov box by default */
+
+#define MP4_FRAGMENT_SAMPLES_MAX 4096 /* Force a new fragment past this number of samples */
+#define MP4_FRAGMENT_BLOCK_SIZE (64*1024)
+
+#define MP4_TABLE_BLOCK_VALUES 16384 /* Sample table values kept in memory before spilling to disk */
+#define MP4_MDAT_HEADER_SIZE 16 /* Free box followed by the mdat box header */
+
 /******************************************************************************
 Type definitions.
 ******************************************************************************/
+typedef struct MP4_FRAGMENT_SAMPLE_T
+{
+   int64_t offset;    /**< Offset of the sample data in the temporary file */
+   int64_t dts;
+   int64_t pts;
+   uint32_t size;
+   uint32_t duration; /**< Duration in timescale units, computed when the fragment is written */
+   uint8_t track;
+   bool keyframe;
+} MP4_FRAGMENT_SAMPLE_T;
+
+/** Sample table data built while samples are written. Only the most recent values are
+ * kept in memory, full blocks of values being spilled to the temporary file. */
+typedef struct MP4_WRITER_TABLE_T
+{
+   uint32_t *values;
+   unsigned int values_num;
+   unsigned int values_max;
+   int64_t *blocks;   /**< Offsets of the spilled blocks in the temporary file */
+   unsigned int blocks_num;
+   unsigned int blocks_max;
+} MP4_WRITER_TABLE_T;
+
+/** How the values of a table are written out */
+typedef enum
+{
+   MP4_TABLE_FORMAT_U32,      /**< 32 bits values */
+   MP4_TABLE_FORMAT_OFFSET32, /**< Pairs of values holding 64 bits offsets, written on 32 bits */
+   MP4_TABLE_FORMAT_OFFSET64, /**< Pairs of values holding 64 bits offsets, written on 64 bits */
+} MP4_TABLE_FORMAT_T;
+
 typedef struct VC_CONTAINER_TRACK_MODULE_T
 {
    uint32_t fourcc;
@@ -60,13 +100,24 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
    uint32_t stsd_entries;
 
    int64_t offset;
-   int64_t timestamp;
-   int64_t delta_timestamp;
-   int64_t samples_in_chunk;
-   int64_t samples_in_prev_chunk;
+   uint32_t samples_in_chunk;
+   uint32_t chunk_sample_description;
+   uint32_t sample_size;      /**< Size of all the samples so far, 0 if they differ */
+
+   /* Pending run-length coded entries of the sample tables */
+   int64_t stts_dts;          /**< Decoding time of the last sample, in timescale units */
+   uint32_t stts_count;
+   uint32_t stts_delta;
+   uint32_t ctts_count;
+   uint32_t ctts_offset;
+   uint32_t ctts_first;       /**< Composition offset of the first sample */
+   uint32_t stsc_first_chunk;
+   uint32_t stsc_samples;
+   uint32_t stsc_sample_description;
    struct {
       uint32_t entries;
       uint32_t entry_size;
+      MP4_WRITER_TABLE_T table;
    } sample_table[MP4_SAMPLE_TABLE_NUM];
 
    int64_t first_pts;
@@ -74,6 +125,13 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
 
    int64_t duration;
 
+   /* Fragmented mode */
+   uint32_t fragment_samples;
+   int64_t fragment_size;
+   int64_t fragment_data_offset;
+   int64_t fragment_dts;
+   uint32_t fragment_last_duration;
+
 } VC_CONTAINER_TRACK_MODULE_T;
 
 typedef struct VC_CONTAINER_MODULE_T
@@ -89,18 +147,34 @@ typedef struct VC_CONTAINER_MODULE_T
    unsigned int current_meta;
 
    unsigned moov_size;
-   int64_t mdat_offset;
+   int64_t moov_offset;       /**< Offset of the room reserved for the moov box */
+   uint32_t moov_reserved;    /**< Size of the room reserved for the moov box */
+   int64_t mdat_offset;       /**< Offset of the free box reserved in front of the mdat box */
    int64_t data_offset;
+   bool co64;                 /**< Chunk offsets don't all fit on 32 bits */
 
    uint32_t samples;
    VC_CONTAINER_WRITER_EXTRAIO_T temp;
    VC_CONTAINER_PACKET_T sample;
    int64_t sample_offset;
-   int64_t prev_sample_dts;
-   int64_t initial_sample_dts;
 
    int64_t earliest_pts;
+   int64_t earliest_dts;
    bool rebase_timestamps;
+   bool faststart;
+
+   /* Fragmented mode */
+   bool fragmented;
+   bool moov_written;
+   int64_t fragment_duration;
+   int64_t fragment_start;
+   int64_t fragment_moof_size;
+   unsigned int fragment_mdat_header_size; /**< 16 when the mdat box needs a 64 bits size */
+   uint32_t fragment_sequence;
+   MP4_FRAGMENT_SAMPLE_T *fragment_samples;
+   unsigned int fragment_samples_num;
+   unsigned int fragment_samples_max;
+   uint8_t *fragment_buffer;
 
 } VC_CONTAINER_MODULE_T;
 
@@ -138,6 +212,12 @@ static VC_CONTAINER_STATUS_T mp4_write_box_soun( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_esds( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_mvex( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_trex( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_moof( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mfhd( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_traf( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_tfhd( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_tfdt( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_trun( VC_CONTAINER_T *p_ctx );
 
 /* Metadata */
 static VC_CONTAINER_STATUS_T mp4_write_box_udta( VC_CONTAINER_T *p_ctx );
@@ -145,6 +225,7 @@ static VC_CONTAINER_STATUS_T mp4_write_box_meta( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_ilst( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_metadata( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_data( VC_CONTAINER_T *p_ctx );
+static int64_t mp4_writer_fragment_time( VC_CONTAINER_T *p_ctx, int64_t time );
 
 static struct {
   const MP4_BOX_TYPE_T type;
@@ -180,6 +261,12 @@ static struct {
    {MP4_BOX_TYPE_ESDS, mp4_write_box_esds},
    {MP4_BOX_TYPE_MVEX, mp4_write_box_mvex},
    {MP4_BOX_TYPE_TREX, mp4_write_box_trex},
+   {MP4_BOX_TYPE_MOOF, mp4_write_box_moof},
+   {MP4_BOX_TYPE_MFHD, mp4_write_box_mfhd},
+   {MP4_BOX_TYPE_TRAF, mp4_write_box_traf},
+   {MP4_BOX_TYPE_TFHD, mp4_write_box_tfhd},
+   {MP4_BOX_TYPE_TFDT, mp4_write_box_tfdt},
+   {MP4_BOX_TYPE_TRUN, mp4_write_box_trun},
 
    {MP4_BOX_TYPE_UDTA, mp4_write_box_udta},
    {MP4_BOX_TYPE_META, mp4_write_box_meta},
@@ -296,9 +383,9 @@ static VC_CONTAINER_STATUS_T mp4_write_box_moov( VC_CONTAINER_T *p_ctx )
       status = mp4_write_box(p_ctx, MP4_BOX_TYPE_UDTA);
    }
 
-#if 0
-   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MVEX);
-#endif
+   if (status == VC_CONTAINER_SUCCESS && module->fragmented)
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MVEX);
+
    return status;
 }
 
@@ -425,6 +512,120 @@ static VC_CONTAINER_STATUS_T mp4_write_box_trex( VC_CONTAINER_T *p_ctx )
    return STREAM_STATUS(p_ctx);
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_moof( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   unsigned int i;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MFHD);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      if(!p_ctx->tracks[i]->priv->module->fragment_samples) continue;
+      module->current_track = i;
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TRAF);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mfhd( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   WRITE_U8(p_ctx, 0, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U32(p_ctx, module->fragment_sequence, "sequence_number");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_traf( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_STATUS_T status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TFHD);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TFDT);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TRUN);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_tfhd( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   WRITE_U8(p_ctx, 0, "version");
+   WRITE_U24(p_ctx, 0x20000, "flags"); /* default-base-is-moof */
+   WRITE_U32(p_ctx, module->current_track + 1, "track_ID");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_tfdt( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
+
+   WRITE_U8(p_ctx, 1, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U64(p_ctx, track_module->fragment_dts, "base_media_decode_time");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_trun( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_T *track = p_ctx->tracks[module->current_track];
+   VC_CONTAINER_TRACK_MODULE_T *track_module = track->priv->module;
+   bool video = track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO;
+   int64_t offset;
+   unsigned int i;
+
+   WRITE_U8(p_ctx, 0, "version");
+   WRITE_U24(p_ctx, 0xF01, "flags"); /* data offset, duration, size, flags and composition offset present */
+   WRITE_U32(p_ctx, track_module->fragment_samples, "sample_count");
+   WRITE_U32(p_ctx, module->fragment_moof_size + module->fragment_mdat_header_size +
+             track_module->fragment_data_offset, "data_offset");
+
+   if(module->null.refcount)
+   {
+      /* We're not actually writing the data, we just want the size */
+      WRITE_BYTES(p_ctx, 0, track_module->fragment_samples * 16);
+      return STREAM_STATUS(p_ctx);
+   }
+
+   for(i = 0; i < module->fragment_samples_num; i++)
+   {
+      MP4_FRAGMENT_SAMPLE_T *sample = &module->fragment_samples[i];
+      if(sample->track != module->current_track) continue;
+
+      WRITE_U32(p_ctx, sample->duration, "sample_duration");
+      WRITE_U32(p_ctx, sample->size, "sample_size");
+      /* Non keyframes depend on other samples and aren't sync samples */
+      WRITE_U32(p_ctx, !video || sample->keyframe ? 0x02000000 : 0x01010000, "sample_flags");
+      offset = mp4_writer_fragment_time(p_ctx, sample->pts) - mp4_writer_fragment_time(p_ctx, sample->dts);
+      WRITE_U32(p_ctx, (uint32_t)(offset < 0 ? 0 : offset), "sample_composition_time_offset");
+   }
+
+   return STREAM_STATUS(p_ctx);
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_write_box_mvhd( VC_CONTAINER_T *p_ctx )
 {
@@ -436,9 +637,10 @@ static VC_CONTAINER_STATUS_T mp4_write_box_mvhd( VC_CONTAINER_T *p_ctx )
    WRITE_U8(p_ctx,  version, "version");
    WRITE_U24(p_ctx, 0, "flags");
 
-   /* Calculate the overall duration of the clip */
+   /* Calculate the overall duration of the clip. A fragmented file gets its
+    * duration from the fragments. */
    p_ctx->duration = 0;
-   for(i = 0; i < p_ctx->tracks_num; i++)
+   for(i = 0; i < p_ctx->tracks_num && !module->fragmented; i++)
    {
       VC_CONTAINER_TRACK_T *track = p_ctx->tracks[i];
       VC_CONTAINER_TRACK_MODULE_T *track_module = track->priv->module;
@@ -575,6 +777,29 @@ static VC_CONTAINER_STATUS_T mp4_write_box_elst( VC_CONTAINER_T *p_ctx )
    WRITE_U8(p_ctx,  version, "version");
    WRITE_U24(p_ctx, 0, "flags");
 
+   if(module->fragmented)
+   {
+      /* The fragments carry the decode time of each track, counted from the
+       * earliest decode time. A single edit of unknown duration shifts the
+       * composition times back so playback starts at the earliest pts. */
+      offset = module->rebase_timestamps ?
+         mp4_writer_fragment_time(p_ctx, module->earliest_pts) : 0;
+      WRITE_U32(p_ctx, 1, "entries");
+      if(version)
+      {
+         WRITE_U64(p_ctx, 0, "track_duration");
+         WRITE_U64(p_ctx, offset, "media_time");
+      }
+      else
+      {
+         WRITE_U32(p_ctx, 0, "track_duration");
+         WRITE_U32(p_ctx, offset, "media_time");
+      }
+      WRITE_U16(p_ctx, 1, "media_rate_integer");
+      WRITE_U16(p_ctx, 0, "media_rate_fraction");
+      return STREAM_STATUS(p_ctx);
+   }
+
    WRITE_U32(p_ctx, offset ? 2 : 1, "entries");
 
    /* Initial empty edit to offset the playback of the track */
@@ -594,16 +819,17 @@ static VC_CONTAINER_STATUS_T mp4_write_box_elst( VC_CONTAINER_T *p_ctx )
       WRITE_U16(p_ctx, 0, "media_rate_fraction");
    }
 
-   /* Edit for the actual track data */
+   /* Edit for the actual track data. Playback starts at the composition time
+    * of the first sample. */
    if(version)
    {
       WRITE_U64(p_ctx, duration, "track_duration");
-      WRITE_U64(p_ctx, 0, "media_time");
+      WRITE_U64(p_ctx, track->priv->module->ctts_first, "media_time");
    }
    else
    {
       WRITE_U32(p_ctx, duration, "track_duration");
-      WRITE_U32(p_ctx, 0, "media_time");
+      WRITE_U32(p_ctx, track->priv->module->ctts_first, "media_time");
    }
    WRITE_U16(p_ctx, 1, "media_rate_integer");
    WRITE_U16(p_ctx, 0, "media_rate_fraction");
@@ -790,7 +1016,9 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stbl( VC_CONTAINER_T *p_ctx )
    status = mp4_write_box(p_ctx, MP4_BOX_TYPE_STTS);
    if(status != VC_CONTAINER_SUCCESS) return status;
 
-   if( 0 && track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO)
+   /* Composition offsets are only needed when they aren't all 0 */
+   if(track->priv->module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries > 1 ||
+      track->priv->module->ctts_offset)
    {
       status = mp4_write_box(p_ctx, MP4_BOX_TYPE_CTTS);
       if(status != VC_CONTAINER_SUCCESS) return status;
@@ -802,10 +1030,11 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stbl( VC_CONTAINER_T *p_ctx )
    status = mp4_write_box(p_ctx, MP4_BOX_TYPE_STSZ);
    if(status != VC_CONTAINER_SUCCESS) return status;
 
-   if(1)
+   if(!p_ctx->priv->module->co64)
       status = mp4_write_box(p_ctx, MP4_BOX_TYPE_STCO);
    else
       status = mp4_write_box(p_ctx, MP4_BOX_TYPE_CO64);
+   if(status != VC_CONTAINER_SUCCESS) return status;
 
    if(track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO)
    {
@@ -841,43 +1070,113 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stsd( VC_CONTAINER_T *p_ctx )
 }
 
 /*****************************************************************************/
-static VC_CONTAINER_STATUS_T mp4_writer_write_sample_to_temp( VC_CONTAINER_T *p_ctx,
-   VC_CONTAINER_PACKET_T *packet)
+static VC_CONTAINER_STATUS_T mp4_writer_table_add( VC_CONTAINER_T *p_ctx,
+   MP4_WRITER_TABLE_T *table, uint32_t value )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
-   uint8_t keyframe = (packet->flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME) ? 0x80 : 0;
-   uint8_t sd_index = ((packet->flags >> 24) & 0x70);
-   int32_t dts_diff;
 
-   if(module->initial_sample_dts == VC_CONTAINER_TIME_UNKNOWN)
+   if(table->values_num >= table->values_max)
    {
-      module->initial_sample_dts = packet->dts;
-      module->prev_sample_dts = packet->dts;
+      unsigned int max = table->values_max ? table->values_max * 2 : 64;
+      uint32_t *values;
+
+      if(table->values_max >= MP4_TABLE_BLOCK_VALUES)
+      {
+         size_t size = table->values_num * sizeof(*table->values);
+
+         /* Spill the values to the temporary file to keep memory usage bounded */
+         if(table->blocks_num >= table->blocks_max)
+         {
+            unsigned int blocks_max = table->blocks_max ? table->blocks_max * 2 : 16;
+            int64_t *blocks = realloc(table->blocks, blocks_max * sizeof(*blocks));
+            if(!blocks) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+            table->blocks = blocks;
+            table->blocks_max = blocks_max;
+         }
+
+         table->blocks[table->blocks_num++] = module->temp.io->offset;
+         if(vc_container_io_write(module->temp.io, table->values, size) != size)
+            return module->temp.io->status ? module->temp.io->status : VC_CONTAINER_ERROR_FAILED;
+         table->values_num = 0;
+      }
+      else
+      {
+         values = realloc(table->values, max * sizeof(*values));
+         if(!values) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+         table->values = values;
+         table->values_max = max;
+      }
+   }
+
+   table->values[table->values_num++] = value;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_table_add_run( VC_CONTAINER_T *p_ctx,
+   MP4_WRITER_TABLE_T *table, uint32_t count, uint32_t value )
+{
+   VC_CONTAINER_STATUS_T status = mp4_writer_table_add(p_ctx, table, count);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+   return mp4_writer_table_add(p_ctx, table, value);
+}
+
+/*****************************************************************************/
+static void mp4_writer_table_write_values( VC_CONTAINER_T *p_ctx, const uint32_t *values,
+   unsigned int num, int64_t offset, MP4_TABLE_FORMAT_T format )
+{
+   unsigned int i;
+
+   if(format == MP4_TABLE_FORMAT_U32)
+   {
+      for(i = 0; i < num; i++)
+         _WRITE_U32(p_ctx, (uint32_t)(values[i] + offset));
+      return;
    }
-   dts_diff = packet->dts - module->prev_sample_dts;
 
-   vc_container_io_write_be_uint32(module->temp.io, packet->size);
-   vc_container_io_write_be_uint32(module->temp.io, dts_diff);
-   vc_container_io_write_be_uint24(module->temp.io, (uint32_t)(packet->pts - packet->dts));
-   vc_container_io_write_uint8(module->temp.io, packet->track | keyframe | sd_index);
-   module->prev_sample_dts = packet->dts;
-   return module->temp.io->status;
+   /* Pairs never straddle two blocks of values since they are added together
+    * and the block sizes are even */
+   for(i = 0; i + 1 < num; i += 2)
+   {
+      uint64_t value = ((uint64_t)values[i] << 32 | values[i+1]) + offset;
+      if(format == MP4_TABLE_FORMAT_OFFSET64) _WRITE_U64(p_ctx, value);
+      else _WRITE_U32(p_ctx, (uint32_t)value);
+   }
 }
 
 /*****************************************************************************/
-static VC_CONTAINER_STATUS_T mp4_writer_read_sample_from_temp( VC_CONTAINER_T *p_ctx,
-   VC_CONTAINER_PACKET_T *packet)
+static VC_CONTAINER_STATUS_T mp4_writer_table_write( VC_CONTAINER_T *p_ctx,
+   MP4_WRITER_TABLE_T *table, int64_t offset, MP4_TABLE_FORMAT_T format )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   uint32_t values[256];
+   unsigned int i, j, num;
+
+   /* Values which were spilled to the temporary file come first */
+   for(i = 0; i < table->blocks_num; i++)
+   {
+      vc_container_io_seek(module->temp.io, table->blocks[i]);
+      for(j = 0; j < MP4_TABLE_BLOCK_VALUES; j += num)
+      {
+         num = MIN(MP4_TABLE_BLOCK_VALUES - j, countof(values));
+         if(vc_container_io_read(module->temp.io, values, num * sizeof(*values)) !=
+            num * sizeof(*values))
+            return module->temp.io->status ? module->temp.io->status : VC_CONTAINER_ERROR_FAILED;
+         mp4_writer_table_write_values(p_ctx, values, num, offset, format);
+      }
+   }
+
+   mp4_writer_table_write_values(p_ctx, table->values, table->values_num, offset, format);
 
-   packet->size = vc_container_io_read_be_uint32(module->temp.io);
-   packet->dts += (int32_t)vc_container_io_read_be_uint32(module->temp.io);
-   packet->pts = packet->dts + vc_container_io_read_be_uint24(module->temp.io);
-   packet->track = vc_container_io_read_uint8(module->temp.io);
-   packet->flags = (packet->track & 0x80) ? VC_CONTAINER_PACKET_FLAG_KEYFRAME : 0;
-   packet->flags |= ((packet->track & 0x70) << 24);
-   packet->track &= 0xF;
-   return module->temp.io->status;
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static void mp4_writer_table_free( MP4_WRITER_TABLE_T *table )
+{
+   free(table->values);
+   free(table->blocks);
+   memset(table, 0, sizeof(*table));
 }
 
 /*****************************************************************************/
@@ -885,10 +1184,7 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stts( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
-   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
-   VC_CONTAINER_PACKET_T sample;
-   unsigned int entries = 0;
-   int64_t last_dts = 0, delta = 0;
+   VC_CONTAINER_STATUS_T status;
 
    WRITE_U8(p_ctx,  0, "version");
    WRITE_U24(p_ctx, 0, "flags");
@@ -902,33 +1198,17 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stts( VC_CONTAINER_T *p_ctx )
       return STREAM_STATUS(p_ctx);
    }
 
-   /* Go through all the samples written */
-   vc_container_io_seek(module->temp.io, INT64_C(0));
-   sample.dts = module->initial_sample_dts;
-
-   status = mp4_writer_read_sample_from_temp(p_ctx, &sample);
-   while(status == VC_CONTAINER_SUCCESS)
-   {
-      if(sample.track != module->current_track) goto skip;
-
-      delta = sample.dts * MP4_TIMESCALE / 1000000 - last_dts;
-      if(delta < 0) delta = 0;
-      last_dts += delta;
-      if(!entries++) goto skip;
-      WRITE_U32(p_ctx, 1, "sample_count");
-      WRITE_U32(p_ctx, delta, "sample_delta");
+   status = mp4_writer_table_write(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STTS].table, 0,
+                                 MP4_TABLE_FORMAT_U32);
+   if(status != VC_CONTAINER_SUCCESS) return status;
 
-     skip:
-      status = mp4_writer_read_sample_from_temp(p_ctx, &sample);
-   }
-   /* The last entry is always a duplicate of the previous one since we do not know
-    * the duration of the sample */
-   if(entries)
+   /* The last sample is given the same duration as the previous one since we do not
+    * know its duration. Fragmented files leave the table empty. */
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries)
    {
-      WRITE_U32(p_ctx, 1, "sample_count");
-      WRITE_U32(p_ctx, delta, "sample_delta");
+      WRITE_U32(p_ctx, track_module->stts_count + 1, "sample_count");
+      WRITE_U32(p_ctx, track_module->stts_delta, "sample_delta");
    }
-   vc_container_assert(entries == track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries);
 
    return STREAM_STATUS(p_ctx);
 }
@@ -939,9 +1219,29 @@ static VC_CONTAINER_STATUS_T mp4_write_box_ctts( VC_CONTAINER_T *p_ctx )
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
 
+   VC_CONTAINER_STATUS_T status;
+
    WRITE_U8(p_ctx,  0, "version");
    WRITE_U24(p_ctx, 0, "flags");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries, "entry_count");
+
+   if(module->null.refcount)
+   {
+      /* We're not actually writing the data, we just want the size */
+      WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries * 8);
+      return STREAM_STATUS(p_ctx);
+   }
+
+   status = mp4_writer_table_write(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].table, 0,
+                                 MP4_TABLE_FORMAT_U32);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries)
+   {
+      WRITE_U32(p_ctx, track_module->ctts_count, "sample_count");
+      WRITE_U32(p_ctx, track_module->ctts_offset, "sample_offset");
+   }
+
    return STREAM_STATUS(p_ctx);
 }
 
@@ -950,65 +1250,44 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stsc( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
-   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
-   VC_CONTAINER_PACKET_T sample;
-   int64_t offset = 0, track_offset = -1;
-   unsigned int entries = 0, chunks = 0, first_chunk = 0, samples_in_chunk = 0;
-
-   memset(&sample, 0, sizeof(VC_CONTAINER_PACKET_T));
+   VC_CONTAINER_STATUS_T status;
+   uint32_t entries;
+   bool last;
 
    WRITE_U8(p_ctx,  0, "version");
    WRITE_U24(p_ctx, 0, "flags");
-   WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries, "entry_count");
+   /* The last chunk only needs an entry of its own if it differs from the previous ones */
+   last = track_module->samples_in_chunk &&
+      (!track_module->stsc_first_chunk ||
+       track_module->samples_in_chunk != track_module->stsc_samples ||
+       track_module->chunk_sample_description != track_module->stsc_sample_description);
+   entries = track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries + (last ? 1 : 0);
+   WRITE_U32(p_ctx, entries, "entry_count");
 
    if(module->null.refcount)
    {
       /* We're not actually writing the data, we just want the size */
-      WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries * 12);
+      WRITE_BYTES(p_ctx, 0, entries * 12);
       return STREAM_STATUS(p_ctx);
    }
 
-   /* Go through all the samples written */
-   vc_container_io_seek(module->temp.io, INT64_C(0));
+   status = mp4_writer_table_write(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STSC].table, 0,
+                                 MP4_TABLE_FORMAT_U32);
+   if(status != VC_CONTAINER_SUCCESS) return status;
 
-   status = mp4_writer_read_sample_from_temp(p_ctx, &sample);
-   while(status == VC_CONTAINER_SUCCESS)
+   if(track_module->stsc_first_chunk)
    {
-      unsigned int sample_description_index = sample.flags >> 28;
-      if(sample.track != module->current_track) goto skip;
-
-      /* Is it a new chunk ? */
-      if(track_offset != offset)
-      {
-         chunks++;
-         if(samples_in_chunk)
-         {
-            WRITE_U32(p_ctx,  first_chunk, "first_chunk");
-            WRITE_U32(p_ctx,  samples_in_chunk, "samples_per_chunk");
-            WRITE_U32(p_ctx,  1 + sample_description_index, "sample_description_index");
-            entries++;
-         }
-         first_chunk = chunks;
-         samples_in_chunk = 0;
-      }
-      track_offset = offset + sample.size;
-      samples_in_chunk++;
-
-     skip:
-      offset += sample.size;
-      status = mp4_writer_read_sample_from_temp(p_ctx, &sample);
+      WRITE_U32(p_ctx,  track_module->stsc_first_chunk, "first_chunk");
+      WRITE_U32(p_ctx,  track_module->stsc_samples, "samples_per_chunk");
+      WRITE_U32(p_ctx,  1 + track_module->stsc_sample_description, "sample_description_index");
    }
-
-   if(samples_in_chunk)
+   if(last)
    {
-      WRITE_U32(p_ctx,  first_chunk, "first_chunk");
-      WRITE_U32(p_ctx,  samples_in_chunk, "samples_per_chunk");
-      WRITE_U32(p_ctx,  1, "sample_description_index");
-      entries++;
+      WRITE_U32(p_ctx,  track_module->chunks, "first_chunk");
+      WRITE_U32(p_ctx,  track_module->samples_in_chunk, "samples_per_chunk");
+      WRITE_U32(p_ctx,  1 + track_module->chunk_sample_description, "sample_description_index");
    }
 
-   vc_container_assert(entries == track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries);
-
    return STREAM_STATUS(p_ctx);
 }
 
@@ -1017,17 +1296,15 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stsz( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
-   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
-   VC_CONTAINER_PACKET_T sample;
-   unsigned int entries = 0;
-
-   memset(&sample, 0, sizeof(VC_CONTAINER_PACKET_T));
 
    WRITE_U8(p_ctx,  0, "version");
    WRITE_U24(p_ctx, 0, "flags");
 
-   WRITE_U32(p_ctx, 0, "sample_size");
+   /* No table is needed when all the samples have the same size */
+   WRITE_U32(p_ctx, track_module->sample_size, "sample_size");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entries, "sample_count");
+   if(track_module->sample_size)
+      return STREAM_STATUS(p_ctx);
 
    if(module->null.refcount)
    {
@@ -1036,23 +1313,8 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stsz( VC_CONTAINER_T *p_ctx )
       return STREAM_STATUS(p_ctx);
    }
 
-   /* Go through all the samples written */
-   vc_container_io_seek(module->temp.io, INT64_C(0));
-
-   status = mp4_writer_read_sample_from_temp(p_ctx, &sample);
-   while(status == VC_CONTAINER_SUCCESS)
-   {
-      if(sample.track != module->current_track) goto skip;
-
-      WRITE_U32(p_ctx, sample.size, "entry_size");
-      entries++;
-
-     skip:
-      status = mp4_writer_read_sample_from_temp(p_ctx, &sample);
-   }
-   vc_container_assert(entries == track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entries);
-
-   return STREAM_STATUS(p_ctx);
+   return mp4_writer_table_write(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].table, 0,
+                                 MP4_TABLE_FORMAT_U32);
 }
 
 /*****************************************************************************/
@@ -1060,12 +1322,6 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stco( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
-   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
-   VC_CONTAINER_PACKET_T sample;
-   int64_t offset = module->data_offset, track_offset = -1;
-   unsigned int entries = 0;
-
-   memset(&sample, 0, sizeof(VC_CONTAINER_PACKET_T));
 
    WRITE_U8(p_ctx,  0, "version");
    WRITE_U24(p_ctx, 0, "flags");
@@ -1078,29 +1334,10 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stco( VC_CONTAINER_T *p_ctx )
       return STREAM_STATUS(p_ctx);
    }
 
-   /* Go through all the samples written */
-   vc_container_io_seek(module->temp.io, INT64_C(0));
-
-   status = mp4_writer_read_sample_from_temp(p_ctx, &sample);
-   while(status == VC_CONTAINER_SUCCESS)
-   {
-      if(sample.track != module->current_track) goto skip;
-
-      /* Is it a new chunk ? */
-      if(track_offset != offset)
-      {
-         WRITE_U32(p_ctx, offset, "chunk_offset");
-         entries++;
-      }
-      track_offset = offset + sample.size;
-
-     skip:
-      offset += sample.size;
-      status = mp4_writer_read_sample_from_temp(p_ctx, &sample);
-   }
-   vc_container_assert(entries == track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entries);
-
-   return STREAM_STATUS(p_ctx);
+   /* Chunk offsets are stored relative to the start of the data since the mdat
+    * might have been moved (fast start) */
+   return mp4_writer_table_write(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STCO].table,
+                                 module->data_offset, MP4_TABLE_FORMAT_OFFSET32);
 }
 
 /*****************************************************************************/
@@ -1111,16 +1348,18 @@ static VC_CONTAINER_STATUS_T mp4_write_box_co64( VC_CONTAINER_T *p_ctx )
 
    WRITE_U8(p_ctx,  0, "version");
    WRITE_U24(p_ctx, 0, "flags");
-   WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_CO64].entries, "entry_count");
+   WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entries, "entry_count");
 
    if(module->null.refcount)
    {
       /* We're not actually writing the data, we just want the size */
-      WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_CO64].entries * 8);
+      WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entries * 8);
       return STREAM_STATUS(p_ctx);
    }
 
-   return STREAM_STATUS(p_ctx);
+   /* Same chunk offsets as the stco box */
+   return mp4_writer_table_write(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STCO].table,
+                                 module->data_offset, MP4_TABLE_FORMAT_OFFSET64);
 }
 
 /*****************************************************************************/
@@ -1128,11 +1367,6 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stss( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
-   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
-   VC_CONTAINER_PACKET_T sample;
-   unsigned int entries = 0, samples = 0;
-
-   memset(&sample, 0, sizeof(VC_CONTAINER_PACKET_T));
 
    WRITE_U8(p_ctx,  0, "version");
    WRITE_U24(p_ctx, 0, "flags");
@@ -1145,27 +1379,8 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stss( VC_CONTAINER_T *p_ctx )
       return STREAM_STATUS(p_ctx);
    }
 
-   /* Go through all the samples written */
-   vc_container_io_seek(module->temp.io, INT64_C(0));
-
-   status = mp4_writer_read_sample_from_temp(p_ctx, &sample);
-   while(status == VC_CONTAINER_SUCCESS)
-   {
-      if(sample.track != module->current_track) goto skip;
-
-      samples++;
-      if(sample.flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME)
-      {
-         WRITE_U32(p_ctx, samples, "sample_number");
-         entries++;
-      }
-
-     skip:
-      status = mp4_writer_read_sample_from_temp(p_ctx, &sample);
-   }
-   vc_container_assert(entries == track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries);
-
-   return STREAM_STATUS(p_ctx);
+   return mp4_writer_table_write(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STSS].table, 0,
+                                 MP4_TABLE_FORMAT_U32);
 }
 
 /*****************************************************************************/
@@ -1441,37 +1656,411 @@ static VC_CONTAINER_STATUS_T mp4_write_box_esds( VC_CONTAINER_T *p_ctx )
 }
 
 /*****************************************************************************/
-static VC_CONTAINER_STATUS_T mp4_writer_close( VC_CONTAINER_T *p_ctx )
+static VC_CONTAINER_STATUS_T mp4_writer_fragment_write_moov( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_STATUS_T status;
-   int64_t mdat_size;
+
+   /* The moov box only describes the tracks. It replaces the empty mdat box
+    * started when opening the file. */
+   SEEK(p_ctx, module->mdat_offset);
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   module->moov_written = true;
+   module->data_offset = STREAM_POSITION(p_ctx);
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static int64_t mp4_writer_fragment_time( VC_CONTAINER_T *p_ctx, int64_t time )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   /* Times are counted from the earliest decode time so decode times can't
+    * go negative when frames are reordered */
+   if(module->rebase_timestamps && module->earliest_dts != VC_CONTAINER_TIME_UNKNOWN)
+      time -= module->earliest_dts;
+   return time < 0 ? 0 : time * MP4_TIMESCALE / 1000000;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_fragment_flush( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_PACKET_T *next )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   int64_t next_dts[MP4_TRACKS_MAX], offset = 0, size;
+   int pending[MP4_TRACKS_MAX];
+   unsigned int i, j;
+
+   if(!module->fragment_samples_num) return VC_CONTAINER_SUCCESS;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      track_module->fragment_samples = 0;
+      track_module->fragment_size = 0;
+      next_dts[i] = -1;
+      pending[i] = -1;
+   }
+   if(next) next_dts[next->track] = mp4_writer_fragment_time(p_ctx,
+      next->dts != VC_CONTAINER_TIME_UNKNOWN ? next->dts : next->pts);
+
+   /* Work out the sample durations by going backwards through the fragment.
+    * The duration of the last sample of a track is only known if the next
+    * sample of that track is available, otherwise we reuse the previous one. */
+   for(i = module->fragment_samples_num; i > 0; i--)
+   {
+      MP4_FRAGMENT_SAMPLE_T *sample = &module->fragment_samples[i-1];
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[sample->track]->priv->module;
+      int64_t dts = mp4_writer_fragment_time(p_ctx, sample->dts);
+
+      track_module->fragment_samples++;
+      track_module->fragment_size += sample->size;
+
+      sample->duration = 0;
+      if(next_dts[sample->track] < 0)
+         pending[sample->track] = i - 1;
+      else if(next_dts[sample->track] > dts)
+         sample->duration = next_dts[sample->track] - dts;
+
+      if(pending[sample->track] >= 0 && pending[sample->track] != (int)i - 1)
+      {
+         module->fragment_samples[pending[sample->track]].duration = sample->duration;
+         pending[sample->track] = -1;
+      }
+      next_dts[sample->track] = dts;
+   }
+
+   /* Samples are grouped per track in the mdat so each track only needs one run */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      if(!track_module->fragment_samples) continue;
+
+      if(pending[i] >= 0)
+         module->fragment_samples[pending[i]].duration = track_module->fragment_last_duration;
+      track_module->fragment_dts = next_dts[i];
+      track_module->fragment_data_offset = offset;
+      offset += track_module->fragment_size;
+   }
+   for(i = 0; i < module->fragment_samples_num; i++)
+      p_ctx->tracks[module->fragment_samples[i].track]->priv->module->fragment_last_duration =
+         module->fragment_samples[i].duration;
+
+   /* The moov box goes out with the first fragment, once we know when the
+    * tracks start */
+   if(!module->moov_written)
+   {
+      status = mp4_writer_fragment_write_moov(p_ctx);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
+
+   /* We need the size of the moof box to generate the data offsets */
+   module->fragment_mdat_header_size = offset + 8 > (int64_t)UINT32_MAX ? 16 : 8;
+   if(!vc_container_writer_extraio_enable(p_ctx, &module->null))
+   {
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOF);
+      module->fragment_moof_size = STREAM_POSITION(p_ctx);
+   }
+   vc_container_writer_extraio_disable(p_ctx, &module->null);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   module->fragment_sequence++;
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOF);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   if(module->fragment_mdat_header_size > 8)
+   {
+      WRITE_U32(p_ctx, 1, "size");
+      WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
+      WRITE_U64(p_ctx, offset + 16, "largesize");
+   }
+   else
+   {
+      WRITE_U32(p_ctx, (uint32_t)(offset + 8), "size");
+      WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
+   }
+
+   /* Copy the sample data over from the temporary file */
+   for(i = 0; i < p_ctx->tracks_num && STREAM_STATUS(p_ctx) == VC_CONTAINER_SUCCESS; i++)
+   {
+      for(j = 0; j < module->fragment_samples_num; j++)
+      {
+         MP4_FRAGMENT_SAMPLE_T *sample = &module->fragment_samples[j];
+         if(sample->track != i) continue;
+
+         vc_container_io_seek(module->temp.io, sample->offset);
+         for(offset = sample->size; offset > 0; offset -= size)
+         {
+            size = MIN(offset, MP4_FRAGMENT_BLOCK_SIZE);
+            if(vc_container_io_read(module->temp.io, module->fragment_buffer, size) != (size_t)size)
+               return module->temp.io->status ? module->temp.io->status : VC_CONTAINER_ERROR_FAILED;
+            if(WRITE_PAYLOAD(p_ctx, module->fragment_buffer, size) != (size_t)size)
+               return STREAM_STATUS(p_ctx);
+         }
+      }
+   }
+
+   /* Make sure the fragment reaches the storage before starting the next one */
+   vc_container_io_control(p_ctx->priv->io, VC_CONTAINER_CONTROL_IO_FLUSH);
+
+   /* The temporary file is reused for the next fragment */
+   module->fragment_samples_num = 0;
+   vc_container_io_seek(module->temp.io, INT64_C(0));
+   if(next) module->fragment_start = next->pts;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_fragment_check( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_PACKET_T *packet )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_T *track = p_ctx->tracks[packet->track];
+   bool video = false;
+   unsigned int i;
+
+   if(!module->moov_written && !module->fragment_samples_num)
+   {
+      module->fragment_start = packet->pts;
+      return VC_CONTAINER_SUCCESS;
+   }
+
+   if(module->fragment_samples_num >= MP4_FRAGMENT_SAMPLES_MAX)
+      return mp4_writer_fragment_flush(p_ctx, packet);
+
+   if(packet->pts - module->fragment_start < module->fragment_duration)
+      return VC_CONTAINER_SUCCESS;
+
+   /* Fragments start on keyframes if we have video */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+      if(p_ctx->tracks[i]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) video = true;
+   if(video && (track->format->es_type != VC_CONTAINER_ES_TYPE_VIDEO ||
+      !(packet->flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME)))
+      return VC_CONTAINER_SUCCESS;
+
+   return mp4_writer_fragment_flush(p_ctx, packet);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_fragment_add_sample( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_PACKET_T *packet )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   MP4_FRAGMENT_SAMPLE_T *sample;
+
+   if(module->fragment_samples_num >= module->fragment_samples_max)
+   {
+      unsigned int max = module->fragment_samples_max ? module->fragment_samples_max * 2 : 256;
+      sample = realloc(module->fragment_samples, max * sizeof(*sample));
+      if(!sample) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      module->fragment_samples = sample;
+      module->fragment_samples_max = max;
+   }
+
+   sample = &module->fragment_samples[module->fragment_samples_num++];
+   sample->offset = module->sample_offset;
+   sample->dts = packet->dts;
+   sample->pts = packet->pts;
+   sample->size = packet->size;
+   sample->duration = 0;
+   sample->track = packet->track;
+   sample->keyframe = !!(packet->flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_reserve_moov( VC_CONTAINER_T *p_ctx, uint32_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   static const uint8_t zeros[1024];
+   uint32_t left;
+
+   /* The room has to be made before any data is written */
+   if(STREAM_POSITION(p_ctx) != module->data_offset || module->fragmented)
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   if(size <= module->moov_reserved) return VC_CONTAINER_SUCCESS;
+   if(size < 8) size = 8;
+
+   /* The room is a free box, which the moov box replaces when the file is closed */
+   SEEK(p_ctx, module->moov_offset);
+   WRITE_U32(p_ctx, size, "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('f','r','e','e'), "type");
+   for(left = size - 8; left && STREAM_STATUS(p_ctx) == VC_CONTAINER_SUCCESS; left -= MIN(left, sizeof(zeros)))
+      WRITE_BYTES(p_ctx, zeros, MIN(left, sizeof(zeros)));
+
+   module->mdat_offset = STREAM_POSITION(p_ctx);
+   WRITE_U32(p_ctx, 8, "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('f','r','e','e'), "type");
+   WRITE_U32(p_ctx, 0, "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
+   module->data_offset = STREAM_POSITION(p_ctx);
+   module->moov_reserved = size;
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_move_mdat( VC_CONTAINER_T *p_ctx, int64_t mdat_size,
+   int64_t shift )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   int64_t offset = module->mdat_offset + mdat_size;
+   uint8_t *buffer;
+   size_t size;
+
+   buffer = malloc(MP4_FASTSTART_BLOCK_SIZE);
+   if(!buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+
+   /* Copy the mdat box one block at a time, starting from the end so we
+    * never overwrite data we haven't moved yet */
+   while(offset > module->mdat_offset && STREAM_STATUS(p_ctx) == VC_CONTAINER_SUCCESS)
+   {
+      size = (size_t)MIN(offset - module->mdat_offset, MP4_FASTSTART_BLOCK_SIZE);
+      offset -= size;
+
+      SEEK(p_ctx, offset);
+      if(READ_BYTES(p_ctx, buffer, size) != size) break;
+      SEEK(p_ctx, offset + shift);
+      if(WRITE_BYTES(p_ctx, buffer, size) != size) break;
+   }
+
+   free(buffer);
+   if(offset > module->mdat_offset && STREAM_STATUS(p_ctx) == VC_CONTAINER_SUCCESS)
+      return VC_CONTAINER_ERROR_FAILED;
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_close( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   int64_t mdat_size, moov_size = 0, room, shift = 0;
+   bool moov_in_front = false;
+   unsigned int i;
 
    mdat_size = STREAM_POSITION(p_ctx) - module->mdat_offset;
-   if (mdat_size == 8)
+   if (mdat_size == MP4_MDAT_HEADER_SIZE)
    {
       /* Empty mdat. Remove it. */
       SEEK(p_ctx, module->mdat_offset);
       mdat_size = 0;
    }
 
+   if (module->fragmented)
+   {
+      /* Output whatever is left as a last fragment */
+      status = mp4_writer_fragment_flush(p_ctx, 0);
+      if (status == VC_CONTAINER_SUCCESS && !module->moov_written)
+         status = mp4_writer_fragment_write_moov(p_ctx);
+      goto end;
+   }
+
    if (!module->rebase_timestamps) module->earliest_pts = 0;
 
+   /* Switch to 64 bits chunk offsets if the end of the data can't be reached
+    * with 32 bits */
+   module->co64 = module->mdat_offset + mdat_size > (int64_t)UINT32_MAX;
+
+   if (mdat_size && module->faststart && STREAM_SEEKABLE(p_ctx))
+   {
+      /* Find out the size of the moov box to see whether it fits in the room
+       * reserved for it. The size only depends on the chunk offsets through
+       * the choice between stco and co64, which we settle here. */
+      room = module->moov_reserved;
+      for(;;)
+      {
+         if(!vc_container_writer_extraio_enable(p_ctx, &module->null))
+         {
+            status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+            moov_size = STREAM_POSITION(p_ctx);
+         }
+         vc_container_writer_extraio_disable(p_ctx, &module->null);
+
+         /* Whatever is left of the room after the moov box must fit a free box */
+         if(moov_size > room) shift = moov_size - room;
+         else if(room - moov_size && room - moov_size < 8) shift = 8 - (room - moov_size);
+         else shift = 0;
+
+         if(status != VC_CONTAINER_SUCCESS || module->co64 ||
+            module->mdat_offset + mdat_size + shift <= (int64_t)UINT32_MAX) break;
+         module->co64 = true;
+      }
+
+      /* The mdat box only has to be moved when the room is too small */
+      if(status == VC_CONTAINER_SUCCESS && shift)
+      {
+         LOG_DEBUG(p_ctx, "mp4: moov box (%"PRIi64") doesn't fit in %"PRIi64" bytes, moving the mdat box",
+                   moov_size, room);
+         status = mp4_writer_move_mdat(p_ctx, mdat_size, shift);
+      }
+      if(status == VC_CONTAINER_ERROR_OUT_OF_MEMORY)
+      {
+         /* Nothing was moved yet so we can still write a normal file */
+         LOG_DEBUG(p_ctx, "mp4: not enough memory for fast start");
+         SEEK(p_ctx, module->mdat_offset + mdat_size);
+      }
+      else if(status != VC_CONTAINER_SUCCESS)
+      {
+         LOG_ERROR(p_ctx, "mp4: failed to move the mdat box (%i)", status);
+         goto end;
+      }
+      else
+      {
+         /* The chunk offsets are generated directly with their final value */
+         module->data_offset += shift;
+         module->mdat_offset += shift;
+         SEEK(p_ctx, module->moov_offset);
+         moov_in_front = true;
+      }
+   }
+
    /* Write the moov box */
    status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
 
+   /* What is left of the room reserved in front of the mdat box stays a free box */
+   if (moov_in_front && status == VC_CONTAINER_SUCCESS)
+   {
+      room = module->mdat_offset - STREAM_POSITION(p_ctx);
+      vc_container_assert(!room || (room >= 8 && room <= (int64_t)UINT32_MAX));
+      if (room)
+      {
+         WRITE_U32(p_ctx, (uint32_t)room, "size");
+         WRITE_FOURCC(p_ctx, VC_FOURCC('f','r','e','e'), "type");
+      }
+   }
+
    /* Finalise the mdat box */
-   if (mdat_size)
+   if (mdat_size > (int64_t)UINT32_MAX + 8)
    {
+      /* The free box becomes the start of an mdat box with a 64 bits size */
       SEEK(p_ctx, module->mdat_offset);
-      WRITE_U32(p_ctx, (uint32_t)mdat_size, "mdat size" );
+      WRITE_U32(p_ctx, 1, "size");
+      WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
+      WRITE_U64(p_ctx, mdat_size, "largesize");
+   }
+   else if (mdat_size)
+   {
+      SEEK(p_ctx, module->mdat_offset + 8);
+      WRITE_U32(p_ctx, (uint32_t)(mdat_size - 8), "mdat size" );
    }
 
+ end:
    for(; p_ctx->tracks_num > 0; p_ctx->tracks_num--)
-      vc_container_free_track(p_ctx, p_ctx->tracks[p_ctx->tracks_num-1]);
+   {
+      VC_CONTAINER_TRACK_T *track = p_ctx->tracks[p_ctx->tracks_num-1];
+      for(i = 0; i < MP4_SAMPLE_TABLE_NUM; i++)
+         mp4_writer_table_free(&track->priv->module->sample_table[i].table);
+      vc_container_free_track(p_ctx, track);
+   }
 
    vc_container_writer_extraio_delete(p_ctx, &module->temp);
    vc_container_writer_extraio_delete(p_ctx, &module->null);
+   free(module->fragment_samples);
+   free(module->fragment_buffer);
    free(module);
 
    return status;
@@ -1506,6 +2095,10 @@ static VC_CONTAINER_STATUS_T mp4_writer_add_track( VC_CONTAINER_T *p_ctx, VC_CON
    if(!(format->flags & VC_CONTAINER_ES_FORMAT_FLAG_FRAMED))
       return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
 
+   /* The track list of a fragmented file is fixed once its moov box is written */
+   if(p_ctx->priv->module->moov_written)
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
    /* Check we support this format */
    switch(format->codec)
    {
@@ -1589,10 +2182,47 @@ static VC_CONTAINER_STATUS_T mp4_writer_control( VC_CONTAINER_T *p_ctx, VC_CONTA
       p_ctx->priv->module->rebase_timestamps = (bool)va_arg( args, bool );
       return VC_CONTAINER_SUCCESS;
 
+   case VC_CONTAINER_CONTROL_MP4_FASTSTART:
+      p_ctx->priv->module->faststart = (bool)va_arg( args, int );
+      /* Leave some room for the moov box if no data was written yet */
+      if(p_ctx->priv->module->faststart)
+         (void)mp4_writer_reserve_moov(p_ctx, MP4_FASTSTART_RESERVE_SIZE);
+      return VC_CONTAINER_SUCCESS;
+
+   case VC_CONTAINER_CONTROL_MP4_RESERVE_MOOV:
+      p_ctx->priv->module->faststart = true;
+      return mp4_writer_reserve_moov(p_ctx, va_arg( args, uint32_t ));
+
+   case VC_CONTAINER_CONTROL_MP4_FRAGMENT:
+      {
+         VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+         if(module->samples) return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+         if(!module->fragment_buffer) module->fragment_buffer = malloc(MP4_FRAGMENT_BLOCK_SIZE);
+         if(!module->fragment_buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+         module->fragment_duration = (int64_t)va_arg( args, unsigned int ) * 1000;
+         module->fragmented = true;
+         return VC_CONTAINER_SUCCESS;
+      }
+
    default: return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
    }
 }
 
+/*****************************************************************************/
+static uint32_t mp4_writer_default_duration( VC_CONTAINER_TRACK_T *track )
+{
+   /* Duration given to a sample when there is no following sample to derive
+    * it from. Use the frame rate when we know it, otherwise make it as short
+    * as possible so it doesn't inflate the duration of the track. */
+   uint64_t duration = 0;
+
+   if(track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO &&
+      track->format->type->video.frame_rate_num)
+      duration = (uint64_t)MP4_TIMESCALE * track->format->type->video.frame_rate_den /
+         track->format->type->video.frame_rate_num;
+   return duration && duration <= UINT32_MAX ? (uint32_t)duration : 1;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_writer_add_sample( VC_CONTAINER_T *p_ctx,
                                                     VC_CONTAINER_PACKET_T *packet )
@@ -1600,6 +2230,9 @@ static VC_CONTAINER_STATUS_T mp4_writer_add_sample( VC_CONTAINER_T *p_ctx,
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_T *track = p_ctx->tracks[packet->track];
    VC_CONTAINER_TRACK_MODULE_T *track_module = track->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   int64_t delta;
+   uint32_t i;
 
    track_module->last_pts = packet->pts;
    if(!track_module->samples)
@@ -1608,37 +2241,148 @@ static VC_CONTAINER_STATUS_T mp4_writer_add_sample( VC_CONTAINER_T *p_ctx,
       if(module->earliest_pts == VC_CONTAINER_TIME_UNKNOWN ||
          packet->pts < module->earliest_pts)
          module->earliest_pts = packet->pts;
+      if(module->earliest_dts == VC_CONTAINER_TIME_UNKNOWN ||
+         packet->dts < module->earliest_dts)
+         module->earliest_dts = packet->dts;
    }
 
    track_module->samples++;
+
+   /* The sample tables of a fragmented file are written in the fragments */
+   if(module->fragmented)
+      return VC_CONTAINER_SUCCESS;
+
    track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entries++; /* sample size */
    p_ctx->size += track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entry_size;
-   track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries++; /* time to sample */
-   p_ctx->size += track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entry_size;
-
-   #if 0
-   delta_ts = packet->dts - track_module->timestamp;
-   track_module->timestamp = packet->dts;
-   if(!track_module->samples) track_module->delta_ts =
-   if()
-#endif
+
+   /* Time to sample, run-length coded. The duration of a sample is only known once
+    * we get the next one, so the pending run is only completed when writing the
+    * table, the last sample reusing the duration of the previous one. */
+   delta = packet->dts * MP4_TIMESCALE / 1000000 - track_module->stts_dts;
+   if(delta < 0) delta = 0;
+   track_module->stts_dts += delta;
+   if(track_module->samples == 1)
+   {
+      /* The delta is the absolute decode time of the first sample, which
+       * isn't a duration. It only gets used if this stays the only sample. */
+      track_module->stts_delta = mp4_writer_default_duration(track);
+      track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries++; /* time to sample */
+      p_ctx->size += track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entry_size;
+   }
+   else if(track_module->stts_count && (uint32_t)delta == track_module->stts_delta)
+   {
+      track_module->stts_count++;
+   }
+   else
+   {
+      if(track_module->stts_count)
+      {
+         status = mp4_writer_table_add_run(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STTS].table,
+                                           track_module->stts_count, track_module->stts_delta);
+         if(status != VC_CONTAINER_SUCCESS) return status;
+         track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries++; /* time to sample */
+         p_ctx->size += track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entry_size;
+      }
+      track_module->stts_count = 1;
+      track_module->stts_delta = (uint32_t)delta;
+   }
+
+   /* Composition offsets, run-length coded as well */
+   delta = packet->pts * MP4_TIMESCALE / 1000000 - track_module->stts_dts;
+   if(delta < 0) delta = 0;
+   if(track_module->samples == 1)
+   {
+      track_module->ctts_first = (uint32_t)delta;
+      track_module->ctts_count = 1;
+      track_module->ctts_offset = (uint32_t)delta;
+      track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries++; /* composition offset */
+      p_ctx->size += track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entry_size;
+   }
+   else if((uint32_t)delta == track_module->ctts_offset)
+   {
+      track_module->ctts_count++;
+   }
+   else
+   {
+      status = mp4_writer_table_add_run(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].table,
+                                        track_module->ctts_count, track_module->ctts_offset);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+      track_module->ctts_count = 1;
+      track_module->ctts_offset = (uint32_t)delta;
+      track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries++; /* composition offset */
+      p_ctx->size += track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entry_size;
+   }
+
+   /* Sample sizes are only stored once we know they aren't all the same */
+   if(track_module->samples == 1)
+      track_module->sample_size = packet->size;
+   else if(track_module->sample_size && packet->size != track_module->sample_size)
+   {
+      for(i = 1; i < track_module->samples && status == VC_CONTAINER_SUCCESS; i++)
+         status = mp4_writer_table_add(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].table,
+                                       track_module->sample_size);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+      track_module->sample_size = 0;
+   }
+   if(!track_module->sample_size)
+   {
+      status = mp4_writer_table_add(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].table,
+                                    packet->size);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
 
    /* Is it a new chunk ? */
    if(module->sample_offset != track_module->offset)
    {
+      /* The previous chunk is complete. Consecutive chunks with the same number
+       * of samples share the same sample to chunk entry. */
+      if(track_module->samples_in_chunk &&
+         (!track_module->stsc_first_chunk ||
+          track_module->samples_in_chunk != track_module->stsc_samples ||
+          track_module->chunk_sample_description != track_module->stsc_sample_description))
+      {
+         if(track_module->stsc_first_chunk)
+         {
+            MP4_WRITER_TABLE_T *table = &track_module->sample_table[MP4_SAMPLE_TABLE_STSC].table;
+            status = mp4_writer_table_add(p_ctx, table, track_module->stsc_first_chunk);
+            if(status == VC_CONTAINER_SUCCESS)
+               status = mp4_writer_table_add(p_ctx, table, track_module->stsc_samples);
+            if(status == VC_CONTAINER_SUCCESS)
+               status = mp4_writer_table_add(p_ctx, table, 1 + track_module->stsc_sample_description);
+            if(status != VC_CONTAINER_SUCCESS) return status;
+         }
+         track_module->stsc_first_chunk = track_module->chunks;
+         track_module->stsc_samples = track_module->samples_in_chunk;
+         track_module->stsc_sample_description = track_module->chunk_sample_description;
+         track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries++; /* sample to chunk */
+         p_ctx->size += track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entry_size;
+      }
+
       track_module->chunks++;
+      track_module->samples_in_chunk = 0;
+      track_module->chunk_sample_description = (packet->flags >> 28) & 0x7;
       track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entries++; /* chunk offset */
       p_ctx->size += track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entry_size;
-      track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries++; /* sample to chunk */
-      p_ctx->size += track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entry_size;
+
+      /* Stored relative to the start of the data, as a pair of 32 bits values */
+      status = mp4_writer_table_add(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STCO].table,
+                                    (uint32_t)((module->sample_offset - module->data_offset) >> 32));
+      if(status == VC_CONTAINER_SUCCESS)
+         status = mp4_writer_table_add(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STCO].table,
+                                       (uint32_t)(module->sample_offset - module->data_offset));
+      if(status != VC_CONTAINER_SUCCESS) return status;
    }
    track_module->offset = module->sample_offset + packet->size;
+   track_module->samples_in_chunk++;
 
    if(track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO &&
       (packet->flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME))
    {
       track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries++; /* sync sample */
       p_ctx->size += track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entry_size;
+      status = mp4_writer_table_add(p_ctx, &track_module->sample_table[MP4_SAMPLE_TABLE_STSS].table,
+                                    track_module->samples);
+      if(status != VC_CONTAINER_SUCCESS) return status;
    }
 
    return VC_CONTAINER_SUCCESS;
@@ -1657,10 +2401,18 @@ static VC_CONTAINER_STATUS_T mp4_writer_write( VC_CONTAINER_T *p_ctx,
 
    if(packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_START)
    {
+      if(module->fragmented)
+      {
+         /* Check if that sample should start a new fragment */
+         status = mp4_writer_fragment_check(p_ctx, packet);
+         if(status != VC_CONTAINER_SUCCESS) return status;
+      }
+
       module->sample_offset = STREAM_POSITION(p_ctx);
+      if(module->fragmented) module->sample_offset = module->temp.io->offset;
       sample->size = packet->size;
       sample->pts = packet->pts;
-      sample->dts = packet->pts;
+      sample->dts = packet->dts != VC_CONTAINER_TIME_UNKNOWN ? packet->dts : packet->pts;
       sample->track = packet->track;
       sample->flags = packet->flags;
    }
@@ -1670,15 +2422,24 @@ static VC_CONTAINER_STATUS_T mp4_writer_write( VC_CONTAINER_T *p_ctx,
       sample->flags |= packet->flags;
    }
 
-   if(WRITE_BYTES(p_ctx, packet->data, packet->size) != packet->size)
+   if(module->fragmented)
+   {
+      /* The data is kept aside until the whole fragment is available */
+      if(vc_container_io_write(module->temp.io, packet->data, packet->size) != packet->size)
+         return module->temp.io->status;
+   }
+   else if(WRITE_PAYLOAD(p_ctx, packet->data, packet->size) != packet->size)
       return STREAM_STATUS(p_ctx); // TODO do something
    p_ctx->size += packet->size;
 
    //
    if(packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_END)
    {
-      status = mp4_writer_write_sample_to_temp(p_ctx, sample);
-      if(status != VC_CONTAINER_SUCCESS) return status;
+      if(module->fragmented)
+      {
+         status = mp4_writer_fragment_add_sample(p_ctx, sample);
+         if(status != VC_CONTAINER_SUCCESS) return status;
+      }
       status = mp4_writer_add_sample(p_ctx, sample);
       if(status != VC_CONTAINER_SUCCESS) return status;
    }
@@ -1735,8 +2496,11 @@ VC_CONTAINER_STATUS_T mp4_writer_open( VC_CONTAINER_T *p_ctx )
    status = mp4_write_box(p_ctx, MP4_BOX_TYPE_FTYP);
    if(status != VC_CONTAINER_SUCCESS) goto error;
 
-   /* Start the mdat box */
-   module->mdat_offset = STREAM_POSITION(p_ctx);
+   /* Start the mdat box. It is preceded by an empty free box which leaves room
+    * for a 64 bits size should the mdat grow over 4GB. */
+   module->moov_offset = module->mdat_offset = STREAM_POSITION(p_ctx);
+   WRITE_U32(p_ctx, 8, "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('f','r','e','e'), "type");
    WRITE_U32(p_ctx, 0, "size");
    WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
    module->data_offset = STREAM_POSITION(p_ctx);
@@ -1745,8 +2509,7 @@ VC_CONTAINER_STATUS_T mp4_writer_open( VC_CONTAINER_T *p_ctx )
    p_ctx->priv->pf_write = mp4_writer_write;
    p_ctx->priv->pf_control = mp4_writer_control;
 
-   module->initial_sample_dts = VC_CONTAINER_TIME_UNKNOWN;
-   module->earliest_pts = VC_CONTAINER_TIME_UNKNOWN;
+   module->earliest_pts = module->earliest_dts = VC_CONTAINER_TIME_UNKNOWN;
    module->rebase_timestamps = true;
    return VC_CONTAINER_SUCCESS;
 
@@ -52,6 +52,11 @@ Defines.
     at open time or when resyncing. */
 #define PS_PACK_SCAN_MAX 128
 
+/** Amount of data kept aside for the search for tracks on streams which can't
+    seek, so we can go back to the start of the data afterwards. */
+#define PS_SCAN_CACHE_SIZE (256*1024)
+#define PS_PES_PACKET_MAX (6 + 65535) /** Including the PES packet header */
+
 /******************************************************************************
 Type definitions.
 ******************************************************************************/
@@ -1121,6 +1126,7 @@ VC_CONTAINER_STATUS_T ps_reader_open( VC_CONTAINER_T *ctx )
    VC_CONTAINER_MODULE_T *module = 0;
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
    uint8_t buffer[4];
+   int64_t scan_end = INT64_MAX;
    unsigned int i;
 
    /* Check if the user has specified a container */
@@ -1155,11 +1161,23 @@ VC_CONTAINER_STATUS_T ps_reader_open( VC_CONTAINER_T *ctx )
       packet */
    module->data_offset = STREAM_POSITION(ctx);
 
+   /* Streams which can't seek only get back there through the block cache, so
+      the search for tracks has to stay within the data it holds */
+   if(!STREAM_SEEKABLE(ctx))
+   {
+      size_t cached = CACHE_BYTES(ctx, PS_SCAN_CACHE_SIZE);
+
+      /* Leave room for the packet we're in the middle of, unless the stream ends there */
+      scan_end = module->data_offset + cached;
+      if(cached == PS_SCAN_CACHE_SIZE) scan_end -= PS_PES_PACKET_MAX;
+      SEEK(ctx, module->data_offset);
+   }
+
    /* Search for tracks, reset time reference and calculation state first */
    ctx->priv->module->scr_offset = ctx->priv->module->scr = VC_CONTAINER_TIME_UNKNOWN;
    ctx->priv->module->searching_tracks = true;
 
-   for (i = 0; i != PS_PACK_SCAN_MAX; ++i)
+   for (i = 0; i != PS_PACK_SCAN_MAX && (int64_t)STREAM_POSITION(ctx) < scan_end; ++i)
    {
       if (buffer[3] == 0xBA && (ps_read_pack_header(ctx) != VC_CONTAINER_SUCCESS))
          goto resync;
@@ -71,6 +71,14 @@ typedef enum {
    /** Set the timeout to be used on read operations
     * arg1: uint32_t - New timeout in milliseconds, or INFINITE_TIMEOUT_MS */
    VC_CONTAINER_NET_CONTROL_SET_READ_TIMEOUT_MS,
+   /** Receive datagrams in batches on a datagram receiver. The datagrams are
+    * kept in a ring of buffers and handed out one per read, so a single system
+    * call can serve many reads when packets arrive faster than they are read.
+    * Datagrams larger than the buffers are truncated.
+    * arg1: uint32_t - Number of datagrams per batch, 0 to go back to receiving
+    *                  them one at a time
+    * arg2: uint32_t - Size of each buffer in bytes, 0 for the maximum datagram size */
+   VC_CONTAINER_NET_CONTROL_SET_READ_BATCH,
 } vc_container_net_control_t;
 
 /** Container Input / Output Context.
@@ -146,6 +154,8 @@ vc_container_net_status_t vc_container_net_status( VC_CONTAINER_NET_T *p_ctx );
  * may have occurred, a zero length datagram received, or the timeout reached.
  * Check vc_container_net_status() to differentiate.
  * Attempting to read on a datagram sender socket will trigger an error.
+ * Datagrams already received in a batch (see \ref VC_CONTAINER_NET_CONTROL_SET_READ_BATCH)
+ * are returned straight away.
  *
  * \param p_ctx The socket instance.
  * \param buffer The buffer into which bytes will be read.
@@ -24,7 +24,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
-
+#define _GNU_SOURCE /* recvmmsg */
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -36,6 +36,38 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /*****************************************************************************/
 
+typedef union
+{
+   struct sockaddr_storage storage;
+   struct sockaddr     sa;
+   struct sockaddr_in  in;
+   struct sockaddr_in6 in6;
+} SOCKET_ADDRESS_T;
+
+/** A datagram received as part of a batch */
+typedef struct
+{
+   uint8_t *data;             /**< Buffer holding the datagram */
+   size_t size;               /**< Size of the datagram */
+   SOCKET_ADDRESS_T from_addr;   /**< Address of the sender */
+   SOCKADDR_LEN_T from_addr_len;
+} SOCKET_DATAGRAM_T;
+
+/** Ring of datagram buffers, filled with as many datagrams as are waiting on
+ * the socket each time it runs dry */
+typedef struct
+{
+   SOCKET_DATAGRAM_T *datagrams;
+   uint32_t datagrams_num;    /**< Number of buffers in the ring */
+   size_t buffer_size;        /**< Size of each buffer */
+   uint32_t received;         /**< Number of datagrams received in the last batch */
+   uint32_t next;             /**< Index of the next datagram to hand out */
+#ifdef ENABLE_CONTAINER_NET_RECVMMSG
+   struct mmsghdr *msgs;
+   struct iovec *iovecs;
+#endif
+} SOCKET_BATCH_T;
+
 struct vc_container_net_tag
 {
    /** The underlying socket */
@@ -45,18 +77,15 @@ struct vc_container_net_tag
    /** Simple socket type */
    vc_container_net_type_t type;
    /** Socket address, used for sending datagrams. */
-   union {
-      struct sockaddr_storage storage;
-      struct sockaddr     sa;
-      struct sockaddr_in  in;
-      struct sockaddr_in6 in6;
-   } to_addr;
+   SOCKET_ADDRESS_T to_addr;
    /** Number of bytes in to_addr that have been filled. */
    SOCKADDR_LEN_T to_addr_len;
    /** Maximum size of datagrams. */
    size_t max_datagram_size;
    /** Timeout to use when reading from a socket. INFINITE_TIMEOUT_MS waits forever. */
    uint32_t read_timeout_ms;
+   /** Datagrams received in a batch, NULL when receiving them one at a time. */
+   SOCKET_BATCH_T *batch;
 };
 
 /*****************************************************************************/
@@ -107,6 +136,145 @@ static vc_container_net_status_t socket_set_read_timeout_ms(VC_CONTAINER_NET_T *
    return VC_CONTAINER_NET_SUCCESS;
 }
 
+/*****************************************************************************/
+static void socket_batch_free( SOCKET_BATCH_T *batch )
+{
+   if (!batch)
+      return;
+   if (batch->datagrams)
+      free(batch->datagrams[0].data);
+   free(batch->datagrams);
+#ifdef ENABLE_CONTAINER_NET_RECVMMSG
+   free(batch->msgs);
+   free(batch->iovecs);
+#endif
+   free(batch);
+}
+
+/*****************************************************************************/
+static vc_container_net_status_t socket_set_read_batch(VC_CONTAINER_NET_T *p_ctx,
+      uint32_t datagrams_num, uint32_t buffer_size)
+{
+   SOCKET_BATCH_T *batch;
+   uint8_t *data;
+   uint32_t i;
+
+   if (p_ctx->type != DATAGRAM_RECEIVER)
+      return VC_CONTAINER_NET_ERROR_NOT_ALLOWED;
+
+   /* Datagrams still waiting to be read would be lost */
+   if (p_ctx->batch && p_ctx->batch->next < p_ctx->batch->received)
+      return VC_CONTAINER_NET_ERROR_IN_PROGRESS;
+
+   socket_batch_free(p_ctx->batch);
+   p_ctx->batch = NULL;
+   if (!datagrams_num)
+      return VC_CONTAINER_NET_SUCCESS;
+
+   if (!buffer_size || buffer_size > p_ctx->max_datagram_size)
+      buffer_size = p_ctx->max_datagram_size;
+
+   batch = (SOCKET_BATCH_T *)calloc(1, sizeof(*batch));
+   if (!batch)
+      return VC_CONTAINER_NET_ERROR_NO_MEMORY;
+   batch->datagrams = (SOCKET_DATAGRAM_T *)calloc(datagrams_num, sizeof(*batch->datagrams));
+   data = (uint8_t *)malloc((size_t)datagrams_num * buffer_size);
+#ifdef ENABLE_CONTAINER_NET_RECVMMSG
+   batch->msgs = (struct mmsghdr *)calloc(datagrams_num, sizeof(*batch->msgs));
+   batch->iovecs = (struct iovec *)calloc(datagrams_num, sizeof(*batch->iovecs));
+   if (!batch->msgs || !batch->iovecs)
+   {
+      free(data);
+      data = NULL;
+   }
+#endif
+   if (!batch->datagrams || !data)
+   {
+      free(data);
+      socket_batch_free(batch);
+      return VC_CONTAINER_NET_ERROR_NO_MEMORY;
+   }
+
+   batch->datagrams_num = datagrams_num;
+   batch->buffer_size = buffer_size;
+   for (i = 0; i < datagrams_num; i++)
+   {
+      batch->datagrams[i].data = data + (size_t)i * buffer_size;
+#ifdef ENABLE_CONTAINER_NET_RECVMMSG
+      batch->iovecs[i].iov_base = batch->datagrams[i].data;
+      batch->iovecs[i].iov_len = buffer_size;
+      batch->msgs[i].msg_hdr.msg_iov = &batch->iovecs[i];
+      batch->msgs[i].msg_hdr.msg_iovlen = 1;
+      batch->msgs[i].msg_hdr.msg_name = &batch->datagrams[i].from_addr;
+#endif
+   }
+
+   p_ctx->batch = batch;
+   return VC_CONTAINER_NET_SUCCESS;
+}
+
+/*****************************************************************************/
+static int socket_receive_batch( VC_CONTAINER_NET_T *p_ctx )
+{
+   SOCKET_BATCH_T *batch = p_ctx->batch;
+   SOCKET_DATAGRAM_T *datagram = batch->datagrams;
+   int result;
+#ifdef ENABLE_CONTAINER_NET_RECVMMSG
+   int i;
+
+   for (i = 0; i < (int)batch->datagrams_num; i++)
+      batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->datagrams[i].from_addr);
+
+   /* Wait for the first datagram only, then take whatever else is already there */
+   result = recvmmsg(p_ctx->socket, batch->msgs, batch->datagrams_num, MSG_WAITFORONE, NULL);
+   for (i = 0; i < result; i++)
+   {
+      datagram[i].size = batch->msgs[i].msg_len;
+      datagram[i].from_addr_len = batch->msgs[i].msg_hdr.msg_namelen;
+   }
+#else
+   /* One datagram at a time is all the platform offers */
+   datagram->from_addr_len = sizeof(datagram->from_addr);
+   result = recvfrom(p_ctx->socket, datagram->data, batch->buffer_size, 0,
+         &datagram->from_addr.sa, &datagram->from_addr_len);
+   if (result != SOCKET_ERROR)
+   {
+      datagram->size = (size_t)result;
+      result = 1;
+   }
+#endif
+
+   return result;
+}
+
+/*****************************************************************************/
+static int socket_read_batched( VC_CONTAINER_NET_T *p_ctx, void *buffer, size_t size )
+{
+   SOCKET_BATCH_T *batch = p_ctx->batch;
+   SOCKET_DATAGRAM_T *datagram;
+   int result;
+
+   if (batch->next >= batch->received)
+   {
+      batch->next = batch->received = 0;
+      result = socket_receive_batch(p_ctx);
+      if (result == SOCKET_ERROR)
+         return SOCKET_ERROR;
+      batch->received = (uint32_t)result;
+   }
+
+   datagram = &batch->datagrams[batch->next++];
+   if (size > datagram->size)
+      size = datagram->size;
+   memcpy(buffer, datagram->data, size);
+
+   /* Keep track of the sender, as a single datagram read would */
+   memcpy(&p_ctx->to_addr, &datagram->from_addr, datagram->from_addr_len);
+   p_ctx->to_addr_len = datagram->from_addr_len;
+
+   return (int)size;
+}
+
 /*****************************************************************************/
 static bool socket_wait_for_data( VC_CONTAINER_NET_T *p_ctx, uint32_t timeout_ms )
 {
@@ -286,6 +454,7 @@ vc_container_net_status_t vc_container_net_close( VC_CONTAINER_NET_T *p_ctx )
       vc_container_net_private_close(p_ctx->socket);
       p_ctx->socket = INVALID_SOCKET;
    }
+   socket_batch_free(p_ctx->batch);
    free(p_ctx);
 
    vc_container_net_private_deinit();
@@ -335,9 +504,14 @@ size_t vc_container_net_read( VC_CONTAINER_NET_T *p_ctx, void *buffer, size_t si
       {
          /* Receive the packet */
          /* FIXME Potential for data loss, as rest of packet will be lost if buffer was not large enough */
-         if (socket_wait_for_data(p_ctx, p_ctx->read_timeout_ms))
+         /* Datagrams left over from the last batch don't need waiting for */
+         if ((p_ctx->batch && p_ctx->batch->next < p_ctx->batch->received) ||
+             socket_wait_for_data(p_ctx, p_ctx->read_timeout_ms))
          {
-            result = recvfrom(p_ctx->socket, buffer, size, 0, &p_ctx->to_addr.sa, &p_ctx->to_addr_len);
+            if (p_ctx->batch)
+               result = socket_read_batched(p_ctx, buffer, size);
+            else
+               result = recvfrom(p_ctx->socket, buffer, size, 0, &p_ctx->to_addr.sa, &p_ctx->to_addr_len);
             if (!result)
                p_ctx->status = VC_CONTAINER_NET_ERROR_CONNECTION_LOST;
          } else
@@ -497,6 +671,12 @@ bool vc_container_net_is_data_available( VC_CONTAINER_NET_T *p_ctx )
       return false;
    }
 
+   if (p_ctx->batch && p_ctx->batch->next < p_ctx->batch->received)
+   {
+      p_ctx->status = VC_CONTAINER_NET_SUCCESS;
+      return true;
+   }
+
    return socket_wait_for_data(p_ctx, 0);
 }
 
@@ -587,6 +767,12 @@ vc_container_net_status_t vc_container_net_control( VC_CONTAINER_NET_T *p_ctx,
    case VC_CONTAINER_NET_CONTROL_SET_READ_TIMEOUT_MS:
       status = socket_set_read_timeout_ms(p_ctx, va_arg(args, uint32_t));
       break;
+   case VC_CONTAINER_NET_CONTROL_SET_READ_BATCH:
+      {
+         uint32_t datagrams_num = va_arg(args, uint32_t);
+         status = socket_set_read_batch(p_ctx, datagrams_num, va_arg(args, uint32_t));
+      }
+      break;
    default:
       status = VC_CONTAINER_NET_ERROR_NOT_ALLOWED;
    }
@@ -190,7 +190,7 @@ static VC_CONTAINER_STATUS_T rawvideo_writer_write( VC_CONTAINER_T *ctx,
    }
 
    /* Write the elementary stream */
-   WRITE_BYTES(ctx, packet->data, packet->size);
+   WRITE_PAYLOAD(ctx, packet->data, packet->size);
 
    return STREAM_STATUS(ctx);
 }
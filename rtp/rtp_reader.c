@@ -98,6 +98,9 @@ Configurable defines and constants.
 /** Maximum size of an RTP packet */
 #define MAXIMUM_PACKET_SIZE   2048
 
+/** Number of RTP packets received from the network in one go */
+#define READ_BATCH_SIZE       32
+
 /** Maximum number of RTP packets that can be missed without restarting. */
 #define MAX_DROPOUT           3000
 /** Maximum number of out of sequence RTP packets that are accepted. */
@@ -110,10 +113,10 @@ Configurable defines and constants.
 Defines and constants.
 ******************************************************************************/
 
-#define RTP_SCHEME                     "rtp:"
+#define RTP_SCHEME                     "rtp"
 
 /** The RTP PKT scheme is used with test pkt files */
-#define RTP_PKT_SCHEME                     "rtppkt:"
+#define RTP_PKT_SCHEME                     "rtppkt"
 
 /** \name RTP URI parameter names
  * @{ */
@@ -1173,6 +1176,11 @@ VC_CONTAINER_STATUS_T rtp_reader_open( VC_CONTAINER_T *p_ctx )
 
    track->is_enabled = true;
 
+   /* Pick up all the packets already waiting on the socket with each receive.
+    * Inputs other than the network don't need this, so failure is fine. */
+   vc_container_io_control(p_ctx->priv->io, VC_CONTAINER_CONTROL_IO_SET_READ_BATCH,
+         (uint32_t)READ_BATCH_SIZE, (uint32_t)MAXIMUM_PACKET_SIZE);
+
    vc_containers_list_destroy(parameters);
 
    p_ctx->priv->pf_close = rtp_reader_close;
@@ -31,6 +31,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "net/net_sockets.h"
 
+static vc_container_net_status_t local_net_control(VC_CONTAINER_NET_T *sock,
+      vc_container_net_control_t operation, ...)
+{
+   vc_container_net_status_t result;
+   va_list args;
+
+   va_start(args, operation);
+   result = vc_container_net_control(sock, operation, args);
+   va_end(args);
+
+   return result;
+}
+
 int main(int argc, char **argv)
 {
    VC_CONTAINER_NET_T *sock;
@@ -41,7 +54,7 @@ int main(int argc, char **argv)
 
    if (argc < 2)
    {
-      printf("Usage:\n%s <port>\n", argv[0]);
+      printf("Usage:\n%s <port> [<datagrams per batch>]\n", argv[0]);
       return 1;
    }
 
@@ -52,6 +65,15 @@ int main(int argc, char **argv)
       return 2;
    }
 
+   /* Optionally receive the datagrams in batches */
+   if (argc > 2)
+   {
+      status = local_net_control(sock, VC_CONTAINER_NET_CONTROL_SET_READ_BATCH,
+            (uint32_t)strtoul(argv[2], NULL, 0), (uint32_t)0);
+      if (status != VC_CONTAINER_NET_SUCCESS)
+         printf("Failed to receive datagrams in batches: %d\n", status);
+   }
+
    buffer_size = vc_container_net_maximum_datagram_size(sock);
    buffer = (char *)malloc(buffer_size);
    if (!buffer)
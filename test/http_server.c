@@ -0,0 +1,291 @@
+/*
+Copyright (c) 2021, Gildas Bazin
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#define _GNU_SOURCE /* usleep */
+#define _FILE_OFFSET_BITS 64 /* Large file support on 32 bits systems */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "net/net_sockets.h"
+
+/* Minimal HTTP/1.1 file server used to benchmark the http i/o, e.g.
+ *    containers_http_server 8080 /path/to/files 50
+ *    containers_io_benchmark http://localhost:8080/file.mp4
+ * It answers HEAD and GET requests (with byte ranges) on persistent
+ * connections, each connection being served by its own thread. A latency
+ * can be given, which is waited for before sending each response so the
+ * effect of round trips on a local network can be measured. The throughput
+ * of each connection can also be capped to mimic the limit a TCP window
+ * puts on it over a long distance link.
+ * Files under /live/ (e.g. http://localhost:8080/live/file.mp3) are served
+ * as a live stream would be: with the chunked transfer encoding, without a
+ * length and without accepting byte ranges. Other files get an ETag made of
+ * their size and modification time. */
+
+#define MAX_REQUEST_LEN 4000
+#define MAX_PATH_LEN    1024
+#define SEND_BUFFER_LEN (64*1024)
+#define LIVE_PREFIX     "/live/"
+#define LIVE_CHUNK_LEN  (4*1024)
+
+static const char *root = ".";
+static unsigned int latency_ms;
+static unsigned int rate_kbps; /* Kilobytes per second per connection, 0 for no limit */
+
+typedef struct
+{
+   VC_CONTAINER_NET_T *sock;
+   char request[MAX_REQUEST_LEN];
+   char path[2*MAX_PATH_LEN];
+   uint8_t buffer[SEND_BUFFER_LEN];
+} CONNECTION_T;
+
+/*****************************************************************************/
+static bool send_data(CONNECTION_T *conn, const void *data, size_t size)
+{
+   const uint8_t *ptr = data;
+   size_t sent;
+
+   while (size)
+   {
+      sent = vc_container_net_write(conn->sock, ptr, size);
+      if (!sent)
+         return false;
+      ptr += sent;
+      size -= sent;
+   }
+   return true;
+}
+
+/*****************************************************************************/
+static int64_t time_get_us(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*****************************************************************************/
+static bool read_request(CONNECTION_T *conn)
+{
+   size_t length = 0;
+
+   /* Read a byte at a time up to the empty line ending the headers */
+   while (length < sizeof(conn->request) - 1)
+   {
+      if (vc_container_net_read(conn->sock, conn->request + length, 1) != 1)
+         return false;
+      length++;
+      if (length >= 4 && !memcmp(conn->request + length - 4, "\r\n\r\n", 4))
+      {
+         conn->request[length] = '\0';
+         return true;
+      }
+   }
+   return false;
+}
+
+/*****************************************************************************/
+static bool send_status(CONNECTION_T *conn, const char *status)
+{
+   char header[256];
+   snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Length: 0\r\n\r\n", status);
+   return send_data(conn, header, strlen(header));
+}
+
+/*****************************************************************************/
+static bool serve_request(CONNECTION_T *conn)
+{
+   char method[16], uri[MAX_PATH_LEN], header[512];
+   int64_t size, start = 0, end = -1, sent = 0, time;
+   const char *range, *path = uri;
+   bool head, live, ret = true;
+   struct stat st;
+   size_t bytes;
+   FILE *file;
+
+   if (sscanf(conn->request, "%15s %1000s", method, uri) != 2)
+   {
+      send_status(conn, "400 Bad Request");
+      return false;
+   }
+   head = !strcmp(method, "HEAD");
+   if (!head && strcmp(method, "GET"))
+      return send_status(conn, "501 Not Implemented");
+
+   if (latency_ms)
+      usleep(latency_ms * 1000);
+
+   live = !strncmp(uri, LIVE_PREFIX, sizeof(LIVE_PREFIX) - 1);
+   if (live)
+      path = uri + sizeof(LIVE_PREFIX) - 1;
+
+   snprintf(conn->path, sizeof(conn->path), "%s/%s", root, path);
+   file = strstr(uri, "..") ? NULL : fopen(conn->path, "rb");
+   if (!file)
+      return send_status(conn, "404 Not Found");
+   fseeko(file, 0, SEEK_END);
+   size = ftello(file);
+
+   range = live ? NULL : strstr(conn->request, "\nRange: bytes=");
+   if (range && sscanf(range, "\nRange: bytes=%"SCNd64"-%"SCNd64, &start, &end) < 1)
+      start = 0, end = -1, range = NULL;
+   if (end < 0 || end >= size)
+      end = size - 1;
+   if (range && start > end)
+   {
+      fclose(file);
+      return send_status(conn, "416 Range Not Satisfiable");
+   }
+
+   if (live)
+      snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+   else if (range)
+      snprintf(header, sizeof(header), "HTTP/1.1 206 Partial Content\r\n"
+               "Content-Range: bytes %"PRId64"-%"PRId64"/%"PRId64"\r\n", start, end, size);
+   else
+      snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n");
+   if (!live && !fstat(fileno(file), &st))
+      snprintf(header + strlen(header), sizeof(header) - strlen(header),
+               "ETag: \"%"PRIx64"-%"PRIx64"\"\r\n", size, (int64_t)st.st_mtime);
+   if (!live)
+      snprintf(header + strlen(header), sizeof(header) - strlen(header),
+               "Accept-Ranges: bytes\r\nContent-Length: %"PRId64"\r\n\r\n", end - start + 1);
+   if (!send_data(conn, header, strlen(header)))
+      ret = false;
+
+   fseeko(file, start, SEEK_SET);
+   time = time_get_us();
+   while (ret && !head && start <= end)
+   {
+      /* Wait until sending more data stays within the rate */
+      if (rate_kbps && sent * 1000 / rate_kbps > time_get_us() - time)
+         usleep((useconds_t)(sent * 1000 / rate_kbps - (time_get_us() - time)));
+
+      bytes = live ? LIVE_CHUNK_LEN : sizeof(conn->buffer);
+      if ((int64_t)bytes > end - start + 1)
+         bytes = (size_t)(end - start + 1);
+      bytes = fread(conn->buffer, 1, bytes, file);
+      if (live && bytes)
+      {
+         snprintf(header, sizeof(header), "%zx\r\n", bytes);
+         if (!send_data(conn, header, strlen(header)))
+            ret = false;
+      }
+      if (!bytes || !send_data(conn, conn->buffer, bytes) ||
+          (live && !send_data(conn, "\r\n", 2)))
+         ret = false;
+      start += bytes;
+      sent += bytes;
+   }
+
+   /* The last chunk of a live stream is empty */
+   if (ret && live && !head && !send_data(conn, "0\r\n\r\n", 5))
+      ret = false;
+
+   fclose(file);
+   return ret;
+}
+
+/*****************************************************************************/
+static void *connection_thread(void *arg)
+{
+   CONNECTION_T *conn = arg;
+
+   while (read_request(conn) && serve_request(conn))
+      continue;
+
+   vc_container_net_close(conn->sock);
+   free(conn);
+   return NULL;
+}
+
+/*****************************************************************************/
+int main(int argc, char **argv)
+{
+   VC_CONTAINER_NET_T *server_sock, *sock;
+   vc_container_net_status_t status;
+   CONNECTION_T *conn;
+   pthread_t thread;
+
+   if (argc < 2)
+   {
+      printf("Usage:\n%s <port> [<root directory>] [<latency ms>] [<KB/s per connection>]\n", argv[0]);
+      return 1;
+   }
+   if (argc > 2)
+      root = argv[2];
+   if (argc > 3)
+      latency_ms = strtoul(argv[3], NULL, 0);
+   if (argc > 4)
+      rate_kbps = strtoul(argv[4], NULL, 0);
+
+   /* Clients going away in the middle of a response mustn't kill the server */
+   signal(SIGPIPE, SIG_IGN);
+
+   server_sock = vc_container_net_open(NULL, argv[1], VC_CONTAINER_NET_OPEN_FLAG_STREAM, &status);
+   if (!server_sock)
+   {
+      printf("vc_container_net_open failed: %d\n", status);
+      return 2;
+   }
+
+   status = vc_container_net_listen(server_sock, 16);
+   if (status != VC_CONTAINER_NET_SUCCESS)
+   {
+      printf("vc_container_net_listen failed: %d\n", status);
+      vc_container_net_close(server_sock);
+      return 3;
+   }
+
+   while (vc_container_net_accept(server_sock, &sock) == VC_CONTAINER_NET_SUCCESS)
+   {
+      conn = malloc(sizeof(*conn));
+      if (!conn)
+      {
+         vc_container_net_close(sock);
+         continue;
+      }
+      conn->sock = sock;
+      if (pthread_create(&thread, NULL, connection_thread, conn))
+      {
+         vc_container_net_close(sock);
+         free(conn);
+         continue;
+      }
+      pthread_detach(thread);
+   }
+
+   vc_container_net_close(server_sock);
+   return 0;
+}
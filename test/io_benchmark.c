@@ -0,0 +1,269 @@
+/*
+Copyright (c) 2021, Gildas Bazin
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "containers.h"
+#include "containers_codecs.h"
+#include "core/containers_common.h"
+#include "core/containers_logging.h"
+#include "core/containers_io.h"
+#include "core/containers_io_helpers.h"
+
+/* Measures the cost of parsing container headers, which is dominated by
+ * reading small integers from the i/o layer.
+ * For each file of the corpus (or a generated mp4 file if none is given), this
+ * times opening the file, scanning all the packet headers, and reading the
+ * whole file as 32 bits integers both with the inline helpers and with plain
+ * vc_container_io_read calls, which is what the helpers used to do. */
+
+#define VIDEO_FRAME_DURATION_US 33333
+#define AUDIO_FRAME_DURATION_US 21333
+#define KEYFRAME_INTERVAL 60
+#define GENERATED_DURATION_US (INT64_C(60) * 60000000)
+
+static unsigned int iterations = 10;
+static int32_t verbosity = VC_CONTAINER_LOG_ERROR|VC_CONTAINER_LOG_INFO;
+
+/*****************************************************************************/
+static int64_t time_get_us(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T generate_file(const char *psz_out, int64_t duration_us)
+{
+   VC_CONTAINER_ES_SPECIFIC_FORMAT_T fmt_es[2];
+   VC_CONTAINER_ES_FORMAT_T fmt[2];
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_PACKET_T packet;
+   int64_t video_pts = 0, audio_pts = 0;
+   uint8_t data[16] = {0};
+   unsigned int frames = 0;
+   VC_CONTAINER_T *ctx;
+
+   memset(fmt, 0, sizeof(fmt));
+   memset(fmt_es, 0, sizeof(fmt_es));
+   fmt[0].type = &fmt_es[0];
+   fmt[0].es_type = VC_CONTAINER_ES_TYPE_VIDEO;
+   fmt[0].codec = VC_CONTAINER_CODEC_H264;
+   fmt[0].codec_variant = VC_CONTAINER_VARIANT_H264_AVC1;
+   fmt[0].flags = VC_CONTAINER_ES_FORMAT_FLAG_FRAMED;
+   fmt[0].type->video.width = 1920;
+   fmt[0].type->video.height = 1080;
+   fmt[1].type = &fmt_es[1];
+   fmt[1].es_type = VC_CONTAINER_ES_TYPE_AUDIO;
+   fmt[1].codec = VC_CONTAINER_CODEC_MP4A;
+   fmt[1].flags = VC_CONTAINER_ES_FORMAT_FLAG_FRAMED;
+   fmt[1].type->audio.channels = 2;
+   fmt[1].type->audio.sample_rate = 48000;
+
+   ctx = vc_container_open_writer(psz_out, &status, 0, 0);
+   if(!ctx) return status;
+
+   status = vc_container_control(ctx, VC_CONTAINER_CONTROL_TRACK_ADD, &fmt[0]);
+   if(status == VC_CONTAINER_SUCCESS)
+      status = vc_container_control(ctx, VC_CONTAINER_CONTROL_TRACK_ADD, &fmt[1]);
+
+   memset(&packet, 0, sizeof(packet));
+   packet.data = data;
+   packet.buffer_size = packet.size = packet.frame_size = sizeof(data);
+
+   while(status == VC_CONTAINER_SUCCESS && video_pts < duration_us)
+   {
+      packet.flags = VC_CONTAINER_PACKET_FLAG_FRAME;
+      if(audio_pts < video_pts)
+      {
+         packet.track = 1;
+         packet.pts = packet.dts = audio_pts;
+         audio_pts += AUDIO_FRAME_DURATION_US;
+      }
+      else
+      {
+         packet.track = 0;
+         packet.pts = packet.dts = video_pts;
+         if(!(frames++ % KEYFRAME_INTERVAL)) packet.flags |= VC_CONTAINER_PACKET_FLAG_KEYFRAME;
+         video_pts += VIDEO_FRAME_DURATION_US + (frames % 3) * 1000; /* Jitter */
+      }
+      status = vc_container_write(ctx, &packet);
+   }
+
+   vc_container_close(ctx);
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T benchmark_parse(const char *psz_in, int64_t *open_us,
+   int64_t *scan_us, unsigned int *packets)
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_PACKET_T packet;
+   VC_CONTAINER_T *ctx;
+   unsigned int i;
+   int64_t time;
+
+   *open_us = *scan_us = 0;
+   for(i = 0; i < iterations; i++)
+   {
+      time = time_get_us();
+      ctx = vc_container_open_reader(psz_in, &status, 0, 0);
+      *open_us += time_get_us() - time;
+      if(!ctx) return status;
+
+      /* Only reads the packet headers, the data is skipped */
+      time = time_get_us();
+      for(*packets = 0; ; (*packets)++)
+      {
+         memset(&packet, 0, sizeof(packet));
+         if(vc_container_read(ctx, &packet, VC_CONTAINER_READ_FLAG_INFO) != VC_CONTAINER_SUCCESS ||
+            vc_container_read(ctx, 0, VC_CONTAINER_READ_FLAG_SKIP) != VC_CONTAINER_SUCCESS)
+            break;
+      }
+      *scan_us += time_get_us() - time;
+
+      vc_container_close(ctx);
+   }
+
+   *open_us /= iterations;
+   *scan_us /= iterations;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T benchmark_read(const char *psz_in, bool b_inline,
+   int64_t *read_us, uint32_t *checksum)
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_IO_T *io;
+   unsigned int i;
+   int64_t time;
+
+   *read_us = 0;
+   for(i = 0; i < iterations; i++)
+   {
+      io = vc_container_io_open(psz_in, VC_CONTAINER_IO_MODE_READ, &status);
+      if(!io) return status;
+
+      *checksum = 0;
+      time = time_get_us();
+      if(b_inline)
+      {
+         while(io->status == VC_CONTAINER_SUCCESS)
+            *checksum += vc_container_io_read_be_uint32(io);
+      }
+      else
+      {
+         uint8_t value[4];
+         while(vc_container_io_read(io, value, 4) == 4)
+            *checksum += (value[0] << 24) | (value[1] << 16) | (value[2] << 8) | value[3];
+      }
+      *read_us += time_get_us() - time;
+
+      vc_container_io_close(io);
+   }
+
+   *read_us /= iterations;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static int benchmark_file(const char *psz_in)
+{
+   int64_t open_us, scan_us, read_us, inline_us;
+   uint32_t checksum, inline_checksum;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int packets = 0;
+
+   status = benchmark_parse(psz_in, &open_us, &scan_us, &packets);
+   if(status == VC_CONTAINER_SUCCESS)
+      status = benchmark_read(psz_in, false, &read_us, &checksum);
+   if(status == VC_CONTAINER_SUCCESS)
+      status = benchmark_read(psz_in, true, &inline_us, &inline_checksum);
+   if(status != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(0, "error benchmarking %s (%i)", psz_in, status);
+      return -1;
+   }
+   if(checksum != inline_checksum)
+   {
+      LOG_ERROR(0, "%s: inline helpers read different data", psz_in);
+      return -1;
+   }
+
+   LOG_INFO(0, "%s: open %8"PRId64"us, scan %8"PRId64"us (%u packets), "
+            "read_be_uint32 %8"PRId64"us (io_read %8"PRId64"us, %.2fx)",
+            psz_in, open_us, scan_us, packets, inline_us, read_us,
+            inline_us ? read_us / (double)inline_us : 0);
+   return 0;
+}
+
+/*****************************************************************************/
+int main(int argc, char **argv)
+{
+   const char *psz_generated = "io-benchmark.mp4";
+   VC_CONTAINER_STATUS_T status;
+   int j, files = 0, ret = 0;
+
+   for(j = 1; j < argc; j++)
+   {
+      if(!strcmp(argv[j], "-n") && j + 1 < argc) iterations = atoi(argv[++j]);
+      else if(!strncmp(argv[j], "-v", 2)) verbosity = (verbosity << 1) | 1;
+      else if(argv[j][0] == '-' || !iterations)
+      {
+         LOG_INFO(0, "usage: %s [-n iterations] [-v] [files...]", argv[0]);
+         LOG_INFO(0, " -n : number of times each file is parsed (default %u)", iterations);
+         return 1;
+      }
+      else files++;
+   }
+
+   vc_container_log_set_verbosity(0, verbosity);
+   vc_container_log_set_default_verbosity(VC_CONTAINER_LOG_ERROR);
+
+   if(!files)
+   {
+      status = generate_file(psz_generated, GENERATED_DURATION_US);
+      if(status == VC_CONTAINER_SUCCESS)
+         ret = benchmark_file(psz_generated);
+      else
+         LOG_ERROR(0, "error generating %s (%i)", psz_generated, status);
+      remove(psz_generated);
+      return status == VC_CONTAINER_SUCCESS ? ret : -1;
+   }
+
+   for(j = 1; j < argc; j++)
+   {
+      if(!strcmp(argv[j], "-n")) j++;
+      else if(argv[j][0] != '-' && benchmark_file(argv[j])) ret = -1;
+   }
+
+   return ret;
+}
@@ -0,0 +1,216 @@
+/*
+Copyright (c) 2021, Gildas Bazin
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "containers.h"
+#include "containers_codecs.h"
+#include "core/containers_common.h"
+#include "core/containers_logging.h"
+
+/* Measures the average latency of random seeks in mp4 files of increasing
+ * length. The files are generated with variable frame durations so the
+ * time to sample tables have one entry per frame, which is the worst case. */
+
+#define VIDEO_FRAME_DURATION_US 33333
+#define AUDIO_FRAME_DURATION_US 21333
+#define KEYFRAME_INTERVAL 60
+
+static unsigned int lengths_min[] = {1, 10, 60, 180};
+#define LENGTHS_NUM (sizeof(lengths_min)/sizeof(lengths_min[0]))
+
+static unsigned int seeks_num = 200;
+static bool b_index = 0;
+static int32_t verbosity = VC_CONTAINER_LOG_ERROR|VC_CONTAINER_LOG_INFO;
+
+/*****************************************************************************/
+static int64_t time_get_us(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T generate_file(const char *psz_out, int64_t duration_us)
+{
+   VC_CONTAINER_ES_SPECIFIC_FORMAT_T fmt_es[2];
+   VC_CONTAINER_ES_FORMAT_T fmt[2];
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_PACKET_T packet;
+   int64_t video_pts = 0, audio_pts = 0;
+   uint8_t data[16] = {0};
+   unsigned int frames = 0;
+   VC_CONTAINER_T *ctx;
+
+   memset(fmt, 0, sizeof(fmt));
+   memset(fmt_es, 0, sizeof(fmt_es));
+   fmt[0].type = &fmt_es[0];
+   fmt[0].es_type = VC_CONTAINER_ES_TYPE_VIDEO;
+   fmt[0].codec = VC_CONTAINER_CODEC_H264;
+   fmt[0].codec_variant = VC_CONTAINER_VARIANT_H264_AVC1;
+   fmt[0].flags = VC_CONTAINER_ES_FORMAT_FLAG_FRAMED;
+   fmt[0].type->video.width = 1920;
+   fmt[0].type->video.height = 1080;
+   fmt[1].type = &fmt_es[1];
+   fmt[1].es_type = VC_CONTAINER_ES_TYPE_AUDIO;
+   fmt[1].codec = VC_CONTAINER_CODEC_MP4A;
+   fmt[1].flags = VC_CONTAINER_ES_FORMAT_FLAG_FRAMED;
+   fmt[1].type->audio.channels = 2;
+   fmt[1].type->audio.sample_rate = 48000;
+
+   ctx = vc_container_open_writer(psz_out, &status, 0, 0);
+   if(!ctx) return status;
+
+   status = vc_container_control(ctx, VC_CONTAINER_CONTROL_TRACK_ADD, &fmt[0]);
+   if(status == VC_CONTAINER_SUCCESS)
+      status = vc_container_control(ctx, VC_CONTAINER_CONTROL_TRACK_ADD, &fmt[1]);
+
+   memset(&packet, 0, sizeof(packet));
+   packet.data = data;
+   packet.buffer_size = packet.size = packet.frame_size = sizeof(data);
+
+   while(status == VC_CONTAINER_SUCCESS && video_pts < duration_us)
+   {
+      packet.flags = VC_CONTAINER_PACKET_FLAG_FRAME;
+      if(audio_pts < video_pts)
+      {
+         packet.track = 1;
+         packet.pts = packet.dts = audio_pts;
+         audio_pts += AUDIO_FRAME_DURATION_US;
+      }
+      else
+      {
+         packet.track = 0;
+         packet.pts = packet.dts = video_pts;
+         if(!(frames++ % KEYFRAME_INTERVAL)) packet.flags |= VC_CONTAINER_PACKET_FLAG_KEYFRAME;
+         video_pts += VIDEO_FRAME_DURATION_US + (frames % 3) * 1000; /* Jitter */
+      }
+      status = vc_container_write(ctx, &packet);
+   }
+
+   vc_container_close(ctx);
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T benchmark_file(const char *psz_in, int64_t duration_us,
+   int64_t *open_us, int64_t *first_us, int64_t *seek_us)
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_T *ctx;
+   char uri[256];
+   unsigned int i;
+   int64_t time;
+
+   snprintf(uri, sizeof(uri), "%s%s", psz_in, b_index ? "?index" : "");
+
+   time = time_get_us();
+   ctx = vc_container_open_reader(uri, &status, 0, 0);
+   *open_us = time_get_us() - time;
+   if(!ctx) return status;
+
+   *seek_us = 0;
+   for(i = 0; i < seeks_num; i++)
+   {
+      int64_t offset = (int64_t)(rand() / (double)RAND_MAX * (duration_us - 1000000));
+      VC_CONTAINER_PACKET_T packet;
+
+      time = time_get_us();
+      status = vc_container_seek(ctx, &offset, VC_CONTAINER_SEEK_MODE_TIME, 0);
+      if(status == VC_CONTAINER_SUCCESS)
+      {
+         memset(&packet, 0, sizeof(packet));
+         status = vc_container_read(ctx, &packet, VC_CONTAINER_READ_FLAG_INFO);
+      }
+      time = time_get_us() - time;
+      if(!i) *first_us = time; /* Includes building the seek tables */
+      else *seek_us += time;
+      if(status != VC_CONTAINER_SUCCESS)
+      {
+         LOG_ERROR(0, "seek %u to %"PRId64"us failed (%i)", i, offset, status);
+         break;
+      }
+   }
+
+   vc_container_close(ctx);
+   return status;
+}
+
+/*****************************************************************************/
+int main(int argc, char **argv)
+{
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+   int j;
+
+   for(j = 1; j < argc; j++)
+   {
+      if(!strcmp(argv[j], "-i")) b_index = 1;
+      else if(!strcmp(argv[j], "-n") && j + 1 < argc) seeks_num = atoi(argv[++j]);
+      else if(!strncmp(argv[j], "-v", 2)) verbosity = (verbosity << 1) | 1;
+      else
+      {
+         LOG_INFO(0, "usage: %s [-i] [-n seeks] [-v]", argv[0]);
+         LOG_INFO(0, " -i : open the files with the in-memory sample index");
+         LOG_INFO(0, " -n : number of random seeks per file (default %u)", seeks_num);
+         return 1;
+      }
+   }
+
+   vc_container_log_set_verbosity(0, verbosity);
+   vc_container_log_set_default_verbosity(VC_CONTAINER_LOG_ERROR);
+   srand(1);
+
+   for(i = 0; i < LENGTHS_NUM; i++)
+   {
+      int64_t duration_us = lengths_min[i] * INT64_C(60000000), open_us, first_us = 0, seek_us = 0;
+      char psz_file[64];
+
+      snprintf(psz_file, sizeof(psz_file), "seek-benchmark-%umin.mp4", lengths_min[i]);
+      status = generate_file(psz_file, duration_us);
+      if(status != VC_CONTAINER_SUCCESS)
+      {
+         LOG_ERROR(0, "error generating %s (%i)", psz_file, status);
+         return -1;
+      }
+
+      status = benchmark_file(psz_file, duration_us, &open_us, &first_us, &seek_us);
+      remove(psz_file);
+      if(status != VC_CONTAINER_SUCCESS)
+      {
+         LOG_ERROR(0, "error benchmarking %s (%i)", psz_file, status);
+         return -1;
+      }
+
+      LOG_INFO(0, "%4u min: open %8"PRId64"us, first seek %8"PRId64"us, %8.1fus per seek",
+               lengths_min[i], open_us, first_us, seeks_num > 1 ? seek_us / (double)(seeks_num - 1) : 0);
+   }
+
+   return 0;
+}
@@ -189,7 +189,7 @@ static VC_CONTAINER_STATUS_T generate_container(const char *psz_out,
     unsigned int tracks, VC_CONTAINER_ES_FORMAT_T *fmt,
     unsigned int pkts_num, VC_CONTAINER_PACKET_T *pkts,
     unsigned int meta_num, VC_CONTAINER_METADATA_KEY_T *meta_keys, const char **meta_vals,
-    bool b_rebase_timestamps, bool b_info)
+    bool b_rebase_timestamps, int moov_reserve, int fragment_ms, bool b_info)
 {
    VC_CONTAINER_STATUS_T status;
    VC_CONTAINER_T *ctx;
@@ -209,6 +209,14 @@ static VC_CONTAINER_STATUS_T generate_container(const char *psz_out,
    if (!b_rebase_timestamps)
       vc_container_control (ctx, VC_CONTAINER_CONTROL_REBASE_TIMESTAMPS, false);
 
+   if (moov_reserve == 0)
+      vc_container_control (ctx, VC_CONTAINER_CONTROL_MP4_FASTSTART, true);
+   else if (moov_reserve > 0)
+      vc_container_control (ctx, VC_CONTAINER_CONTROL_MP4_RESERVE_MOOV, (uint32_t)moov_reserve);
+
+   if (fragment_ms >= 0)
+      vc_container_control (ctx, VC_CONTAINER_CONTROL_MP4_FRAGMENT, (unsigned int)fragment_ms);
+
    for(i = 0; i < meta_num; i++)
    {
       status = vc_container_control (ctx, VC_CONTAINER_CONTROL_METADATA_ADD, meta_keys[i], meta_vals[i]);
@@ -247,22 +255,488 @@ error:
    return status;
 }
 
+/* Loads a whole file in memory */
+static uint8_t *load_file(const char *psz_in, size_t *p_size)
+{
+   uint8_t *data;
+   size_t size = 0;
+   FILE *file;
+
+   file = fopen(psz_in, "rb");
+   if(!file) return 0;
+   if(!fseek(file, 0, SEEK_END)) size = ftell(file);
+   fseek(file, 0, SEEK_SET);
+   data = malloc(size ? size : 1);
+   if(data && fread(data, 1, size, file) != size)
+   {
+      free(data);
+      data = 0;
+   }
+   fclose(file);
+   *p_size = size;
+   return data;
+}
+
+/* Opens a reader on a file loaded in memory, split over a few buffers so the
+ * data crosses buffer boundaries */
+static VC_CONTAINER_T *open_memory_reader(const char *psz_in, uint8_t **pp_data,
+    VC_CONTAINER_STATUS_T *p_status)
+{
+   VC_CONTAINER_IO_MEMORY_BUFFER_T buffers[4];
+   VC_CONTAINER_T *ctx = 0;
+   VC_CONTAINER_IO_T *io;
+   size_t size;
+
+   *p_status = VC_CONTAINER_ERROR_URI_NOT_FOUND;
+   *pp_data = load_file(psz_in, &size);
+   if(!*pp_data) return 0;
+
+   buffers[0].data = *pp_data;
+   buffers[0].size = size / 3;
+   buffers[1].data = 0;
+   buffers[1].size = 0;
+   buffers[2].data = *pp_data + size / 3;
+   buffers[2].size = size / 3;
+   buffers[3].data = *pp_data + 2 * (size / 3);
+   buffers[3].size = size - 2 * (size / 3);
+
+   io = vc_container_io_open_memory_chain(psz_in, buffers, 4, p_status);
+   if(io) ctx = vc_container_open_reader_with_io(io, psz_in, p_status, 0, 0);
+   if(io && !ctx) vc_container_io_close(io);
+
+   if(!ctx) free(*pp_data);
+   if(!ctx) *pp_data = 0;
+   return ctx;
+}
+
+static uint32_t read_be32(const uint8_t *p)
+{
+   return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Checks the sequence of top level boxes of an mp4 file, e.g. "ftyp moov mdat" */
+static int check_mp4_layout(const char *psz_in, const char *layout)
+{
+   char boxes[256] = "";
+   size_t size, offset = 0, len = 0;
+   uint8_t *data = load_file(psz_in, &size), *p;
+   uint64_t box_size;
+
+   if(!data)
+   {
+      LOG_ERROR(0, "error loading file %s", psz_in);
+      return VC_CONTAINER_ERROR_URI_NOT_FOUND;
+   }
+
+   while(offset + 8 <= size && len + 5 < sizeof(boxes))
+   {
+      p = data + offset;
+      box_size = read_be32(p);
+      if(box_size == 1 && offset + 16 <= size)
+         box_size = ((uint64_t)read_be32(p + 8) << 32) | read_be32(p + 12);
+      else if(!box_size) box_size = size - offset;
+      len += snprintf(boxes + len, sizeof(boxes) - len, "%s%4.4s", len ? " " : "", data + offset + 4);
+      if(box_size < 8 || box_size > size - offset) break;
+      offset += box_size;
+   }
+   free(data);
+
+   if(offset != size || strcmp(boxes, layout))
+   {
+      LOG_ERROR(0, "unexpected layout for %s (%s/%s)", psz_in, boxes, layout);
+      return VC_CONTAINER_ERROR_CORRUPTED;
+   }
+   return 0;
+}
+
+/* Copies an mp4 file, overwriting a 32 bits field of the first box of the given type */
+static int patch_mp4_box(const char *psz_in, const char *psz_out, const char *type,
+    unsigned int field_offset, uint32_t value)
+{
+   size_t size, offset;
+   uint8_t *data = load_file(psz_in, &size);
+   int status = VC_CONTAINER_ERROR_CORRUPTED;
+   FILE *file;
+
+   if(!data) return VC_CONTAINER_ERROR_URI_NOT_FOUND;
+   for(offset = 4; offset + field_offset + 4 <= size; offset++)
+   {
+      if(memcmp(data + offset, type, 4)) continue;
+      offset += field_offset;
+      data[offset] = value >> 24; data[offset+1] = value >> 16;
+      data[offset+2] = value >> 8; data[offset+3] = value;
+      file = fopen(psz_out, "wb");
+      if(file && fwrite(data, 1, size, file) == size) status = 0;
+      if(file) fclose(file);
+      break;
+   }
+   free(data);
+   return status;
+}
+
+/* Checks the time to sample table of each track of an mp4 file adds up to at
+ * most max_duration (in milliseconds) */
+static int check_mp4_stts_duration(const char *psz_in, uint64_t max_duration)
+{
+   size_t size, offset;
+   uint8_t *data = load_file(psz_in, &size);
+   unsigned int tables = 0;
+   int status = 0;
+
+   if(!data) return VC_CONTAINER_ERROR_URI_NOT_FOUND;
+   for(offset = 4; offset + 12 <= size && !status; offset++)
+   {
+      uint64_t duration = 0;
+      uint32_t i, entries;
+      if(memcmp(data + offset, "stts", 4)) continue;
+      entries = read_be32(data + offset + 8);
+      for(i = 0; i < entries && offset + 20 + i * 8 <= size; i++)
+         duration += (uint64_t)read_be32(data + offset + 12 + i * 8) *
+            read_be32(data + offset + 16 + i * 8);
+      if(i != entries || duration > max_duration)
+      {
+         LOG_ERROR(0, "unexpected time to sample table in %s (%u entries, duration %"PRIu64"/%"PRIu64")",
+                   psz_in, entries, duration, max_duration);
+         status = VC_CONTAINER_ERROR_CORRUPTED;
+      }
+      tables++;
+   }
+   free(data);
+   return status || tables ? status : VC_CONTAINER_ERROR_CORRUPTED;
+}
+
+/* Copies a file without its last few bytes */
+static int truncate_file(const char *psz_in, const char *psz_out, size_t bytes)
+{
+   size_t size;
+   uint8_t *data = load_file(psz_in, &size);
+   int status = VC_CONTAINER_ERROR_FAILED;
+   FILE *file;
+
+   if(!data) return VC_CONTAINER_ERROR_URI_NOT_FOUND;
+   file = fopen(psz_out, "wb");
+   size = size > bytes ? size - bytes : 0;
+   if(file && fwrite(data, 1, size, file) == size) status = 0;
+   if(file) fclose(file);
+   free(data);
+   return status;
+}
+
+/* Reads a truncated file with zero-copy until it fails, then checks the packet
+ * still uses the caller's buffer and can be used for a normal read */
+static int check_zero_copy_truncated(const char *psz_in)
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_PACKET_T packet = {0};
+   uint8_t buffer[256];
+   VC_CONTAINER_T *ctx;
+   int64_t time = 0;
+   unsigned int i;
+
+   LOG_INFO(0, "reading %s with zero-copy", psz_in);
+
+   ctx = vc_container_open_reader(psz_in, &status, 0, 0);
+   if(!ctx)
+   {
+      LOG_ERROR(0, "error opening file %s (%i)", psz_in, status);
+      return status;
+   }
+
+   for(i = 0; ; i++)
+   {
+      packet.data = buffer;
+      packet.buffer_size = sizeof(buffer);
+      status = vc_container_read(ctx, &packet, VC_CONTAINER_READ_FLAG_ZERO_COPY);
+      if(status != VC_CONTAINER_SUCCESS) break;
+      vc_container_packet_release(ctx, &packet);
+   }
+   if(packet.data != buffer)
+   {
+      LOG_ERROR(0, "packet %u failed (%i) but doesn't use its buffer anymore", i, status);
+      status = VC_CONTAINER_ERROR_CORRUPTED;
+      goto error;
+   }
+
+   status = vc_container_seek(ctx, &time, VC_CONTAINER_SEEK_MODE_TIME, 0);
+   if(status == VC_CONTAINER_SUCCESS)
+   {
+      packet.buffer_size = sizeof(buffer);
+      status = vc_container_read(ctx, &packet, 0);
+   }
+   if(status != VC_CONTAINER_SUCCESS || packet.data != buffer)
+   {
+      LOG_ERROR(0, "error reading after seeking back (%i)", status);
+      status = VC_CONTAINER_ERROR_CORRUPTED;
+   }
+
+ error:
+   vc_container_close(ctx);
+   return status;
+}
+
+/* Seeks around a file and checks each seek lands on the video keyframe that a
+ * linear scan of the packets picks, i.e. the last one starting at or before the
+ * requested time or the first one when seeking before it */
+static int check_seek(const char *psz_in)
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_PACKET_T packet = {0};
+   int64_t keyframes[100], targets[4 * 100 + 3], time, expected;
+   unsigned int keyframes_num = 0, targets_num = 0, track, i, j;
+   VC_CONTAINER_T *ctx;
+
+   LOG_INFO(0, "seeking in %s", psz_in);
+
+   ctx = vc_container_open_reader(psz_in, &status, 0, 0);
+   if(!ctx)
+   {
+      LOG_ERROR(0, "error opening file %s (%i)", psz_in, status);
+      return status;
+   }
+
+   for(track = 0; track < ctx->tracks_num; track++)
+      if(ctx->tracks[track]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) break;
+   if(track == ctx->tracks_num)
+   {
+      LOG_ERROR(0, "no video track in %s", psz_in);
+      status = VC_CONTAINER_ERROR_CORRUPTED;
+      goto error;
+   }
+
+   /* Linear scan of the keyframes */
+   while(vc_container_read(ctx, &packet, VC_CONTAINER_READ_FLAG_INFO) == VC_CONTAINER_SUCCESS)
+   {
+      if(packet.track == track && (packet.flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME) &&
+         keyframes_num < 100)
+         keyframes[keyframes_num++] = packet.pts;
+      if(vc_container_read(ctx, &packet, VC_CONTAINER_READ_FLAG_SKIP) != VC_CONTAINER_SUCCESS)
+         break;
+   }
+   if(!keyframes_num)
+   {
+      LOG_ERROR(0, "no keyframes in %s", psz_in);
+      status = VC_CONTAINER_ERROR_CORRUPTED;
+      goto error;
+   }
+
+   /* Around each keyframe, before the first sample and past the end */
+   targets[targets_num++] = 1000;
+   for(i = 0; i < keyframes_num; i++)
+   {
+      targets[targets_num++] = keyframes[i] - 1000;
+      targets[targets_num++] = keyframes[i];
+      targets[targets_num++] = keyframes[i] + 1000;
+      if(i + 1 < keyframes_num)
+         targets[targets_num++] = (keyframes[i] + keyframes[i + 1]) / 2;
+   }
+   targets[targets_num++] = keyframes[keyframes_num - 1] + 10000000;
+
+   for(i = 0; i < targets_num; i++)
+   {
+      if(targets[i] <= 0) continue;
+      for(j = 0, expected = keyframes[0]; j < keyframes_num && keyframes[j] <= targets[i]; j++)
+         expected = keyframes[j];
+
+      time = targets[i];
+      status = vc_container_seek(ctx, &time, VC_CONTAINER_SEEK_MODE_TIME, 0);
+      if(status != VC_CONTAINER_SUCCESS)
+      {
+         LOG_ERROR(0, "error seeking to %"PRIi64" (%i)", targets[i], status);
+         goto error;
+      }
+      while((status = vc_container_read(ctx, &packet, VC_CONTAINER_READ_FLAG_INFO)) == VC_CONTAINER_SUCCESS &&
+            packet.track != track)
+         status = vc_container_read(ctx, &packet, VC_CONTAINER_READ_FLAG_SKIP);
+
+      if(status != VC_CONTAINER_SUCCESS || time != expected || packet.pts != expected ||
+         !(packet.flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME))
+      {
+         LOG_ERROR(0, "seeking to %"PRIi64" landed on %"PRIi64" (packet %"PRIi64", flags %x, status %i) "
+                   "instead of %"PRIi64, targets[i], time, packet.pts, packet.flags, status, expected);
+         status = VC_CONTAINER_ERROR_CORRUPTED;
+         goto error;
+      }
+   }
+
+ error:
+   vc_container_close(ctx);
+   return status;
+}
+
+/* Checks the track runs of a traf box against the packets written for its track.
+ * next[] holds the index of the next packet expected for each track. */
+static int check_mp4_traf(const uint8_t *data, size_t size, size_t moof_offset,
+    const uint8_t *traf, size_t traf_size, unsigned int pkts_num,
+    VC_CONTAINER_PACKET_T *pkts, unsigned int *next, int64_t ts_offset_us)
+{
+   const uint8_t *box, *end = traf + traf_size, *p;
+   unsigned int track = UINT_MAX, count, i;
+   size_t box_size, offset;
+   int64_t dts = -1;
+
+   for(box = traf + 8; box + 8 <= end; box += box_size)
+   {
+      box_size = read_be32(box);
+      if(box_size < 8 || box_size > (size_t)(end - box))
+         break;
+
+      if(!memcmp(box + 4, "tfhd", 4) && box_size >= 16)
+         track = read_be32(box + 12) - 1;
+      else if(!memcmp(box + 4, "tfdt", 4) && box_size >= (box[8] ? 20u : 16u))
+         dts = box[8] ? (int64_t)(((uint64_t)read_be32(box + 12) << 32) | read_be32(box + 16)) :
+            (int64_t)read_be32(box + 12);
+      else if(!memcmp(box + 4, "trun", 4) && box_size >= 20)
+      {
+         /* The writer always gives the data offset and the duration, size,
+          * flags and composition offset of each sample */
+         count = read_be32(box + 12);
+         if(read_be32(box + 8) != 0xF01 || box_size != 20 + (size_t)count * 16 ||
+            track >= 10 || dts < 0)
+         {
+            LOG_ERROR(0, "unexpected trun box (track %u, dts %"PRIi64")", track, dts);
+            return VC_CONTAINER_ERROR_CORRUPTED;
+         }
+
+         /* The data offset is relative to the moof box */
+         offset = moof_offset + read_be32(box + 16);
+         for(i = 0, p = box + 20; i < count; i++, p += 16)
+         {
+            VC_CONTAINER_PACKET_T *pkt;
+
+            while(next[track] < pkts_num && pkts[next[track]].track != track) next[track]++;
+            if(next[track] >= pkts_num)
+            {
+               LOG_ERROR(0, "too many samples for track %u", track);
+               return VC_CONTAINER_ERROR_CORRUPTED;
+            }
+            pkt = pkts + next[track]++;
+
+            /* The writer uses a millisecond timescale */
+            if(dts != (pkt->dts - ts_offset_us) / 1000 ||
+               dts + read_be32(p + 12) != (pkt->pts - ts_offset_us) / 1000 ||
+               read_be32(p + 4) != pkt->size ||
+               offset + pkt->size > size || memcmp(data + offset, pkt->data, pkt->size))
+            {
+               LOG_ERROR(0, "packet %u of track %u doesn't match (dts %"PRIi64"/%"PRIi64", "
+                         "composition offset %u, size %u/%u)", next[track] - 1, track, dts,
+                         (pkt->dts - ts_offset_us) / 1000, read_be32(p + 12),
+                         read_be32(p + 4), pkt->size);
+               return VC_CONTAINER_ERROR_CORRUPTED;
+            }
+            dts += read_be32(p);
+            offset += pkt->size;
+         }
+      }
+   }
+
+   return track < 10 && dts >= 0 ? 0 : VC_CONTAINER_ERROR_CORRUPTED;
+}
+
+/* Walks the moof boxes of a fragmented mp4 file and checks they describe
+ * the packets that were written, in order. Decode times are counted from
+ * ts_offset_us and the edit list of each track must start playback at
+ * media_time (in milliseconds). */
+static int check_mp4_fragments(const char *psz_in, unsigned int pkts_num,
+    VC_CONTAINER_PACKET_T *pkts, int64_t ts_offset_us, int64_t media_time)
+{
+   unsigned int next[10] = {0}, fragments = 0, edits = 0, i;
+   size_t size, offset, box_size, traf_size, traf;
+   uint8_t *data = load_file(psz_in, &size);
+   int status = VC_CONTAINER_ERROR_CORRUPTED;
+
+   LOG_INFO(0, "checking fragments of %s", psz_in);
+
+   if(!data)
+   {
+      LOG_ERROR(0, "error loading file %s", psz_in);
+      return VC_CONTAINER_ERROR_URI_NOT_FOUND;
+   }
+
+   for(offset = 0; offset + 8 <= size; offset += box_size)
+   {
+      box_size = read_be32(data + offset);
+      if(box_size < 8 || box_size > size - offset)
+         goto end;
+      if(!memcmp(data + offset + 4, "moov", 4))
+      {
+         /* Each track has a single edit of unknown duration */
+         for(i = 8; i + 28 <= box_size; i++)
+         {
+            const uint8_t *p = data + offset + i;
+            int64_t time;
+            if(memcmp(p, "elst", 4)) continue;
+            time = p[4] ? (int64_t)(((uint64_t)read_be32(p + 20) << 32) | read_be32(p + 24)) :
+               (int32_t)read_be32(p + 16);
+            if(read_be32(p + 8) != 1 || time != media_time)
+            {
+               LOG_ERROR(0, "unexpected edit list (%u entries, media time %"PRIi64"/%"PRIi64")",
+                         read_be32(p + 8), time, media_time);
+               goto end;
+            }
+            edits++;
+         }
+      }
+      if(memcmp(data + offset + 4, "moof", 4))
+         continue;
+
+      /* The first child is the mfhd box with the sequence number */
+      fragments++;
+      if(box_size < 24 || memcmp(data + offset + 12, "mfhd", 4) ||
+         read_be32(data + offset + 20) != fragments)
+      {
+         LOG_ERROR(0, "unexpected mfhd box in fragment %u", fragments);
+         goto end;
+      }
+
+      for(traf = offset + 24; traf + 8 <= offset + box_size; traf += traf_size)
+      {
+         traf_size = read_be32(data + traf);
+         if(traf_size < 8 || traf_size > offset + box_size - traf)
+            goto end;
+         if(memcmp(data + traf + 4, "traf", 4))
+            continue;
+         if(check_mp4_traf(data, size, offset, data + traf, traf_size,
+                           pkts_num, pkts, next, ts_offset_us))
+            goto end;
+      }
+   }
+
+   /* Every packet must have been found */
+   for(i = 0; i < pkts_num; i++)
+   {
+      if(i >= next[pkts[i].track])
+      {
+         LOG_ERROR(0, "packet %u missing from %u fragments", i, fragments);
+         goto end;
+      }
+   }
+   status = fragments > 1 && edits ? 0 : VC_CONTAINER_ERROR_CORRUPTED;
+
+ end:
+   free(data);
+   return status;
+}
+
 static int verify_container(const char *psz_in,
     unsigned int tracks, VC_CONTAINER_ES_FORMAT_T *fmt,
     unsigned int pkts_num, VC_CONTAINER_PACKET_T *pkts,
     int64_t ts_offset_us,
     unsigned int meta_num, VC_CONTAINER_METADATA_KEY_T *meta_keys, const char **meta_vals,
-    bool b_info)
+    bool b_info, uint32_t read_flags)
 {
    VC_CONTAINER_STATUS_T status;
    VC_CONTAINER_T *ctx;
+   uint8_t *data = 0;
    unsigned int i;
 
    LOG_INFO(0, "verifying %s", psz_in);
 
    vc_container_log_set_default_verbosity(verbosity_input);
 
-   ctx = vc_container_open_reader(psz_in, &status, 0, 0);
+   if(!strncmp(psz_in, "memory:", 7))
+      ctx = open_memory_reader(psz_in + 7, &data, &status);
+   else
+      ctx = vc_container_open_reader(psz_in, &status, 0, 0);
    if(!ctx)
    {
       LOG_ERROR(0, "error opening file %s (%i)", psz_in, status);
@@ -318,19 +792,39 @@ static int verify_container(const char *psz_in,
          goto error;
       }
 
-      status = vc_container_read(ctx, &packet, 0);
+      status = vc_container_read(ctx, &packet, read_flags);
       if(status != VC_CONTAINER_SUCCESS)
       {
          LOG_ERROR(0, "error skipping packet %i (%i)", i, status);
          goto error;
       }
 
-      if(memcmp(buffer, pkts[i].data, pkts[i].size))
+      if(memcmp(packet.data, pkts[i].data, pkts[i].size))
       {
          LOG_ERROR(0, "packet data %i mismatch", i);
          status = VC_CONTAINER_ERROR_CORRUPTED;
          goto error;
       }
+
+      if(read_flags & VC_CONTAINER_READ_FLAG_ZERO_COPY)
+         vc_container_packet_release(ctx, &packet);
+   }
+
+   /* Check the read counters account for what we've read */
+   {
+      VC_CONTAINER_READ_COUNTERS_T counters = {0};
+      unsigned int packets = 0;
+
+      status = vc_container_control(ctx, VC_CONTAINER_CONTROL_GET_READ_COUNTERS, &counters);
+      for(i = 0; status == VC_CONTAINER_SUCCESS && i < tracks; i++)
+         packets += counters.packets[i];
+      if(status != VC_CONTAINER_SUCCESS || packets != pkts_num || !counters.bytes_read)
+      {
+         LOG_ERROR(0, "read counters mismatch (%i packets, %"PRIu64" bytes)",
+                   packets, counters.bytes_read);
+         status = VC_CONTAINER_ERROR_CORRUPTED;
+         goto error;
+      }
    }
 
    /* Check metadata */
@@ -358,6 +852,7 @@ error:
       print_info(ctx, true);
 
    vc_container_close(ctx);
+   free(data);
    return status;
 }
 
@@ -462,6 +957,32 @@ static void fill_packets(VC_CONTAINER_PACKET_T *pkts, unsigned pkts_num,
    }
 }
 
+static void reorder_packets(VC_CONTAINER_PACKET_T *pkts, unsigned pkts_num, unsigned track)
+{
+   /* Turn the packets of a track into an I P B P B... sequence in decoding order.
+    * Frames are displayed one frame late and each B frame before the P frame
+    * preceding it in decoding order. */
+   VC_CONTAINER_PACKET_T *frames[100];
+   unsigned i, frames_num = 0;
+   int64_t pts;
+   assert(pkts_num <= 100);
+
+   for(i = 0; i < pkts_num; i++)
+      if(pkts[i].track == track) frames[frames_num++] = pkts + i;
+   if(!frames_num) return;
+
+   for(i = 0; i + 1 < frames_num; i++)
+      frames[i]->pts = frames[i + 1]->dts;
+   frames[frames_num - 1]->pts = frames[frames_num - 1]->dts + 40000;
+
+   for(i = 1; i + 1 < frames_num; i += 2)
+   {
+      pts = frames[i]->pts;
+      frames[i]->pts = frames[i + 1]->pts;
+      frames[i + 1]->pts = pts;
+   }
+}
+
 static int test_mp4(void)
 {
    static const int64_t TS_OFFSET_US = 3000000;
@@ -478,9 +999,130 @@ static int test_mp4(void)
 
    fill_packets(pkts, 100, fmts, 2, TS_OFFSET_US);
 
-   ret = generate_container("test-h264-aac.mp4", 2, fmts, 100, pkts, 2, meta_keys, meta_vals, true, true);
+   ret = generate_container("test-h264-aac.mp4", 2, fmts, 100, pkts, 2, meta_keys, meta_vals, true, -1, -1, true);
+   if (!ret)
+      ret = verify_container("test-h264-aac.mp4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, true, 0);
+   if (!ret)
+      ret = verify_container("test-h264-aac.mp4?index", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (!ret)
+      ret = verify_container("mmap:test-h264-aac.mp4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (!ret)
+      ret = verify_container("test-h264-aac.mp4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false,
+                             VC_CONTAINER_READ_FLAG_ZERO_COPY);
+   if (!ret)
+      ret = verify_container("mmap:test-h264-aac.mp4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false,
+                             VC_CONTAINER_READ_FLAG_ZERO_COPY);
+   if (!ret)
+      ret = verify_container("memory:test-h264-aac.mp4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false,
+                             VC_CONTAINER_READ_FLAG_ZERO_COPY);
+   if (!ret)
+      ret = verify_container("test-h264-aac.mp4?readahead", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (!ret)
+      ret = verify_container("test-h264-aac.mp4?readahead=2", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false,
+                             VC_CONTAINER_READ_FLAG_ZERO_COPY);
+   if (!ret)
+      ret = verify_container("test-h264-aac.mp4?cachesize=4096", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false,
+                             VC_CONTAINER_READ_FLAG_ZERO_COPY);
+   if (!ret)
+      ret = verify_container("test-h264-aac.mp4?cachebudget=32768", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (!ret)
+      ret = verify_container("test-h264-aac.mp4?cachebudget=0", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (!ret)
+      ret = verify_container("test-h264-aac.mp4?uring=4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (!ret)
+      ret = check_seek("test-h264-aac.mp4");
+   if (!ret)
+      ret = check_seek("test-h264-aac.mp4?index");
+   if (ret)
+      return ret;
+
+   /* Entry counts larger than the tables are clamped to what the boxes hold */
+   ret = patch_mp4_box("test-h264-aac.mp4", "test-h264-aac-stsc.mp4", "stsc", 8, 0x7FFFFFFF);
+   if (!ret)
+      ret = verify_container("test-h264-aac-stsc.mp4?index", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (!ret)
+      ret = patch_mp4_box("test-h264-aac.mp4", "test-h264-aac-stsz.mp4", "stsz", 12, 0xFFFFFFFF);
+   if (!ret)
+      ret = verify_container("test-h264-aac-stsz.mp4?index", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (ret)
+      return ret;
+
+   /* Test muxing / demuxing with the moov box in front */
+   ret = generate_container("test-h264-aac-faststart.mp4", 2, fmts, 100, pkts, 2, meta_keys, meta_vals, true, 0, -1, false);
+   if (!ret)
+      ret = check_mp4_layout("test-h264-aac-faststart.mp4", "ftyp moov free free mdat");
+   if (!ret)
+      ret = verify_container("test-h264-aac-faststart.mp4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   /* The mdat box is moved when the room reserved for the moov box is too small */
+   if (!ret)
+      ret = generate_container("test-h264-aac-faststart-move.mp4", 2, fmts, 100, pkts, 2, meta_keys, meta_vals, true, 64, -1, false);
+   if (!ret)
+      ret = check_mp4_layout("test-h264-aac-faststart-move.mp4", "ftyp moov free mdat");
+   if (!ret)
+      ret = verify_container("test-h264-aac-faststart-move.mp4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   /* Zero-copy reads running into the end of a truncated file */
+   if (!ret)
+      ret = truncate_file("test-h264-aac-faststart.mp4", "test-h264-aac-truncated.mp4", 50);
+   if (!ret)
+      ret = check_zero_copy_truncated("test-h264-aac-truncated.mp4?mmap");
+   if (!ret)
+      ret = check_zero_copy_truncated("test-h264-aac-truncated.mp4");
+   if (ret)
+      return ret;
+
+   /* Same thing written with O_DIRECT, which has to merge the header rewrites */
+   ret = generate_container("test-h264-aac-direct.mp4?direct&preallocate=65536", 2, fmts, 100, pkts, 2, meta_keys, meta_vals, true, 0, -1, false);
+   if (!ret)
+      ret = verify_container("test-h264-aac-direct.mp4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (ret)
+      return ret;
+
+   /* Same thing with the temporary data spilling out of memory straight away */
+   ret = generate_container("test-h264-aac-tmpfile.mp4?tmpbudget=0", 2, fmts, 100, pkts, 2, meta_keys, meta_vals, true, 0, -1, false);
+   if (!ret)
+      ret = verify_container("test-h264-aac-tmpfile.mp4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (!ret)
+      ret = generate_container("test-h264-aac-tmpdir.mp4?tmpbudget=4096&tmpdir=.", 2, fmts, 100, pkts, 2, meta_keys, meta_vals, true, -1, -1, false);
+   if (!ret)
+      ret = verify_container("test-h264-aac-tmpdir.mp4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (ret)
+      return ret;
+
+   /* Enough samples for the sample tables to spill out of their in-memory block
+    * (16384 values) on both tracks. Sizes and durations vary from sample to
+    * sample so every table gets one value per sample. */
+   {
+      static const unsigned int LARGE_PKTS_NUM = 2 * 17000;
+      VC_CONTAINER_PACKET_T *large_pkts = calloc(LARGE_PKTS_NUM, sizeof(*large_pkts));
+      if (!large_pkts)
+         return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      fill_packets(large_pkts, LARGE_PKTS_NUM, fmts, 2, TS_OFFSET_US);
+      ret = generate_container("test-h264-aac-large.mp4", 2, fmts, LARGE_PKTS_NUM, large_pkts, 0, NULL, NULL, true, -1, -1, false);
+      if (!ret)
+         ret = verify_container("test-h264-aac-large.mp4", 2, fmts, LARGE_PKTS_NUM, large_pkts, TS_OFFSET_US, 0, NULL, NULL, false, 0);
+      if (!ret)
+         ret = verify_container("test-h264-aac-large.mp4?index", 2, fmts, LARGE_PKTS_NUM, large_pkts, TS_OFFSET_US, 0, NULL, NULL, false, 0);
+      free(large_pkts);
+      if (ret)
+         return ret;
+   }
+
+   /* Test muxing of a fragmented file. The reader only checks the tracks so
+    * the samples are checked against the track runs directly. */
+   ret = generate_container("test-h264-aac-fragmented.mp4", 2, fmts, 100, pkts, 2, meta_keys, meta_vals, true, -1, 200, false);
    if (!ret)
-      ret = verify_container("test-h264-aac.mp4", 2, fmts, 100, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, true);
+      ret = verify_container("test-h264-aac-fragmented.mp4", 2, fmts, 0, pkts, TS_OFFSET_US, 2, meta_keys, meta_vals, false, 0);
+   if (!ret)
+      ret = check_mp4_fragments("test-h264-aac-fragmented.mp4", 100, pkts, TS_OFFSET_US, 0);
+   if (ret)
+      return ret;
+
+   /* A track with a single sample mustn't get its start time as duration */
+   ret = generate_container("test-h264-aac-single.mp4", 2, fmts, 3, pkts, 0, NULL, NULL, true, -1, -1, false);
+   if (!ret)
+      ret = verify_container("test-h264-aac-single.mp4", 2, fmts, 3, pkts, TS_OFFSET_US, 0, NULL, NULL, false, 0);
+   if (!ret)
+      ret = check_mp4_stts_duration("test-h264-aac-single.mp4", (pkts[2].dts - pkts[0].dts) * 2 / 1000);
    if (ret)
       return ret;
 
@@ -489,9 +1131,47 @@ static int test_mp4(void)
       1920, 1080, true);
    set_audio_format(fmts + 1, VC_CONTAINER_CODEC_OPUS, 2, 48000, true);
 
-   ret = generate_container("test-h265-opus.mp4", 2, fmts, 100, pkts, 0, NULL, NULL, false, true);
+   ret = generate_container("test-h265-opus.mp4", 2, fmts, 100, pkts, 0, NULL, NULL, false, -1, -1, true);
    if (!ret)
-      ret = verify_container("test-h265-opus.mp4", 2, fmts, 100, pkts, 0, 0, NULL, NULL, true);
+      ret = verify_container("test-h265-opus.mp4", 2, fmts, 100, pkts, 0, 0, NULL, NULL, true, 0);
+   /* Not rebased, so this one also gets seeks before its first sample */
+   if (!ret)
+      ret = check_seek("test-h265-opus.mp4");
+   if (!ret)
+      ret = check_seek("test-h265-opus.mp4?index");
+   if (ret)
+      return ret;
+
+   /* Test muxing / demuxing of H264 with B frames (composition offsets) */
+   set_video_format(fmts, VC_CONTAINER_CODEC_H264, VC_CONTAINER_VARIANT_H264_AVC1,
+      1920, 1080, true);
+   set_audio_format(fmts + 1, VC_CONTAINER_CODEC_MP4A, 2, 48000, true);
+
+   memset(pkts, 0, sizeof(pkts));
+   fill_packets(pkts, 100, fmts, 2, TS_OFFSET_US);
+   reorder_packets(pkts, 100, 0);
+
+   ret = generate_container("test-h264-bframes.mp4", 2, fmts, 100, pkts, 0, NULL, NULL, false, -1, -1, false);
+   if (!ret)
+      ret = verify_container("test-h264-bframes.mp4", 2, fmts, 100, pkts, 0, 0, NULL, NULL, false, 0);
+   if (ret)
+      return ret;
+
+   /* Same thing fragmented. Decode times start from the earliest dts and the
+    * edit lists shift the composition times back to the earliest pts. */
+   ret = generate_container("test-h264-bframes-fragmented.mp4", 2, fmts, 100, pkts, 0, NULL, NULL, true, -1, 200, false);
+   if (!ret)
+   {
+      int64_t earliest_pts = pkts[0].pts, earliest_dts = pkts[0].dts;
+      unsigned int i;
+      for(i = 1; i < 100; i++)
+      {
+         if(pkts[i].pts < earliest_pts) earliest_pts = pkts[i].pts;
+         if(pkts[i].dts < earliest_dts) earliest_dts = pkts[i].dts;
+      }
+      ret = check_mp4_fragments("test-h264-bframes-fragmented.mp4", 100, pkts, earliest_dts,
+                                (earliest_pts - earliest_dts) / 1000);
+   }
 
    return ret;
 }